@@ -5,57 +5,69 @@ layout (location = 1) in vec3 aNorm;
 layout (location = 2) in vec3 aTang;
 layout (location = 3) in vec3 aBitang;
 layout (location = 4) in vec2 aUv;
+// Per instance transforms, used instead of model and normalMat when instanced != 0
+layout (location = 5) in mat4 instanceModel;
+layout (location = 9) in mat3 instanceNormalMat;
+layout (location = 12) in uint instanceMaterial;
 
 out VS_OUT {
   vec2 texCoord;
   vec3 fragPos;
   mat3 TBN;
+  flat int material;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "shaders/frame.glhl"
+
 uniform mat4 model;
 uniform mat3 normalMat;
+uniform int instanced;
+uniform int materialId;
 
 void main()
 {
-   gl_Position = projection * view * model * vec4(aPos, 1.0);
-   vs_out.fragPos = vec3(model * vec4(aPos, 1.0));
+   mat4 M = instanced != 0 ? instanceModel : model;
+   mat3 NM = instanced != 0 ? instanceNormalMat : normalMat;
+   gl_Position = projection * view * M * vec4(aPos, 1.0);
+   vs_out.fragPos = vec3(M * vec4(aPos, 1.0));
    vs_out.texCoord = aUv;
-   vec3 T = normalize(normalMat * aTang);
-   vec3 B = normalize(normalMat * aBitang);
-   vec3 N = normalize(normalMat * aNorm);
+   vec3 T = normalize(NM * aTang);
+   vec3 B = normalize(NM * aBitang);
+   vec3 N = normalize(NM * aNorm);
    vs_out.TBN = mat3(T, B, N);
+   vs_out.material = instanced != 0 ? int(instanceMaterial) : materialId;
 };
 
 #endif
 #ifdef _FRAGMENT_
 
+#define LIGHTS_BLOCK
 #include "shaders/materials.glhl"
 #include "shaders/lights.glhl"
+#include "shaders/frame.glhl"
 
 out vec4 FragColor;
 in VS_OUT {
    vec2 texCoord;
    vec3 fragPos;
    mat3 TBN;
+   flat int material;
 } vs_out;
 
 
 
-uniform PointLight pointLight;
-uniform DirLight dirLight;
-uniform SpotLight spotLight;
-uniform Material material;
-uniform vec3 viewPos;
 
 void main()
 {
+    Material material = materials[vs_out.material];
+
     // Calculate normal:
     vec3 normal = vec3(0,0,1);
     if(material.numNormalLayers>0u) {
         normal = evaluateTextureLayers(vec3(0), material.normalLayers, material.numNormalLayers, vs_out.texCoord);
-        normal = normalize(normal*2.0 - 1.0);
+        // Z is reconstructed, as BC5 compressed normal maps only store X and Y
+        normal.xy = normal.xy*2.0 - 1.0;
+        normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
     }
     normal = normalize(vs_out.TBN * normal);
 
@@ -75,7 +87,7 @@ void main()
 
     vec3 total = emissiveColor + lightResult;
     
-    FragColor = vec4(total, 1.0);
+    FragColor = vec4(total, material.opacity);
 };
 
 
@@ -4,6 +4,7 @@
 
 #include <cxxopts.hpp>
 
+#include "mork/render/GLState.h"
 #include "mork/core/Timer.h"
 
 #include "mork/ui/GlfwWindow.h"
@@ -253,10 +254,8 @@ public:
         
         prog4.use();
         vao4.bind();
-        glActiveTexture(GL_TEXTURE0 + 0);
-        tex1.bind();
-        glActiveTexture(GL_TEXTURE0 + 1);
-        tex2.bind();
+        tex1.bind(0);
+        tex2.bind(1);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0); 
 
 
@@ -269,7 +268,7 @@ public:
     {
         // TODO:
         // Move to new Framebuffer class
-        glViewport(0, 0, x, y);
+        mork::GLState::getInstance().viewport(0, 0, x, y);
         GlfwWindow::reshape(x, y);
         idle(false);
     }
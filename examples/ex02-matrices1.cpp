@@ -4,6 +4,7 @@
 
 #include <cxxopts.hpp>
 
+#include "mork/render/GLState.h"
 #include "mork/ui/GlfwWindow.h"
 #include "mork/core/Log.h"
 #include "mork/render/Program.h"
@@ -115,7 +116,7 @@ public:
     {
         // TODO:
         // Move to new Framebuffer class
-        glViewport(0, 0, x, y);
+        mork::GLState::getInstance().viewport(0, 0, x, y);
         GlfwWindow::reshape(x, y);
         idle(false);
     }
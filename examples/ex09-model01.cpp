@@ -5,6 +5,7 @@
 #include <set>
 #include <cxxopts.hpp>
 
+#include "mork/render/GLState.h"
 #include "mork/ui/GlfwWindow.h"
 #include "mork/core/Log.h"
 #include "mork/render/Font.h"
@@ -257,7 +258,7 @@ public:
     {
         // TODO:
         // Move to new Framebuffer class
-        glViewport(0, 0, x, y);
+        mork::GLState::getInstance().viewport(0, 0, x, y);
         GlfwWindow::reshape(x, y);
 
         scene.getCamera().setAspectRatio(static_cast<double>(x), static_cast<double>(y));
@@ -15,6 +15,8 @@
 #include "mork/math/quat.h"
 #include "mork/render/Mesh.h"
 #include "mork/render/Material.h"
+#include "mork/render/TextureArrayPool.h"
+#include "mork/render/TextureCache.h"
 #include "mork/util/ModelImporter.h"
 #include "mork/render/Framebuffer.h"
 #include "mork/core/stb_image.h"
@@ -80,7 +82,7 @@ class App : public mork::GlfwWindow {
 public:
     App()
             : mork::GlfwWindow(mork::Window::Parameters().size(800,600).name(window_title)),
-               prog(330, "shaders/ex11.glsl"),
+               prog(430, "shaders/ex11.glsl"),
                font(mork::Font::createFont("resources/fonts/LiberationSans-Regular.ttf", 48)),
                textBox(800, 600),
                fsQuad(mork::MeshHelper<VN>::PLANE()),
@@ -103,21 +105,28 @@ public:
         auto moonMesh1 = mork::MeshHelper<VTBN>::SPHERE(radius, radius, radius, 40, 80); 
         //auto moonMesh1 = mork::MeshHelper<VTBN>::PLANE();//(radius, radius, radius, 4, 8); 
         
+        // The materials share the textures, which are loaded and packed once
+        auto moonTexture = mork::TextureCache::getInstance().load("textures/moon-4k.png", true);
+        auto moonNormals = mork::TextureCache::getInstance().load("textures/moon_normal.jpg", true);
+
         mork::Material moonMat1;
-        moonMat1.diffuseLayers.push_back(mork::TextureLayer(mork::Texture<2>::fromFile("textures/moon-4k.png", true)));
-        moonMat1.normalLayers.push_back(mork::TextureLayer(mork::Texture<2>::fromFile("textures/moon_normal.jpg", true)));
+        moonMat1.diffuseLayers.push_back(mork::TextureLayer(moonTexture, mork::Op::ADD, 1.0f));
+        moonMat1.normalLayers.push_back(mork::TextureLayer(moonNormals, mork::Op::ADD, 1.0f));
+        texturePool.pack(moonMat1);
         auto moon1 = std::make_unique<mork::Model>("moon1", std::move(moonMesh1), std::move(moonMat1));
 
 
         // Material 2 - texture only
         mork::Material moonMatTexOnly;
-        moonMatTexOnly.diffuseLayers.push_back(mork::TextureLayer(mork::Texture<2>::fromFile("textures/moon-4k.png", true)));
+        moonMatTexOnly.diffuseLayers.push_back(mork::TextureLayer(moonTexture, mork::Op::ADD, 1.0f));
+        texturePool.pack(moonMatTexOnly);
         moon1->addMaterial(std::move(moonMatTexOnly));
 
         // Material 3 - normal map only
         mork::Material moonMatNormOnly;
         moonMatNormOnly.diffuseColor = mork::vec3f(1.0, 1.0, 1.0);
-        moonMatNormOnly.normalLayers.push_back(mork::TextureLayer(mork::Texture<2>::fromFile("textures/moon_normal.jpg", true)));
+        moonMatNormOnly.normalLayers.push_back(mork::TextureLayer(moonNormals, mork::Op::ADD, 1.0f));
+        texturePool.pack(moonMatNormOnly);
         moon1->addMaterial(std::move(moonMatNormOnly));
 
 
@@ -125,6 +134,8 @@ public:
         moon1->setLocalToParent(mork::mat4d::translate(mork::vec3d(5*radius, 0, 0))*mork::mat4d::rotatez(radians(180.0)));
         //moon1->setLocalToParent(mork::mat4d::translate(mork::vec3d(5*radius, 0, 0))*mork::mat4d::rotatex(radians(90.0))*mork::mat4d::rotatey(radians(-90.0)));
         scene.getRoot().addChild(std::move(moon1));
+        // The materials sample their textures from the pool arrays
+        scene.getRenderQueue().setTexturePool(&texturePool);
 
              
         scene.getCamera().setPosition(mork::vec3d(0, 0, 0));
@@ -230,12 +241,11 @@ public:
         pointLight.setColor(mork::Light::NO_LIGHT);
       
            
-        prog.use();
-        dirLight.set(prog, "dirLight");
- 
-        spotLight.set(prog, "spotLight");
-       
-        pointLight.set(prog, "pointLight");
+        // The lights are uploaded with the camera block in scene.draw
+        auto& frameUniforms = scene.getFrameUniforms();
+        frameUniforms.setDirLight(dirLight);
+        frameUniforms.setSpotLight(spotLight);
+        frameUniforms.setPointLight(pointLight);
 
         scene.draw(prog);
         
@@ -443,6 +453,7 @@ private:
     mork::Program normalProg;
     mork::Program tbnProg;
 
+    mork::TextureArrayPool texturePool;
 
     //mork::BasicMesh mesh;
     //mork::TBNMesh plane;
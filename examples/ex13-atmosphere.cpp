@@ -7,6 +7,7 @@
 #include <random>
 
 #include "mork/ui/GlfwWindow.h"
+#include "mork/render/GLState.h"
 #include "mork/core/Log.h"
 #include "mork/render/Font.h"
 #include "mork/scene/Scene.h"
@@ -437,6 +438,8 @@ atmosphere:
                 moHandledByIM = io.WantCaptureMouse;
 
                 ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                // ImGui changes GL state behind the back of the state cache
+                mork::GLState::getInstance().reset();
             }
 
             GlfwWindow::redisplay(t, dt);
@@ -154,6 +154,44 @@ template <typename type> struct box3
         return p.x >= xmin && p.x <= xmax && p.y >= ymin && p.y <= ymax && p.z >=zmin && p.z <= zmax;
     }
 
+    /**
+     * Returns true if this bounding box is empty, i.e. contains no points.
+     */
+    bool empty() const
+    {
+        return xmin > xmax || ymin > ymax || zmin > zmax;
+    }
+
+    /**
+     * Returns the surface area of this bounding box, or 0 if it is empty.
+     */
+    type area() const
+    {
+        if (empty()) {
+            return 0;
+        }
+        type dx = xmax - xmin;
+        type dy = ymax - ymin;
+        type dz = zmax - zmin;
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    /**
+     * Returns true if this bounding box is equal to the given box.
+     */
+    bool operator==(const box3<type> &r) const
+    {
+        return xmin == r.xmin && xmax == r.xmax && ymin == r.ymin && ymax == r.ymax && zmin == r.zmin && zmax == r.zmax;
+    }
+
+    /**
+     * Returns true if this bounding box is different from the given box.
+     */
+    bool operator!=(const box3<type> &r) const
+    {
+        return !(*this == r);
+    }
+
     /**
      * Returns the characteristic length/norm of this bounding box
      * i.e. the maximum size in either dimension.
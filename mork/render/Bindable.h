@@ -2,7 +2,7 @@
 #define _MORK_BINDABLE_H_
 
 // Interface for bindable Opengl resources
-// 
+// Implementations bind through GLState, so binding what is bound is skipped
 
 namespace mork {
 
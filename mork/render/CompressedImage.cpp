@@ -0,0 +1,339 @@
+#include "mork/render/CompressedImage.h"
+#include "mork/glad/glad.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace mork {
+
+    // Container fields are little endian, and are written and read byte by byte
+
+    static void putU32(std::vector<unsigned char>& out, uint32_t v) {
+        for(int i = 0; i < 4; ++i)
+            out.push_back((v >> (8*i)) & 0xff);
+    }
+
+    static void putU64(std::vector<unsigned char>& out, uint64_t v) {
+        for(int i = 0; i < 8; ++i)
+            out.push_back((v >> (8*i)) & 0xff);
+    }
+
+    static void setU64(std::vector<unsigned char>& out, size_t offset, uint64_t v) {
+        for(int i = 0; i < 8; ++i)
+            out[offset + i] = (v >> (8*i)) & 0xff;
+    }
+
+    // Reads fields of a file read to memory, throwing on reads past the end
+    class Reader {
+        public:
+            Reader(const std::vector<unsigned char>& data, const std::string& file) : data(data), file(file) {}
+
+            uint64_t get(size_t offset, int bytes) const {
+                check(offset, bytes);
+                uint64_t v = 0;
+                for(int i = 0; i < bytes; ++i)
+                    v |= uint64_t(data[offset + i]) << (8*i);
+                return v;
+            }
+
+            uint32_t u32(size_t offset) const {
+                return static_cast<uint32_t>(get(offset, 4));
+            }
+
+            uint64_t u64(size_t offset) const {
+                return get(offset, 8);
+            }
+
+            std::vector<unsigned char> bytes(size_t offset, size_t size) const {
+                check(offset, size);
+                return std::vector<unsigned char>(data.begin() + offset, data.begin() + offset + size);
+            }
+
+            void check(size_t offset, size_t size) const {
+                if(offset + size > data.size() || offset + size < offset)
+                    fail("is truncated");
+            }
+
+            [[noreturn]] void fail(const std::string& what) const {
+                error_logger("CompressedImage: File \"", file, "\" ", what);
+                throw std::runtime_error(error_logger.last());
+            }
+
+        private:
+            const std::vector<unsigned char>& data;
+            const std::string& file;
+    };
+
+    static std::vector<unsigned char> readFile(const std::string& file) {
+        std::ifstream in(file, std::ios::binary);
+        if(!in) {
+            error_logger("CompressedImage: File \"", file, "\" could not be opened");
+            throw std::runtime_error(error_logger.last());
+        }
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    static void writeFile(const std::string& file, const std::vector<unsigned char>& data) {
+        std::ofstream out(file, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if(!out) {
+            error_logger("CompressedImage: File \"", file, "\" could not be written");
+            throw std::runtime_error(error_logger.last());
+        }
+    }
+
+    static bool hasExtension(const std::string& file, const std::string& ext) {
+        if(file.size() < ext.size())
+            return false;
+        std::string end = file.substr(file.size() - ext.size());
+        std::transform(end.begin(), end.end(), end.begin(), ::tolower);
+        return end == ext;
+    }
+
+    // The format codes of the containers, in BlockFormat order
+    static const BlockFormat FORMATS[] = {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7};
+    static const uint32_t VK_FORMATS[] = {131, 137, 139, 141, 145};     // VK_FORMAT_BCn_*_UNORM_BLOCK
+    static const uint32_t DXGI_FORMATS[] = {71, 77, 80, 83, 98};        // DXGI_FORMAT_BCn_UNORM
+
+    static const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+    static uint32_t fourCC(const char* s) {
+        return uint32_t(s[0]) | (uint32_t(s[1]) << 8) | (uint32_t(s[2]) << 16) | (uint32_t(s[3]) << 24);
+    }
+
+    size_t CompressedImage::getBlockSize(BlockFormat format) {
+        return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+    }
+
+    size_t CompressedImage::getLevelSize(BlockFormat format, int width, int height) {
+        return size_t((width + 3)/4)*((height + 3)/4)*getBlockSize(format);
+    }
+
+    int CompressedImage::getGLFormat(BlockFormat format) {
+        switch(format) {
+            case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+            case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+            case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        }
+        return -1;
+    }
+
+    bool CompressedImage::isCompressedFile(const std::string& file) {
+        return hasExtension(file, ".ktx2") || hasExtension(file, ".dds");
+    }
+
+    CompressedImage CompressedImage::load(const std::string& file) {
+        if(hasExtension(file, ".ktx2"))
+            return loadKTX2(file);
+        if(hasExtension(file, ".dds"))
+            return loadDDS(file);
+
+        error_logger("CompressedImage: Unknown container of \"", file, "\", expected .ktx2 or .dds");
+        throw std::runtime_error(error_logger.last());
+    }
+
+    // Sets the format, size and level count of image, checking them
+    static void setHeader(CompressedImage& image, const Reader& r, const uint32_t* codes, uint32_t code,
+            uint32_t width, uint32_t height, uint32_t levels) {
+        const uint32_t* end = codes + 5;
+        const uint32_t* c = std::find(codes, end, code);
+        if(c == end)
+            r.fail("has an unsupported format " + std::to_string(code));
+        if(width == 0 || height == 0 || width > 65536 || height > 65536)
+            r.fail("has an invalid size");
+        if(levels == 0 || levels > 17)
+            r.fail("has an invalid number of levels");
+
+        image.format = FORMATS[c - codes];
+        image.width = width;
+        image.height = height;
+        image.levels.resize(levels);
+    }
+
+    CompressedImage CompressedImage::loadKTX2(const std::string& file) {
+        std::vector<unsigned char> data = readFile(file);
+        Reader r(data, file);
+        r.check(0, 80);
+        if(!std::equal(KTX2_IDENTIFIER, KTX2_IDENTIFIER + 12, data.begin()))
+            r.fail("is not a KTX2 file");
+
+        uint32_t depth = r.u32(28);
+        uint32_t layers = r.u32(32);
+        uint32_t faces = r.u32(36);
+        uint32_t supercompression = r.u32(44);
+        if(depth > 1 || layers > 1 || faces != 1 || supercompression != 0)
+            r.fail("is not a single 2D texture without supercompression");
+
+        CompressedImage image;
+        // A level count of 0 asks to generate the mip levels, which we can not
+        setHeader(image, r, VK_FORMATS, r.u32(12), r.u32(20), r.u32(24), r.u32(40));
+
+        for(size_t l = 0; l < image.levels.size(); ++l) {
+            size_t entry = 80 + 24*l;
+            uint64_t offset = r.u64(entry);
+            uint64_t length = r.u64(entry + 8);
+            int w = std::max(image.width >> l, 1);
+            int h = std::max(image.height >> l, 1);
+            if(length != getLevelSize(image.format, w, h))
+                r.fail("has a level of the wrong size");
+            image.levels[l] = r.bytes(offset, length);
+        }
+        return image;
+    }
+
+    void CompressedImage::saveKTX2(const std::string& file) const {
+        size_t blockSize = getBlockSize(format);
+        uint32_t levelCount = levels.size();
+        bool twoSamples = format == BlockFormat::BC3 || format == BlockFormat::BC5;
+
+        // The basic data format descriptor, with one sample per 64 bits of a block
+        std::vector<unsigned char> dfd;
+        uint32_t blockBytes = 24 + (twoSamples ? 32 : 16);
+        putU32(dfd, 4 + blockBytes);
+        putU32(dfd, 0);                             // vendor id and descriptor type
+        putU32(dfd, 2 | (blockBytes << 16));        // version and block size
+        static const uint32_t MODELS[] = {128, 130, 131, 132, 134};   // KHR_DF_MODEL_BC1A ..
+        putU32(dfd, MODELS[static_cast<int>(format)] | (1 << 8) | (1 << 16));  // BT709 primaries, linear
+        putU32(dfd, 3 | (3 << 8));                  // 4x4 texel blocks
+        putU32(dfd, blockSize);                     // bytes of plane 0
+        putU32(dfd, 0);
+        auto putSample = [&](uint32_t bitOffset, uint32_t bitLength, uint32_t channel) {
+            putU32(dfd, bitOffset | ((bitLength - 1) << 16) | (channel << 24));
+            putU32(dfd, 0);
+            putU32(dfd, 0);
+            putU32(dfd, 0xffffffff);
+        };
+        switch(format) {
+            case BlockFormat::BC1: putSample(0, 64, 0); break;
+            case BlockFormat::BC3: putSample(0, 64, 15); putSample(64, 64, 0); break;
+            case BlockFormat::BC4: putSample(0, 64, 0); break;
+            case BlockFormat::BC5: putSample(0, 64, 0); putSample(64, 64, 1); break;
+            case BlockFormat::BC7: putSample(0, 128, 0); break;
+        }
+
+        std::vector<unsigned char> out(KTX2_IDENTIFIER, KTX2_IDENTIFIER + 12);
+        putU32(out, VK_FORMATS[static_cast<int>(format)]);
+        putU32(out, 1);                 // type size
+        putU32(out, width);
+        putU32(out, height);
+        putU32(out, 0);                 // depth
+        putU32(out, 0);                 // layers
+        putU32(out, 1);                 // faces
+        putU32(out, levelCount);
+        putU32(out, 0);                 // supercompression
+        size_t dfdOffset = 80 + 24*levelCount;
+        putU32(out, dfdOffset);
+        putU32(out, dfd.size());
+        putU32(out, 0);                 // no key/value data
+        putU32(out, 0);
+        putU64(out, 0);                 // no supercompression global data
+        putU64(out, 0);
+
+        size_t index = out.size();
+        out.resize(index + 24*levelCount);
+        out.insert(out.end(), dfd.begin(), dfd.end());
+
+        // Levels are stored smallest first, each aligned to the block size
+        for(int l = levelCount - 1; l >= 0; --l) {
+            out.resize((out.size() + blockSize - 1)/blockSize*blockSize);
+            setU64(out, index + 24*l, out.size());
+            setU64(out, index + 24*l + 8, levels[l].size());
+            setU64(out, index + 24*l + 16, levels[l].size());
+            out.insert(out.end(), levels[l].begin(), levels[l].end());
+        }
+
+        writeFile(file, out);
+    }
+
+    // DDS header flags
+    static const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+    static const uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    static const uint32_t DDPF_FOURCC = 0x4;
+    static const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+    CompressedImage CompressedImage::loadDDS(const std::string& file) {
+        std::vector<unsigned char> data = readFile(file);
+        Reader r(data, file);
+        r.check(0, 128);
+        if(r.u32(0) != fourCC("DDS ") || r.u32(4) != 124)
+            r.fail("is not a DDS file");
+
+        uint32_t flags = r.u32(8);
+        uint32_t height = r.u32(12);
+        uint32_t width = r.u32(16);
+        uint32_t levels = (flags & DDSD_MIPMAPCOUNT) ? std::max(r.u32(28), 1u) : 1;
+        if(!(r.u32(80) & DDPF_FOURCC))
+            r.fail("is not block compressed");
+
+        // Legacy four character codes are mapped to the DXGI formats
+        uint32_t code = r.u32(84);
+        uint32_t dxgiFormat = 0;
+        size_t offset = 128;
+        if(code == fourCC("DX10")) {
+            r.check(offset, 20);
+            dxgiFormat = r.u32(128);
+            if(r.u32(128 + 4) != 3 || r.u32(128 + 12) > 1)
+                r.fail("is not a single 2D texture");
+            offset += 20;
+        } else if(code == fourCC("DXT1")) {
+            dxgiFormat = DXGI_FORMATS[0];
+        } else if(code == fourCC("DXT5")) {
+            dxgiFormat = DXGI_FORMATS[1];
+        } else if(code == fourCC("ATI1") || code == fourCC("BC4U")) {
+            dxgiFormat = DXGI_FORMATS[2];
+        } else if(code == fourCC("ATI2") || code == fourCC("BC5U")) {
+            dxgiFormat = DXGI_FORMATS[3];
+        }
+
+        CompressedImage image;
+        setHeader(image, r, DXGI_FORMATS, dxgiFormat, width, height, levels);
+        for(size_t l = 0; l < image.levels.size(); ++l) {
+            size_t size = getLevelSize(image.format, std::max(image.width >> l, 1), std::max(image.height >> l, 1));
+            image.levels[l] = r.bytes(offset, size);
+            offset += size;
+        }
+        return image;
+    }
+
+    void CompressedImage::saveDDS(const std::string& file) const {
+        std::vector<unsigned char> out;
+        putU32(out, fourCC("DDS "));
+        putU32(out, 124);
+        putU32(out, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+        putU32(out, height);
+        putU32(out, width);
+        putU32(out, levels.empty() ? 0 : levels[0].size());
+        putU32(out, 0);                 // depth
+        putU32(out, levels.size());
+        for(int i = 0; i < 11; ++i)
+            putU32(out, 0);
+        // Pixel format
+        putU32(out, 32);
+        putU32(out, DDPF_FOURCC);
+        putU32(out, fourCC("DX10"));
+        for(int i = 0; i < 5; ++i)
+            putU32(out, 0);
+        putU32(out, DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+        for(int i = 0; i < 4; ++i)
+            putU32(out, 0);
+
+        // DX10 header: a single 2D texture
+        putU32(out, DXGI_FORMATS[static_cast<int>(format)]);
+        putU32(out, 3);
+        putU32(out, 0);
+        putU32(out, 1);
+        putU32(out, 0);
+
+        for(const std::vector<unsigned char>& level : levels)
+            out.insert(out.end(), level.begin(), level.end());
+
+        writeFile(file, out);
+    }
+
+}
@@ -0,0 +1,50 @@
+#ifndef _MORK_COMPRESSEDIMAGE_H_
+#define _MORK_COMPRESSEDIMAGE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mork {
+
+    // The block compressed formats written by the TextureCompressor. All have 4x4
+    // texel blocks, of 8 bytes (BC1, BC4) or 16 bytes (BC3, BC5, BC7).
+    enum class BlockFormat {
+        BC1,    // RGB
+        BC3,    // RGBA, with BC4 alpha
+        BC4,    // R
+        BC5,    // RG, two BC4 channels, used for normal maps
+        BC7     // RGBA, high quality
+    };
+
+    // A block compressed image with its mip chain, as stored in KTX2 and DDS files
+    // and uploaded by Texture<2>::loadTexture(const CompressedImage&).
+    struct CompressedImage {
+        BlockFormat     format;
+        int             width;
+        int             height;
+        // The blocks of each mip level, largest first
+        std::vector<std::vector<unsigned char> > levels;
+
+        static size_t getBlockSize(BlockFormat format);
+        // The size in bytes of a level of width x height texels
+        static size_t getLevelSize(BlockFormat format, int width, int height);
+        static int getGLFormat(BlockFormat format);
+
+        // Returns true for files with the .ktx2 or .dds extension
+        static bool isCompressedFile(const std::string& file);
+
+        // Reads a KTX2 or DDS file, by extension. Throws if the file can not be
+        // read or has a format other than the BlockFormats.
+        static CompressedImage load(const std::string& file);
+        static CompressedImage loadKTX2(const std::string& file);
+        static CompressedImage loadDDS(const std::string& file);
+
+        void saveKTX2(const std::string& file) const;
+        // Writes a DDS file with the DX10 header extension
+        void saveDDS(const std::string& file) const;
+    };
+
+}
+
+#endif
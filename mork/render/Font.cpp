@@ -1,5 +1,7 @@
 #include "mork/render/Font.h"
 
+#include <cstring>
+
 #include <freetype/include/ft2build.h>
 #include FT_FREETYPE_H
 
@@ -38,12 +40,11 @@ void main()
 )";   
  
     Font::Font() 
-        : prog(font_vs, font_ps){
+        : prog(font_vs, font_ps), vbo(1 << 16) {
         vao.bind();
-        vbo.bind();
-        vbo.setBufferSize(sizeof(float)*6*5);
-        vbo.setAttributes();
-        vbo.unbind();
+        vbo.bind(GL_ARRAY_BUFFER);
+        vertex_pos_uv::setAttributes();
+        vbo.unbind(GL_ARRAY_BUFFER);
         vao.unbind();    
 
         yMax = 0.0f;
@@ -196,14 +197,13 @@ void main()
 
             // Render glyph texture over quad
 			ch.texture.bind(0);
-        	// Update content of VBO memory
-        	vbo.bind();
-			// TODO: make new method in VB class to do this
-        	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); 
-        	vbo.unbind();
+        	// Write the quad to the stream buffer
+            size_t first;
+            float* dst = reinterpret_cast<float*>(vbo.allocate<vertex_pos_uv>(6, first));
+            std::memcpy(dst, vertices, sizeof(vertices));
         
 			// Render quad
-        	glDrawArrays(GL_TRIANGLES, 0, 6);
+        	glDrawArrays(GL_TRIANGLES, first, 6);
         	// Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
         	x += (ch.advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64)
             ch.texture.unbind(0);
@@ -10,6 +10,7 @@
 
 #include "mork/render/VertexArrayObject.h"
 #include "mork/render/VertexBuffer.h"
+#include "mork/render/StreamBuffer.h"
 #include "mork/render/Program.h"
 
 namespace mork {
@@ -64,7 +65,8 @@ namespace mork {
 
         Program             prog;
         VertexArrayObject   vao;
-        DynamicVertexBuffer<mork::vertex_pos_uv> vbo;
+        // Glyph quads are streamed, so drawing never waits for earlier glyphs
+        mutable StreamBuffer vbo;
         std::map<char, Glyph > characters;
         float yMax, yMin, yAdvance;
 
@@ -0,0 +1,137 @@
+#include "mork/render/FrameUniforms.h"
+#include "mork/render/GLState.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace mork {
+
+    const char* const FrameUniforms::CAMERA_BLOCK = "Camera";
+    const char* const FrameUniforms::LIGHTS_BLOCK = "Lights";
+
+    // Each upload writes at most two blocks, so a frame uses little of a region
+    static const size_t STREAM_REGION_SIZE = 1 << 16;
+
+    static void copyMatrix(const mat4d& m, float* dst) {
+        const double* c = m.coefficients();
+        for(int i = 0; i < 16; ++i)
+            dst[i] = static_cast<float>(c[i]);
+    }
+
+    // Assigns only if the value differs, returning whether it did
+    template<typename T>
+    static bool update(T& block, const T& value) {
+        if(std::memcmp(&block, &value, sizeof(T)) == 0)
+            return false;
+        block = value;
+        return true;
+    }
+
+    FrameUniforms::FrameUniforms()
+        :   camera(),
+            lights(),
+            changed(true),
+            alignment(0),
+            cameraOffset(0),
+            lightsOffset(0),
+            writeCount(0) {
+        DirLight dirLight;
+        dirLight.setColor(Light::NO_LIGHT);
+        setDirLight(dirLight);
+
+        PointLight pointLight;
+        pointLight.setColor(Light::NO_LIGHT);
+        setPointLight(pointLight);
+
+        SpotLight spotLight;
+        spotLight.setColor(Light::NO_LIGHT);
+        setSpotLight(spotLight);
+    }
+
+    void FrameUniforms::setCamera(const mat4d& projection, const mat4d& view, const vec3d& viewPos) {
+        CameraBlock block = camera;
+        copyMatrix(projection, block.projection);
+        copyMatrix(view, block.view);
+        block.viewPos = viewPos.cast<float>();
+        changed |= update(camera, block);
+    }
+
+    void FrameUniforms::setDirLight(const DirLight& light) {
+        DirLightBlock block = lights.dirLight;
+        block.direction = light.getDirection().cast<float>();
+        block.ambient = light.getAmbientColor().cast<float>();
+        block.diffuse = light.getDiffuseColor().cast<float>();
+        block.specular = light.getSpecularColor().cast<float>();
+        changed |= update(lights.dirLight, block);
+    }
+
+    void FrameUniforms::setPointLight(const PointLight& light) {
+        PointLightBlock block = lights.pointLight;
+        AttenuationModel att = light.getAttenuation();
+        block.position = light.getPosition().cast<float>();
+        block.constant = static_cast<float>(att.constant);
+        block.linear = static_cast<float>(att.linear);
+        block.quadratic = static_cast<float>(att.quadratic);
+        block.ambient = light.getAmbientColor().cast<float>();
+        block.diffuse = light.getDiffuseColor().cast<float>();
+        block.specular = light.getSpecularColor().cast<float>();
+        changed |= update(lights.pointLight, block);
+    }
+
+    void FrameUniforms::setSpotLight(const SpotLight& light) {
+        SpotLightBlock block = lights.spotLight;
+        AttenuationModel att = light.getAttenuation();
+        block.position = light.getPosition().cast<float>();
+        block.direction = light.getDirection().cast<float>();
+        // The shaders compare cosines of the angles
+        block.cutOff = std::cos(static_cast<float>(light.getInnerAngle()));
+        block.outerCutOff = std::cos(static_cast<float>(light.getOuterAngle()));
+        block.ambient = light.getAmbientColor().cast<float>();
+        block.diffuse = light.getDiffuseColor().cast<float>();
+        block.specular = light.getSpecularColor().cast<float>();
+        block.constant = static_cast<float>(att.constant);
+        block.linear = static_cast<float>(att.linear);
+        block.quadratic = static_cast<float>(att.quadratic);
+        changed |= update(lights.spotLight, block);
+    }
+
+    const CameraBlock& FrameUniforms::getCameraBlock() const {
+        return camera;
+    }
+
+    const LightsBlock& FrameUniforms::getLightsBlock() const {
+        return lights;
+    }
+
+    void FrameUniforms::upload() {
+        if(!stream) {
+            GLint align = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+            alignment = align > 0 ? align : 256;
+            stream = std::make_unique<StreamBuffer>(STREAM_REGION_SIZE);
+        }
+
+        // Both blocks are written in one allocation, so the last written blocks are
+        // never overwritten by later writes as the ring wraps around, and the region
+        // is not fenced between them, before the draws reading them
+        if(changed) {
+            size_t lightsStart = ((sizeof(CameraBlock) + alignment - 1)/alignment)*alignment;
+            StreamBuffer::Allocation a = stream->allocate(lightsStart + sizeof(LightsBlock), alignment);
+            std::memcpy(a.ptr, &camera, sizeof(CameraBlock));
+            std::memcpy(static_cast<char*>(a.ptr) + lightsStart, &lights, sizeof(LightsBlock));
+            cameraOffset = a.offset;
+            lightsOffset = a.offset + lightsStart;
+            writeCount += 2;
+            changed = false;
+        }
+
+        GLState& state = GLState::getInstance();
+        state.bindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, stream->getId(), cameraOffset, sizeof(CameraBlock));
+        state.bindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, stream->getId(), lightsOffset, sizeof(LightsBlock));
+    }
+
+    unsigned int FrameUniforms::getWriteCount() const {
+        return writeCount;
+    }
+
+}
@@ -0,0 +1,129 @@
+#ifndef _MORK_FRAMEUNIFORMS_H_
+#define _MORK_FRAMEUNIFORMS_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "mork/math/vec3.h"
+#include "mork/math/mat4.h"
+#include "mork/render/Light.h"
+#include "mork/render/StreamBuffer.h"
+
+namespace mork {
+
+    // The std140 layouts of the per frame uniform blocks declared in
+    // shaders/frame.glhl and shaders/lights.glhl. Matrices are row major, as the blocks are declared
+    // row_major. Padding fills vec3s to the 16 byte alignment of std140.
+
+    struct CameraBlock {
+        float   projection[16];
+        float   view[16];
+        vec3f   viewPos;
+        float   pad0;
+    };
+
+    struct DirLightBlock {
+        vec3f   direction;
+        float   pad0;
+        vec3f   ambient;
+        float   pad1;
+        vec3f   diffuse;
+        float   pad2;
+        vec3f   specular;
+        float   pad3;
+    };
+
+    struct PointLightBlock {
+        vec3f   position;
+        float   constant;
+        float   linear;
+        float   quadratic;
+        float   pad0[2];
+        vec3f   ambient;
+        float   pad1;
+        vec3f   diffuse;
+        float   pad2;
+        vec3f   specular;
+        float   pad3;
+    };
+
+    struct SpotLightBlock {
+        vec3f   position;
+        float   pad0;
+        vec3f   direction;
+        float   cutOff;
+        float   outerCutOff;
+        float   pad1[3];
+        vec3f   ambient;
+        float   pad2;
+        vec3f   diffuse;
+        float   pad3;
+        vec3f   specular;
+        float   constant;
+        float   linear;
+        float   quadratic;
+        float   pad4[2];
+    };
+
+    struct LightsBlock {
+        DirLightBlock   dirLight;
+        PointLightBlock pointLight;
+        SpotLightBlock  spotLight;
+    };
+
+    static_assert(sizeof(vec3f) == 12, "vec3f must be packed for std140 blocks");
+    static_assert(offsetof(CameraBlock, viewPos) == 128 && sizeof(CameraBlock) == 144, "CameraBlock must match std140");
+    static_assert(sizeof(DirLightBlock) == 64, "DirLightBlock must match std140");
+    static_assert(offsetof(PointLightBlock, ambient) == 32 && sizeof(PointLightBlock) == 80, "PointLightBlock must match std140");
+    static_assert(offsetof(SpotLightBlock, ambient) == 48 && offsetof(SpotLightBlock, constant) == 92
+            && sizeof(SpotLightBlock) == 112, "SpotLightBlock must match std140");
+    static_assert(offsetof(LightsBlock, pointLight) == 64 && offsetof(LightsBlock, spotLight) == 144
+            && sizeof(LightsBlock) == 256, "LightsBlock must match std140");
+
+    // The camera and light uniforms shared by all programs in a frame. They are
+    // written once per change to a stream buffer and bound as uniform buffer
+    // ranges to fixed binding points, so programs declaring the blocks (see
+    // Program::queryUniformBlock) need no per program uniform updates.
+    // GL objects are created on the first upload.
+    class FrameUniforms {
+        public:
+            static constexpr unsigned int CAMERA_BINDING = 0;
+            static constexpr unsigned int LIGHTS_BINDING = 1;
+
+            // The block names in the shaders
+            static const char* const CAMERA_BLOCK;
+            static const char* const LIGHTS_BLOCK;
+
+            // All lights are initially black
+            FrameUniforms();
+
+            void    setCamera(const mat4d& projection, const mat4d& view, const vec3d& viewPos);
+            void    setDirLight(const DirLight& light);
+            void    setPointLight(const PointLight& light);
+            void    setSpotLight(const SpotLight& light);
+
+            const CameraBlock& getCameraBlock() const;
+            const LightsBlock& getLightsBlock() const;
+
+            // Writes the blocks to the buffer if they changed since the last
+            // upload, and binds them to their binding points
+            void    upload();
+
+            // Returns the number of blocks written by upload so far
+            unsigned int getWriteCount() const;
+
+        private:
+            CameraBlock camera;
+            LightsBlock lights;
+            bool        changed;
+
+            std::unique_ptr<StreamBuffer> stream;
+            size_t      alignment;
+            size_t      cameraOffset;
+            size_t      lightsOffset;
+            unsigned int writeCount;
+    };
+
+}
+
+#endif
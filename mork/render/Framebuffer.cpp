@@ -1,5 +1,6 @@
 #include "mork/render/Framebuffer.h"
 #include "mork/ui/GlfwWindow.h"
+#include "mork/render/GLState.h"
 
 #include <stdexcept>
 
@@ -16,12 +17,13 @@ namespace mork {
 	*/
 
 	bool Framebuffer::isFramebufferRgbFormatSupported(bool half_precision) {
+	  GLState& state = GLState::getInstance();
 	  GLuint test_fbo = 0;
 	  glGenFramebuffers(1, &test_fbo);
-	  glBindFramebuffer(GL_FRAMEBUFFER, test_fbo);
+	  state.bindFramebuffer(GL_FRAMEBUFFER, test_fbo);
 	  GLuint test_texture = 0;
 	  glGenTextures(1, &test_texture);
-	  glBindTexture(GL_TEXTURE_2D, test_texture);
+	  state.bindTexture(GL_TEXTURE_2D, test_texture);
 	  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	  glTexImage2D(GL_TEXTURE_2D, 0, half_precision ? GL_RGB16F : GL_RGB32F,
 				   1, 1, 0, GL_RGB, GL_FLOAT, NULL);
@@ -29,8 +31,8 @@ namespace mork {
 							 GL_TEXTURE_2D, test_texture, 0);
 	  bool rgb_format_supported =
 		  glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
-	  glDeleteTextures(1, &test_texture);
-	  glDeleteFramebuffers(1, &test_fbo);
+	  state.deleteTexture(test_texture);
+	  state.deleteFramebuffer(test_fbo);
 	  return rgb_format_supported;
 	}
 
@@ -145,15 +147,15 @@ namespace mork {
         if(GlfwWindow::isContextActive())
         {
             if(fbo)
-                glDeleteFramebuffers(1, &fbo);
+                GLState::getInstance().deleteFramebuffer(fbo);
         } 
  
     }
 
     void Framebuffer::bind() const {
         ACTIVE_FRAMEBUFFER = this;
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glViewport(0, 0, size.x, size.y);
+        GLState::getInstance().bindFramebuffer(GL_FRAMEBUFFER, fbo);
+        GLState::getInstance().viewport(0, 0, size.x, size.y);
     }
 
     void Framebuffer::unbind() const {
@@ -189,7 +191,7 @@ namespace mork {
         }
 
         if(Framebuffer::ACTIVE_FRAMEBUFFER == this)
-           glViewport(0, 0, size.x, size.y); 
+           GLState::getInstance().viewport(0, 0, size.x, size.y);
     }
 
     vec2i Framebuffer::getSize() const {
@@ -0,0 +1,260 @@
+#include "mork/render/GLState.h"
+
+#include <algorithm>
+
+namespace mork {
+
+    GLState& GLState::getInstance() {
+        static GLState instance;
+        return instance;
+    }
+
+    GLState::GLState() : lazyUnbind(false), issuedCalls(0), elidedCalls(0) {
+        reset();
+    }
+
+    int GLState::bufferSlot(GLenum target) {
+        switch(target) {
+            case GL_ARRAY_BUFFER:           return 0;
+            case GL_ELEMENT_ARRAY_BUFFER:   return 1;
+            case GL_UNIFORM_BUFFER:         return 2;
+            case GL_SHADER_STORAGE_BUFFER:  return 3;
+            case GL_DRAW_INDIRECT_BUFFER:   return 4;
+            case GL_PIXEL_UNPACK_BUFFER:    return 5;
+            case GL_PIXEL_PACK_BUFFER:      return 6;
+            case GL_COPY_READ_BUFFER:       return 7;
+            case GL_COPY_WRITE_BUFFER:      return 8;
+            default:                        return -1;
+        }
+    }
+
+    int GLState::textureSlot(GLenum target) {
+        switch(target) {
+            case GL_TEXTURE_2D:             return 0;
+            case GL_TEXTURE_3D:             return 1;
+            case GL_TEXTURE_CUBE_MAP:       return 2;
+            case GL_TEXTURE_2D_ARRAY:       return 3;
+            case GL_TEXTURE_1D:             return 4;
+            default:                        return -1;
+        }
+    }
+
+    bool GLState::change(unsigned int& binding, unsigned int value) {
+        if(binding == value) {
+            ++elidedCalls;
+            return false;
+        }
+        binding = value;
+        ++issuedCalls;
+        return true;
+    }
+
+    void GLState::useProgram(unsigned int p) {
+        if(change(program, p))
+            glUseProgram(p);
+    }
+
+    void GLState::bindVertexArray(unsigned int vao) {
+        if(change(vertexArray, vao)) {
+            glBindVertexArray(vao);
+            // The index buffer binding is part of the vertex array
+            buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+    }
+
+    void GLState::bindBuffer(GLenum target, unsigned int buffer) {
+        int slot = bufferSlot(target);
+        if(slot < 0) {
+            ++issuedCalls;
+            glBindBuffer(target, buffer);
+        } else if(change(buffers[slot], buffer)) {
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    void GLState::bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size) {
+        ++issuedCalls;
+        if(size == 0)
+            glBindBufferBase(target, index, buffer);
+        else
+            glBindBufferRange(target, index, buffer, offset, size);
+
+        int slot = bufferSlot(target);
+        if(slot >= 0)
+            buffers[slot] = buffer;
+    }
+
+    void GLState::bindFramebuffer(GLenum target, unsigned int fbo) {
+        bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+        bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+        if((!draw || drawFramebuffer == fbo) && (!read || readFramebuffer == fbo)) {
+            ++elidedCalls;
+            return;
+        }
+        if(draw)
+            drawFramebuffer = fbo;
+        if(read)
+            readFramebuffer = fbo;
+        ++issuedCalls;
+        glBindFramebuffer(target, fbo);
+    }
+
+    void GLState::activeTexture(unsigned int unit) {
+        if(change(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void GLState::bindTexture(GLenum target, unsigned int texture) {
+        int slot = textureSlot(target);
+        if(slot < 0 || activeUnit == UNKNOWN) {
+            ++issuedCalls;
+            glBindTexture(target, texture);
+            return;
+        }
+
+        size_t index = activeUnit*NUM_TEXTURE_TARGETS + slot;
+        if(index >= textures.size())
+            textures.resize(index + 1, UNKNOWN);
+        if(change(textures[index], texture))
+            glBindTexture(target, texture);
+    }
+
+    void GLState::viewport(int x, int y, int width, int height) {
+        if(viewportKnown && viewportRect[0] == x && viewportRect[1] == y
+                && viewportRect[2] == width && viewportRect[3] == height) {
+            ++elidedCalls;
+            return;
+        }
+        viewportRect[0] = x;
+        viewportRect[1] = y;
+        viewportRect[2] = width;
+        viewportRect[3] = height;
+        viewportKnown = true;
+        ++issuedCalls;
+        glViewport(x, y, width, height);
+    }
+
+    void GLState::unbindProgram() {
+        if(lazyUnbind)
+            ++elidedCalls;
+        else
+            useProgram(0);
+    }
+
+    void GLState::unbindVertexArray() {
+        if(lazyUnbind)
+            ++elidedCalls;
+        else
+            bindVertexArray(0);
+    }
+
+    void GLState::unbindBuffer(GLenum target) {
+        if(lazyUnbind)
+            ++elidedCalls;
+        else
+            bindBuffer(target, 0);
+    }
+
+    void GLState::unbindTexture(GLenum target) {
+        if(lazyUnbind)
+            ++elidedCalls;
+        else
+            bindTexture(target, 0);
+    }
+
+    void GLState::setLazyUnbind(bool enable) {
+        lazyUnbind = enable;
+    }
+
+    bool GLState::hasLazyUnbind() const {
+        return lazyUnbind;
+    }
+
+    void GLState::deleteProgram(unsigned int p) {
+        // A program in use is only deleted when no longer used, so it is unused
+        // explicitly (the name may be reused at once)
+        if(p != 0 && program == p)
+            program = UNKNOWN;
+        glDeleteProgram(p);
+    }
+
+    void GLState::deleteVertexArray(unsigned int vao) {
+        if(vao != 0 && vertexArray == vao) {
+            vertexArray = 0;
+            buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    void GLState::deleteBuffer(unsigned int buffer) {
+        for(unsigned int& b : buffers) {
+            if(buffer != 0 && b == buffer)
+                b = 0;
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void GLState::deleteFramebuffer(unsigned int fbo) {
+        if(fbo != 0 && drawFramebuffer == fbo)
+            drawFramebuffer = 0;
+        if(fbo != 0 && readFramebuffer == fbo)
+            readFramebuffer = 0;
+        glDeleteFramebuffers(1, &fbo);
+    }
+
+    void GLState::deleteTexture(unsigned int texture) {
+        for(unsigned int& t : textures) {
+            if(texture != 0 && t == texture)
+                t = 0;
+        }
+        glDeleteTextures(1, &texture);
+    }
+
+    void GLState::reset() {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        std::fill(buffers, buffers + NUM_BUFFER_TARGETS, UNKNOWN);
+        drawFramebuffer = UNKNOWN;
+        readFramebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        textures.clear();
+        viewportKnown = false;
+    }
+
+    unsigned int GLState::getProgram() const {
+        return program;
+    }
+
+    unsigned int GLState::getVertexArray() const {
+        return vertexArray;
+    }
+
+    unsigned int GLState::getBuffer(GLenum target) const {
+        int slot = bufferSlot(target);
+        return slot < 0 ? UNKNOWN : buffers[slot];
+    }
+
+    unsigned int GLState::getActiveTexture() const {
+        return activeUnit;
+    }
+
+    unsigned int GLState::getTexture(unsigned int unit, GLenum target) const {
+        int slot = textureSlot(target);
+        size_t index = unit*NUM_TEXTURE_TARGETS + slot;
+        return slot < 0 || index >= textures.size() ? UNKNOWN : textures[index];
+    }
+
+    unsigned int GLState::getIssuedCalls() const {
+        return issuedCalls;
+    }
+
+    unsigned int GLState::getElidedCalls() const {
+        return elidedCalls;
+    }
+
+    void GLState::resetCounters() {
+        issuedCalls = 0;
+        elidedCalls = 0;
+    }
+
+}
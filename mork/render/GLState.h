@@ -0,0 +1,108 @@
+#ifndef _MORK_GLSTATE_H_
+#define _MORK_GLSTATE_H_
+
+#include <vector>
+
+#include "mork/glad/glad.h"
+
+namespace mork {
+
+    // A cache of the GL bindings of the context: program, vertex array, buffers,
+    // framebuffers, textures and viewport. All bindable objects of mork bind
+    // through it, so binds of what is already bound are skipped (and counted).
+    //
+    // GL calls changing bindings without going through the cache must be
+    // followed by reset(). Objects must be deleted through the cache, as GL
+    // unbinds deleted objects and reuses their names.
+    //
+    // There is a single cache, for the single context of a GlfwWindow.
+    class GLState {
+        public:
+            // A binding not known to the cache, so the next bind is always issued
+            static constexpr unsigned int UNKNOWN = ~0u;
+
+            static GLState& getInstance();
+
+            GLState(const GLState&) = delete;
+            GLState& operator=(const GLState&) = delete;
+
+            void useProgram(unsigned int program);
+            void bindVertexArray(unsigned int vao);
+            void bindBuffer(GLenum target, unsigned int buffer);
+            // Binds a range of buffer to an indexed binding point (always issued),
+            // which also binds it to target. A size of 0 binds the whole buffer.
+            void bindBufferRange(GLenum target, unsigned int index, unsigned int buffer,
+                    GLintptr offset = 0, GLsizeiptr size = 0);
+            // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+            void bindFramebuffer(GLenum target, unsigned int fbo);
+            void activeTexture(unsigned int unit);
+            // Binds texture to target of the active texture unit
+            void bindTexture(GLenum target, unsigned int texture);
+            void viewport(int x, int y, int width, int height);
+
+            // Unbinds (binds 0). With lazy unbinding nothing is issued, and the
+            // object stays bound until something else is bound.
+            void unbindProgram();
+            void unbindVertexArray();
+            void unbindBuffer(GLenum target);
+            void unbindTexture(GLenum target);
+
+            // Lazy unbinding is off by default, as code binding index buffers or
+            // changing vertex attributes must then bind its own vertex array first
+            void setLazyUnbind(bool enable);
+            bool hasLazyUnbind() const;
+
+            void deleteProgram(unsigned int program);
+            void deleteVertexArray(unsigned int vao);
+            void deleteBuffer(unsigned int buffer);
+            void deleteFramebuffer(unsigned int fbo);
+            void deleteTexture(unsigned int texture);
+
+            // Forgets all bindings
+            void reset();
+
+            unsigned int getProgram() const;
+            unsigned int getVertexArray() const;
+            unsigned int getBuffer(GLenum target) const;
+            unsigned int getActiveTexture() const;
+            unsigned int getTexture(unsigned int unit, GLenum target) const;
+
+            // The number of GL calls issued and skipped since the last resetCounters
+            unsigned int getIssuedCalls() const;
+            unsigned int getElidedCalls() const;
+            void resetCounters();
+
+        private:
+            GLState();
+
+            // Returns the slot of a tracked buffer or texture target, or -1 for
+            // targets that are not tracked (always issued)
+            static int bufferSlot(GLenum target);
+            static int textureSlot(GLenum target);
+
+            // Returns true (and counts an issued call) if the binding changes
+            bool change(unsigned int& binding, unsigned int value);
+
+            static const int NUM_BUFFER_TARGETS = 9;
+            static const int NUM_TEXTURE_TARGETS = 5;
+
+            unsigned int program;
+            unsigned int vertexArray;
+            unsigned int buffers[NUM_BUFFER_TARGETS];
+            unsigned int drawFramebuffer;
+            unsigned int readFramebuffer;
+            unsigned int activeUnit;
+            // Texture per unit and target slot
+            std::vector<unsigned int> textures;
+            int          viewportRect[4];
+            bool         viewportKnown;
+
+            bool         lazyUnbind;
+
+            unsigned int issuedCalls;
+            unsigned int elidedCalls;
+    };
+
+}
+
+#endif
@@ -2,10 +2,13 @@
 #define _MORK_GPURBUFFER_H_
 
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 #include "mork/render/Bindable.h"
 #include "mork/glad/glad.h"
 #include "mork/ui/GlfwWindow.h"
+#include "mork/render/GLState.h"
 #include "mork/core/Log.h"
 
 namespace mork {
@@ -63,13 +66,16 @@ namespace mork {
     class GPUBuffer : public Bindable {
 
     public:
-        GPUBuffer() {
-            glGenBuffers(1, &bufptr);
+        GPUBuffer() : immutable(false) {
+            // Created (not only named) so the direct state access calls below
+            // can be used before the first bind
+            glCreateBuffers(1, &bufptr);
             assert(glGetError() == 0);
         }
 
         GPUBuffer(GPUBuffer&& o) noexcept {
             bufptr = o.bufptr;
+            immutable = o.immutable;
             o.bufptr = 0;
 
         }
@@ -77,13 +83,12 @@ namespace mork {
         GPUBuffer& operator=(GPUBuffer&& o) noexcept {
             if(GlfwWindow::isContextActive() && bufptr!=o.bufptr)
             {
-                if(bufptr) {
-                    unbind();
-                    glDeleteBuffers(1, &bufptr);
-                }
+                if(bufptr)
+                    GLState::getInstance().deleteBuffer(bufptr);
             }   
             
             bufptr = o.bufptr;
+            immutable = o.immutable;
             o.bufptr = 0;
             
             return *this;
@@ -94,34 +99,92 @@ namespace mork {
             // (do not use GLFWWindow)
             if(GlfwWindow::isContextActive())
             {
-                if(bufptr) {
-                    unbind();
-                    glDeleteBuffers(1, &bufptr);
-                }
+                if(bufptr)
+                    GLState::getInstance().deleteBuffer(bufptr);
             }   
  
         }
 
         virtual void bind() const {
-            glBindBuffer(target, bufptr);
+            GLState::getInstance().bindBuffer(target, bufptr);
         }
         virtual void unbind() const {
-            glBindBuffer(target, 0);
+            GLState::getInstance().unbindBuffer(target);
  
         }
 
-        virtual void setData(std::vector<T> data) {
-            glNamedBufferData(bufptr, data.size()*sizeof(T), &data[0], usage);
+        virtual void setData(const std::vector<T>& data) {
+            setData(data.data(), data.size());
+        }
+
+        // Uploads count elements from data, without copying them first
+        virtual void setData(const T* data, size_t count) {
+            if(immutable) {
+                error_logger("Tried to respecify a buffer with immutable storage, use setStorage");
+                throw std::runtime_error(error_logger.last());
+            }
+            glNamedBufferData(bufptr, count*sizeof(T), data, usage);
         }
         
         // Sets an empty buffer with the given size
         // MOstly used with dynamic buffers at initialization
         virtual void setBufferSize(size_t size) {
+            if(immutable) {
+                error_logger("Tried to respecify a buffer with immutable storage, use setStorage");
+                throw std::runtime_error(error_logger.last());
+            }
             glNamedBufferData(bufptr, size, NULL, usage);
         }
 
+        // Allocates immutable storage for count elements, initialized from data
+        // (may be NULL). Static data should use this rather than setData, as the
+        // driver knows the size and use of the storage never changes. flags are
+        // glNamedBufferStorage flags, e.g. GL_DYNAMIC_STORAGE_BIT to allow setSubData.
+        // Calling this again replaces the buffer with a new one, so vertex arrays
+        // using it must be set up again.
+        void setStorage(const T* data, size_t count, GLbitfield flags = 0) {
+            if(immutable) {
+                GLState::getInstance().deleteBuffer(bufptr);
+                glCreateBuffers(1, &bufptr);
+            }
+            // Zero sized storage is not allowed
+            glNamedBufferStorage(bufptr, std::max<size_t>(count, 1)*sizeof(T), data, flags);
+            immutable = true;
+        }
+
+        void setStorage(const std::vector<T>& data, GLbitfield flags = 0) {
+            setStorage(data.data(), data.size(), flags);
+        }
+
+        bool isImmutable() const {
+            return immutable;
+        }
 
 
+
+        // Replaces data.size() elements from element offset on. The buffer must be
+        // large enough
+        void setSubData(size_t offset, const std::vector<T>& data) {
+            setSubData(offset, data.data(), data.size());
+        }
+
+        // Replaces count elements from element offset on
+        void setSubData(size_t offset, const T* data, size_t count) {
+            if(count > 0)
+                glNamedBufferSubData(bufptr, offset*sizeof(T), count*sizeof(T), data);
+        }
+
+        // Copies count elements from src, starting at element srcOffset, to this
+        // buffer at element dstOffset. The ranges must not overlap if src is this buffer
+        void copySubData(const GPUBuffer& src, size_t srcOffset, size_t dstOffset, size_t count) {
+            if(count > 0)
+                glCopyNamedBufferSubData(src.bufptr, bufptr, srcOffset*sizeof(T), dstOffset*sizeof(T), count*sizeof(T));
+        }
+
+        unsigned int getId() const {
+            return bufptr;
+        }
+
         // Maps this buffer to a reachable adress space
         // As noted on the documentation, accessing a buffer in a way incompatible
         // with the buffer usage may be very slow
@@ -165,6 +228,7 @@ namespace mork {
     private:
 
         unsigned int bufptr;
+        bool immutable;
     };
 
 
@@ -0,0 +1,214 @@
+#include "mork/render/GeometryArena.h"
+
+#include <algorithm>
+
+namespace mork {
+
+    GeometryArenaBase::GeometryArenaBase(unsigned int indexCapacity)
+        : indexAllocator(indexCapacity) {
+        ib.setBufferSize(indexCapacity*sizeof(unsigned int));
+    }
+
+    GeometryArenaBase::~GeometryArenaBase() {
+
+    }
+
+    void GeometryArenaBase::bind() const {
+        vao.bind();
+    }
+
+    void GeometryArenaBase::unbind() const {
+        vao.unbind();
+    }
+
+    void GeometryArenaBase::multiDraw(const std::vector<DrawElementsIndirectCommand>& commands) const {
+        if(commands.empty())
+            return;
+
+        indirectBuffer.setData(commands);
+        indirectBuffer.bind();
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, commands.size(), 0);
+        indirectBuffer.unbind();
+    }
+
+    void GeometryArenaBase::remove(unsigned int id) {
+        if(id >= ranges.size() || !ranges[id].live) {
+            error_logger("GeometryArena: No mesh with id ", id);
+            throw std::runtime_error(error_logger.last());
+        }
+
+        Range& range = ranges[id];
+        vertexAllocator.free(range.baseVertex);
+        indexAllocator.free(range.firstIndex);
+        range.live = false;
+        freeIds.push_back(id);
+    }
+
+    const GeometryArenaBase::Range& GeometryArenaBase::getRange(unsigned int id) const {
+        return ranges[id];
+    }
+
+    DrawElementsIndirectCommand GeometryArenaBase::getCommand(unsigned int id, unsigned int instanceCount, unsigned int baseInstance) const {
+        const Range& range = ranges[id];
+        return {range.numIndices, instanceCount, range.firstIndex, static_cast<int>(range.baseVertex), baseInstance};
+    }
+
+    unsigned int GeometryArenaBase::getNumMeshes() const {
+        return ranges.size() - freeIds.size();
+    }
+
+    const RangeAllocator& GeometryArenaBase::getVertexAllocator() const {
+        return vertexAllocator;
+    }
+
+    const RangeAllocator& GeometryArenaBase::getIndexAllocator() const {
+        return indexAllocator;
+    }
+
+    unsigned int GeometryArenaBase::allocateIndices(unsigned int numIndices) {
+        unsigned int offset = indexAllocator.allocate(numIndices);
+        if(offset != RangeAllocator::INVALID)
+            return offset;
+
+        unsigned int capacity = indexAllocator.getCapacity();
+        unsigned int newCapacity = std::max(2*capacity, capacity + numIndices);
+
+        IndexBuffer grown;
+        grown.setBufferSize(newCapacity*sizeof(unsigned int));
+        grown.copySubData(ib, 0, 0, capacity);
+        ib = std::move(grown);
+        indexAllocator.grow(newCapacity);
+        setupVertexArray();
+
+        return indexAllocator.allocate(numIndices);
+    }
+
+    void GeometryArenaBase::compactIndices() {
+        std::vector<RangeAllocator::Move> moves = indexAllocator.compact();
+        if(moves.empty())
+            return;
+
+        std::unordered_map<unsigned int, unsigned int> moved;
+        for(const auto& move : moves)
+            moved.emplace(move.from, move.to);
+
+        // Indices are relative to the first vertex of each mesh, so they are copied
+        // as they are
+        IndexBuffer packed;
+        packed.setBufferSize(indexAllocator.getCapacity()*sizeof(unsigned int));
+        for(Range& range : ranges) {
+            if(!range.live)
+                continue;
+            auto it = moved.find(range.firstIndex);
+            unsigned int to = it == moved.end() ? range.firstIndex : it->second;
+            packed.copySubData(ib, range.firstIndex, to, range.numIndices);
+            range.firstIndex = to;
+        }
+        ib = std::move(packed);
+        setupVertexArray();
+    }
+
+    unsigned int GeometryArenaBase::addRange(const Range& range) {
+        if(!freeIds.empty()) {
+            unsigned int id = freeIds.back();
+            freeIds.pop_back();
+            ranges[id] = range;
+            return id;
+        }
+        ranges.push_back(range);
+        return ranges.size() - 1;
+    }
+
+
+    ArenaMesh::ArenaMesh(GeometryArenaBase* arena, unsigned int id) : arena(arena), id(id) {
+
+    }
+
+    ArenaMesh::~ArenaMesh() {
+        release();
+    }
+
+    ArenaMesh::ArenaMesh(ArenaMesh&& o) noexcept : arena(o.arena), id(o.id) {
+        o.arena = nullptr;
+    }
+
+    ArenaMesh& ArenaMesh::operator=(ArenaMesh&& o) noexcept {
+        if(this != &o) {
+            release();
+            arena = o.arena;
+            id = o.id;
+            o.arena = nullptr;
+        }
+        return *this;
+    }
+
+    void ArenaMesh::release() noexcept {
+        if(arena == nullptr)
+            return;
+        try {
+            arena->remove(id);
+        } catch(const std::exception& e) {
+            error_logger("ArenaMesh: Could not remove mesh ", id, ": ", e.what());
+        }
+        arena = nullptr;
+    }
+
+    void ArenaMesh::draw() const {
+        bind();
+        issueDraw();
+        unbind();
+    }
+
+    void ArenaMesh::bind() const {
+        arena->bind();
+    }
+
+    void ArenaMesh::issueDraw(unsigned int /*lod*/) const {
+        const auto& range = arena->getRange(id);
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.numIndices, GL_UNSIGNED_INT,
+                (void*)(range.firstIndex*sizeof(unsigned int)), range.baseVertex);
+    }
+
+    void ArenaMesh::unbind() const {
+        arena->unbind();
+    }
+
+    void ArenaMesh::issueDrawInstanced(unsigned int /*lod*/, unsigned int instanceCount, unsigned int baseInstance) const {
+        const auto& range = arena->getRange(id);
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.numIndices, GL_UNSIGNED_INT,
+                (void*)(range.firstIndex*sizeof(unsigned int)), instanceCount, range.baseVertex, baseInstance);
+    }
+
+    unsigned int ArenaMesh::getNumLods() const {
+        return 1;
+    }
+
+    float ArenaMesh::getLodError(unsigned int /*lod*/) const {
+        return 0.0f;
+    }
+
+    const GeometryArenaBase* ArenaMesh::getArena() const {
+        return arena;
+    }
+
+    void ArenaMesh::getDrawCommand(unsigned int /*lod*/, unsigned int instanceCount, unsigned int baseInstance, DrawElementsIndirectCommand& command) const {
+        command = arena->getCommand(id, instanceCount, baseInstance);
+    }
+
+    unsigned int ArenaMesh::getId() const {
+        return id;
+    }
+
+    box3d ArenaMesh::getBounds() const {
+        return arena->getRange(id).bounds;
+    }
+
+    int ArenaMesh::getNumVertices() const {
+        return arena->getRange(id).numVertices;
+    }
+
+    int ArenaMesh::getNumIndices() const {
+        return arena->getRange(id).numIndices;
+    }
+
+}
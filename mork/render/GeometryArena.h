@@ -0,0 +1,231 @@
+#ifndef _MORK_GEOMETRYARENA_H_
+#define _MORK_GEOMETRYARENA_H_
+
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+#include "mork/math/box3.h"
+#include "mork/core/Log.h"
+#include "mork/render/Mesh.h"
+#include "mork/render/VertexBuffer.h"
+#include "mork/render/VertexArrayObject.h"
+#include "mork/util/RangeAllocator.h"
+
+namespace mork {
+
+    class ArenaMesh;
+
+    // The vertex format independent part of a GeometryArena: the index buffer, the
+    // vertex array, the bookkeeping of meshes, and multi draw submission
+    class GeometryArenaBase {
+        public:
+            // The vertices and indices of a mesh in the arena. Indices are relative
+            // to the first vertex of the mesh.
+            struct Range {
+                unsigned int    baseVertex;
+                unsigned int    numVertices;
+                unsigned int    firstIndex;
+                unsigned int    numIndices;
+                box3d           bounds;
+                bool            live;
+            };
+
+            GeometryArenaBase(const GeometryArenaBase&) = delete;
+            GeometryArenaBase& operator=(const GeometryArenaBase&) = delete;
+
+            virtual ~GeometryArenaBase();
+
+            void bind() const;
+            void unbind() const;
+
+            // Draws all commands with one glMultiDrawElementsIndirect call. The arena
+            // must be bound.
+            void multiDraw(const std::vector<DrawElementsIndirectCommand>& commands) const;
+
+            // Removes the mesh with the given id, freeing its ranges
+            void remove(unsigned int id);
+
+            const Range& getRange(unsigned int id) const;
+
+            // Returns the draw command of instanceCount instances of the mesh
+            DrawElementsIndirectCommand getCommand(unsigned int id, unsigned int instanceCount, unsigned int baseInstance) const;
+
+            // Moves all meshes to the start of the buffers, removing the holes left by
+            // removed meshes. Ids and ArenaMeshes stay valid.
+            virtual void compact() = 0;
+
+            unsigned int getNumMeshes() const;
+            const RangeAllocator& getVertexAllocator() const;
+            const RangeAllocator& getIndexAllocator() const;
+
+        protected:
+            GeometryArenaBase(unsigned int indexCapacity);
+
+            // Returns the offset of numIndices new indices, growing the index buffer
+            // if needed
+            unsigned int allocateIndices(unsigned int numIndices);
+
+            // Packs the index buffer, see compact
+            void compactIndices();
+
+            // Returns the id of a new mesh
+            unsigned int addRange(const Range& range);
+
+            // Sets up the vertex array after the buffers have changed
+            virtual void setupVertexArray() = 0;
+
+            VertexArrayObject       vao;
+            IndexBuffer             ib;
+            mutable GPUBuffer<DrawElementsIndirectCommand, GL_DRAW_INDIRECT_BUFFER, GL_STREAM_DRAW> indirectBuffer;
+
+            RangeAllocator          vertexAllocator;
+            RangeAllocator          indexAllocator;
+
+            std::vector<Range>          ranges;
+            std::vector<unsigned int>   freeIds;
+    };
+
+    // A mesh stored in a GeometryArena. Draws of meshes in the same arena share a
+    // single vertex array, so a RenderQueue can draw batches of them with one
+    // multi draw call. The arena must outlive its meshes.
+    class ArenaMesh : public MeshBase {
+        public:
+            ArenaMesh(GeometryArenaBase* arena, unsigned int id);
+            ~ArenaMesh();
+
+            ArenaMesh(const ArenaMesh&) = delete;
+            ArenaMesh& operator=(const ArenaMesh&) = delete;
+            ArenaMesh(ArenaMesh&& o) noexcept;
+            ArenaMesh& operator=(ArenaMesh&& o) noexcept;
+
+            virtual void draw() const;
+            virtual void bind() const;
+            virtual void issueDraw(unsigned int lod = 0) const;
+            virtual void unbind() const;
+            virtual void issueDrawInstanced(unsigned int lod, unsigned int instanceCount, unsigned int baseInstance) const;
+
+            virtual unsigned int getNumLods() const;
+            virtual float getLodError(unsigned int lod) const;
+
+            virtual const GeometryArenaBase* getArena() const;
+            virtual void getDrawCommand(unsigned int lod, unsigned int instanceCount, unsigned int baseInstance, DrawElementsIndirectCommand& command) const;
+
+            unsigned int getId() const;
+            box3d getBounds() const;
+            int getNumVertices() const;
+            int getNumIndices() const;
+
+        private:
+            // Removes the mesh from its arena, logging instead of throwing, as it is
+            // used by the destructor and move assignment
+            void release() noexcept;
+
+            GeometryArenaBase*  arena;
+            unsigned int        id;
+    };
+
+    // Sub-allocates the vertices and indices of many meshes of the same vertex
+    // format from one large vertex buffer and one large index buffer. The buffers
+    // grow (doubling) when full, and compact() removes the holes left by removed
+    // meshes.
+    template<typename vertex>
+    class GeometryArena : public GeometryArenaBase {
+        public:
+            GeometryArena(unsigned int vertexCapacity = 1 << 16, unsigned int indexCapacity = 1 << 18)
+                : GeometryArenaBase(indexCapacity) {
+                vertexAllocator.grow(vertexCapacity);
+                vb.setBufferSize(vertexCapacity*sizeof(vertex));
+                setupVertexArray();
+            }
+
+            // Adds an indexed triangle mesh to the arena
+            ArenaMesh add(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices) {
+                if(vertices.empty() || indices.empty()) {
+                    error_logger("GeometryArena: Meshes must have vertices and indices");
+                    throw std::runtime_error(error_logger.last());
+                }
+
+                Range range;
+                range.baseVertex = allocateVertices(vertices.size());
+                range.numVertices = vertices.size();
+                range.firstIndex = allocateIndices(indices.size());
+                range.numIndices = indices.size();
+                range.bounds = calculateBounds(vertices);
+                range.live = true;
+
+                vb.setSubData(range.baseVertex, vertices);
+                ib.setSubData(range.firstIndex, indices);
+
+                return ArenaMesh(this, addRange(range));
+            }
+
+            virtual void compact() {
+                compactIndices();
+
+                // Copy all meshes to a new buffer, as copies within a buffer must not
+                // overlap
+                std::vector<RangeAllocator::Move> moves = vertexAllocator.compact();
+                if(moves.empty())
+                    return;
+
+                std::unordered_map<unsigned int, unsigned int> moved;
+                for(const auto& move : moves)
+                    moved.emplace(move.from, move.to);
+
+                VertexBuffer<vertex> packed;
+                packed.setBufferSize(vertexAllocator.getCapacity()*sizeof(vertex));
+                for(Range& range : ranges) {
+                    if(!range.live)
+                        continue;
+                    auto it = moved.find(range.baseVertex);
+                    unsigned int to = it == moved.end() ? range.baseVertex : it->second;
+                    packed.copySubData(vb, range.baseVertex, to, range.numVertices);
+                    range.baseVertex = to;
+                }
+                vb = std::move(packed);
+                setupVertexArray();
+            }
+
+        protected:
+            virtual void setupVertexArray() {
+                vao.bind();
+                vb.bind();
+                vb.setAttributes();
+                ib.bind();
+                vao.unbind();
+                vb.unbind();
+            }
+
+        private:
+            unsigned int allocateVertices(unsigned int numVertices) {
+                unsigned int offset = vertexAllocator.allocate(numVertices);
+                if(offset != RangeAllocator::INVALID)
+                    return offset;
+
+                unsigned int capacity = vertexAllocator.getCapacity();
+                unsigned int newCapacity = std::max(2*capacity, capacity + numVertices);
+
+                VertexBuffer<vertex> grown;
+                grown.setBufferSize(newCapacity*sizeof(vertex));
+                grown.copySubData(vb, 0, 0, capacity);
+                vb = std::move(grown);
+                vertexAllocator.grow(newCapacity);
+                setupVertexArray();
+
+                return vertexAllocator.allocate(numVertices);
+            }
+
+            static box3d calculateBounds(const std::vector<vertex>& vertices) {
+                box3d b;
+                for(const auto& v : vertices)
+                    b = b.enlarge(vec3d(v.pos.x, v.pos.y, v.pos.z));
+                return b;
+            }
+
+            VertexBuffer<vertex>    vb;
+    };
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "mork/render/Image.h"
+#include "mork/core/stb_image.h"
+#include "mork/glad/glad.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mork {
+
+    void Image::PixelDeleter::operator()(unsigned char* pixels) const {
+        stbi_image_free(pixels);
+    }
+
+    Image::Image() : width(0), height(0), channels(0) {
+    }
+
+    Image Image::load(const std::string& file, bool flipVertical) {
+        // stbi_set_flip_vertically_on_load is global state, so it is never set and
+        // images are flipped here instead
+        Image image;
+        unsigned char* data = stbi_load(file.c_str(), &image.width, &image.height, &image.channels, 0);
+        if(!data) {
+            // Not error_logger.last(), which other threads may change
+            std::string message = "File \"" + file + "\" could not be loaded.";
+            error_logger(message);
+            throw std::runtime_error(message);
+        }
+        image.pixels.reset(data);
+
+        if(flipVertical)
+            image.flipVertical();
+        return image;
+    }
+
+    void Image::flipVertical() {
+        size_t rowSize = size_t(width)*channels;
+        unsigned char* p = pixels.get();
+        for(int top = 0, bottom = height - 1; top < bottom; ++top, --bottom)
+            std::swap_ranges(p + top*rowSize, p + (top + 1)*rowSize, p + bottom*rowSize);
+    }
+
+    bool Image::empty() const {
+        return !pixels;
+    }
+
+    int Image::getWidth() const {
+        return width;
+    }
+
+    int Image::getHeight() const {
+        return height;
+    }
+
+    int Image::getChannels() const {
+        return channels;
+    }
+
+    size_t Image::getSize() const {
+        return size_t(width)*height*channels;
+    }
+
+    int Image::getFormat() const {
+        switch(channels) {
+            case 1: return GL_R8;
+            case 2: return GL_RG8;
+            case 3: return GL_RGB8;
+            case 4: return GL_RGBA8;
+        }
+        return -1;
+    }
+
+    const unsigned char* Image::getPixels() const {
+        return pixels.get();
+    }
+
+    unsigned char* Image::getPixels() {
+        return pixels.get();
+    }
+
+}
@@ -0,0 +1,58 @@
+#ifndef _MORK_IMAGE_H_
+#define _MORK_IMAGE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace mork {
+
+    // Decoded 8 bit pixels of an image file, with tightly packed rows of 1 to 4
+    // channels. Images are decoded without any GL calls, so they can be decoded on
+    // other threads (see ImageDecoder) and handed to the GL thread for upload.
+    class Image {
+        public:
+            // An empty image
+            Image();
+
+            Image(Image&& o) noexcept = default;
+            Image& operator=(Image&& o) noexcept = default;
+            Image(const Image&) = delete;
+            Image& operator=(const Image&) = delete;
+
+            // Decodes file (PNG, JPEG, TGA, BMP etc.), with the first row at the
+            // bottom if flipVertical. Throws if the file can not be decoded.
+            // Thread safe.
+            static Image load(const std::string& file, bool flipVertical);
+
+            // Reverses the order of the rows
+            void flipVertical();
+
+            bool empty() const;
+            int getWidth() const;
+            int getHeight() const;
+            int getChannels() const;
+            // The size of the pixels in bytes
+            size_t getSize() const;
+
+            // The internal format of a texture with the channels of the image
+            // (GL_R8, GL_RG8, GL_RGB8 or GL_RGBA8)
+            int getFormat() const;
+
+            const unsigned char* getPixels() const;
+            unsigned char* getPixels();
+
+        private:
+            struct PixelDeleter {
+                void operator()(unsigned char* pixels) const;
+            };
+
+            int width;
+            int height;
+            int channels;
+            std::unique_ptr<unsigned char, PixelDeleter> pixels;
+    };
+
+}
+
+#endif
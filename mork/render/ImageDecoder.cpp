@@ -0,0 +1,41 @@
+#include "mork/render/ImageDecoder.h"
+
+namespace mork {
+
+    ImageDecoder& ImageDecoder::getInstance() {
+        static ImageDecoder instance;
+        return instance;
+    }
+
+    ImageDecoder::ImageDecoder(unsigned int threads) : pool(threads) {
+    }
+
+    std::future<Image> ImageDecoder::decode(const std::string& file, bool flipVertical) {
+        return pool.submit([file, flipVertical]() {
+            return Image::load(file, flipVertical);
+        });
+    }
+
+    std::vector<Image> ImageDecoder::decodeAll(const std::vector<std::string>& files, bool flipVertical) {
+        std::vector<std::future<Image> > futures;
+        futures.reserve(files.size());
+        for(const std::string& file : files)
+            futures.push_back(decode(file, flipVertical));
+
+        // Wait for all before rethrowing, so a bad file does not leave the others
+        // decoding in the background
+        for(auto& f : futures)
+            f.wait();
+
+        std::vector<Image> images;
+        images.reserve(files.size());
+        for(auto& f : futures)
+            images.push_back(f.get());
+        return images;
+    }
+
+    unsigned int ImageDecoder::getNumThreads() const {
+        return pool.size();
+    }
+
+}
@@ -0,0 +1,44 @@
+#ifndef _MORK_IMAGEDECODER_H_
+#define _MORK_IMAGEDECODER_H_
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "mork/render/Image.h"
+#include "mork/util/ThreadPool.h"
+
+namespace mork {
+
+    // Decodes image files on a pool of worker threads, so loading many textures
+    // decodes them concurrently. The GL thread only uploads the decoded images,
+    // and can do other loading work while waiting for the futures.
+    class ImageDecoder {
+        public:
+            // The decoder shared by all texture loading, with one thread per
+            // hardware thread
+            static ImageDecoder& getInstance();
+
+            // 0 threads gives one per hardware thread
+            ImageDecoder(unsigned int threads = 0);
+
+            ImageDecoder(const ImageDecoder&) = delete;
+            ImageDecoder& operator=(const ImageDecoder&) = delete;
+
+            // Queues the decoding of file, see Image::load. Errors are thrown from
+            // the future's get().
+            std::future<Image> decode(const std::string& file, bool flipVertical);
+
+            // Decodes all files concurrently and waits for them, returning the
+            // images in the order of the files
+            std::vector<Image> decodeAll(const std::vector<std::string>& files, bool flipVertical);
+
+            unsigned int getNumThreads() const;
+
+        private:
+            ThreadPool pool;
+    };
+
+}
+
+#endif
@@ -2,37 +2,66 @@
 #include "mork/resource/ResourceFactory.h"
 #include "mork/util/Util.h"
 
+#include <atomic>
+
 namespace mork {
 
     TextureLayer::TextureLayer()
-        : blendFactor(1.0f), op(ADD), texture(){} 
+        : blendFactor(1.0f), op(ADD), texture(), arrayIndex(-1), arrayLayer(-1) {} 
+
+    TextureLayer::TextureLayer(std::shared_ptr<Texture<2> > texture, Op op, float blendFactor)
+        : texture(std::move(texture)), op(op), blendFactor(blendFactor), arrayIndex(-1), arrayLayer(-1) {}
 
     TextureLayer::TextureLayer(Texture<2>&& texture, Op op, float blendFactor)
-        : texture(std::move(texture)), op(op), blendFactor(blendFactor) {}
+        : texture(std::make_shared<Texture<2> >(std::move(texture))), op(op), blendFactor(blendFactor), arrayIndex(-1), arrayLayer(-1) {}
 
     TextureLayer::TextureLayer(Texture<2>&& texture)
-        : texture(std::move(texture)), op(Op::ADD), blendFactor(1.0f) {}
+        : texture(std::make_shared<Texture<2> >(std::move(texture))), op(Op::ADD), blendFactor(1.0f), arrayIndex(-1), arrayLayer(-1) {}
 
 
     
     TextureLayer::TextureLayer(TextureLayer&& o) noexcept :
         texture(std::move(o.texture)),
         op(o.op),
-        blendFactor(o.blendFactor)
+        blendFactor(o.blendFactor),
+        arrayIndex(o.arrayIndex),
+        arrayLayer(o.arrayLayer)
     {
     }
 
     TextureLayer& TextureLayer::operator=(TextureLayer&& o) noexcept {
-        if(o.texture != texture) {
+        if(this != &o) {
             texture = std::move(o.texture);
             op = o.op;
             blendFactor = o.blendFactor;
+            arrayIndex = o.arrayIndex;
+            arrayLayer = o.arrayLayer;
         }
 
         return *this;
 
     }
 
+    bool TextureLayer::isPooled() const {
+        return arrayIndex >= 0;
+    }
+
+    static std::atomic<uint64_t> nextSerial(0);
+
+    Material::Serial::Serial() : value(nextSerial++) {}
+
+    Material::Serial::Serial(Serial&& o) noexcept : value(o.value) {
+        o.value = nextSerial++;
+    }
+
+    Material::Serial& Material::Serial::operator=(Serial&& o) noexcept {
+        if(this != &o) {
+            value = o.value;
+            o.value = nextSerial++;
+        }
+        return *this;
+    }
+
     // All values inititialized to default
     Material::Material() :
         ambientColor(vec3f::ZERO),
@@ -42,7 +71,8 @@ namespace mork {
         shininess(32.0f),
         reflectiveFactor(0.0f),
         refractiveFactor(0.0f),            
-        refractiveIndex(0.0f) {}
+        refractiveIndex(0.0f),
+        opacity(1.0f) {}
 
 /*    Material::Material(Material&& o) noexcept
         : diffuseLayers(std::move(o.diffuseLayers)),
@@ -73,7 +103,12 @@ namespace mork {
         prog.getUniform(target + ".refractiveFactor").set(refractiveFactor);
         prog.getUniform(target + ".refractiveIndex").set(refractiveIndex);
 
-        // Running counter for active textures
+        // Opacity is not used by all shaders, so check before setting it:
+        if(prog.queryUniform(target + ".opacity"))
+            prog.getUniform(target + ".opacity").set(opacity);
+
+        // Running counter for active textures. Pooled layers can not be sampled
+        // through these uniforms, and get no texture unit.
         int tex = 0;
 
         unsigned int l = 0;
@@ -82,7 +117,8 @@ namespace mork {
         prog.getUniform(target + ".numAmbientLayers").set(l);
         for(int i = 0; i < l; ++i) {
             std::string num = std::to_string(i);
-            prog.getUniform(target + ".ambientLayers[" + num + "].texture").set(tex++);
+            if(!ambientLayers[i].isPooled())
+                prog.getUniform(target + ".ambientLayers[" + num + "].texture").set(tex++);
             prog.getUniform(target + ".ambientLayers[" + num + "].op").set(ambientLayers[i].op);
             prog.getUniform(target + ".ambientLayers[" + num + "].blendFactor").set(ambientLayers[i].blendFactor);
         }
@@ -91,7 +127,8 @@ namespace mork {
         prog.getUniform(target + ".numDiffuseLayers").set(l);
         for(int i = 0; i < l; ++i) {
             std::string num = std::to_string(i);
-            prog.getUniform(target + ".diffuseLayers[" + num + "].texture").set(tex++);
+            if(!diffuseLayers[i].isPooled())
+                prog.getUniform(target + ".diffuseLayers[" + num + "].texture").set(tex++);
             prog.getUniform(target + ".diffuseLayers[" + num + "].op").set(diffuseLayers[i].op);
             prog.getUniform(target + ".diffuseLayers[" + num + "].blendFactor").set(diffuseLayers[i].blendFactor);
         }
@@ -100,7 +137,8 @@ namespace mork {
         prog.getUniform(target + ".numSpecularLayers").set(l);
         for(int i = 0; i < l; ++i) {
             std::string num = std::to_string(i);
-            prog.getUniform(target + ".specularLayers[" + num + "].texture").set(tex++);
+            if(!specularLayers[i].isPooled())
+                prog.getUniform(target + ".specularLayers[" + num + "].texture").set(tex++);
             prog.getUniform(target + ".specularLayers[" + num + "].op").set(specularLayers[i].op);
             prog.getUniform(target + ".specularLayers[" + num + "].blendFactor").set(specularLayers[i].blendFactor);
         }
@@ -109,7 +147,8 @@ namespace mork {
         prog.getUniform(target + ".numEmissiveLayers").set(l);
         for(int i = 0; i < l; ++i) {
             std::string num = std::to_string(i);
-            prog.getUniform(target + ".emissiveLayers[" + num + "].texture").set(tex++);
+            if(!emissiveLayers[i].isPooled())
+                prog.getUniform(target + ".emissiveLayers[" + num + "].texture").set(tex++);
             prog.getUniform(target + ".emissiveLayers[" + num + "].op").set(emissiveLayers[i].op);
             prog.getUniform(target + ".emissiveLayers[" + num + "].blendFactor").set(emissiveLayers[i].blendFactor);
         }
@@ -118,7 +157,8 @@ namespace mork {
         prog.getUniform(target + ".numNormalLayers").set(l);
         for(int i = 0; i < l; ++i) {
             std::string num = std::to_string(i);
-            prog.getUniform(target + ".normalLayers[" + num + "].texture").set(tex++);
+            if(!normalLayers[i].isPooled())
+                prog.getUniform(target + ".normalLayers[" + num + "].texture").set(tex++);
             prog.getUniform(target + ".normalLayers[" + num + "].op").set(normalLayers[i].op);
             prog.getUniform(target + ".normalLayers[" + num + "].blendFactor").set(normalLayers[i].blendFactor);
         }
@@ -134,32 +174,51 @@ namespace mork {
        
         l = ambientLayers.size();
         for(int i = 0; i < l; ++i) {
-            ambientLayers[i].texture.bind(tex++);
+            if(!ambientLayers[i].isPooled())
+                ambientLayers[i].texture->bind(tex++);
         }
 
         l = diffuseLayers.size();
         for(int i = 0; i < l; ++i) {
-            diffuseLayers[i].texture.bind(tex++);
+            if(!diffuseLayers[i].isPooled())
+                diffuseLayers[i].texture->bind(tex++);
         }
 
         l = specularLayers.size();
         for(int i = 0; i < l; ++i) {
-            specularLayers[i].texture.bind(tex++);
+            if(!specularLayers[i].isPooled())
+                specularLayers[i].texture->bind(tex++);
         }
 
         l = emissiveLayers.size();
         for(int i = 0; i < l; ++i) {
-            emissiveLayers[i].texture.bind(tex++);
+            if(!emissiveLayers[i].isPooled())
+                emissiveLayers[i].texture->bind(tex++);
         }
         
         l = normalLayers.size();
         for(int i = 0; i < l; ++i) {
-            normalLayers[i].texture.bind(tex++);
+            if(!normalLayers[i].isPooled())
+                normalLayers[i].texture->bind(tex++);
         }
 
 
     }
 
+    bool Material::hasBoundTextures() const {
+        for(const std::vector<TextureLayer>* layers : {&ambientLayers, &diffuseLayers, &specularLayers, &emissiveLayers, &normalLayers}) {
+            for(const TextureLayer& layer : *layers) {
+                if(!layer.isPooled())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t Material::getSerial() const {
+        return serial.value;
+    }
+
     inline json materialSchema = R"(
     {
         "$schema": "http://json-schema.org/draft-07/schema#",
@@ -169,6 +228,7 @@ namespace mork {
         "properties": {
             "name": { "type": "string" },
             "diffuseColor": { "type": "string" },
+            "opacity": { "type": "number", "minimum": 0, "maximum": 1 },
             "diffuseLayers": { "type": "array", "items": { "type": "object"} },
             "normalLayers": { "type": "array", "items": { "type": "object" } }
         },
@@ -198,6 +258,10 @@ namespace mork {
                     material.diffuseColor = dc.cast<float>();
                 }
 
+                if(js.count("opacity")) {
+                    material.opacity = js["opacity"].get<float>();
+                }
+
                 if(js.count("diffuseLayers")) {
                     json diff = js["diffuseLayers"];
                     for( auto& arrayObject : diff) {
@@ -210,7 +274,7 @@ namespace mork {
                         json texj = arrayObject["texture2d"];
                         Resource& cr = r.addChildResource(Resource(manager, "texture2d", texj, texj["file"]));
     
-                        auto tex = ResourceFactory<Texture<2>>::getInstance().create(manager, cr);
+                        auto tex = ResourceFactory<std::shared_ptr<Texture<2> > >::getInstance().create(manager, cr);
                         
                         material.diffuseLayers.push_back(TextureLayer(std::move(tex), op, bf)); 
                     }
@@ -229,7 +293,7 @@ namespace mork {
                          
                         Resource& cr = r.addChildResource(Resource(manager, "texture2d", texj, texj["file"]));
     
-                        auto tex = ResourceFactory<Texture<2>>::getInstance().create(manager, cr);
+                        auto tex = ResourceFactory<std::shared_ptr<Texture<2> > >::getInstance().create(manager, cr);
      
                         material.normalLayers.push_back(TextureLayer(std::move(tex), op, bf)); 
                     }
@@ -4,6 +4,8 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
+#include <cstdint>
 
 #include <mork/math/vec3.h>
 #include <mork/render/Texture.h>
@@ -13,20 +15,30 @@ namespace mork {
         
     enum Op : unsigned int { ADD = 1, MULTIPLY = 2 };
  
-    // Wrapper class for textures that adds an blend op and blend factor
+    // Wrapper class for textures that adds an blend op and blend factor. The texture
+    // is shared, e.g. by the layers of all materials using it from the TextureCache.
+    // Layers packed in a TextureArrayPool refer to a layer of a pool array instead
+    // of the texture.
     class TextureLayer {
        
         public:
             TextureLayer();
+            TextureLayer(std::shared_ptr<Texture<2> > texture, Op op, float blendFactor);
             TextureLayer(Texture<2>&& texture, Op op, float blendFactor);
             TextureLayer(Texture<2>&& texture);
             TextureLayer(TextureLayer&& o) noexcept;
             TextureLayer& operator=(TextureLayer&& o) noexcept;
 
-            Texture<2>  texture;
+            bool isPooled() const;
+
+            std::shared_ptr<Texture<2> > texture;
             Op          op;
             float       blendFactor;
 
+            // The pool array and layer holding the texture, -1 if not pooled
+            int         arrayIndex;
+            int         arrayLayer;
+
 
     };
    
@@ -39,9 +51,22 @@ namespace mork {
             Material(Material&& o) = default;
             Material& operator=(Material&&) = default;
 
+            // Sets all fields as uniforms of the struct target. Programs reading the
+            // MaterialTable only need the textures bound.
             void set(const Program& prog, const std::string& target) const;
+            // Binds the texture layers to units 0.., in the order ambient, diffuse,
+            // specular, emissive and normal layers. Pooled layers are skipped.
             void bindTextures() const;
 
+            // Returns true if any texture layer has its own texture to bind, i.e.
+            // is not pooled
+            bool hasBoundTextures() const;
+
+            // Returns a number unique to this material for the run, identifying it in
+            // a MaterialTable. Unlike the address, it is never reused. A moved
+            // material keeps its serial, and the moved from material gets a new one.
+            uint64_t getSerial() const;
+
             // Base colors:
             vec3f                   ambientColor;
             vec3f                   diffuseColor;
@@ -55,6 +80,9 @@ namespace mork {
             float                   refractiveFactor;
             float                   refractiveIndex;
 
+            // Materials with opacity < 1 are drawn blended, after all opaque materials
+            float                   opacity;
+
             // Texture layers
             std::vector<TextureLayer > diffuseLayers;
             std::vector<TextureLayer > specularLayers;
@@ -66,6 +94,15 @@ namespace mork {
             std::vector<TextureLayer> heightLayers;
 
         private:
+            struct Serial {
+                Serial();
+                Serial(Serial&& o) noexcept;
+                Serial& operator=(Serial&& o) noexcept;
+
+                uint64_t value;
+            };
+
+            Serial                  serial;
     };
 }
 #endif
@@ -0,0 +1,116 @@
+#include "mork/render/MaterialTable.h"
+#include "mork/render/GLState.h"
+#include "mork/core/Log.h"
+
+#include <stdexcept>
+
+namespace mork {
+
+    const char* const MaterialTable::BLOCK = "Materials";
+    const char* const MaterialTable::TEXTURES = "materialTextures";
+    const char* const MaterialTable::ARRAYS = "materialArrays";
+
+    // Compiles a kind of layers, numbering their (not pooled) textures from unit
+    static unsigned int compileLayers(const std::vector<TextureLayer>& layers, TextureLayerData* data, int& unit) {
+        if(layers.size() > MaterialData::MAX_LAYERS) {
+            error_logger("MaterialTable: Materials can have at most ", MaterialData::MAX_LAYERS, " layers of each kind, got ", layers.size());
+            throw std::runtime_error(error_logger.last());
+        }
+
+        for(unsigned int i = 0; i < layers.size(); ++i) {
+            const TextureLayer& layer = layers[i];
+            if(layer.isPooled())
+                data[i] = {layer.op, layer.blendFactor, layer.arrayIndex, layer.arrayLayer};
+            else
+                data[i] = {layer.op, layer.blendFactor, unit++, -1};
+        }
+        return layers.size();
+    }
+
+    MaterialTable::MaterialTable() : changed(true) {
+
+    }
+
+    unsigned int MaterialTable::add(const Material& material) {
+        auto it = ids.find(material.getSerial());
+        if(it != ids.end())
+            return it->second;
+
+        MaterialData data = {};
+        compile(material, data);
+        records.push_back(data);
+        changed = true;
+
+        unsigned int id = records.size() - 1;
+        ids.emplace(material.getSerial(), id);
+        return id;
+    }
+
+    void MaterialTable::update(const Material& material) {
+        auto it = ids.find(material.getSerial());
+        if(it == ids.end()) {
+            add(material);
+            return;
+        }
+
+        MaterialData data = {};
+        compile(material, data);
+        records[it->second] = data;
+        changed = true;
+    }
+
+    void MaterialTable::clear() {
+        records.clear();
+        ids.clear();
+        changed = true;
+    }
+
+    bool MaterialTable::contains(const Material& material) const {
+        return ids.find(material.getSerial()) != ids.end();
+    }
+
+    unsigned int MaterialTable::getNumMaterials() const {
+        return records.size();
+    }
+
+    const MaterialData& MaterialTable::getData(unsigned int id) const {
+        return records[id];
+    }
+
+    void MaterialTable::upload() {
+        if(!buffer)
+            buffer = std::make_unique<GPUBuffer<MaterialData, GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_DRAW> >();
+
+        if(changed && !records.empty()) {
+            buffer->setData(records);
+            changed = false;
+        }
+        GLState::getInstance().bindBufferRange(GL_SHADER_STORAGE_BUFFER, BINDING, buffer->getId());
+    }
+
+    void MaterialTable::compile(const Material& material, MaterialData& data) {
+        data.ambientColor = material.ambientColor;
+        data.diffuseColor = material.diffuseColor;
+        data.specularColor = material.specularColor;
+        data.emissiveColor = material.emissiveColor;
+        data.shininess = material.shininess;
+        data.reflectiveFactor = material.reflectiveFactor;
+        data.refractiveFactor = material.refractiveFactor;
+        data.refractiveIndex = material.refractiveIndex;
+        data.opacity = material.opacity;
+
+        // Textures are numbered in the order Material::bindTextures binds them
+        int unit = 0;
+        data.numAmbientLayers = compileLayers(material.ambientLayers, data.ambientLayers, unit);
+        data.numDiffuseLayers = compileLayers(material.diffuseLayers, data.diffuseLayers, unit);
+        data.numSpecularLayers = compileLayers(material.specularLayers, data.specularLayers, unit);
+        data.numEmissiveLayers = compileLayers(material.emissiveLayers, data.emissiveLayers, unit);
+        data.numNormalLayers = compileLayers(material.normalLayers, data.normalLayers, unit);
+
+        if(unit > static_cast<int>(MAX_TEXTURES)) {
+            error_logger("MaterialTable: Materials can have at most ", MAX_TEXTURES, " texture layers, got ", unit);
+            throw std::runtime_error(error_logger.last());
+        }
+    }
+
+}
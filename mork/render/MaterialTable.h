@@ -0,0 +1,116 @@
+#ifndef _MORK_MATERIALTABLE_H_
+#define _MORK_MATERIALTABLE_H_
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "mork/math/vec3.h"
+#include "mork/render/Material.h"
+#include "mork/render/GPUBuffer.h"
+
+namespace mork {
+
+    // The std430 layouts of the material table records in shaders/materials.glhl
+
+    struct TextureLayerData {
+        unsigned int    op;
+        float           blendFactor;
+        // For layers with layer < 0, the index in the materialTextures sampler
+        // array, i.e. the texture unit the layer is bound to by
+        // Material::bindTextures. For pooled layers, the index in materialArrays.
+        int             texture;
+        // The layer in the pool array, or -1
+        int             layer;
+    };
+
+    struct MaterialData {
+        static constexpr unsigned int MAX_LAYERS = 4;
+
+        vec3f           ambientColor;
+        float           shininess;
+        vec3f           diffuseColor;
+        float           reflectiveFactor;
+        vec3f           specularColor;
+        float           refractiveFactor;
+        vec3f           emissiveColor;
+        float           refractiveIndex;
+
+        float           opacity;
+        unsigned int    numAmbientLayers;
+        unsigned int    numDiffuseLayers;
+        unsigned int    numSpecularLayers;
+        unsigned int    numEmissiveLayers;
+        unsigned int    numNormalLayers;
+        unsigned int    pad0[2];
+
+        TextureLayerData ambientLayers[MAX_LAYERS];
+        TextureLayerData diffuseLayers[MAX_LAYERS];
+        TextureLayerData specularLayers[MAX_LAYERS];
+        TextureLayerData emissiveLayers[MAX_LAYERS];
+        TextureLayerData normalLayers[MAX_LAYERS];
+    };
+
+    static_assert(sizeof(TextureLayerData) == 16, "TextureLayerData must match std430");
+    static_assert(offsetof(MaterialData, opacity) == 64 && offsetof(MaterialData, ambientLayers) == 96
+            && sizeof(MaterialData) == 416, "MaterialData must match std430");
+
+    // A table of materials compiled once to fixed size records, stored in a shader
+    // storage buffer. Programs declaring the Materials block read the material of a
+    // draw from the table at the index in their materialId uniform, instead of
+    // getting all material fields as uniforms on each material change (see
+    // Material::set). Texture layers index the materialTextures sampler array,
+    // whose elements are bound to texture units 0.. when the program is built.
+    // Layers packed in a TextureArrayPool index the materialArrays sampler array
+    // instead, bound to the units after those.
+    //
+    // Materials are identified by Material::getSerial, and must be updated in the
+    // table if they change after being added. GL objects are created on the first upload.
+    class MaterialTable {
+        public:
+            static constexpr unsigned int BINDING = 2;
+            // Texture layers of a material are limited by the size of the sampler array
+            static constexpr unsigned int MAX_TEXTURES = 16;
+            // The size of the sampler array of TextureArrayPool arrays
+            static constexpr unsigned int MAX_ARRAYS = 8;
+
+            // The block and sampler array names in the shaders
+            static const char* const BLOCK;
+            static const char* const TEXTURES;
+            static const char* const ARRAYS;
+
+            MaterialTable();
+
+            // Returns the index of material in the table, adding it if needed
+            unsigned int add(const Material& material);
+
+            // Compiles material again, after it has changed. Adds it if needed.
+            void update(const Material& material);
+
+            // Removes all materials
+            void clear();
+
+            bool contains(const Material& material) const;
+            unsigned int getNumMaterials() const;
+            const MaterialData& getData(unsigned int id) const;
+
+            // Uploads the table if it changed since the last upload, and binds it to
+            // its binding point
+            void upload();
+
+            // Compiles material to a table record. Throws if it has more texture
+            // layers than a record holds.
+            static void compile(const Material& material, MaterialData& data);
+
+        private:
+            std::vector<MaterialData>                       records;
+            // By material serial
+            std::unordered_map<uint64_t, unsigned int>      ids;
+            bool                                            changed;
+
+            std::unique_ptr<GPUBuffer<MaterialData, GL_SHADER_STORAGE_BUFFER, GL_DYNAMIC_DRAW> > buffer;
+    };
+
+}
+
+#endif
@@ -267,6 +267,9 @@ Mesh<vertex_pos_norm_uv> MeshHelper<vertex_pos_norm_uv>::SPHERE(double rx, doubl
         v.norm = v.norm.normalize();
     }
 
+    // Stacks and sectors are emitted in rows, reorder for the vertex cache
+    MeshUtil::optimize(vertices, indices);
+
     return Mesh<vertex_pos_norm_uv>(vertices, indices); 
 }
  
@@ -346,6 +349,8 @@ Mesh<VTBN> MeshHelper<VTBN>::SPHERE(double rx, double ry, double rz, unsigned in
                         throw std::invalid_argument("Sphere: slices/stacks cannot be negative");
 
                     auto m = MeshHelper<VTBN>::SPHERE(r.x, r.y, r.z, stacks, slices);
+                    if(sphere.count("lods"))
+                        MeshUtil::generateLods(m, sphere["lods"].get<int>());
                     if(materialIndex > 0)
                         m.setMaterialIndex(materialIndex);
                     return std::move(m);
@@ -1,17 +1,120 @@
 #ifndef _MORK_MESH_H_
 #define _MORK_MESH_H_
 
+#include <vector>
+#include <stdexcept>
+
 #include "mork/math/box3.h"
+#include "mork/core/Log.h"
 #include "mork/render/VertexBuffer.h"
 #include "mork/render/VertexArrayObject.h"
 
 namespace mork {
 
+    class GeometryArenaBase;
+
+    // The layout of glMultiDrawElementsIndirect commands
+    struct DrawElementsIndirectCommand {
+        unsigned int    count;
+        unsigned int    instanceCount;
+        unsigned int    firstIndex;
+        int             baseVertex;
+        unsigned int    baseInstance;
+    };
+
+    // A cluster of triangles that are adjacent in the index buffer, with bounds for
+    // culling it as a whole (see MeshUtil::buildMeshlets and MeshUtil::cullMeshlets)
+    struct Meshlet {
+        unsigned int    firstIndex;
+        unsigned int    numIndices;
+        unsigned int    numVertices;
+        // Bounding sphere
+        vec3f           center;
+        float           radius;
+        // All triangles face away from viewers where the direction to the center is
+        // within the cone around coneAxis with the cosine coneCutoff. A cutoff of 1
+        // or more means the meshlet is never back facing.
+        vec3f           coneAxis;
+        float           coneCutoff;
+    };
+
+    // How positions of packed vertices decode, and the largest errors of the
+    // attributes packed by MeshUtil::packVertices. The default decodes positions
+    // as they are.
+    struct VertexPacking {
+        // Object space position of the quantized 0 and extent of the quantized range,
+        // set as positionOffset and positionScale in shaders/packing.glhl
+        vec3f   offset = vec3f::ZERO;
+        vec3f   scale = vec3f(1.0f, 1.0f, 1.0f);
+
+        // In object units
+        float   positionError = 0.0f;
+        // Angles, in radians
+        float   normalError = 0.0f;
+        float   tangentError = 0.0f;
+        // In uv units
+        float   uvError = 0.0f;
+
+        // Maps positions and bounds of packed meshes to object space
+        vec3f decode(const vec3f& normalized) const {
+            return vec3f(offset.x + normalized.x*scale.x, offset.y + normalized.y*scale.y, offset.z + normalized.z*scale.z);
+        }
+
+        box3d decode(const box3d& normalized) const {
+            vec3d lo = decode(vec3f(normalized.xmin, normalized.ymin, normalized.zmin)).cast<double>();
+            vec3d hi = decode(vec3f(normalized.xmax, normalized.ymax, normalized.zmax)).cast<double>();
+            return box3d(lo.x, hi.x, lo.y, hi.y, lo.z, hi.z);
+        }
+    };
+
     // Virtual interface for drawable meshes
     class MeshBase {
     public:
         virtual void draw() const = 0;
 
+        // Split draw, to let several draws of the same mesh share one bind
+        // (e.g. from a RenderQueue). draw() equals bind(); issueDraw(); unbind();
+        virtual void bind() const = 0;
+        virtual void issueDraw(unsigned int lod = 0) const = 0;
+        virtual void unbind() const = 0;
+
+        // Draws instanceCount instances, with per instance attributes read from
+        // baseInstance on. Must be called between bind() and unbind()
+        virtual void issueDrawInstanced(unsigned int lod, unsigned int instanceCount, unsigned int baseInstance) const = 0;
+
+        // Levels of detail, level 0 being the full mesh. The error of a level is the
+        // deviation from the full mesh, in object space units.
+        virtual unsigned int getNumLods() const = 0;
+        virtual float getLodError(unsigned int lod) const = 0;
+
+        // Meshes stored in a shared GeometryArena return it, so draws of different
+        // meshes in the same arena can share one bind and one multi draw call
+        virtual const GeometryArenaBase* getArena() const {
+            return nullptr;
+        }
+
+        // The indirect draw command of this mesh, only for meshes with an arena
+        virtual void getDrawCommand(unsigned int /*lod*/, unsigned int /*instanceCount*/, unsigned int /*baseInstance*/, DrawElementsIndirectCommand& /*command*/) const {
+        }
+
+        // The meshlets of the mesh, empty if it is not split into meshlets. Their
+        // bounds are in the object space of the mesh.
+        virtual const std::vector<Meshlet>& getMeshlets() const {
+            static const std::vector<Meshlet> none;
+            return none;
+        }
+
+        // Draws ranges of the index buffer, e.g. the visible meshlets. Only for
+        // meshes with meshlets. Must be called between bind() and unbind()
+        virtual void issueDrawRanges(const std::vector<DrawElementsIndirectCommand>& /*commands*/) const {
+        }
+
+        // The decoding of the positions of meshes of packed vertices, nullptr for
+        // meshes of plain positions
+        virtual const VertexPacking* getPacking() const {
+            return nullptr;
+        }
+
     };
 
 
@@ -44,12 +147,20 @@ namespace mork {
                 setVertices(vertices);
             }
 
-            Mesh(const std::vector<vertex>& vertices, const std::vector<unsigned int> indices, unsigned int materialIndex) 
+            Mesh(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int materialIndex) 
             : materialIndex(materialIndex), drawMode(GL_TRIANGLES)
             {
                 setVerticesIndexed(vertices, indices);
             }
 
+            // Uploads the vertices and indices directly from memory, e.g. from a
+            // mapped file (see ModelData)
+            Mesh(const vertex* vertices, size_t numVertices, const unsigned int* indices, size_t numIndices, unsigned int materialIndex)
+            : materialIndex(materialIndex), drawMode(GL_TRIANGLES)
+            {
+                setVerticesIndexed(vertices, numVertices, indices, numIndices);
+            }
+
             void setDrawMode(Mesh::DrawMode m) {
                 if(m == Mesh::DrawMode::Triangles)
                     drawMode = GL_TRIANGLES;
@@ -62,30 +173,42 @@ namespace mork {
 
             void setVertices(const std::vector<vertex>& vertices) {
                 indexed = false;
+                lodOffsets.clear();
+                lodCounts.clear();
+                lodErrors.clear();
+                meshlets.clear();
                 numVertices = vertices.size();
                 numIndices = 0;
+                vb.setStorage(vertices, STORAGE_FLAGS);
                 vao.bind();
                 vb.bind();
-                vb.setData(vertices);
                 vb.setAttributes();
                 vb.unbind();
                 vao.unbind();
-                bounds = calculateBounds(vertices);
+                bounds = calculateBounds(vertices.data(), vertices.size());
             }
 
             void setVerticesIndexed(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices) {
+                setVerticesIndexed(vertices.data(), vertices.size(), indices.data(), indices.size());
+            }
+
+            void setVerticesIndexed(const vertex* vertices, size_t numVertices, const unsigned int* indices, size_t numIndices) {
                 indexed = true;
-                numVertices = vertices.size();
-                numIndices = indices.size();
+                lodOffsets.clear();
+                lodCounts.clear();
+                lodErrors.clear();
+                meshlets.clear();
+                this->numVertices = numVertices;
+                this->numIndices = numIndices;
+                vb.setStorage(vertices, numVertices, STORAGE_FLAGS);
+                ib.setStorage(indices, numIndices, STORAGE_FLAGS);
                 vao.bind();
                 vb.bind();
-                vb.setData(vertices);
                 vb.setAttributes();
                 ib.bind();
-                ib.setData(indices);
                 vb.unbind();
                 vao.unbind();
-                bounds = calculateBounds(vertices);
+                bounds = calculateBounds(vertices, numVertices);
             }
 
             int getNumVertices() const {
@@ -117,30 +240,145 @@ namespace mork {
             }
 
             virtual void draw() const {
+                bind();
+                issueDraw();
+                unbind();
+            }
+
+            virtual void bind() const {
                 vao.bind();
-                
+            }
+
+            virtual void issueDraw(unsigned int lod = 0) const {
                 if(!indexed) 
                     glDrawArrays(drawMode, 0, numVertices); 
-                else {
+                else if(lod == 0 || lod >= lodCounts.size()) {
                     glDrawElements(drawMode, numIndices, GL_UNSIGNED_INT, 0); 
+                } else {
+                    glDrawElements(drawMode, lodCounts[lod], GL_UNSIGNED_INT,
+                            (void*)(lodOffsets[lod]*sizeof(unsigned int))); 
                 }
+            }
+
+            virtual void issueDrawInstanced(unsigned int lod, unsigned int instanceCount, unsigned int baseInstance) const {
+                if(!indexed)
+                    glDrawArraysInstancedBaseInstance(drawMode, 0, numVertices, instanceCount, baseInstance);
+                else if(lod == 0 || lod >= lodCounts.size()) {
+                    glDrawElementsInstancedBaseInstance(drawMode, numIndices, GL_UNSIGNED_INT, 0,
+                            instanceCount, baseInstance);
+                } else {
+                    glDrawElementsInstancedBaseInstance(drawMode, lodCounts[lod], GL_UNSIGNED_INT,
+                            (void*)(lodOffsets[lod]*sizeof(unsigned int)), instanceCount, baseInstance);
+                }
+            }
+
+            // Sets the indices of all levels of detail (level 0 being the full mesh) and
+            // their errors, storing all levels after each other in the index buffer.
+            // See MeshUtil::generateLods
+            void setLods(const std::vector<std::vector<unsigned int> >& lodIndices, const std::vector<float>& errors) {
+                if(lodIndices.empty() || lodIndices.size() != errors.size()) {
+                    error_logger("Mesh LODs must have one error per level, and at least one level");
+                    throw std::runtime_error(error_logger.last());
+                }
+
+                lodOffsets.clear();
+                lodCounts.clear();
+                std::vector<unsigned int> all;
+                for(const auto& lod : lodIndices) {
+                    lodOffsets.push_back(all.size());
+                    lodCounts.push_back(lod.size());
+                    all.insert(all.end(), lod.begin(), lod.end());
+                }
+                lodErrors = errors;
+                meshlets.clear();
+
+                indexed = true;
+                numIndices = lodCounts[0];
+                ib.setStorage(all, STORAGE_FLAGS);
+                vao.bind();
+                ib.bind();
+                vao.unbind();
+            }
+
+            // Sets the indices in meshlet order and the meshlets of the mesh, see
+            // MeshUtil::generateMeshlets. Replaces the levels of detail.
+            void setMeshlets(const std::vector<unsigned int>& indices, const std::vector<Meshlet>& meshlets) {
+                lodOffsets.clear();
+                lodCounts.clear();
+                lodErrors.clear();
+                this->meshlets = meshlets;
 
+                indexed = true;
+                numIndices = indices.size();
+                ib.setStorage(indices, STORAGE_FLAGS);
+                vao.bind();
+                ib.bind();
                 vao.unbind();
+            }
+
+            virtual const std::vector<Meshlet>& getMeshlets() const {
+                return meshlets;
+            }
+
+            // Draws ranges of the index buffer with one call, e.g. the visible meshlets
+            // from MeshUtil::cullMeshlets. Only count and firstIndex of the commands are
+            // used. Must be called between bind() and unbind()
+            virtual void issueDrawRanges(const std::vector<DrawElementsIndirectCommand>& commands) const {
+                if(commands.empty())
+                    return;
+                std::vector<GLsizei> counts(commands.size());
+                std::vector<const void*> offsets(commands.size());
+                for(std::size_t i = 0; i < commands.size(); ++i) {
+                    counts[i] = commands[i].count;
+                    offsets[i] = (void*)(commands[i].firstIndex*sizeof(unsigned int));
+                }
+                glMultiDrawElements(drawMode, counts.data(), GL_UNSIGNED_INT, offsets.data(), commands.size());
+            }
 
+            virtual unsigned int getNumLods() const {
+                return lodCounts.empty() ? 1 : lodCounts.size();
             }
 
+            virtual float getLodError(unsigned int lod) const {
+                return lod < lodErrors.size() ? lodErrors[lod] : 0.0f;
+            }
+
+            // Returns the number of indices drawn for the given level of detail
+            int getNumIndices(unsigned int lod) const {
+                return lod == 0 || lod >= lodCounts.size() ? numIndices : lodCounts[lod];
+            }
+
+            virtual void unbind() const {
+                vao.unbind();
+            }
+
+            // In object space, also for meshes of packed vertices
             box3d getBounds() const {
-                return bounds;
+                return packed ? packing.decode(bounds) : bounds;
+            }
+
+            // Sets how the positions of the vertices decode, for meshes of packed
+            // vertices (see MeshUtil::packVertices)
+            void setPacking(const VertexPacking& packing) {
+                this->packing = packing;
+                packed = true;
+            }
+
+            virtual const VertexPacking* getPacking() const {
+                return packed ? &packing : nullptr;
             }
     
 
         private:
 
-            box3d calculateBounds(const std::vector<vertex> vertices) {
+            // Mesh data never changes after upload, but may be read back (see MeshUtil)
+            static const GLbitfield STORAGE_FLAGS = GL_MAP_READ_BIT;
+
+            box3d calculateBounds(const vertex* vertices, size_t count) {
                 box3d b = box3d::ZERO;
                 
                 // Set initial values
-                if(vertices.size()>0) {
+                if(count>0) {
                     const auto& p = mork::vec3f(vertices[0].pos);
 
                     b.xmax = p.x;
@@ -151,8 +389,8 @@ namespace mork {
                     b.zmin = p.z;
                 }
 
-                for(auto& v : vertices) {
-                    auto p = mork::vec3f(v.pos);
+                for(size_t i = 0; i < count; ++i) {
+                    auto p = mork::vec3f(vertices[i].pos);
 
                     if(p.x > b.xmax)
                         b.xmax = p.x;
@@ -188,10 +426,23 @@ namespace mork {
             mork::IndexBuffer           ib;
             mork::VertexArrayObject     vao;      
 
+            // In the units of the vertex positions
             mork::box3d bounds;
 
+            bool            packed = false;
+            VertexPacking   packing;
+
             GLenum  drawMode;
 
+            // Start and number of indices in the index buffer for each level of detail,
+            // empty if the mesh has a single level
+            std::vector<unsigned int>   lodOffsets;
+            std::vector<unsigned int>   lodCounts;
+            std::vector<float>          lodErrors;
+
+            // Empty if the mesh has no meshlets
+            std::vector<Meshlet>        meshlets;
+
     };
 
     template<typename T>
@@ -1,4 +1,6 @@
 #include "mork/render/Model.h"
+#include "mork/render/RenderQueue.h"
+#include "mork/core/Log.h"
 #include "mork/resource/ResourceFactory.h"
 #include "mork/util/Util.h"
 
@@ -45,13 +47,46 @@ namespace mork {
             
         }
 
+        // Children are checked to be ModelNodes on insertion
         for(SceneNode& node : childrenRefs) {
-            const auto& modelNode = dynamic_cast<ModelNode&>(node);
+            const auto& modelNode = static_cast<ModelNode&>(node);
             modelNode.draw(prog, model);
         }
 
     }
 
+    void ModelNode::collectDrawItems(RenderQueue& queue, const Program& prog, const Model& model) const {
+        if(!isVisible())
+            return;
+
+        const auto& materials = model.getMaterials();
+        for(unsigned int index : getMeshIndices()) {
+            const auto& mesh = model.getMesh(index);
+            unsigned int materialIndex = mesh.getMaterialIndex();
+            const Material* mat = materialIndex < materials.size() ? &materials[materialIndex] : nullptr;
+            queue.add(&prog, mat, &mesh, this);
+        }
+
+        for(const SceneNode& node : childrenRefs) {
+            const auto& modelNode = static_cast<const ModelNode&>(node);
+            modelNode.collectDrawItems(queue, prog, model);
+        }
+    }
+
+    SceneNode& ModelNode::addChild(SceneNode&& child) {
+        // Moving into a SceneNode would slice the ModelNode
+        error_logger("Child element " + child.getName() + " of model node " + getName() + " must be a ModelNode");
+        throw std::runtime_error(error_logger.last());
+    }
+
+    SceneNode& ModelNode::addChild(std::unique_ptr<SceneNode> child) {
+        if(dynamic_cast<ModelNode*>(child.get()) == nullptr) {
+            error_logger("Child element " + child->getName() + " of model node " + getName() + " must be a ModelNode");
+            throw std::runtime_error(error_logger.last());
+        }
+        return SceneNode::addChild(std::move(child));
+    }
+
     Model::Model(const std::string& name) : SceneNode(name) {
 
     }
@@ -104,12 +139,36 @@ namespace mork {
 	void Model::draw(const Program& prog) const {
 
 		for(SceneNode& node : childrenRefs) {
-            const auto& modelNode = dynamic_cast<ModelNode&>(node); 
+            const auto& modelNode = static_cast<ModelNode&>(node); 
             modelNode.draw(prog, *this);
 
         }
 	}
 
+    void Model::collectDrawItems(RenderQueue& queue, const Program& prog) const {
+        if(!isVisible())
+            return;
+
+        for(const SceneNode& node : childrenRefs) {
+            const auto& modelNode = static_cast<const ModelNode&>(node);
+            modelNode.collectDrawItems(queue, prog, *this);
+        }
+    }
+
+    SceneNode& Model::addChild(SceneNode&& child) {
+        // Moving into a SceneNode would slice the ModelNode
+        error_logger("Child element " + child.getName() + " of model " + getName() + " must be a ModelNode");
+        throw std::runtime_error(error_logger.last());
+    }
+
+    SceneNode& Model::addChild(std::unique_ptr<SceneNode> child) {
+        if(dynamic_cast<ModelNode*>(child.get()) == nullptr) {
+            error_logger("Child element " + child->getName() + " of model " + getName() + " must be a ModelNode");
+            throw std::runtime_error(error_logger.last());
+        }
+        return SceneNode::addChild(std::move(child));
+    }
+
     inline json modelSchema = R"(
     {
         "$schema": "http://json-schema.org/draft-07/schema#",
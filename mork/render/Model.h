@@ -37,6 +37,12 @@ namespace mork {
             unsigned int getNumMeshes() const;
 
 			virtual void draw(const Program& prog) const;
+
+            virtual void collectDrawItems(RenderQueue& queue, const Program& prog) const;
+
+            // Children of a model must be ModelNodes
+            virtual SceneNode& addChild(SceneNode&& child);
+            virtual SceneNode& addChild(std::unique_ptr<SceneNode> child);
         private:
 
             std::vector<Material>       materials;
@@ -54,6 +60,12 @@ namespace mork {
             void addMeshIndex(unsigned int index);
     
             virtual void draw(const Program& prog, const Model& model) const; 
+
+            virtual void collectDrawItems(RenderQueue& queue, const Program& prog, const Model& model) const;
+
+            // Children of a model node must be ModelNodes
+            virtual SceneNode& addChild(SceneNode&& child);
+            virtual SceneNode& addChild(std::unique_ptr<SceneNode> child);
         protected:
             std::vector<unsigned int>    meshIndices;
 
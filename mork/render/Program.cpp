@@ -2,6 +2,9 @@
 #include "mork/render/Program.h"
 #include "mork/core/Log.h"
 #include "mork/ui/GlfwWindow.h"
+#include "mork/render/FrameUniforms.h"
+#include "mork/render/MaterialTable.h"
+#include "mork/render/GLState.h"
 #include <cstring>
 #include <vector>
 #include <string>
@@ -261,7 +264,7 @@ Program::~Program()
     if(GlfwWindow::isContextActive())
     {
         if(_programID)
-            glDeleteProgram(_programID);
+            GLState::getInstance().deleteProgram(_programID);
     }   
 }
 
@@ -270,6 +273,9 @@ Program::Program(Program&& o) noexcept {
     o._programID = 0;
 
     uniforms = std::move(o.uniforms);
+    attributes = std::move(o.attributes);
+    uniformBlocks = std::move(o.uniformBlocks);
+    storageBlocks = std::move(o.storageBlocks);
 
 }
 
@@ -277,13 +283,16 @@ Program& Program::operator=(Program&& o) noexcept {
     if(GlfwWindow::isContextActive())
     {
         if(_programID)
-            glDeleteProgram(_programID);
+            GLState::getInstance().deleteProgram(_programID);
     }   
     
     _programID = o._programID;
     o._programID = 0;  
 
     uniforms = std::move(o.uniforms);
+    attributes = std::move(o.attributes);
+    uniformBlocks = std::move(o.uniformBlocks);
+    storageBlocks = std::move(o.storageBlocks);
 
     return *this;
 }
@@ -293,7 +302,7 @@ void    Program::buildProgram(const std::vector<std::reference_wrapper<Shader> >
     // This will delete the program if it allready exist, and detach shaders
     // (Those allready marked for deletion and will be freed)
     if(_programID!=0) {
-        glDeleteProgram(_programID);
+        GLState::getInstance().deleteProgram(_programID);
         _programID = 0;
     }
      
@@ -339,6 +348,82 @@ void    Program::buildProgram(const std::vector<std::reference_wrapper<Shader> >
         int location = values[3];
         mork::info_logger("Name: \"", name, "\", type: ", type, ", location: ", location);
         uniforms.insert({name, Uniform(type, location)});
+
+        // The material texture array is bound to the first texture units, once
+        if(name == std::string(MaterialTable::TEXTURES) + "[0]") {
+            GLint units[MaterialTable::MAX_TEXTURES];
+            for(unsigned int i = 0; i < MaterialTable::MAX_TEXTURES; ++i)
+                units[i] = i;
+            glProgramUniform1iv(_programID, location, MaterialTable::MAX_TEXTURES, units);
+        }
+        // and the texture pool arrays to the units after it
+        if(name == std::string(MaterialTable::ARRAYS) + "[0]") {
+            GLint units[MaterialTable::MAX_ARRAYS];
+            for(unsigned int i = 0; i < MaterialTable::MAX_ARRAYS; ++i)
+                units[i] = MaterialTable::MAX_TEXTURES + i;
+            glProgramUniform1iv(_programID, location, MaterialTable::MAX_ARRAYS, units);
+        }
+    }
+
+    // Establish active vertex attributes
+    attributes.clear();
+
+    int numAttributes = 0;
+    glGetProgramInterfaceiv(_programID, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &numAttributes);
+    const GLenum attribProperties[2] = {GL_NAME_LENGTH, GL_LOCATION};
+
+    for(int attrib = 0; attrib < numAttributes; ++attrib)
+    {
+        GLint values[2];
+        glGetProgramResourceiv(_programID, GL_PROGRAM_INPUT, attrib, 2, attribProperties, 2, NULL, values);
+
+        std::vector<char> nameData(values[0]);
+        glGetProgramResourceName(_programID, GL_PROGRAM_INPUT, attrib, nameData.size(), NULL, &nameData[0]);
+        std::string name(nameData.begin(), nameData.end() - 1);
+        // Built-in inputs (gl_VertexID etc.) have location -1
+        if(values[1] < 0)
+            continue;
+        attributes.insert({name, values[1]});
+    }
+
+    // Establish active uniform blocks, binding the per frame blocks to their
+    // fixed binding points
+    uniformBlocks.clear();
+
+    int numBlocks = 0;
+    glGetProgramInterfaceiv(_programID, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &numBlocks);
+    const GLenum blockProperties[1] = {GL_NAME_LENGTH};
+
+    for(int block = 0; block < numBlocks; ++block)
+    {
+        GLint values[1];
+        glGetProgramResourceiv(_programID, GL_UNIFORM_BLOCK, block, 1, blockProperties, 1, NULL, values);
+
+        std::vector<char> nameData(values[0]);
+        glGetProgramResourceName(_programID, GL_UNIFORM_BLOCK, block, nameData.size(), NULL, &nameData[0]);
+        std::string name(nameData.begin(), nameData.end() - 1);
+        if(name == FrameUniforms::CAMERA_BLOCK)
+            glUniformBlockBinding(_programID, block, FrameUniforms::CAMERA_BINDING);
+        else if(name == FrameUniforms::LIGHTS_BLOCK)
+            glUniformBlockBinding(_programID, block, FrameUniforms::LIGHTS_BINDING);
+        uniformBlocks.insert({name, block});
+    }
+
+    // Establish active shader storage blocks
+    storageBlocks.clear();
+
+    glGetProgramInterfaceiv(_programID, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &numBlocks);
+    for(int block = 0; block < numBlocks; ++block)
+    {
+        GLint values[1];
+        glGetProgramResourceiv(_programID, GL_SHADER_STORAGE_BLOCK, block, 1, blockProperties, 1, NULL, values);
+
+        std::vector<char> nameData(values[0]);
+        glGetProgramResourceName(_programID, GL_SHADER_STORAGE_BLOCK, block, nameData.size(), NULL, &nameData[0]);
+        std::string name(nameData.begin(), nameData.end() - 1);
+        if(name == MaterialTable::BLOCK)
+            glShaderStorageBlockBinding(_programID, block, MaterialTable::BINDING);
+        storageBlocks.insert({name, block});
     }
 }
 
@@ -346,7 +431,7 @@ void    Program::use() const
 {
     if(!_programID)
         throw std::runtime_error("Program was not created before attempting to use it");
-    glUseProgram(_programID);
+    GLState::getInstance().useProgram(_programID);
  
 }
 
@@ -374,6 +459,28 @@ bool Program::queryUniform(const std::string& name) const {
     return true;
 }
 
+bool Program::queryUniformBlock(const std::string& name) const {
+    return uniformBlocks.find(name) != uniformBlocks.end();
+}
+
+bool Program::queryStorageBlock(const std::string& name) const {
+    return storageBlocks.find(name) != storageBlocks.end();
+}
+
+bool Program::queryAttribute(const std::string& name) const {
+    return attributes.find(name) != attributes.end();
+}
+
+int Program::getAttributeLocation(const std::string& name) const {
+    auto entry = attributes.find(name);
+    if(entry==attributes.end()) {
+        mork::error_logger("Tried to acess attribute \"", name, "\" which is not active in program ", _programID);
+        throw std::runtime_error("Error acessing attribute, see log");
+    }
+
+    return entry->second;
+}
+
 bool Program::bindTexture(const TextureBase& tex, const std::string& name, int texUnit) const {
     const Uniform& u = this->getUniform(name);
     auto type = u.getType();
@@ -72,6 +72,21 @@ public:
  
     // Queries wether a uniform exist
     bool queryUniform(const std::string& name) const;
+
+    // Queries wether a uniform block is active. The blocks of FrameUniforms are
+    // bound to their binding points when the program is built.
+    bool queryUniformBlock(const std::string& name) const;
+
+    // Queries wether a shader storage block is active. The MaterialTable block
+    // is bound to its binding point when the program is built.
+    bool queryStorageBlock(const std::string& name) const;
+
+    // Queries wether a vertex attribute (vertex shader input) is active
+    bool queryAttribute(const std::string& name) const;
+
+    // Returns the location of the specified vertex attribute
+    // Throws an exception if the attribute does not exist
+    int getAttributeLocation(const std::string& name) const;
     
     //protected:
     int getProgramId() const;
@@ -85,6 +100,14 @@ private:
 
     std::unordered_map<std::string, Uniform> uniforms;
 
+    std::unordered_map<std::string, int> attributes;
+
+    // Uniform block name -> block index
+    std::unordered_map<std::string, int> uniformBlocks;
+
+    // Shader storage block name -> block index
+    std::unordered_map<std::string, int> storageBlocks;
+
 };
 
 
@@ -0,0 +1,518 @@
+#include "mork/render/RenderQueue.h"
+#include "mork/render/Program.h"
+#include "mork/render/Material.h"
+#include "mork/render/Mesh.h"
+#include "mork/render/VertexBuffer.h"
+#include "mork/render/GeometryArena.h"
+#include "mork/render/StreamBuffer.h"
+#include "mork/render/FrameUniforms.h"
+#include "mork/render/MaterialTable.h"
+#include "mork/render/TextureArrayPool.h"
+#include "mork/scene/SceneNode.h"
+#include "mork/scene/Frustum.h"
+#include "mork/util/MeshUtil.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace mork {
+
+    // Key layout, from the most significant bit:
+    //   opaque:       0 | program (8) | material (16) | mesh (16) | depth (23)
+    //   transparent:  1 | inverted depth (23) | program (8) | material (16) | mesh (16)
+    // Ids larger than their field wrap around, which only affects the number of
+    // state changes, not correctness, as submit compares the actual objects.
+    static const int        DEPTH_BITS = 23;
+    static const uint64_t   DEPTH_MASK = (uint64_t(1) << DEPTH_BITS) - 1;
+    static const uint64_t   PROGRAM_MASK = 0xff;
+    static const uint64_t   MATERIAL_MASK = 0xffff;
+    static const uint64_t   MESH_MASK = 0xffff;
+
+    RenderQueue::RenderQueue()
+        :   instancing(true),
+            materialTable(std::make_unique<MaterialTable>()),
+            texturePool(nullptr),
+            viewPos(vec3d::ZERO),
+            farDistance(1.0),
+            lodScale(0.0),
+            programChanges(0),
+            materialChanges(0),
+            meshChanges(0),
+            drawCalls(0),
+            instancedDrawCalls(0) {
+    }
+
+    RenderQueue::~RenderQueue() = default;
+
+    RenderQueue::RenderQueue(RenderQueue&& o) = default;
+
+    RenderQueue& RenderQueue::operator=(RenderQueue&& o) = default;
+
+    void RenderQueue::begin(const vec3d& viewPos, double farDistance, double lodScale) {
+        this->viewPos = viewPos;
+        this->farDistance = farDistance;
+        this->lodScale = lodScale;
+        items.clear();
+        batches.clear();
+        programIds.clear();
+        materialIds.clear();
+        meshIds.clear();
+    }
+
+    unsigned int RenderQueue::getId(std::unordered_map<const void*, unsigned int>& ids, const void* ptr) {
+        auto it = ids.find(ptr);
+        if(it != ids.end())
+            return it->second;
+
+        unsigned int id = ids.size();
+        ids.emplace(ptr, id);
+        return id;
+    }
+
+    void RenderQueue::add(const Program* program, const Material* material, const MeshBase* mesh, const SceneNode* node) {
+        if(mesh == nullptr) {
+            error_logger("RenderQueue: Draw of node ", node->getName(), " has no mesh");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        bool transparent = material != nullptr && material->opacity < 1.0f;
+
+        // Distance to the center of the node's own bounds
+        box3d bounds = node->getLocalBounds();
+        vec3d center = node->getLocalToWorld()*(bounds.empty() ? vec3d::ZERO : bounds.center());
+        double distance = (center - viewPos).length();
+        double d = std::min(std::max(distance/farDistance, 0.0), 1.0);
+        uint64_t depth = static_cast<uint64_t>(d*DEPTH_MASK);
+
+        unsigned int lod = 0;
+        if(lodScale > 0.0 && mesh->getNumLods() > 1) {
+            // Errors are in object space, so scale them by the largest axis scale of the node
+            const mat4d& m = node->getLocalToWorld();
+            double scale = std::sqrt(std::max({
+                        m[0][0]*m[0][0] + m[1][0]*m[1][0] + m[2][0]*m[2][0],
+                        m[0][1]*m[0][1] + m[1][1]*m[1][1] + m[2][1]*m[2][1],
+                        m[0][2]*m[0][2] + m[1][2]*m[1][2] + m[2][2]*m[2][2]}));
+            for(lod = mesh->getNumLods() - 1; lod > 0; --lod) {
+                if(mesh->getLodError(lod)*scale*lodScale <= distance)
+                    break;
+            }
+        }
+
+        uint64_t p = getId(programIds, program) & PROGRAM_MASK;
+        uint64_t m = getId(materialIds, material) & MATERIAL_MASK;
+        uint64_t me = getId(meshIds, mesh) & MESH_MASK;
+
+        uint64_t key;
+        if(transparent)
+            key = TRANSPARENT_BIT | ((DEPTH_MASK - depth) << 40) | (p << 32) | (m << 16) | me;
+        else
+            key = (p << 55) | (m << 39) | (me << 23) | depth;
+
+        items.push_back({key, program, material, mesh, node, lod});
+    }
+
+    void RenderQueue::sort() {
+        // LSD radix sort on bytes, skipping the passes where all items have the same
+        // byte (common for the high bytes, as ids are small)
+        scratch.resize(items.size());
+        for(int shift = 0; shift < 64; shift += 8) {
+            unsigned int counts[256] = {0};
+            for(const DrawItem& item : items)
+                ++counts[(item.key >> shift) & 0xff];
+
+            if(counts[(items.empty() ? 0 : (items[0].key >> shift) & 0xff)] == items.size())
+                continue;
+
+            unsigned int offsets[256];
+            unsigned int sum = 0;
+            for(int i = 0; i < 256; ++i) {
+                offsets[i] = sum;
+                sum += counts[i];
+            }
+            for(const DrawItem& item : items)
+                scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+
+            items.swap(scratch);
+        }
+
+        batches.clear();
+        for(unsigned int i = 0; i < items.size(); ++i) {
+            const DrawItem& item = items[i];
+            if(!batches.empty()) {
+                const DrawItem& prev = items[batches.back().first];
+                if(item.program == prev.program && item.material == prev.material
+                        && item.mesh == prev.mesh && item.lod == prev.lod) {
+                    ++batches.back().count;
+                    continue;
+                }
+            }
+            batches.push_back({i, 1});
+        }
+    }
+
+    MaterialTable& RenderQueue::getMaterialTable() {
+        return *materialTable;
+    }
+
+    const MaterialTable& RenderQueue::getMaterialTable() const {
+        return *materialTable;
+    }
+
+    void RenderQueue::setTexturePool(const TextureArrayPool* pool) {
+        texturePool = pool;
+    }
+
+    const TextureArrayPool* RenderQueue::getTexturePool() const {
+        return texturePool;
+    }
+
+    bool RenderQueue::canSpanMaterials(const Material* material) {
+        return material != nullptr && !material->hasBoundTextures();
+    }
+
+    bool RenderQueue::supportsInstancing(const Program& program) {
+        return program.queryAttribute("instanceModel") && program.queryAttribute("instanceNormalMat")
+            && program.queryUniform("instanced") && !program.queryUniform("scale");
+    }
+
+    void RenderQueue::submit(const mat4d& projection, const mat4d& view) {
+        programChanges = 0;
+        materialChanges = 0;
+        meshChanges = 0;
+        drawCalls = 0;
+        instancedDrawCalls = 0;
+
+        // Whether each program draws its batches instanced
+        std::unordered_map<const Program*, bool> instancedPrograms;
+        auto isInstanced = [&](const Program* p) {
+            auto it = instancedPrograms.find(p);
+            if(it == instancedPrograms.end())
+                it = instancedPrograms.emplace(p, instancing && supportsInstancing(*p)).first;
+            return it->second;
+        };
+        // Meshes with meshlets are culled for each node, so their batches are drawn
+        // one node at a time
+        auto drawsInstanced = [&](const DrawItem& item) {
+            return isInstanced(item.program) && item.mesh->getMeshlets().empty();
+        };
+
+        // Whether each program reads its materials from the material table
+        std::unordered_map<const Program*, bool> tablePrograms;
+        auto readsTable = [&](const Program* p) {
+            auto it = tablePrograms.find(p);
+            if(it == tablePrograms.end())
+                it = tablePrograms.emplace(p, p->queryStorageBlock(MaterialTable::BLOCK)).first;
+            return it->second;
+        };
+
+        // Add new materials to the table before drawing
+        bool tableUsed = false;
+        for(const DrawBatch& batch : batches) {
+            const DrawItem& item = items[batch.first];
+            if(item.material != nullptr && readsTable(item.program)) {
+                materialTable->add(*item.material);
+                tableUsed = true;
+            }
+        }
+        if(tableUsed) {
+            materialTable->upload();
+            if(texturePool != nullptr)
+                texturePool->bind();
+        }
+
+        // Write the transforms and material ids of all instanced batches, in
+        // drawing order, to the instance stream
+        unsigned int numInstances = 0;
+        for(const DrawBatch& batch : batches) {
+            if(drawsInstanced(items[batch.first]))
+                numInstances += batch.count;
+        }
+        // Instance indices of the draws start at the first instance of this frame
+        unsigned int baseInstance = 0;
+        if(numInstances > 0) {
+            if(!instanceStream)
+                instanceStream = std::make_unique<StreamBuffer>(1 << 20);
+            size_t first;
+            instance_model_normal* instance = instanceStream->allocate<instance_model_normal>(numInstances, first);
+            baseInstance = first;
+
+            for(const DrawBatch& batch : batches) {
+                const DrawItem& item = items[batch.first];
+                if(!drawsInstanced(item))
+                    continue;
+                unsigned int id = 0;
+                if(item.material != nullptr && readsTable(item.program))
+                    id = materialTable->add(*item.material);
+                for(unsigned int i = batch.first; i < batch.first + batch.count; ++i) {
+                    mat4d modelMat = items[i].node->getLocalToWorld();
+                    mat3d normalMat = ((modelMat.inverse()).transpose()).mat3x3();
+                    *instance++ = instance_model_normal(modelMat.cast<float>(), normalMat.cast<float>(), id);
+                }
+            }
+        }
+
+        const Program* program = nullptr;
+        const Material* material = nullptr;
+        const MeshBase* mesh = nullptr;
+        bool transparent = false;
+
+        bool hasMaterial = false;
+        const Uniform* materialId = nullptr;
+        bool instanceMaterials = false;
+        bool hasNormalMat = false;
+        bool hasScale = false;
+        bool hasPacking = false;
+        // The packing the positionOffset and positionScale uniforms are set to
+        const VertexPacking* packing = nullptr;
+        bool packingSet = false;
+        bool instanced = false;
+        // Whether the instanced uniform of the program is set
+        bool instancedSet = false;
+        // The mesh (or arena) whose vertex array has the instance attributes set up
+        const void* instanceVertexArray = nullptr;
+        std::vector<DrawElementsIndirectCommand> commands;
+
+        vec3f viewPosf = viewPos.cast<float>();
+
+        for(unsigned int b = 0; b < batches.size(); ++b) {
+            const DrawBatch& batch = batches[b];
+            const DrawItem& item = items[batch.first];
+
+            if(item.program != program) {
+                // Leave the program as other draws of it expect
+                if(instancedSet)
+                    program->getUniform("instanced").set(0);
+
+                program = item.program;
+                program->use();
+                if(!program->queryUniformBlock(FrameUniforms::CAMERA_BLOCK)) {
+                    program->getUniform("projection").set(projection.cast<float>());
+                    program->getUniform("view").set(view.cast<float>());
+                    // Viewpos is not present in all shaders, so check before setting it:
+                    if(program->queryUniform("viewPos"))
+                        program->getUniform("viewPos").set(viewPosf);
+                }
+
+                // Test for material.ambient color, and assume the whole material structure
+                // is present in the shader is this is true:
+                hasMaterial = program->queryUniform("material.ambientColor");
+                materialId = readsTable(program) ? &program->getUniform("materialId") : nullptr;
+                instanceMaterials = materialId != nullptr && program->queryAttribute("instanceMaterial");
+                hasNormalMat = program->queryUniform("normalMat");
+                hasScale = program->queryUniform("scale");
+                hasPacking = program->queryUniform("positionOffset");
+                packingSet = false;
+
+                instanced = isInstanced(program);
+                instancedSet = false;
+
+                // Material uniforms are per program
+                material = nullptr;
+                ++programChanges;
+            }
+
+            if((item.key & TRANSPARENT_BIT) && !transparent) {
+                // Transparent items are last, blend them over the opaque ones without
+                // writing depth
+                transparent = true;
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDepthMask(GL_FALSE);
+            }
+
+            if(item.material != material) {
+                material = item.material;
+                if(material != nullptr && materialId != nullptr) {
+                    materialId->set(static_cast<int>(materialTable->add(*material)));
+                    material->bindTextures();
+                } else if(material != nullptr && hasMaterial) {
+                    material->set(*program, "material");
+                    material->bindTextures();
+                }
+                ++materialChanges;
+            }
+
+            if(item.mesh != mesh) {
+                // Meshes in the same arena share their vertex array
+                const GeometryArenaBase* arena = item.mesh->getArena();
+                bool bound = mesh != nullptr && arena != nullptr && mesh->getArena() == arena;
+                mesh = item.mesh;
+                if(!bound) {
+                    mesh->bind();
+                    ++meshChanges;
+                }
+            }
+
+            if(hasPacking && (!packingSet || mesh->getPacking() != packing)) {
+                // Positions of packed vertices decode to object space in the shader,
+                // plain positions decode as they are
+                static const VertexPacking identity;
+                packing = mesh->getPacking();
+                const VertexPacking& decode = packing != nullptr ? *packing : identity;
+                program->getUniform("positionOffset").set(decode.offset);
+                program->getUniform("positionScale").set(decode.scale);
+                packingSet = true;
+            }
+
+            bool drawInstanced = instanced && mesh->getMeshlets().empty();
+            if(drawInstanced != instancedSet) {
+                program->getUniform("instanced").set(drawInstanced ? 1 : 0);
+                instancedSet = drawInstanced;
+            }
+
+            if(drawInstanced) {
+                const GeometryArenaBase* arena = mesh->getArena();
+                const void* vertexArray = arena != nullptr ? static_cast<const void*>(arena) : mesh;
+                if(instanceVertexArray != vertexArray) {
+                    // Point the instance attributes of the bound vertex array to the
+                    // instance stream
+                    instanceStream->bind(GL_ARRAY_BUFFER);
+                    instance_model_normal::setAttributes();
+                    instanceStream->unbind(GL_ARRAY_BUFFER);
+                    instanceVertexArray = vertexArray;
+                }
+
+                if(arena == nullptr) {
+                    mesh->issueDrawInstanced(item.lod, batch.count, baseInstance);
+                    baseInstance += batch.count;
+                } else {
+                    // Draw this and the following batches with the same program and
+                    // material from the same arena with one multi draw. Programs
+                    // reading the material table take the material of each instance
+                    // from the instance stream, so the batches may also have other
+                    // materials without textures to bind.
+                    commands.clear();
+                    unsigned int last = getMultiDrawEnd(b, instanceMaterials);
+                    for(unsigned int n = b; n <= last; ++n) {
+                        const DrawBatch& next = batches[n];
+                        const DrawItem& nextItem = items[next.first];
+                        DrawElementsIndirectCommand command;
+                        nextItem.mesh->getDrawCommand(nextItem.lod, next.count, baseInstance, command);
+                        commands.push_back(command);
+                        baseInstance += next.count;
+                        mesh = nextItem.mesh;
+                        material = nextItem.material;
+                    }
+                    b = last;
+                    arena->multiDraw(commands);
+                }
+                ++drawCalls;
+                ++instancedDrawCalls;
+                continue;
+            }
+
+            const std::vector<Meshlet>& meshlets = mesh->getMeshlets();
+            for(unsigned int i = batch.first; i < batch.first + batch.count; ++i) {
+                const SceneNode* node = items[i].node;
+                mat4d modelMat = node->getLocalToWorld();
+                program->getUniform("model").set(modelMat.cast<float>());
+                if(hasNormalMat) {
+                    mat3d normalMat = ((modelMat.inverse()).transpose()).mat3x3();
+                    program->getUniform("normalMat").set(normalMat.cast<float>());
+                }
+                if(hasScale) {
+                    // Set to 1=10th of characteristoc size of this object:
+                    program->getUniform("scale").set((float)node->getWorldBounds().norm()/10.0f);
+                }
+                if(meshlets.empty()) {
+                    mesh->issueDraw(item.lod);
+                    ++drawCalls;
+                } else {
+                    commands.clear();
+                    if(getVisibleMeshlets(*mesh, *node, projection, view, commands) > 0) {
+                        mesh->issueDrawRanges(commands);
+                        ++drawCalls;
+                    }
+                }
+            }
+        }
+
+        if(instancedSet)
+            program->getUniform("instanced").set(0);
+
+        if(mesh != nullptr)
+            mesh->unbind();
+
+        // The next submit writes to another region, while these draws read this one
+        if(numInstances > 0)
+            instanceStream->endFrame();
+
+        if(transparent) {
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        }
+    }
+
+    const std::vector<DrawItem>& RenderQueue::getItems() const {
+        return items;
+    }
+
+    const std::vector<DrawBatch>& RenderQueue::getBatches() const {
+        return batches;
+    }
+
+    unsigned int RenderQueue::getMultiDrawEnd(unsigned int first, bool spanMaterials) const {
+        const DrawItem& item = items[batches[first].first];
+        const GeometryArenaBase* arena = item.mesh->getArena();
+        if(arena == nullptr)
+            return first;
+
+        const Material* material = item.material;
+        unsigned int last = first;
+        while(last + 1 < batches.size()) {
+            const DrawItem& following = items[batches[last + 1].first];
+            if(following.program != item.program || following.mesh->getArena() != arena)
+                break;
+            // Transparent items are drawn with other state, after the opaque ones
+            if((following.key ^ item.key) & TRANSPARENT_BIT)
+                break;
+            if(following.material != material) {
+                if(!spanMaterials || !canSpanMaterials(material) || !canSpanMaterials(following.material))
+                    break;
+                material = following.material;
+            }
+            ++last;
+        }
+        return last;
+    }
+
+    unsigned int RenderQueue::getVisibleMeshlets(const MeshBase& mesh, const SceneNode& node, const mat4d& projection,
+            const mat4d& view, std::vector<DrawElementsIndirectCommand>& commands) const {
+        // The meshlet bounds are in object space, where the frustum planes are those
+        // of the full transform
+        Frustum frustum;
+        frustum.setPlanes(projection*view*node.getLocalToWorld());
+        return MeshUtil::cullMeshlets(mesh.getMeshlets(), frustum, node.getWorldToLocal()*viewPos, commands);
+    }
+
+    void RenderQueue::setInstancing(bool enable) {
+        instancing = enable;
+    }
+
+    bool RenderQueue::hasInstancing() const {
+        return instancing;
+    }
+
+    unsigned int RenderQueue::getProgramChanges() const {
+        return programChanges;
+    }
+
+    unsigned int RenderQueue::getMaterialChanges() const {
+        return materialChanges;
+    }
+
+    unsigned int RenderQueue::getMeshChanges() const {
+        return meshChanges;
+    }
+
+    unsigned int RenderQueue::getDrawCalls() const {
+        return drawCalls;
+    }
+
+    unsigned int RenderQueue::getInstancedDrawCalls() const {
+        return instancedDrawCalls;
+    }
+
+}
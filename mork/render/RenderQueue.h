@@ -0,0 +1,175 @@
+#ifndef _MORK_RENDERQUEUE_H_
+#define _MORK_RENDERQUEUE_H_
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "mork/math/vec3.h"
+#include "mork/math/mat4.h"
+
+namespace mork {
+
+    class Program;
+    class Material;
+    class MeshBase;
+    class SceneNode;
+    class StreamBuffer;
+    class MaterialTable;
+    class TextureArrayPool;
+    struct DrawElementsIndirectCommand;
+
+    // A single draw of a mesh with a material, transformed by the local to world
+    // transform of a scene node
+    struct DrawItem {
+        uint64_t            key;
+        const Program*      program;
+        const Material*     material;
+        const MeshBase*     mesh;
+        const SceneNode*    node;
+        // Level of detail of the mesh to draw
+        unsigned int        lod;
+    };
+
+    // A run of sorted items with the same program, material, mesh and level of
+    // detail, which can be drawn with a single instanced draw call
+    struct DrawBatch {
+        unsigned int        first;
+        unsigned int        count;
+    };
+
+    // Collects the draw items of a frame, sorts them by a 64 bit state key, and
+    // submits them changing GL state only when it differs from the previous item.
+    //
+    // Opaque items are sorted by program, material and mesh, and front to back
+    // within equal state. Transparent items (material opacity < 1) are drawn after
+    // all opaque items, back to front.
+    //
+    // Batches of items sharing all state are drawn with one instanced draw call if
+    // the program supports it (see supportsInstancing), taking the transforms from
+    // a per frame instance stream instead of the model and normalMat uniforms.
+    // Consecutive instanced batches of meshes in the same GeometryArena with the
+    // same program and material are drawn together with one multi draw call.
+    //
+    // Programs declaring the Materials storage block read their materials from the
+    // material table of the queue, so a material change only sets the materialId
+    // uniform and binds the textures of the material. Instances also carry their
+    // material id, so multi draws of such programs span materials whose textures
+    // are all in the texture pool of the queue.
+    //
+    // Meshes with meshlets are drawn one node at a time, with the meshlets outside
+    // the frustum or facing away from the viewer culled for each node.
+    class RenderQueue {
+        public:
+            RenderQueue();
+            ~RenderQueue();
+
+            RenderQueue(RenderQueue&& o);
+            RenderQueue& operator=(RenderQueue&& o);
+
+            // Starts a new frame seen from viewPos. Distances are quantized relative
+            // to farDistance for the sort keys.
+            // If lodScale > 0, each draw uses the coarsest mesh level of detail with
+            // (world space error)*lodScale <= distance, see Scene::setLodThreshold.
+            void begin(const vec3d& viewPos, double farDistance, double lodScale = 0.0);
+
+            // Adds a draw of mesh with material (may be nullptr), transformed by node.
+            // Throws if mesh is nullptr.
+            void add(const Program* program, const Material* material, const MeshBase* mesh, const SceneNode* node);
+
+            // Sorts all items by key (stable), and groups them in batches
+            void sort();
+
+            // Draws all items in order. Programs without the Camera block get the
+            // projection, view and viewPos uniforms when first used, programs with it
+            // read the block bound by FrameUniforms::upload. Should be called after sort.
+            void submit(const mat4d& projection, const mat4d& view);
+
+            const std::vector<DrawItem>& getItems() const;
+
+            // The batches of the sorted items, see sort
+            const std::vector<DrawBatch>& getBatches() const;
+
+            // Returns the last of the batches drawn with one multi draw call from batch
+            // first on: following batches of meshes in the same GeometryArena with the
+            // same program and transparency, and the same material, or (if
+            // spanMaterials) other materials without textures to bind. Returns first if
+            // its mesh is not in an arena.
+            unsigned int getMultiDrawEnd(unsigned int first, bool spanMaterials) const;
+
+            // Appends the draw commands of the meshlets of mesh that may be visible when
+            // drawn transformed by node, see MeshUtil::cullMeshlets. The frustum and the
+            // view position of the frame are brought to the object space of the mesh.
+            // Returns the number of visible meshlets.
+            unsigned int getVisibleMeshlets(const MeshBase& mesh, const SceneNode& node, const mat4d& projection,
+                    const mat4d& view, std::vector<DrawElementsIndirectCommand>& commands) const;
+
+            // Enables or disables instanced drawing (enabled by default)
+            void setInstancing(bool enable);
+            bool hasInstancing() const;
+
+            // Returns true if program takes per instance transforms: the attributes
+            // instanceModel (mat4, location 5) and instanceNormalMat (mat3, location 9),
+            // optionally instanceMaterial (uint, location 12, the material table id),
+            // and an int uniform "instanced" telling the shader to use them instead
+            // of the model and normalMat uniforms. Programs using the per node "scale"
+            // uniform are drawn one node at a time.
+            static bool supportsInstancing(const Program& program);
+
+            // Returns the table of the materials drawn with programs reading it. Materials
+            // are added when first drawn, and must be updated in it when they change.
+            MaterialTable& getMaterialTable();
+            const MaterialTable& getMaterialTable() const;
+
+            // Sets the pool of the pooled texture layers of the drawn materials (may be
+            // nullptr), bound by submit along with the material table. Not owned.
+            void setTexturePool(const TextureArrayPool* pool);
+            const TextureArrayPool* getTexturePool() const;
+
+            // Statistics for the last submit
+            unsigned int getProgramChanges() const;
+            unsigned int getMaterialChanges() const;
+            unsigned int getMeshChanges() const;
+            unsigned int getDrawCalls() const;
+            unsigned int getInstancedDrawCalls() const;
+
+            static const uint64_t TRANSPARENT_BIT = uint64_t(1) << 63;
+
+        private:
+            // Returns a small id for ptr, in order of first appearance this frame
+            static unsigned int getId(std::unordered_map<const void*, unsigned int>& ids, const void* ptr);
+
+            // Returns true if material has no textures to bind, so draws with it
+            // need no state change when the material comes from the instance
+            static bool canSpanMaterials(const Material* material);
+
+            std::vector<DrawItem>   items;
+            std::vector<DrawItem>   scratch;
+            std::vector<DrawBatch>  batches;
+
+            bool                                    instancing;
+            // Created on first use, as it needs a GL context
+            std::unique_ptr<StreamBuffer>           instanceStream;
+
+            std::unique_ptr<MaterialTable>          materialTable;
+            const TextureArrayPool*                 texturePool;
+
+            std::unordered_map<const void*, unsigned int> programIds;
+            std::unordered_map<const void*, unsigned int> materialIds;
+            std::unordered_map<const void*, unsigned int> meshIds;
+
+            vec3d   viewPos;
+            double  farDistance;
+            double  lodScale;
+
+            unsigned int programChanges;
+            unsigned int materialChanges;
+            unsigned int meshChanges;
+            unsigned int drawCalls;
+            unsigned int instancedDrawCalls;
+    };
+
+}
+
+#endif
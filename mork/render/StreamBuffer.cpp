@@ -0,0 +1,176 @@
+#include "mork/render/StreamBuffer.h"
+#include "mork/ui/GlfwWindow.h"
+#include "mork/render/GLState.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mork {
+
+    static const GLbitfield STREAM_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    StreamBuffer::StreamBuffer(size_t regionSize, unsigned int numRegions)
+        :   buffer(0),
+            mapped(nullptr),
+            regionSize(0),
+            numRegions(std::max(numRegions, 1u)),
+            region(0),
+            head(0),
+            fences(this->numRegions, nullptr),
+            waitCount(0) {
+        create(regionSize);
+    }
+
+    StreamBuffer::~StreamBuffer() {
+        if(GlfwWindow::isContextActive())
+            destroy();
+    }
+
+    StreamBuffer::StreamBuffer(StreamBuffer&& o) noexcept
+        :   buffer(o.buffer),
+            mapped(o.mapped),
+            regionSize(o.regionSize),
+            numRegions(o.numRegions),
+            region(o.region),
+            head(o.head),
+            fences(std::move(o.fences)),
+            waitCount(o.waitCount) {
+        o.buffer = 0;
+        o.mapped = nullptr;
+        o.fences.assign(o.numRegions, nullptr);
+    }
+
+    StreamBuffer& StreamBuffer::operator=(StreamBuffer&& o) noexcept {
+        if(this != &o) {
+            if(GlfwWindow::isContextActive())
+                destroy();
+            buffer = o.buffer;
+            mapped = o.mapped;
+            regionSize = o.regionSize;
+            numRegions = o.numRegions;
+            region = o.region;
+            head = o.head;
+            fences = std::move(o.fences);
+            waitCount = o.waitCount;
+            o.buffer = 0;
+            o.mapped = nullptr;
+            o.fences.assign(o.numRegions, nullptr);
+        }
+        return *this;
+    }
+
+    StreamBuffer::Allocation StreamBuffer::allocate(size_t size, size_t alignment) {
+        if(alignment == 0)
+            alignment = 1;
+
+        if(size + alignment > regionSize) {
+            // Recreate with regions large enough, once all regions are done with
+            for(unsigned int i = 0; i < numRegions; ++i)
+                waitForRegion(i);
+            destroy();
+            create(std::max(2*regionSize, size + alignment));
+        }
+
+        size_t start = region*regionSize;
+        size_t offset = ((start + head + alignment - 1)/alignment)*alignment;
+        if(offset + size > start + regionSize) {
+            nextRegion();
+            start = region*regionSize;
+            offset = ((start + alignment - 1)/alignment)*alignment;
+        }
+
+        head = offset + size - start;
+        return {mapped + offset, offset};
+    }
+
+    void StreamBuffer::endFrame() {
+        if(head > 0)
+            nextRegion();
+    }
+
+    void StreamBuffer::bind(GLenum target) const {
+        GLState::getInstance().bindBuffer(target, buffer);
+    }
+
+    void StreamBuffer::unbind(GLenum target) const {
+        GLState::getInstance().unbindBuffer(target);
+    }
+
+    unsigned int StreamBuffer::getId() const {
+        return buffer;
+    }
+
+    size_t StreamBuffer::getRegionSize() const {
+        return regionSize;
+    }
+
+    unsigned int StreamBuffer::getNumRegions() const {
+        return numRegions;
+    }
+
+    unsigned int StreamBuffer::getWaitCount() const {
+        return waitCount;
+    }
+
+    void StreamBuffer::create(size_t size) {
+        regionSize = size;
+        region = 0;
+        head = 0;
+
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, regionSize*numRegions, NULL, STREAM_FLAGS);
+        mapped = static_cast<char*>(glMapNamedBufferRange(buffer, 0, regionSize*numRegions, STREAM_FLAGS));
+        if(mapped == nullptr) {
+            error_logger("StreamBuffer: Could not map buffer of ", regionSize*numRegions, " bytes");
+            throw std::runtime_error(error_logger.last());
+        }
+    }
+
+    void StreamBuffer::destroy() {
+        for(GLsync& fence : fences) {
+            if(fence != nullptr) {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        if(buffer) {
+            glUnmapNamedBuffer(buffer);
+            GLState::getInstance().deleteBuffer(buffer);
+            buffer = 0;
+            mapped = nullptr;
+        }
+    }
+
+    void StreamBuffer::nextRegion() {
+        // Callers have issued the draws reading this region (see the header)
+        if(fences[region] != nullptr)
+            glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        region = (region + 1)%numRegions;
+        head = 0;
+        waitForRegion(region);
+    }
+
+    void StreamBuffer::waitForRegion(unsigned int r) {
+        GLsync& fence = fences[r];
+        if(fence == nullptr)
+            return;
+
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if(result == GL_TIMEOUT_EXPIRED) {
+            ++waitCount;
+            // Flush on the first wait, so the fence is sure to be signaled
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            do {
+                result = glClientWaitSync(fence, flags, 1000000);
+                flags = 0;
+            } while(result == GL_TIMEOUT_EXPIRED);
+        }
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+}
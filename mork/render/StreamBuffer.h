@@ -0,0 +1,96 @@
+#ifndef _MORK_STREAMBUFFER_H_
+#define _MORK_STREAMBUFFER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "mork/glad/glad.h"
+
+namespace mork {
+
+    // A ring buffer for data written by the CPU every frame (dynamic vertices,
+    // instance transforms, uniforms). The buffer has immutable storage and is
+    // mapped persistently and coherently once, so writing never synchronizes with
+    // the driver.
+    //
+    // The ring is split in regions (three by default). Allocations are bumped
+    // through the current region. When an allocation does not fit, or at endFrame,
+    // the region is fenced after all commands issued so far and the next region is
+    // used once the GPU has passed its previous fence. Writes thus only wait if the
+    // CPU is a whole ring ahead of the GPU.
+    //
+    // Since the fence is inserted by the allocation that overflows the region,
+    // the draws reading an allocation must be issued before the next allocate
+    // (or endFrame). Draws issued later are not covered by the fence, and their
+    // data may be overwritten while the GPU reads it.
+    class StreamBuffer {
+        public:
+            // A part of the buffer to write to. Draws read it at offset (bytes)
+            struct Allocation {
+                void*   ptr;
+                size_t  offset;
+            };
+
+            StreamBuffer(size_t regionSize, unsigned int numRegions = 3);
+            ~StreamBuffer();
+
+            StreamBuffer(const StreamBuffer&) = delete;
+            StreamBuffer& operator=(const StreamBuffer&) = delete;
+            StreamBuffer(StreamBuffer&& o) noexcept;
+            StreamBuffer& operator=(StreamBuffer&& o) noexcept;
+
+            // Returns size bytes at an offset that is a multiple of alignment (which
+            // need not be a power of two, e.g. a vertex size, so offset/alignment is
+            // the first vertex). Fences the current region first if the allocation
+            // does not fit in it, so the draws reading earlier allocations must be
+            // issued by then.
+            // Allocations larger than a region recreate the buffer with larger
+            // regions, which changes getId() and waits for the GPU.
+            Allocation allocate(size_t size, size_t alignment = 16);
+
+            // Allocates count elements of T aligned to sizeof(T), returning the
+            // offset in elements
+            template<typename T>
+            T* allocate(size_t count, size_t& first) {
+                Allocation a = allocate(count*sizeof(T), sizeof(T));
+                first = a.offset/sizeof(T);
+                return reinterpret_cast<T*>(a.ptr);
+            }
+
+            // Fences the current region after all draws issued so far, and moves to
+            // the next region. Call it after the draws reading the last allocations. Calling this once per frame bounds the latency of
+            // the ring to numRegions frames.
+            void endFrame();
+
+            void bind(GLenum target) const;
+            void unbind(GLenum target) const;
+
+            unsigned int getId() const;
+            size_t getRegionSize() const;
+            unsigned int getNumRegions() const;
+
+            // Returns the number of times a region was still in use by the GPU
+            // when needed again
+            unsigned int getWaitCount() const;
+
+        private:
+            void create(size_t regionSize);
+            void destroy();
+            void nextRegion();
+            void waitForRegion(unsigned int region);
+
+            unsigned int    buffer;
+            char*           mapped;
+            size_t          regionSize;
+            unsigned int    numRegions;
+
+            unsigned int    region;
+            size_t          head;
+
+            std::vector<GLsync> fences;
+            unsigned int        waitCount;
+    };
+
+}
+
+#endif
@@ -1,12 +1,16 @@
 #include "mork/render/Texture.h"
 #include "mork/ui/GlfwWindow.h"
+#include "mork/render/GLState.h"
 
 #include "mork/core/Log.h"
-#include "mork/core/stb_image.h"
+#include "mork/render/ImageDecoder.h"
+#include "mork/render/TextureCache.h"
 
 #include "mork/resource/ResourceFactory.h"
 
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
 
 namespace mork {
 
@@ -37,21 +41,21 @@ namespace mork {
         if(GlfwWindow::isContextActive())
         {
             if(texture)
-                glDeleteTextures(1, &texture);
+                GLState::getInstance().deleteTexture(texture);
         } 
     }
 
     void TextureBase::bind(int texUnit) const {
         if(texUnit < 0)
             throw std::runtime_error("texUnit < 0 not allowed");
-        glActiveTexture(GL_TEXTURE0 + texUnit);
+        GLState::getInstance().activeTexture(texUnit);
         bind();
     }
 
     void TextureBase::unbind(int texUnit) const {
         if(texUnit < 0)
             throw std::runtime_error("texUnit < 0 not allowed");
-        glActiveTexture(GL_TEXTURE0 + texUnit);
+        GLState::getInstance().activeTexture(texUnit);
         unbind();
     }   
         
@@ -70,37 +74,40 @@ namespace mork {
 
     TextureBase::TextureData TextureBase::loadTexture2D(unsigned int texture, const std::string& file, bool flip_vertical = false, bool generate_mip = true)
     {
-        TextureBase::TextureData td;
-        
-        stbi_set_flip_vertically_on_load(flip_vertical);
-
-
-
-        int numChannels;
-        unsigned char* data = stbi_load(file.c_str(), &td.width, &td.height, &numChannels, 0);
-       
-        if(!data) {
-           mork::error_logger("File \"", file, "\" could not be loaded.");           
-           throw std::runtime_error("Error loading image, see logs");
-        }
+        // Compressed files are stored with their mip levels, as they are to be
+        // uploaded, so neither flipped nor mipmapped here
+        if(CompressedImage::isCompressedFile(file))
+            return loadTexture2D(texture, CompressedImage::load(file));
 
-        // Guess internal format from stbis numChannels:
-        td.format = (numChannels == 4) ? GL_RGBA8 : ( numChannels == 3 ? GL_RGB8 : ( numChannels == 2 ? GL_RG8 : ( numChannels == 1 ? GL_R8 : -1 ) ) );
-
-        td =  loadTexture2D(texture, td, data, generate_mip);
-        
-        stbi_image_free(data);
-
-        return td;
-
-   }
+        Image image = Image::load(file, flip_vertical);
+        return loadTexture2D(texture, image, generate_mip);
+    }
 
-    TextureBase::TextureData TextureBase::loadTexture2D(unsigned int texture, const TextureData& td, unsigned char* data, bool generate_mip = true) {
+    TextureBase::TextureData TextureBase::loadTexture2D(unsigned int texture, const Image& image, bool generate_mip)
+    {
+        TextureBase::TextureData td;
+        td.width = image.getWidth();
+        td.height = image.getHeight();
+        td.depth = 1;
+        td.format = image.getFormat();
 
+        return loadTexture2D(texture, td, image.getPixels(), generate_mip);
+    }
 
+    void TextureBase::prepareTexture2D(bool mipmaps) {
         // Set default texture wrapping/filtering option
         // TODO: Make options for ajusting wrapping and min/mag filtering
         bind(0);
+
+        // Immutable storage can not be respecified, so a texture loaded before is
+        // replaced by a new texture object
+        GLint immutable = GL_FALSE;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+        if(immutable) {
+            GLState::getInstance().deleteTexture(this->texture);
+            glGenTextures(1, &this->texture);
+            bind(0);
+        }
         
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -109,29 +116,32 @@ namespace mork {
         //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        if(generate_mip)
+        if(mipmaps)
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         else
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
- 
-        
-        auto format = td.format== GL_RGBA8 ? GL_RGBA :
-            ( td.format==GL_RGB8 ? GL_RGB :
-             ( td.format==GL_RG8 ? GL_RG : 
-               (td.format==GL_R8 ? GL_RED :
-                (td.format==GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL
-                  : -1 // defaul
-                 )
-                )
-               )
-            );
-    
-        // SET type to unsigned byte unsless it is a depth/stencil buffer:
-        auto type = td.format==GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8 : GL_UNSIGNED_BYTE;
+    }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, td.format, td.width, td.height, 0, format, type, data);
-        if(generate_mip)
-            glGenerateMipmap(GL_TEXTURE_2D);
+    TextureBase::TextureData TextureBase::loadTexture2D(unsigned int texture, const TextureData& td, const unsigned char* data, bool generate_mip = true) {
+
+        prepareTexture2D(generate_mip);
+
+        // Empty textures (e.g. the glyph of a space) get no storage, as zero sized
+        // storage is not allowed
+        if(td.width > 0 && td.height > 0) {
+            int levels = 1;
+            if(generate_mip) {
+                while((std::max(td.width, td.height) >> levels) > 0)
+                    ++levels;
+            }
+            glTexStorage2D(GL_TEXTURE_2D, levels, td.format, td.width, td.height);
+
+            if(data != nullptr) {
+                subImage2D(0, 0, td.width, td.height, td.format, data);
+                if(generate_mip)
+                    glGenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
         
         unbind(7);
 
@@ -139,6 +149,96 @@ namespace mork {
 
         return td;
     }
+
+    TextureBase::TextureData TextureBase::loadTexture2D(unsigned int texture, const CompressedImage& image) {
+        TextureData td;
+        td.width = image.width;
+        td.height = image.height;
+        td.depth = 1;
+        td.format = CompressedImage::getGLFormat(image.format);
+
+        prepareTexture2D(image.levels.size() > 1);
+
+        // The levels are uploaded as they are, the blocks are decoded when sampled
+        glTexStorage2D(GL_TEXTURE_2D, image.levels.size(), td.format, td.width, td.height);
+        GLState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for(unsigned int l = 0; l < image.levels.size(); ++l) {
+            const std::vector<unsigned char>& level = image.levels[l];
+            glCompressedTextureSubImage2D(this->texture, l, 0, 0, std::max(td.width >> l, 1), std::max(td.height >> l, 1),
+                    td.format, level.size(), level.data());
+        }
+
+        unbind(7);
+
+        return td;
+    }
+
+    // Uploads at least this large are staged through a pixel unpack buffer
+    static const size_t PBO_UPLOAD_THRESHOLD = 1 << 20;
+
+    void TextureBase::subImage2D(int x, int y, int width, int height, int internalFormat, const unsigned char* data) {
+        GLenum format = getPixelFormat(internalFormat);
+        GLenum type = getPixelType(internalFormat);
+        if(format == GL_NONE) {
+            error_logger("Unsupported texture format: ", internalFormat);
+            throw std::runtime_error(error_logger.last());
+        }
+
+        // Rows are padded to the unpack alignment
+        GLint alignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        size_t rowSize = size_t(width)*getBytesPerPixel(internalFormat);
+        size_t stride = (rowSize + alignment - 1)/alignment*alignment;
+        size_t size = stride*(height - 1) + rowSize;
+
+        GLState& state = GLState::getInstance();
+        if(size < PBO_UPLOAD_THRESHOLD) {
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glTextureSubImage2D(texture, 0, x, y, width, height, format, type, data);
+            return;
+        }
+
+        // The texture reads from the buffer asynchronously, and the buffer is freed
+        // by the driver once the upload is done
+        unsigned int pbo;
+        glCreateBuffers(1, &pbo);
+        glNamedBufferStorage(pbo, size, NULL, GL_MAP_WRITE_BIT);
+        void* dst = glMapNamedBufferRange(pbo, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        std::memcpy(dst, data, size);
+        glUnmapNamedBuffer(pbo);
+
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glTextureSubImage2D(texture, 0, x, y, width, height, format, type, (void*)0);
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        state.deleteBuffer(pbo);
+    }
+
+    GLenum TextureBase::getPixelFormat(int internalFormat) {
+        switch(internalFormat) {
+            case GL_RGBA8: return GL_RGBA;
+            case GL_RGB8: return GL_RGB;
+            case GL_RG8: return GL_RG;
+            case GL_R8: return GL_RED;
+            case GL_DEPTH24_STENCIL8: return GL_DEPTH_STENCIL;
+            default: return GL_NONE;
+        }
+    }
+
+    GLenum TextureBase::getPixelType(int internalFormat) {
+        // Unsigned byte unless it is a depth/stencil buffer
+        return internalFormat == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8 : GL_UNSIGNED_BYTE;
+    }
+
+    int TextureBase::getBytesPerPixel(int internalFormat) {
+        switch(internalFormat) {
+            case GL_RGBA8: return 4;
+            case GL_RGB8: return 3;
+            case GL_RG8: return 2;
+            case GL_R8: return 1;
+            case GL_DEPTH24_STENCIL8: return 4;
+            default: return 0;
+        }
+    }
     
     CubeMapTexture::CubeMapTexture() :  Texture<2>()  {}
 
@@ -158,11 +258,11 @@ namespace mork {
 
 
     void CubeMapTexture::bind() const {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        GLState::getInstance().bindTexture(GL_TEXTURE_CUBE_MAP, texture);
     }
     
     void CubeMapTexture::unbind() const {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GLState::getInstance().unbindTexture(GL_TEXTURE_CUBE_MAP);
     }
     
     void CubeMapTexture::bind(int texUnit) const {
@@ -175,24 +275,19 @@ namespace mork {
 
 
     void CubeMapTexture::loadTextures(const std::vector<std::string>& face_paths) {
+        // The faces are decoded concurrently, before anything is uploaded
+        std::vector<Image> faces = ImageDecoder::getInstance().decodeAll(face_paths, false);
+
 		bind(0);
+        GLState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
-		int width, height, nrChannels;
-		for (unsigned int i = 0; i < face_paths.size(); i++)
+		for (unsigned int i = 0; i < faces.size(); i++)
 		{
-			unsigned char *data = stbi_load(face_paths[i].c_str(), &width, &height, &nrChannels, 0);
-			if (data)
-			{
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
-							 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-				);
-				stbi_image_free(data);
-			}
-			else
-			{
-                mork::error_logger("Cubemap texture failed to load at path: ", face_paths[i]);
-                throw std::runtime_error("Failed to load cubemap texture");
-			}
+            const Image& face = faces[i];
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
+						 0, face.getFormat(), face.getWidth(), face.getHeight(), 0,
+                         getPixelFormat(face.getFormat()), GL_UNSIGNED_BYTE, face.getPixels()
+			);
 		}
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -205,7 +300,7 @@ namespace mork {
 
     void CubeMapTexture::loadTexture(const std::string& file, bool flip_vertical) {}
 
-    void CubeMapTexture::loadTexture(int width, int height, int internalformat, unsigned char* data, bool generateMip) {}
+    void CubeMapTexture::loadTexture(int width, int height, int internalformat, const unsigned char* data, bool generateMip) {}
 
     inline json texture2dSchema = R"(
     {
@@ -221,11 +316,13 @@ namespace mork {
     }
     )"_json;
 
-    class Texture2dResource: public ResourceTemplate<Texture<2> >
+    // Texture2d resources are shared through the TextureCache, so all resources
+    // with the same file and flip get the same texture
+    class Texture2dResource: public ResourceTemplate<std::shared_ptr<Texture<2> > >
     {
 		public:
 		    Texture2dResource(ResourceManager& manager, Resource& r) :
-				ResourceTemplate<Texture<2> >(texture2dSchema)
+				ResourceTemplate<std::shared_ptr<Texture<2> > >(texture2dSchema)
 			{
 	            info_logger("Resource - Texture2d");
          	    const json& js = r.getDescriptor();
@@ -239,7 +336,9 @@ namespace mork {
                 if(js.count("file")) {
                     std::string file = js["file"].get<std::string>();
                     info_logger("Resource - loading texture: ", file);
-                    tex.loadTexture(file, flip);
+                    tex = TextureCache::getInstance().load(file, flip);
+                } else {
+                    tex = std::make_shared<Texture<2> >();
                 }
                 
                 // TODO: handle min, mag etc
@@ -249,18 +348,18 @@ namespace mork {
 
             }
 
-            Texture<2> releaseResource() {
+            std::shared_ptr<Texture<2> > releaseResource() {
 				return std::move(tex);
 
             }
 		private:
-            Texture<2> tex;			
+            std::shared_ptr<Texture<2> > tex;
 
     };
 
     inline std::string texture2d = "texture2d";
 
-    static ResourceFactory<Texture<2> >::Type<texture2d, Texture2dResource> Texture2dType;
+    static ResourceFactory<std::shared_ptr<Texture<2> > >::Type<texture2d, Texture2dResource> Texture2dType;
 
 
 
@@ -5,6 +5,9 @@
 #include <vector>
 
 #include "mork/render/Bindable.h"
+#include "mork/render/Image.h"
+#include "mork/render/CompressedImage.h"
+#include "mork/render/GLState.h"
 #include "mork/glad/glad.h"
 #include "mork/core/Log.h"
 
@@ -52,7 +55,25 @@ namespace mork {
 
         virtual TextureData loadTexture2D(unsigned int texture, const std::string& file, bool flip_vertical, bool generate_mip);
 
-        virtual TextureData loadTexture2D(unsigned int texture, const TextureData& td, unsigned char* data, bool generate_mip);
+        TextureData loadTexture2D(unsigned int texture, const Image& image, bool generate_mip);
+
+        TextureData loadTexture2D(unsigned int texture, const CompressedImage& image);
+
+        // Binds the texture to unit 0 for loading (replacing it if it has immutable
+        // storage), and sets the default wrapping and filtering
+        void prepareTexture2D(bool mipmaps);
+
+        virtual TextureData loadTexture2D(unsigned int texture, const TextureData& td, const unsigned char* data, bool generate_mip);
+
+        // Uploads a region of level 0 of the bound 2D texture from tightly packed
+        // pixels of the given internal format. Large uploads are staged through a
+        // pixel unpack buffer, so the driver need not copy the data before returning.
+        void subImage2D(int x, int y, int width, int height, int internalFormat, const unsigned char* data);
+
+        // The pixel format, type and size of an internal format
+        static GLenum getPixelFormat(int internalFormat);
+        static GLenum getPixelType(int internalFormat);
+        static int getBytesPerPixel(int internalFormat);
 
 
 
@@ -91,13 +112,13 @@ namespace mork {
             Texture<2>(int width, int height, GLenum format, bool half_precision)
                 : TextureBase() {
 
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, texture);
+                GLState::getInstance().activeTexture(0);
+                GLState::getInstance().bindTexture(GL_TEXTURE_2D, texture);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                GLState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
                 if(format != GL_RGBA && format != GL_RGB) {
                     error_logger("Unspported format: ", format, ", only supported are GL_RGBA and GL_RGB.");
                     throw std::runtime_error(error_logger.last());
@@ -126,16 +147,42 @@ namespace mork {
                 TextureBase::unbind(texUnit);
             }
    
+            // Loads an image file, or a block compressed .ktx2 or .dds file with its
+            // mip levels (which is not flipped)
             virtual void loadTexture(const std::string& file, bool flip_vertical) {
                 td = loadTexture2D(texture, file, flip_vertical, true);
             }
              
-            virtual void loadTexture(int width, int height, int internalformat, unsigned char* data, bool generateMip) {
-                TextureData td;
-                td.width = width;
-                td.height = height;
-                td.format = internalformat;
-                td = loadTexture2D(texture, td, data, generateMip);
+            // Loads the texture from tightly packed pixels of the given internal
+            // format (data may be NULL to only allocate the texture). The texture gets
+            // immutable storage, so loading again replaces the GL texture object.
+            virtual void loadTexture(int width, int height, int internalformat, const unsigned char* data, bool generateMip) {
+                TextureData t;
+                t.width = width;
+                t.height = height;
+                t.depth = 1;
+                t.format = internalformat;
+                td = loadTexture2D(texture, t, data, generateMip);
+            }
+
+            // Loads the texture from an image decoded before, e.g. by the ImageDecoder
+            void loadTexture(const Image& image, bool generateMip) {
+                td = loadTexture2D(texture, image, generateMip);
+            }
+
+            // Loads the texture with the mip levels of a block compressed image
+            void loadTexture(const CompressedImage& image) {
+                td = loadTexture2D(texture, image);
+            }
+
+            // Replaces a region of the loaded texture with tightly packed pixels of its
+            // format. Mipmaps are not updated.
+            void setSubImage(int x, int y, int width, int height, const unsigned char* data) {
+                if(x < 0 || y < 0 || x + width > td.width || y + height > td.height) {
+                    error_logger("Texture region (", x, ", ", y, ", ", width, ", ", height, ") outside of texture");
+                    throw std::runtime_error(error_logger.last());
+                }
+                subImage2D(x, y, width, height, td.format, data);
             }
             
             virtual int getWidth() const {
@@ -155,11 +202,11 @@ namespace mork {
             }
 
             virtual void bind() const {
-                glBindTexture(GL_TEXTURE_2D, texture);
+                GLState::getInstance().bindTexture(GL_TEXTURE_2D, texture);
             }
     
             virtual void unbind() const {
-                glBindTexture(GL_TEXTURE_2D, 0);
+                GLState::getInstance().unbindTexture(GL_TEXTURE_2D);
             }
             
             static Texture<2> fromFile(const std::string& filename, bool flip = false) {
@@ -198,14 +245,14 @@ namespace mork {
             Texture<3>(int width, int height, int depth, GLenum format, bool half_precision)
                 : TextureBase() {
                 
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_3D, texture);
+                GLState::getInstance().activeTexture(0);
+                GLState::getInstance().bindTexture(GL_TEXTURE_3D, texture);
                 glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
                 glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                 glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
                 glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                GLState::getInstance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
                 if(format != GL_RGBA && format != GL_RGB) {
                     error_logger("Unspported format: ", format, ", only supported are GL_RGBA and GL_RGB.");
                     throw std::runtime_error(error_logger.last());
@@ -248,11 +295,11 @@ namespace mork {
             }
 
             virtual void bind() const {
-                glBindTexture(GL_TEXTURE_3D, texture);
+                GLState::getInstance().bindTexture(GL_TEXTURE_3D, texture);
             }
     
             virtual void unbind() const {
-                glBindTexture(GL_TEXTURE_3D, 0);
+                GLState::getInstance().unbindTexture(GL_TEXTURE_3D);
             }
             
             virtual void loadTexture(const std::string& file, bool flip_vertical) {
@@ -284,7 +331,7 @@ namespace mork {
         
         // Hide these:
         virtual void loadTexture(const std::string& file, bool flip_vertical);
-        virtual void loadTexture(int width, int height, int internalformat, unsigned char* data, bool generateMip);
+        virtual void loadTexture(int width, int height, int internalformat, const unsigned char* data, bool generateMip);
 
 
  
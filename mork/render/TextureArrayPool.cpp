@@ -0,0 +1,148 @@
+#include "mork/render/TextureArrayPool.h"
+#include "mork/render/MaterialTable.h"
+#include "mork/render/GLState.h"
+#include "mork/ui/GlfwWindow.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mork {
+
+    TextureArrayPool::TextureArrayPool(unsigned int initialLayers)
+        : initialLayers(std::max(initialLayers, 1u)) {
+    }
+
+    TextureArrayPool::~TextureArrayPool() {
+        if(!GlfwWindow::isContextActive())
+            return;
+        for(Array& a : arrays)
+            GLState::getInstance().deleteTexture(a.texture);
+    }
+
+    TextureArrayPool::Entry TextureArrayPool::add(const Texture<2>& texture) {
+        unsigned int id = texture.getTextureId();
+        GLint levels = 0;
+        glGetTextureParameteriv(id, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+        if(levels == 0) {
+            error_logger("TextureArrayPool: Only textures with immutable storage can be pooled");
+            throw std::runtime_error(error_logger.last());
+        }
+        GLint width = 0, height = 0, format = 0;
+        glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        // The first array of this kind with a free layer, or room to grow
+        int index = -1;
+        for(unsigned int i = 0; i < arrays.size(); ++i) {
+            const Array& a = arrays[i];
+            if(a.width == width && a.height == height && a.format == format && a.levels == levels
+                    && a.size < static_cast<unsigned int>(maxLayers)) {
+                index = i;
+                break;
+            }
+        }
+
+        if(index < 0) {
+            if(arrays.size() == MaterialTable::MAX_ARRAYS) {
+                error_logger("TextureArrayPool: At most ", MaterialTable::MAX_ARRAYS, " arrays can be used, can not add a ",
+                        width, "x", height, " texture of format ", format);
+                throw std::runtime_error(error_logger.last());
+            }
+            arrays.push_back({0, width, height, format, levels, 0, 0});
+            index = arrays.size() - 1;
+        }
+
+        Array& a = arrays[index];
+        if(a.size == a.capacity)
+            resize(a, std::min(std::max(2*a.capacity, initialLayers), static_cast<unsigned int>(maxLayers)));
+
+        for(int level = 0; level < levels; ++level) {
+            glCopyImageSubData(id, GL_TEXTURE_2D, level, 0, 0, 0,
+                    a.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, a.size,
+                    std::max(width >> level, 1), std::max(height >> level, 1), 1);
+        }
+
+        return {index, static_cast<int>(a.size++)};
+    }
+
+    void TextureArrayPool::pack(Material& material) {
+        packLayers(material.ambientLayers);
+        packLayers(material.diffuseLayers);
+        packLayers(material.specularLayers);
+        packLayers(material.emissiveLayers);
+        packLayers(material.normalLayers);
+    }
+
+    void TextureArrayPool::packLayers(std::vector<TextureLayer>& layers) {
+        for(TextureLayer& layer : layers) {
+            if(layer.isPooled())
+                continue;
+            // Textures shared by several layers are added once
+            auto i = packed.find(layer.texture);
+            Entry e;
+            if(i != packed.end()) {
+                e = i->second;
+            } else {
+                e = add(*layer.texture);
+                packed.emplace(layer.texture, e);
+            }
+            layer.arrayIndex = e.array;
+            layer.arrayLayer = e.layer;
+            // Deletes the texture when no other layer or cache handle holds it
+            layer.texture.reset();
+        }
+    }
+
+    void TextureArrayPool::bind() const {
+        GLState& state = GLState::getInstance();
+        for(unsigned int i = 0; i < arrays.size(); ++i) {
+            state.activeTexture(MaterialTable::MAX_TEXTURES + i);
+            state.bindTexture(GL_TEXTURE_2D_ARRAY, arrays[i].texture);
+        }
+    }
+
+    unsigned int TextureArrayPool::getNumArrays() const {
+        return arrays.size();
+    }
+
+    unsigned int TextureArrayPool::getNumLayers(int array) const {
+        return arrays[array].size;
+    }
+
+    unsigned int TextureArrayPool::getCapacity(int array) const {
+        return arrays[array].capacity;
+    }
+
+    unsigned int TextureArrayPool::getTextureId(int array) const {
+        return arrays[array].texture;
+    }
+
+    void TextureArrayPool::resize(Array& a, unsigned int capacity) {
+        unsigned int texture;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+        glTextureStorage3D(texture, a.levels, a.format, a.width, a.height, capacity);
+        // The same sampling as textures loaded from files
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, a.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+        if(a.texture != 0) {
+            for(int level = 0; level < a.levels; ++level) {
+                glCopyImageSubData(a.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                        texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                        std::max(a.width >> level, 1), std::max(a.height >> level, 1), a.size);
+            }
+            GLState::getInstance().deleteTexture(a.texture);
+        }
+
+        a.texture = texture;
+        a.capacity = capacity;
+    }
+
+}
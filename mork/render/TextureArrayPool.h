@@ -0,0 +1,80 @@
+#ifndef _MORK_TEXTUREARRAYPOOL_H_
+#define _MORK_TEXTUREARRAYPOOL_H_
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "mork/render/Texture.h"
+#include "mork/render/Material.h"
+
+namespace mork {
+
+    // Packs 2D textures of the same size, internal format and number of mip levels
+    // as layers of shared GL_TEXTURE_2D_ARRAY textures, so materials using them need
+    // no texture binds. Programs reading the MaterialTable sample the arrays through
+    // the materialArrays sampler array, whose elements are bound to the units after
+    // the materialTextures (see bind).
+    //
+    // Arrays have immutable storage, and grow by doubling their layers (copying the
+    // old layers on the GPU) up to the GL limit, after which a new array is started.
+    // Only textures with immutable storage (e.g. loaded from files) can be added.
+    class TextureArrayPool {
+        public:
+            // Where a texture went in the pool
+            struct Entry {
+                int array;
+                int layer;
+            };
+
+            // Arrays start with room for initialLayers layers
+            TextureArrayPool(unsigned int initialLayers = 8);
+            ~TextureArrayPool();
+
+            TextureArrayPool(const TextureArrayPool&) = delete;
+            TextureArrayPool& operator=(const TextureArrayPool&) = delete;
+
+            // Copies all mip levels of texture to a free layer of an array of its
+            // size and format. Throws if the texture has mutable storage, or if
+            // more than MaterialTable::MAX_ARRAYS arrays are needed.
+            Entry add(const Texture<2>& texture);
+
+            // Adds the textures of all texture layers of material that are not
+            // pooled yet, and releases them, so the layers refer to the pool only.
+            // Textures shared by several layers (e.g. from the TextureCache) are
+            // added once.
+            void pack(Material& material);
+
+            // Binds array i to texture unit MaterialTable::MAX_TEXTURES + i
+            void bind() const;
+
+            unsigned int getNumArrays() const;
+            unsigned int getNumLayers(int array) const;
+            unsigned int getCapacity(int array) const;
+            unsigned int getTextureId(int array) const;
+
+        private:
+            struct Array {
+                unsigned int    texture;
+                int             width;
+                int             height;
+                int             format;
+                int             levels;
+                unsigned int    size;
+                unsigned int    capacity;
+            };
+
+            void packLayers(std::vector<TextureLayer>& layers);
+            // Creates new storage for array with room for capacity layers, keeping its layers
+            void resize(Array& array, unsigned int capacity);
+
+            std::vector<Array>  arrays;
+            unsigned int        initialLayers;
+            // The entries of packed textures. Keyed by the weak owner, so a released
+            // texture's address can not be mistaken for a new texture.
+            std::map<std::weak_ptr<Texture<2> >, Entry, std::owner_less<> > packed;
+    };
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "mork/render/TextureCache.h"
+#include "mork/render/CompressedImage.h"
+#include "mork/core/Log.h"
+
+#include <filesystem>
+#include <system_error>
+
+namespace mork {
+
+    TextureCache& TextureCache::getInstance() {
+        static TextureCache instance;
+        return instance;
+    }
+
+    std::string TextureCache::getKey(const std::string& file, bool flipVertical, bool mipmaps) {
+        // Resolves ./, ../ and links of the existing part of the path
+        std::error_code ec;
+        std::filesystem::path path = std::filesystem::weakly_canonical(file, ec);
+        if(ec)
+            path = std::filesystem::absolute(file, ec).lexically_normal();
+
+        if(CompressedImage::isCompressedFile(file))
+            flipVertical = false;
+
+        return path.generic_string() + (flipVertical ? "|flip" : "|noflip") + (mipmaps ? "|mip" : "|nomip");
+    }
+
+    TextureCache::Handle TextureCache::find(const std::string& file, bool flipVertical, bool mipmaps) {
+        auto i = textures.find(getKey(file, flipVertical, mipmaps));
+        if(i == textures.end())
+            return Handle();
+        return i->second.lock();
+    }
+
+    TextureCache::Handle TextureCache::load(const std::string& file, bool flipVertical, bool mipmaps) {
+        std::string key = getKey(file, flipVertical, mipmaps);
+        auto i = textures.find(key);
+        if(i != textures.end()) {
+            if(Handle h = i->second.lock())
+                return h;
+        }
+
+        Texture<2> texture;
+        if(CompressedImage::isCompressedFile(file))
+            texture.loadTexture(file, flipVertical);
+        else
+            texture.loadTexture(Image::load(file, flipVertical), mipmaps);
+        return insert(key, std::move(texture));
+    }
+
+    TextureCache::Handle TextureCache::load(const std::string& file, bool flipVertical, bool mipmaps, const Image& image) {
+        std::string key = getKey(file, flipVertical, mipmaps);
+        auto i = textures.find(key);
+        if(i != textures.end()) {
+            if(Handle h = i->second.lock())
+                return h;
+        }
+
+        Texture<2> texture;
+        texture.loadTexture(image, mipmaps);
+        return insert(key, std::move(texture));
+    }
+
+    unsigned int TextureCache::size() {
+        prune();
+        return textures.size();
+    }
+
+    TextureCache::Handle TextureCache::insert(const std::string& key, Texture<2>&& texture) {
+        prune();
+        Handle h = std::make_shared<Texture<2> >(std::move(texture));
+        textures[key] = h;
+        debug_logger("TextureCache: Loaded ", key, ", ", textures.size(), " textures in use");
+        return h;
+    }
+
+    void TextureCache::prune() {
+        for(auto i = textures.begin(); i != textures.end(); ) {
+            if(i->second.expired())
+                i = textures.erase(i);
+            else
+                ++i;
+        }
+    }
+
+}
@@ -0,0 +1,57 @@
+#ifndef _MORK_TEXTURECACHE_H_
+#define _MORK_TEXTURECACHE_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mork/render/Texture.h"
+#include "mork/render/Image.h"
+
+namespace mork {
+
+    // Shares loaded 2D textures by file, so materials and models referring to the
+    // same image get the same GL texture. Textures are keyed by their canonical
+    // path and load options, and live as long as any handle to them: the cache
+    // only holds weak references.
+    //
+    // Textures are created and released on the GL thread, so the cache is not
+    // synchronized.
+    class TextureCache {
+        public:
+            typedef std::shared_ptr<Texture<2> > Handle;
+
+            static TextureCache& getInstance();
+
+            TextureCache() = default;
+            TextureCache(const TextureCache&) = delete;
+            TextureCache& operator=(const TextureCache&) = delete;
+
+            // The key of file loaded with the given options. Block compressed files
+            // are never flipped, so their key ignores flipVertical.
+            static std::string getKey(const std::string& file, bool flipVertical, bool mipmaps);
+
+            // Returns the texture of file if it is loaded, or nullptr
+            Handle find(const std::string& file, bool flipVertical, bool mipmaps = true);
+
+            // Returns the texture of file, loading it if it is not loaded
+            Handle load(const std::string& file, bool flipVertical, bool mipmaps = true);
+
+            // As load, but uploads image (decoded from file with the same options)
+            // instead of reading file if it is not loaded
+            Handle load(const std::string& file, bool flipVertical, bool mipmaps, const Image& image);
+
+            // The number of loaded textures still in use
+            unsigned int size();
+
+        private:
+            Handle insert(const std::string& key, Texture<2>&& texture);
+            // Drops the entries of released textures
+            void prune();
+
+            std::unordered_map<std::string, std::weak_ptr<Texture<2> > > textures;
+    };
+
+}
+
+#endif
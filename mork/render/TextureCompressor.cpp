@@ -0,0 +1,481 @@
+#include "mork/render/TextureCompressor.h"
+#include "mork/util/ThreadPool.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace mork {
+
+    // Fits a line through the texels (the first dims channels), returning their
+    // mean and the direction of largest variance (zero if all texels are equal)
+    static void principalAxis(const float texels[16][4], int dims, float mean[4], float axis[4]) {
+        for(int c = 0; c < 4; ++c) {
+            mean[c] = 0.0f;
+            axis[c] = 0.0f;
+        }
+        for(int i = 0; i < 16; ++i)
+            for(int c = 0; c < dims; ++c)
+                mean[c] += texels[i][c]/16.0f;
+
+        float cov[4][4] = {};
+        for(int i = 0; i < 16; ++i) {
+            for(int a = 0; a < dims; ++a)
+                for(int b = 0; b < dims; ++b)
+                    cov[a][b] += (texels[i][a] - mean[a])*(texels[i][b] - mean[b]);
+        }
+
+        // Power iteration, from the channel with the largest variance
+        int largest = 0;
+        for(int c = 1; c < dims; ++c) {
+            if(cov[c][c] > cov[largest][largest])
+                largest = c;
+        }
+        if(cov[largest][largest] <= 0.0f)
+            return;
+
+        float v[4] = {};
+        for(int c = 0; c < dims; ++c)
+            v[c] = cov[largest][c];
+        for(int iteration = 0; iteration < 8; ++iteration) {
+            float w[4] = {};
+            float norm = 0.0f;
+            for(int a = 0; a < dims; ++a) {
+                for(int b = 0; b < dims; ++b)
+                    w[a] += cov[a][b]*v[b];
+                norm += w[a]*w[a];
+            }
+            if(norm <= 0.0f)
+                return;
+            norm = std::sqrt(norm);
+            for(int c = 0; c < dims; ++c)
+                v[c] = w[c]/norm;
+        }
+        for(int c = 0; c < dims; ++c)
+            axis[c] = v[c];
+    }
+
+    // The range of the projections of the texels on the axis through mean
+    static void projectRange(const float texels[16][4], int dims, const float mean[4], const float axis[4], float& tmin, float& tmax) {
+        tmin = 0.0f;
+        tmax = 0.0f;
+        for(int i = 0; i < 16; ++i) {
+            float t = 0.0f;
+            for(int c = 0; c < dims; ++c)
+                t += (texels[i][c] - mean[c])*axis[c];
+            tmin = std::min(tmin, t);
+            tmax = std::max(tmax, t);
+        }
+    }
+
+    static int clampByte(float v) {
+        return std::min(std::max(static_cast<int>(v + 0.5f), 0), 255);
+    }
+
+    // Writes bits from bit 0 of byte 0 on, as the block formats are little endian
+    class BitWriter {
+        public:
+            BitWriter(unsigned char* out, int size) : out(out), pos(0) {
+                std::memset(out, 0, size);
+            }
+
+            void put(uint32_t value, int bits) {
+                for(int b = 0; b < bits; ++b, ++pos) {
+                    if((value >> b) & 1)
+                        out[pos >> 3] |= 1 << (pos & 7);
+                }
+            }
+
+        private:
+            unsigned char*  out;
+            int             pos;
+    };
+
+    // BC1
+
+    static uint16_t toRGB565(const float c[3]) {
+        int r = std::min(std::max(static_cast<int>(c[0]*31.0f/255.0f + 0.5f), 0), 31);
+        int g = std::min(std::max(static_cast<int>(c[1]*63.0f/255.0f + 0.5f), 0), 63);
+        int b = std::min(std::max(static_cast<int>(c[2]*31.0f/255.0f + 0.5f), 0), 31);
+        return (r << 11) | (g << 5) | b;
+    }
+
+    static void fromRGB565(uint16_t c, int rgb[3]) {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // Picks the nearest of the four colors between c0 and c1 for each texel,
+    // returning the squared error
+    static int bc1Indices(const float texels[16][4], uint16_t c0, uint16_t c1, int indices[16]) {
+        int palette[4][3];
+        fromRGB565(c0, palette[0]);
+        fromRGB565(c1, palette[1]);
+        for(int c = 0; c < 3; ++c) {
+            palette[2][c] = (2*palette[0][c] + palette[1][c])/3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c])/3;
+        }
+
+        int error = 0;
+        for(int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for(int p = 0; p < 4; ++p) {
+                int e = 0;
+                for(int c = 0; c < 3; ++c) {
+                    int d = static_cast<int>(texels[i][c]) - palette[p][c];
+                    e += d*d;
+                }
+                if(e < bestError) {
+                    best = p;
+                    bestError = e;
+                }
+            }
+            indices[i] = best;
+            error += bestError;
+        }
+        return error;
+    }
+
+    static void encodeColorBlock(const unsigned char rgba[64], unsigned char block[8]) {
+        float texels[16][4];
+        for(int i = 0; i < 16; ++i)
+            for(int c = 0; c < 4; ++c)
+                texels[i][c] = rgba[4*i + c];
+
+        float mean[4], axis[4], tmin, tmax;
+        principalAxis(texels, 3, mean, axis);
+        projectRange(texels, 3, mean, axis, tmin, tmax);
+
+        float e0[3], e1[3];
+        for(int c = 0; c < 3; ++c) {
+            e0[c] = mean[c] + tmax*axis[c];
+            e1[c] = mean[c] + tmin*axis[c];
+        }
+        uint16_t c0 = toRGB565(e0), c1 = toRGB565(e1);
+        int indices[16];
+        int error = bc1Indices(texels, c0, c1, indices);
+
+        // Refine the endpoints by least squares for the chosen indices
+        static const float WEIGHTS[4] = {1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f};
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+        for(int i = 0; i < 16; ++i) {
+            float a = WEIGHTS[indices[i]], b = 1.0f - a;
+            aa += a*a;
+            ab += a*b;
+            bb += b*b;
+            for(int c = 0; c < 3; ++c) {
+                ax[c] += a*texels[i][c];
+                bx[c] += b*texels[i][c];
+            }
+        }
+        float det = aa*bb - ab*ab;
+        if(std::fabs(det) > 1e-6f) {
+            float r0[3], r1[3];
+            for(int c = 0; c < 3; ++c) {
+                r0[c] = (bb*ax[c] - ab*bx[c])/det;
+                r1[c] = (aa*bx[c] - ab*ax[c])/det;
+            }
+            uint16_t rc0 = toRGB565(r0), rc1 = toRGB565(r1);
+            int refined[16];
+            int refinedError = bc1Indices(texels, rc0, rc1, refined);
+            if(refinedError < error) {
+                c0 = rc0;
+                c1 = rc1;
+                std::copy(refined, refined + 16, indices);
+            }
+        }
+
+        // c0 > c1 selects the four color mode. Equal endpoints use index 0 only.
+        if(c0 < c1) {
+            std::swap(c0, c1);
+            static const int SWAPPED[4] = {1, 0, 3, 2};
+            for(int i = 0; i < 16; ++i)
+                indices[i] = SWAPPED[indices[i]];
+        } else if(c0 == c1) {
+            std::fill(indices, indices + 16, 0);
+        }
+
+        BitWriter out(block, 8);
+        out.put(c0, 16);
+        out.put(c1, 16);
+        for(int i = 0; i < 16; ++i)
+            out.put(indices[i], 2);
+    }
+
+    void TextureCompressor::encodeBC1(const unsigned char rgba[64], unsigned char block[8]) {
+        encodeColorBlock(rgba, block);
+    }
+
+    // BC4
+
+    void TextureCompressor::encodeBC4(const unsigned char rgba[64], int channel, unsigned char block[8]) {
+        int a0 = 0, a1 = 255;
+        for(int i = 0; i < 16; ++i) {
+            a0 = std::max(a0, int(rgba[4*i + channel]));
+            a1 = std::min(a1, int(rgba[4*i + channel]));
+        }
+
+        BitWriter out(block, 8);
+        out.put(a0, 8);
+        out.put(a1, 8);
+        if(a0 == a1)
+            return;
+
+        // a0 > a1 selects eight values, a0, a1 and six between them
+        int palette[8] = {a0, a1};
+        for(int p = 2; p < 8; ++p)
+            palette[p] = ((8 - p)*a0 + (p - 1)*a1)/7;
+        for(int i = 0; i < 16; ++i) {
+            int v = rgba[4*i + channel];
+            int best = 0;
+            for(int p = 1; p < 8; ++p) {
+                if(std::abs(v - palette[p]) < std::abs(v - palette[best]))
+                    best = p;
+            }
+            out.put(best, 3);
+        }
+    }
+
+    void TextureCompressor::encodeBC3(const unsigned char rgba[64], unsigned char block[16]) {
+        encodeBC4(rgba, 3, block);
+        encodeColorBlock(rgba, block + 8);
+    }
+
+    void TextureCompressor::encodeBC5(const unsigned char rgba[64], unsigned char block[16]) {
+        encodeBC4(rgba, 0, block);
+        encodeBC4(rgba, 1, block + 8);
+    }
+
+    // BC7 mode 6: RGBA endpoints of 7 bits plus a shared low bit per endpoint,
+    // and 4 bit indices
+
+    void TextureCompressor::encodeBC7(const unsigned char rgba[64], unsigned char block[16]) {
+        static const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+        float texels[16][4];
+        for(int i = 0; i < 16; ++i)
+            for(int c = 0; c < 4; ++c)
+                texels[i][c] = rgba[4*i + c];
+
+        float mean[4], axis[4], tmin, tmax;
+        principalAxis(texels, 4, mean, axis);
+        projectRange(texels, 4, mean, axis, tmin, tmax);
+
+        // Quantize each endpoint with the low bit giving the least error
+        int q[2][4], p[2];
+        for(int e = 0; e < 2; ++e) {
+            float t = e == 0 ? tmin : tmax;
+            int bestError = 1 << 30;
+            for(int bit = 0; bit < 2; ++bit) {
+                int error = 0, values[4];
+                for(int c = 0; c < 4; ++c) {
+                    int v = clampByte(mean[c] + t*axis[c]);
+                    values[c] = std::min(std::max((v - bit + 1)/2, 0), 127);
+                    int d = (values[c] << 1 | bit) - v;
+                    error += d*d;
+                }
+                if(error < bestError) {
+                    bestError = error;
+                    p[e] = bit;
+                    std::copy(values, values + 4, q[e]);
+                }
+            }
+        }
+
+        int palette[16][4];
+        for(int i = 0; i < 16; ++i) {
+            for(int c = 0; c < 4; ++c) {
+                int e0 = q[0][c] << 1 | p[0], e1 = q[1][c] << 1 | p[1];
+                palette[i][c] = ((64 - WEIGHTS[i])*e0 + WEIGHTS[i]*e1 + 32) >> 6;
+            }
+        }
+
+        int indices[16];
+        for(int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for(int j = 0; j < 16; ++j) {
+                int error = 0;
+                for(int c = 0; c < 4; ++c) {
+                    int d = rgba[4*i + c] - palette[j][c];
+                    error += d*d;
+                }
+                if(error < bestError) {
+                    best = j;
+                    bestError = error;
+                }
+            }
+            indices[i] = best;
+        }
+
+        // The high bit of the first index is implicitly 0
+        if(indices[0] & 8) {
+            std::swap(q[0], q[1]);
+            std::swap(p[0], p[1]);
+            for(int i = 0; i < 16; ++i)
+                indices[i] = 15 - indices[i];
+        }
+
+        BitWriter out(block, 16);
+        out.put(1 << 6, 7);
+        for(int c = 0; c < 4; ++c) {
+            out.put(q[0][c], 7);
+            out.put(q[1][c], 7);
+        }
+        out.put(p[0], 1);
+        out.put(p[1], 1);
+        out.put(indices[0], 3);
+        for(int i = 1; i < 16; ++i)
+            out.put(indices[i], 4);
+    }
+
+    // Images
+
+    BlockFormat TextureCompressor::chooseFormat(int channels, const Options& options) {
+        if(options.normalMap)
+            return BlockFormat::BC5;
+        if(channels == 1)
+            return BlockFormat::BC4;
+        if(channels == 3)
+            return BlockFormat::BC1;
+        return options.highQuality ? BlockFormat::BC7 : BlockFormat::BC3;
+    }
+
+    bool TextureCompressor::isNormalMapName(const std::string& file) {
+        std::string name = file.substr(file.find_last_of("/\\") + 1);
+        name = name.substr(0, name.find_last_of('.'));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        for(const std::string suffix : {"_normal", "_nrm", "_n"}) {
+            if(name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<unsigned char> TextureCompressor::downsample(const std::vector<unsigned char>& rgba, int width, int height, bool normalMap) {
+        int w = std::max(width/2, 1), h = std::max(height/2, 1);
+        std::vector<unsigned char> out(size_t(w)*h*4);
+
+        for(int y = 0; y < h; ++y) {
+            int y0 = std::min(2*y, height - 1), y1 = std::min(2*y + 1, height - 1);
+            for(int x = 0; x < w; ++x) {
+                int x0 = std::min(2*x, width - 1), x1 = std::min(2*x + 1, width - 1);
+                const unsigned char* s[4] = {
+                    &rgba[(size_t(y0)*width + x0)*4], &rgba[(size_t(y0)*width + x1)*4],
+                    &rgba[(size_t(y1)*width + x0)*4], &rgba[(size_t(y1)*width + x1)*4]};
+                unsigned char* d = &out[(size_t(y)*w + x)*4];
+
+                float sum[4] = {};
+                for(int c = 0; c < 4; ++c) {
+                    for(int i = 0; i < 4; ++i)
+                        sum[c] += normalMap && c < 3 ? s[i][c]/127.5f - 1.0f : s[i][c];
+                }
+
+                if(normalMap) {
+                    float len = std::sqrt(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+                    for(int c = 0; c < 3; ++c)
+                        d[c] = clampByte(len > 0.0f ? (sum[c]/len + 1.0f)*127.5f : 127.5f);
+                    d[3] = clampByte(sum[3]/4.0f);
+                } else {
+                    for(int c = 0; c < 4; ++c)
+                        d[c] = clampByte(sum[c]/4.0f);
+                }
+            }
+        }
+        return out;
+    }
+
+    CompressedImage TextureCompressor::compress(const Image& image, const Options& options, ThreadPool* pool) {
+        if(image.empty()) {
+            error_logger("TextureCompressor: Can not compress an empty image");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        std::unique_ptr<ThreadPool> ownPool;
+        if(pool == nullptr) {
+            ownPool = std::make_unique<ThreadPool>();
+            pool = ownPool.get();
+        }
+
+        // Expand to RGBA, grey to all color channels
+        int width = image.getWidth(), height = image.getHeight(), channels = image.getChannels();
+        std::vector<unsigned char> rgba(size_t(width)*height*4);
+        const unsigned char* src = image.getPixels();
+        for(size_t i = 0; i < size_t(width)*height; ++i) {
+            const unsigned char* s = src + i*channels;
+            unsigned char* d = &rgba[i*4];
+            if(channels <= 2) {
+                d[0] = d[1] = d[2] = s[0];
+                d[3] = channels == 2 ? s[1] : 255;
+            } else {
+                d[0] = s[0];
+                d[1] = s[1];
+                d[2] = s[2];
+                d[3] = channels == 4 ? s[3] : 255;
+            }
+        }
+
+        CompressedImage result;
+        result.format = chooseFormat(channels, options);
+        result.width = width;
+        result.height = height;
+        size_t blockSize = CompressedImage::getBlockSize(result.format);
+
+        int w = width, h = height;
+        while(true) {
+            int bw = (w + 3)/4, bh = (h + 3)/4;
+            std::vector<unsigned char> blocks(size_t(bw)*bh*blockSize);
+
+            // Rows of blocks are encoded in parallel, about 1024 blocks per job
+            pool->runWeighted(bh, 1024, [bw](std::size_t) { return bw; }, [&](std::size_t by) {
+                unsigned char texels[64];
+                for(int bx = 0; bx < bw; ++bx) {
+                    // Blocks over the edge repeat the last row and column
+                    for(int y = 0; y < 4; ++y) {
+                        int sy = std::min(int(by)*4 + y, h - 1);
+                        for(int x = 0; x < 4; ++x) {
+                            int sx = std::min(bx*4 + x, w - 1);
+                            std::memcpy(&texels[(y*4 + x)*4], &rgba[(size_t(sy)*w + sx)*4], 4);
+                        }
+                    }
+
+                    unsigned char* block = &blocks[(by*bw + bx)*blockSize];
+                    switch(result.format) {
+                        case BlockFormat::BC1: encodeBC1(texels, block); break;
+                        case BlockFormat::BC3: encodeBC3(texels, block); break;
+                        case BlockFormat::BC4: encodeBC4(texels, 0, block); break;
+                        case BlockFormat::BC5: encodeBC5(texels, block); break;
+                        case BlockFormat::BC7: encodeBC7(texels, block); break;
+                    }
+                }
+            });
+            result.levels.push_back(std::move(blocks));
+
+            if(!options.mipmaps || (w == 1 && h == 1))
+                break;
+            rgba = downsample(rgba, w, h, options.normalMap);
+            w = std::max(w/2, 1);
+            h = std::max(h/2, 1);
+        }
+
+        return result;
+    }
+
+    void TextureCompressor::compressFile(const std::string& source, const std::string& destination, Options options, ThreadPool* pool) {
+        Image image = Image::load(source, options.flipVertical);
+        options.normalMap = options.normalMap || isNormalMapName(source);
+
+        CompressedImage compressed = compress(image, options, pool);
+        if(destination.size() >= 4 && destination.compare(destination.size() - 4, 4, ".dds") == 0)
+            compressed.saveDDS(destination);
+        else
+            compressed.saveKTX2(destination);
+    }
+
+}
@@ -0,0 +1,69 @@
+#ifndef _MORK_TEXTURECOMPRESSOR_H_
+#define _MORK_TEXTURECOMPRESSOR_H_
+
+#include <string>
+#include <vector>
+
+#include "mork/render/Image.h"
+#include "mork/render/CompressedImage.h"
+
+namespace mork {
+
+    class ThreadPool;
+
+    // Encodes images and their mip chains to block compressed formats, to be
+    // saved in KTX2 or DDS files offline and uploaded without decoding.
+    //
+    // Colors are fitted along their principal axis, refined by least squares for
+    // BC1. BC7 blocks are all mode 6 (one RGBA subset with 4 bit indices), which
+    // suits smooth color and alpha well.
+    class TextureCompressor {
+        public:
+            struct Options {
+                // Normal maps are stored as BC5 (X and Y), the shaders reconstruct Z.
+                // Their mip levels are renormalized.
+                bool    normalMap;
+                bool    mipmaps;
+                // BC7 instead of BC3 for images with alpha
+                bool    highQuality;
+                // Flips the decoded source of compressFile, as loaded textures are
+                // not flipped
+                bool    flipVertical;
+
+                Options() : normalMap(false), mipmaps(true), highQuality(true), flipVertical(true) {}
+            };
+
+            // Returns the format for an image with the given channels: BC5 for
+            // normal maps, BC4 for grey, BC1 for RGB, and BC7 (or BC3) for grey with
+            // alpha and RGBA
+            static BlockFormat chooseFormat(int channels, const Options& options);
+
+            // Returns true for file names ending with a normal map suffix before the
+            // extension (_normal, _nrm, _n)
+            static bool isNormalMapName(const std::string& file);
+
+            // Compresses image and (if enabled) its mip levels, encoding blocks on
+            // the threads of pool, or on threads created for the call if nullptr
+            static CompressedImage compress(const Image& image, const Options& options, ThreadPool* pool = nullptr);
+
+            // Decodes source and saves it compressed to destination (.ktx2 or .dds).
+            // Normal maps are also detected by name.
+            static void compressFile(const std::string& source, const std::string& destination,
+                    Options options = Options(), ThreadPool* pool = nullptr);
+
+            // Block encoders, from 4x4 RGBA texels in rows
+            static void encodeBC1(const unsigned char rgba[64], unsigned char block[8]);
+            static void encodeBC3(const unsigned char rgba[64], unsigned char block[16]);
+            // Encodes the channel at offset 0..3 of the texels
+            static void encodeBC4(const unsigned char rgba[64], int channel, unsigned char block[8]);
+            static void encodeBC5(const unsigned char rgba[64], unsigned char block[16]);
+            static void encodeBC7(const unsigned char rgba[64], unsigned char block[16]);
+
+            // Returns the next mip level of an RGBA image, a 2x2 box filter.
+            // Normal maps are renormalized.
+            static std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height, bool normalMap);
+    };
+
+}
+
+#endif
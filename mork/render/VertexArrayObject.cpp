@@ -1,6 +1,7 @@
 #include "VertexArrayObject.h"
 #include "mork/glad/glad.h"
 #include "mork/ui/GlfwWindow.h"
+#include "mork/render/GLState.h"
 namespace mork {
 
 VertexArrayObject::VertexArrayObject()
@@ -23,8 +24,7 @@ VertexArrayObject& VertexArrayObject::operator=(VertexArrayObject&& o)
     {
         if(VAO)
         {
-            unbind();
-            glDeleteVertexArrays(1, &VAO);
+            GLState::getInstance().deleteVertexArray(VAO);
         }
     }
     
@@ -41,19 +41,18 @@ VertexArrayObject::~VertexArrayObject() {
     {
         if(VAO)
         {
-            unbind();
-            glDeleteVertexArrays(1, &VAO);
+            GLState::getInstance().deleteVertexArray(VAO);
         }
     }
 }
 
 void VertexArrayObject::bind() const {
-    glBindVertexArray(VAO);
+    GLState::getInstance().bindVertexArray(VAO);
     
 }
 
 void VertexArrayObject::unbind() const {
-    glBindVertexArray(0);
+    GLState::getInstance().unbindVertexArray();
 }
 
 }
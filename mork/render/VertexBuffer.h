@@ -3,6 +3,8 @@
 #include "mork/math/vec2.h"
 #include "mork/math/vec3.h"
 #include "mork/math/vec4.h"
+#include "mork/math/mat3.h"
+#include "mork/math/mat4.h"
 #include "mork/render/GPUBuffer.h"
 
 namespace mork {
@@ -149,6 +151,90 @@ struct vertex_pos_norm_tang_bitang_uv {
 
 
 
+// A position quantized to 16 bit unsigned normalized integers within the bounds
+// of its mesh, see MeshUtil::packVertices. Converts to the normalized position in
+// [0,1], as the vertex shader reads it. Meshes of packed vertices decode them with
+// the VertexPacking set on the mesh.
+struct unorm16_pos {
+    unsigned short  x;
+    unsigned short  y;
+    unsigned short  z;
+    // The handedness of the tangent frame of the vertex, 0 for -1 and 65535 for 1
+    unsigned short  w;
+
+    operator mork::vec3f() const {
+        return mork::vec3f(x, y, z)/65535.0f;
+    }
+};
+
+// Packed vertex object, 20 bytes instead of the 56 of vertex_pos_norm_tang_bitang_uv.
+// Positions are quantized in the mesh bounds, the normal and tangent are octahedral
+// encoded as 16 bit snorms, the bitangent is reduced to the handedness in pos.w,
+// and uvs are half floats. See MeshUtil::packVertices, and shaders/packing.glhl for
+// the decoding in shaders.
+struct vertex_pos_norm_tang_uv_packed {
+    unorm16_pos     pos;
+    // Octahedral normal in xy and tangent in zw
+    short           normTang[4];
+    unsigned short  uv[2];
+
+    inline static void setAttributes() {
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, 20, (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, 20, (void*)8);
+        glEnableVertexAttribArray(1);
+
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, 20, (void*)16);
+        glEnableVertexAttribArray(2);
+    }
+};
+
+static_assert(sizeof(vertex_pos_norm_tang_uv_packed) == 20, "Packed vertices must be tightly packed");
+
+
+
+// Per instance transforms for instanced drawing, see RenderQueue. The matrices
+// are stored column-major, as OpenGL expects them. The model matrix goes to
+// attribute locations 5-8, the normal matrix to 9-11 and the material table id
+// to 12 (an integer attribute), all advancing once per instance.
+struct instance_model_normal {
+    float   model[16];
+    float   normalMat[9];
+    unsigned int material;
+
+    static const unsigned int MODEL_LOCATION = 5;
+    static const unsigned int NORMAL_MAT_LOCATION = 9;
+    static const unsigned int MATERIAL_LOCATION = 12;
+
+    instance_model_normal() {};
+
+    instance_model_normal(const mork::mat4f& m, const mork::mat3f& n, unsigned int material = 0) : material(material) {
+        for(int c = 0; c < 4; ++c)
+            for(int r = 0; r < 4; ++r)
+                model[c*4 + r] = m[r][c];
+        for(int c = 0; c < 3; ++c)
+            for(int r = 0; r < 3; ++r)
+                normalMat[c*3 + r] = n[r][c];
+    }
+
+    inline static void setAttributes() {
+        for(unsigned int c = 0; c < 4; ++c) {
+            glVertexAttribPointer(MODEL_LOCATION + c, 4, GL_FLOAT, GL_FALSE, sizeof(instance_model_normal), (void*)(4*c*sizeof(float)));
+            glEnableVertexAttribArray(MODEL_LOCATION + c);
+            glVertexAttribDivisor(MODEL_LOCATION + c, 1);
+        }
+        for(unsigned int c = 0; c < 3; ++c) {
+            glVertexAttribPointer(NORMAL_MAT_LOCATION + c, 3, GL_FLOAT, GL_FALSE, sizeof(instance_model_normal), (void*)((16 + 3*c)*sizeof(float)));
+            glEnableVertexAttribArray(NORMAL_MAT_LOCATION + c);
+            glVertexAttribDivisor(NORMAL_MAT_LOCATION + c, 1);
+        }
+        glVertexAttribIPointer(MATERIAL_LOCATION, 1, GL_UNSIGNED_INT, sizeof(instance_model_normal), (void*)(25*sizeof(float)));
+        glEnableVertexAttribArray(MATERIAL_LOCATION);
+        glVertexAttribDivisor(MATERIAL_LOCATION, 1);
+    }
+};
+
 struct vertex_pos_col_uv {
     mork::vec3f     pos;
     mork::vec4f     col;
@@ -0,0 +1,304 @@
+#include "mork/scene/BoundingVolumeHierarchy.h"
+#include "mork/scene/SceneNode.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mork {
+
+    // Tree nodes with more leaves than this are always split
+    static const int MAX_LEAF_SIZE = 4;
+
+    // Number of bins per axis for the surface area heuristic
+    static const int BINS = 12;
+
+    // Cost of traversing an inner node, relative to testing one leaf
+    static const double TRAVERSAL_COST = 1.0;
+
+    static double axisValue(const vec3d& v, int axis) {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    static double axisMin(const box3d& b, int axis) {
+        return axis == 0 ? b.xmin : (axis == 1 ? b.ymin : b.zmin);
+    }
+
+    static double axisMax(const box3d& b, int axis) {
+        return axis == 0 ? b.xmax : (axis == 1 ? b.ymax : b.zmax);
+    }
+
+    BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+        :   root(nullptr),
+            structureVersion(0),
+            cost(0.0),
+            buildCost(0.0),
+            rebuildRatio(1.5),
+            testedNodes(0) {
+    }
+
+    void BoundingVolumeHierarchy::build(SceneNode& root) {
+        this->root = &root;
+        structureVersion = root.getStructureVersion();
+
+        nodes.clear();
+        leaves.clear();
+        unbounded.clear();
+        visibleNodes.clear();
+
+        collect(root);
+
+        if(!leaves.empty()) {
+            nodes.reserve(2*leaves.size());
+            split(0, leaves.size());
+        }
+
+        cost = buildCost = computeCost();
+    }
+
+    void BoundingVolumeHierarchy::clear() {
+        root = nullptr;
+        nodes.clear();
+        leaves.clear();
+        unbounded.clear();
+        visibleNodes.clear();
+        cost = buildCost = 0.0;
+    }
+
+    bool BoundingVolumeHierarchy::collect(SceneNode& node) {
+        node.isVisible(false);
+
+        bool bounded = node.hasLocalBounds();
+        if(bounded) {
+            box3d bounds = node.getLocalToWorld()*node.getLocalBounds();
+            leaves.push_back({&node, bounds, bounds.center(), node.getWorldVersion(), -1});
+        }
+
+        for(SceneNode& child : node.getChildren())
+            bounded = collect(child) || bounded;
+
+        if(!bounded && &node != root)
+            unbounded.push_back(&node);
+        return bounded;
+    }
+
+    int BoundingVolumeHierarchy::split(int first, int count) {
+        int index = nodes.size();
+        nodes.push_back({box3d(), -1, first, count, -1});
+
+        box3d bounds;
+        box3d centroids;
+        for(int i = first; i < first + count; ++i) {
+            bounds = bounds.enlarge(leaves[i].bounds);
+            centroids = centroids.enlarge(leaves[i].centroid);
+        }
+        nodes[index].bounds = bounds;
+
+        if(count <= MAX_LEAF_SIZE)
+            return index;
+
+        // Find the best split between bins along any axis
+        double area = std::max(bounds.area(), 1e-12);
+        double bestCost = INFINITY;
+        int bestAxis = -1;
+        int bestBin = -1;
+
+        for(int axis = 0; axis < 3; ++axis) {
+            double lo = axisMin(centroids, axis);
+            double hi = axisMax(centroids, axis);
+            if(!(hi > lo))
+                continue;
+
+            box3d binBounds[BINS];
+            int binCounts[BINS] = {0};
+            double scale = BINS/(hi - lo);
+            for(int i = first; i < first + count; ++i) {
+                int b = std::min(BINS - 1, static_cast<int>((axisValue(leaves[i].centroid, axis) - lo)*scale));
+                binBounds[b] = binBounds[b].enlarge(leaves[i].bounds);
+                ++binCounts[b];
+            }
+
+            // Sweep from the right, then from the left, evaluating each split
+            double rightArea[BINS];
+            int rightCount[BINS];
+            box3d acc;
+            int n = 0;
+            for(int b = BINS - 1; b > 0; --b) {
+                acc = acc.enlarge(binBounds[b]);
+                n += binCounts[b];
+                rightArea[b] = acc.area();
+                rightCount[b] = n;
+            }
+
+            acc = box3d();
+            n = 0;
+            for(int b = 0; b < BINS - 1; ++b) {
+                acc = acc.enlarge(binBounds[b]);
+                n += binCounts[b];
+                if(n == 0 || rightCount[b + 1] == 0)
+                    continue;
+
+                double c = TRAVERSAL_COST + (acc.area()*n + rightArea[b + 1]*rightCount[b + 1])/area;
+                if(c < bestCost) {
+                    bestCost = c;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        int mid = count/2;
+        if(bestAxis >= 0) {
+            double lo = axisMin(centroids, bestAxis);
+            double scale = BINS/(axisMax(centroids, bestAxis) - lo);
+            auto it = std::partition(leaves.begin() + first, leaves.begin() + first + count,
+                    [=](const Leaf& l) {
+                        return std::min(BINS - 1, static_cast<int>((axisValue(l.centroid, bestAxis) - lo)*scale)) <= bestBin;
+                    });
+            mid = static_cast<int>(it - (leaves.begin() + first));
+        }
+        // All centroids equal: split in the middle
+
+        split(first, mid);
+        int right = split(first + mid, count - mid);
+        nodes[index].right = right;
+
+        return index;
+    }
+
+    bool BoundingVolumeHierarchy::isOutdated(const SceneNode& root) const {
+        return this->root != &root || structureVersion != root.getStructureVersion();
+    }
+
+    bool BoundingVolumeHierarchy::refit() {
+        bool changed = false;
+        for(Leaf& l : leaves) {
+            unsigned int version = l.node->getWorldVersion();
+            if(version != l.version) {
+                l.version = version;
+                l.bounds = l.node->getLocalToWorld()*l.node->getLocalBounds();
+                l.centroid = l.bounds.center();
+                changed = true;
+            }
+        }
+
+        if(changed) {
+            // Children are stored after their parents
+            for(int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i)
+                updateBounds(i);
+
+            cost = computeCost();
+        }
+
+        return cost <= rebuildRatio*buildCost;
+    }
+
+    void BoundingVolumeHierarchy::updateBounds(int index) {
+        Node& n = nodes[index];
+        if(n.right < 0) {
+            box3d bounds;
+            for(int i = n.first; i < n.first + n.count; ++i)
+                bounds = bounds.enlarge(leaves[i].bounds);
+            n.bounds = bounds;
+        } else {
+            n.bounds = nodes[index + 1].bounds.enlarge(nodes[n.right].bounds);
+        }
+    }
+
+    double BoundingVolumeHierarchy::computeCost() const {
+        if(nodes.empty())
+            return 0.0;
+
+        double rootArea = std::max(nodes[0].bounds.area(), 1e-12);
+        double sum = 0.0;
+        for(const Node& n : nodes) {
+            if(n.right < 0)
+                sum += n.bounds.area()*n.count;
+            else
+                sum += n.bounds.area()*TRAVERSAL_COST;
+        }
+        return sum/rootArea;
+    }
+
+    void BoundingVolumeHierarchy::computeVisibility(const Frustum& frustum) {
+        for(SceneNode* node : visibleNodes)
+            node->isVisible(false);
+        visibleNodes.clear();
+
+        testedNodes = 0;
+        if(!nodes.empty())
+            visit(0, frustum, Frustum::ALL_PLANES);
+
+        // In reverse, so parents are set before their children
+        for(auto it = unbounded.rbegin(); it != unbounded.rend(); ++it) {
+            SceneNode* node = *it;
+            if(node->getParent()->isVisible()) {
+                node->isVisible(true);
+                visibleNodes.push_back(node);
+            }
+        }
+    }
+
+    void BoundingVolumeHierarchy::visit(int index, const Frustum& frustum, unsigned int planeMask) {
+        Node& n = nodes[index];
+
+        ++testedNodes;
+        Visibility v = frustum.getVisibility(n.bounds, planeMask, n.lastPlane);
+        if(v == INVISIBLE)
+            return;
+
+        if(v == FULLY_VISIBLE) {
+            // No need to test anything below
+            for(int i = n.first; i < n.first + n.count; ++i)
+                markVisible(leaves[i].node);
+        } else if(n.right < 0) {
+            for(int i = n.first; i < n.first + n.count; ++i) {
+                Leaf& l = leaves[i];
+                unsigned int mask = planeMask;
+                if(n.count == 1 || frustum.getVisibility(l.bounds, mask, l.lastPlane) != INVISIBLE)
+                    markVisible(l.node);
+            }
+        } else {
+            visit(index + 1, frustum, planeMask);
+            visit(n.right, frustum, planeMask);
+        }
+    }
+
+    void BoundingVolumeHierarchy::markVisible(SceneNode* node) {
+        // Stop at the first ancestor already visible
+        for(SceneNode* n = node; n != nullptr && !n->isVisible(); n = n->getParent()) {
+            n->isVisible(true);
+            visibleNodes.push_back(n);
+            if(n == root)
+                break;
+        }
+    }
+
+    double BoundingVolumeHierarchy::getCost() const {
+        return cost;
+    }
+
+    double BoundingVolumeHierarchy::getBuildCost() const {
+        return buildCost;
+    }
+
+    void BoundingVolumeHierarchy::setRebuildRatio(double ratio) {
+        rebuildRatio = ratio;
+    }
+
+    double BoundingVolumeHierarchy::getRebuildRatio() const {
+        return rebuildRatio;
+    }
+
+    unsigned int BoundingVolumeHierarchy::getLeafCount() const {
+        return leaves.size();
+    }
+
+    unsigned int BoundingVolumeHierarchy::getNodeCount() const {
+        return nodes.size();
+    }
+
+    unsigned int BoundingVolumeHierarchy::getTestedNodeCount() const {
+        return testedNodes;
+    }
+
+}
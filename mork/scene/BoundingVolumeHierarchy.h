@@ -0,0 +1,125 @@
+#ifndef _MORK_BOUNDINGVOLUMEHIERARCHY_H_
+#define _MORK_BOUNDINGVOLUMEHIERARCHY_H_
+
+#include <vector>
+
+#include "mork/math/box3.h"
+#include "mork/math/vec3.h"
+#include "mork/scene/Frustum.h"
+
+namespace mork {
+
+    class SceneNode;
+
+    // A spatial bounding volume hierarchy over the nodes of a scene that have bounds
+    // of their own (e.g. the nodes of a Model holding meshes), as opposed to the
+    // union of their children used by the logical hierarchy. Nodes without any
+    // bounds in their subtree, e.g. lights and empty transform nodes, are not in
+    // the tree, and are visible whenever their parent is.
+    //
+    // The tree is built with a binned surface area heuristic, and refitted when the
+    // world transforms/bounds of the nodes change. Refitting degrades the tree over
+    // time, so it should be rebuilt when the cost grows too much compared to the
+    // cost when it was built.
+    class BoundingVolumeHierarchy {
+        public:
+            BoundingVolumeHierarchy();
+
+            BoundingVolumeHierarchy(const BoundingVolumeHierarchy&) = delete;
+            BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&) = delete;
+
+            // Builds the tree over all nodes with local bounds in the hierarchy below
+            // (and including) root. All nodes in the hierarchy are set invisible.
+            void build(SceneNode& root);
+
+            // Forgets the nodes of the tree, e.g. when they have moved to another
+            // address. The tree must be built again before next refit.
+            void clear();
+
+            // Returns true if the structure of the hierarchy has changed since the tree
+            // was built, and it must be rebuilt before next refit
+            bool isOutdated(const SceneNode& root) const;
+
+            // Updates the boxes of nodes with changed world transform or bounds, and
+            // refits the tree. Returns false if the cost of the refitted tree exceeds
+            // the cost when built by more than the rebuild ratio.
+            bool refit();
+
+            // Sets the visibility of all nodes in the hierarchy: a node is visible if its
+            // own bounds are inside the frustum, or if any of its descendants are. Nodes
+            // without bounds in their subtree are visible with their parent.
+            // Only the nodes visible after the last call are reset.
+            void computeVisibility(const Frustum& frustum);
+
+            // The surface area heuristic cost of the tree, now and when it was built
+            double getCost() const;
+            double getBuildCost() const;
+
+            void    setRebuildRatio(double ratio);
+            double  getRebuildRatio() const;
+
+            unsigned int getLeafCount() const;
+            unsigned int getNodeCount() const;
+
+            // Returns the number of tree nodes tested against the frustum in the last
+            // call to computeVisibility
+            unsigned int getTestedNodeCount() const;
+
+        private:
+            // Tree nodes are stored in depth first order: the left child of an inner
+            // node follows directly after it. Leaf nodes have right < 0. The leaves
+            // below any tree node are the range [first, first + count) of leaves.
+            struct Node {
+                box3d   bounds;
+                int     right;
+                int     first;
+                int     count;
+                int     lastPlane;
+            };
+
+            struct Leaf {
+                SceneNode*      node;
+                box3d           bounds;
+                vec3d           centroid;
+                unsigned int    version;
+                int             lastPlane;
+            };
+
+            // Returns true if any node in the subtree of node has local bounds
+            bool collect(SceneNode& node);
+
+            int split(int first, int count);
+
+            void updateBounds(int index);
+
+            double computeCost() const;
+
+            // Tests the tree node at index against the planes in planeMask, the parent is
+            // fully inside the others
+            void visit(int index, const Frustum& frustum, unsigned int planeMask);
+
+            // Sets node and its ancestors visible
+            void markVisible(SceneNode* node);
+
+            const SceneNode*        root;
+            unsigned int            structureVersion;
+
+            std::vector<Node>       nodes;
+            std::vector<Leaf>       leaves;
+
+            // The nodes without bounds in their subtree, descendants before ancestors
+            std::vector<SceneNode*> unbounded;
+
+            // The scene nodes set visible by the last computeVisibility
+            std::vector<SceneNode*> visibleNodes;
+
+            double                  cost;
+            double                  buildCost;
+            double                  rebuildRatio;
+
+            unsigned int            testedNodes;
+    };
+
+}
+
+#endif
@@ -296,8 +296,8 @@ namespace mork {
 
     }
     
-    void    Camera::updateLocalToWorld(const mat4d& parentLocalToWorld) {
-        SceneNode::updateLocalToWorld(parentLocalToWorld);
+    unsigned int Camera::updateLocalToWorld(const mat4d& parentLocalToWorld) {
+        return SceneNode::updateLocalToWorld(parentLocalToWorld);
     }
 
 
@@ -93,7 +93,7 @@ namespace mork {
 
             // This is hidde so that cameras cannot be made children of other nodes. 
             // Cameras use their reference nodes to calculate global position, if it exist.           
-            virtual void    updateLocalToWorld(const mat4d& parentLocalToWorld);
+            virtual unsigned int updateLocalToWorld(const mat4d& parentLocalToWorld);
 
 
 
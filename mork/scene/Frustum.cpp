@@ -1,7 +1,225 @@
 #include "Frustum.h"
+#include "mork/core/Log.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MORK_FRUSTUM_X86
+#include <immintrin.h>
+#endif
 
 namespace mork {
 
+// Number of planes tested for bounding boxes
+static const int BOX_PLANES = 6;
+
+// A plane in single precision, with the box arrays giving its p-vertex (the corner
+// furthest along the plane normal) and n-vertex (the opposite corner) selected
+// up front. This keeps the inner loops free of per box selects.
+struct BatchPlane {
+    float x, y, z, w;
+    const float *px, *py, *pz;
+    const float *nx, *ny, *nz;
+};
+
+static void setupPlanes(const vec4d* planes, const BoxArrays& boxes, BatchPlane* out) {
+    for(int i = 0; i < BOX_PLANES; ++i) {
+        const vec4d& p = planes[i];
+        BatchPlane& b = out[i];
+        b.x = static_cast<float>(p.x);
+        b.y = static_cast<float>(p.y);
+        b.z = static_cast<float>(p.z);
+        b.w = static_cast<float>(p.w);
+        b.px = b.x > 0 ? boxes.xmax.data() : boxes.xmin.data();
+        b.nx = b.x > 0 ? boxes.xmin.data() : boxes.xmax.data();
+        b.py = b.y > 0 ? boxes.ymax.data() : boxes.ymin.data();
+        b.ny = b.y > 0 ? boxes.ymin.data() : boxes.ymax.data();
+        b.pz = b.z > 0 ? boxes.zmax.data() : boxes.zmin.data();
+        b.nz = b.z > 0 ? boxes.zmin.data() : boxes.zmax.data();
+    }
+}
+
+// Scalar reference. All the versions evaluate the plane distances with the same
+// operations in the same order, so they give identical results.
+__attribute__((optimize("fp-contract=off")))
+static void visibilityScalar(const BatchPlane* planes, std::size_t begin, std::size_t end, Visibility* result) {
+    for(std::size_t i = begin; i < end; ++i) {
+        bool invisible = false;
+        bool fully = true;
+        for(int j = 0; j < BOX_PLANES; ++j) {
+            const BatchPlane& p = planes[j];
+            float dp = p.x*p.px[i] + p.y*p.py[i] + p.z*p.pz[i] + p.w;
+            float dn = p.x*p.nx[i] + p.y*p.ny[i] + p.z*p.nz[i] + p.w;
+            invisible = invisible || dp <= 0;
+            fully = fully && dn > 0;
+        }
+        result[i] = invisible ? INVISIBLE : (fully ? FULLY_VISIBLE : PARTIALLY_VISIBLE);
+    }
+}
+
+#ifdef MORK_FRUSTUM_X86
+
+static_assert(sizeof(Visibility) == sizeof(int), "Visibility must be stored as 32 bit integers");
+static_assert(FULLY_VISIBLE == 0 && PARTIALLY_VISIBLE == 1 && INVISIBLE == 2, "Unexpected Visibility values");
+
+// The versions below return the number of boxes processed, the rest is left for
+// the scalar version. Contraction into fused multiply-add (enabled by AVX-512) is
+// turned off, as it would change the rounding compared to the scalar version.
+__attribute__((target("sse2"), optimize("fp-contract=off")))
+static std::size_t visibilitySSE(const BatchPlane* planes, std::size_t count, Visibility* result) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i partial = _mm_set1_epi32(PARTIALLY_VISIBLE);
+    const __m128i invisibleValue = _mm_set1_epi32(INVISIBLE);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128 invisible = _mm_setzero_ps();
+        __m128 fully = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int j = 0; j < BOX_PLANES; ++j) {
+            const BatchPlane& p = planes[j];
+            const __m128 x = _mm_set1_ps(p.x), y = _mm_set1_ps(p.y), z = _mm_set1_ps(p.z), w = _mm_set1_ps(p.w);
+            __m128 dp = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_loadu_ps(p.px + i)),
+                            _mm_mul_ps(y, _mm_loadu_ps(p.py + i))), _mm_mul_ps(z, _mm_loadu_ps(p.pz + i))), w);
+            __m128 dn = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_loadu_ps(p.nx + i)),
+                            _mm_mul_ps(y, _mm_loadu_ps(p.ny + i))), _mm_mul_ps(z, _mm_loadu_ps(p.nz + i))), w);
+            invisible = _mm_or_ps(invisible, _mm_cmple_ps(dp, zero));
+            fully = _mm_and_ps(fully, _mm_cmpgt_ps(dn, zero));
+        }
+        // INVISIBLE if any plane rejects, else FULLY_VISIBLE (0) or PARTIALLY_VISIBLE
+        __m128i inv = _mm_castps_si128(invisible);
+        __m128i r = _mm_andnot_si128(_mm_castps_si128(fully), partial);
+        r = _mm_or_si128(_mm_andnot_si128(inv, r), _mm_and_si128(inv, invisibleValue));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+static std::size_t visibilityAVX2(const BatchPlane* planes, std::size_t count, Visibility* result) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i partial = _mm256_set1_epi32(PARTIALLY_VISIBLE);
+    const __m256i invisibleValue = _mm256_set1_epi32(INVISIBLE);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256 invisible = _mm256_setzero_ps();
+        __m256 fully = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int j = 0; j < BOX_PLANES; ++j) {
+            const BatchPlane& p = planes[j];
+            const __m256 x = _mm256_set1_ps(p.x), y = _mm256_set1_ps(p.y), z = _mm256_set1_ps(p.z), w = _mm256_set1_ps(p.w);
+            __m256 dp = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_loadu_ps(p.px + i)),
+                            _mm256_mul_ps(y, _mm256_loadu_ps(p.py + i))), _mm256_mul_ps(z, _mm256_loadu_ps(p.pz + i))), w);
+            __m256 dn = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_loadu_ps(p.nx + i)),
+                            _mm256_mul_ps(y, _mm256_loadu_ps(p.ny + i))), _mm256_mul_ps(z, _mm256_loadu_ps(p.nz + i))), w);
+            invisible = _mm256_or_ps(invisible, _mm256_cmp_ps(dp, zero, _CMP_LE_OQ));
+            fully = _mm256_and_ps(fully, _mm256_cmp_ps(dn, zero, _CMP_GT_OQ));
+        }
+        __m256i inv = _mm256_castps_si256(invisible);
+        __m256i r = _mm256_andnot_si256(_mm256_castps_si256(fully), partial);
+        r = _mm256_or_si256(_mm256_andnot_si256(inv, r), _mm256_and_si256(inv, invisibleValue));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i), r);
+    }
+    return i;
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static std::size_t visibilityAVX512(const BatchPlane* planes, std::size_t count, Visibility* result) {
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512i fullyValue = _mm512_set1_epi32(FULLY_VISIBLE);
+    const __m512i partial = _mm512_set1_epi32(PARTIALLY_VISIBLE);
+    const __m512i invisibleValue = _mm512_set1_epi32(INVISIBLE);
+
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __mmask16 invisible = 0;
+        __mmask16 fully = 0xffff;
+        for(int j = 0; j < BOX_PLANES; ++j) {
+            const BatchPlane& p = planes[j];
+            const __m512 x = _mm512_set1_ps(p.x), y = _mm512_set1_ps(p.y), z = _mm512_set1_ps(p.z), w = _mm512_set1_ps(p.w);
+            __m512 dp = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, _mm512_loadu_ps(p.px + i)),
+                            _mm512_mul_ps(y, _mm512_loadu_ps(p.py + i))), _mm512_mul_ps(z, _mm512_loadu_ps(p.pz + i))), w);
+            __m512 dn = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, _mm512_loadu_ps(p.nx + i)),
+                            _mm512_mul_ps(y, _mm512_loadu_ps(p.ny + i))), _mm512_mul_ps(z, _mm512_loadu_ps(p.nz + i))), w);
+            invisible |= _mm512_cmp_ps_mask(dp, zero, _CMP_LE_OQ);
+            fully &= _mm512_cmp_ps_mask(dn, zero, _CMP_GT_OQ);
+        }
+        __m512i r = _mm512_mask_blend_epi32(fully, partial, fullyValue);
+        r = _mm512_mask_blend_epi32(invisible, r, invisibleValue);
+        _mm512_storeu_si512(result + i, r);
+    }
+    return i;
+}
+
+#endif
+
+void BoxArrays::push_back(const box3d& bb) {
+    xmin.push_back(static_cast<float>(bb.xmin));
+    xmax.push_back(static_cast<float>(bb.xmax));
+    ymin.push_back(static_cast<float>(bb.ymin));
+    ymax.push_back(static_cast<float>(bb.ymax));
+    zmin.push_back(static_cast<float>(bb.zmin));
+    zmax.push_back(static_cast<float>(bb.zmax));
+}
+
+void BoxArrays::clear() {
+    xmin.clear();
+    xmax.clear();
+    ymin.clear();
+    ymax.clear();
+    zmin.clear();
+    zmax.clear();
+}
+
+std::size_t BoxArrays::size() const {
+    return xmin.size();
+}
+
+Frustum::Simd Frustum::getSimdLevel() {
+#ifdef MORK_FRUSTUM_X86
+    static const Simd level = __builtin_cpu_supports("avx512f") ? AVX512 :
+        (__builtin_cpu_supports("avx2") ? AVX2 :
+         (__builtin_cpu_supports("sse2") ? SSE : SCALAR));
+    return level;
+#else
+    return SCALAR;
+#endif
+}
+
+void Frustum::getVisibility(const BoxArrays& boxes, Visibility* result) const {
+    getVisibility(boxes, result, getSimdLevel());
+}
+
+void Frustum::getVisibility(const BoxArrays& boxes, Visibility* result, Simd simd) const {
+    if(simd > getSimdLevel()) {
+        error_logger("Instruction set ", simd, " requested for frustum culling is not supported by this cpu");
+        throw std::runtime_error(error_logger.last());
+    }
+
+    BatchPlane planes[BOX_PLANES];
+    setupPlanes(frustumPlanes, boxes, planes);
+
+    const std::size_t count = boxes.size();
+    std::size_t done = 0;
+#ifdef MORK_FRUSTUM_X86
+    switch(simd) {
+        case AVX512:
+            done = visibilityAVX512(planes, count, result);
+            break;
+        case AVX2:
+            done = visibilityAVX2(planes, count, result);
+            break;
+        case SSE:
+            done = visibilitySSE(planes, count, result);
+            break;
+        default:
+            break;
+    }
+#endif
+    // The remainder, or all if no simd
+    visibilityScalar(planes, done, count, result);
+}
+
 void Frustum::setPlanes(const mat4d& toScreen) {
 
     const double *m = toScreen.coefficients();
@@ -59,6 +277,10 @@ bool Frustum::isInside(const vec3d& point) const {
     if (v4 == INVISIBLE) {
             return false;
     }
+    Visibility v5 = getVisibility(point, frustumPlanes[5]);
+    if (v5 == INVISIBLE) {
+            return false;
+    }
 
 /*    if (v0 == FULLY_VISIBLE && v1 == FULLY_VISIBLE &&
                 v2 == FULLY_VISIBLE && v3 == FULLY_VISIBLE &&
@@ -70,6 +292,21 @@ bool Frustum::isInside(const vec3d& point) const {
    return true;
 }
 
+// Returns the visibility of a bounding sphere
+Visibility Frustum::getVisibility(const vec3d& center, double radius) const {
+    bool fully = true;
+    for(int i = 0; i < BOX_PLANES; ++i) {
+        const vec4d& p = frustumPlanes[i];
+        // The planes are not normalized, so the radius is scaled instead
+        double d = p.x*center.x + p.y*center.y + p.z*center.z + p.w;
+        double r = radius*sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+        if(d <= -r)
+            return INVISIBLE;
+        fully = fully && d > r;
+    }
+    return fully ? FULLY_VISIBLE : PARTIALLY_VISIBLE;
+}
+
 // Returns the visibility of a bounding box
 Visibility Frustum::getVisibility(const box3d& bb) const {
 
@@ -93,15 +330,49 @@ Visibility Frustum::getVisibility(const box3d& bb) const {
     if (v4 == INVISIBLE) {
             return INVISIBLE;
     }
+    Visibility v5 = getVisibility(bb, frustumPlanes[5]);
+    if (v5 == INVISIBLE) {
+            return INVISIBLE;
+    }
     if (v0 == FULLY_VISIBLE && v1 == FULLY_VISIBLE &&
                 v2 == FULLY_VISIBLE && v3 == FULLY_VISIBLE &&
-                    v4 == FULLY_VISIBLE)
+                    v4 == FULLY_VISIBLE && v5 == FULLY_VISIBLE)
     {
             return FULLY_VISIBLE;
     }
     return PARTIALLY_VISIBLE;
 }
 
+Visibility Frustum::getVisibility(const box3d& bb, unsigned int& planeMask, int& lastPlane) const {
+    // With high frame to frame coherence, the plane rejecting the box last time
+    // is likely to reject it again
+    if (lastPlane >= 0 && (planeMask & (1u << lastPlane))) {
+        Visibility v = getVisibility(bb, frustumPlanes[lastPlane]);
+        if (v == INVISIBLE) {
+            return INVISIBLE;
+        }
+        if (v == FULLY_VISIBLE) {
+            planeMask &= ~(1u << lastPlane);
+        }
+    }
+
+    for (int i = 0; i < 6; ++i) {
+        unsigned int bit = 1u << i;
+        if (!(planeMask & bit) || i == lastPlane) {
+            continue;
+        }
+        Visibility v = getVisibility(bb, frustumPlanes[i]);
+        if (v == INVISIBLE) {
+            lastPlane = i;
+            return INVISIBLE;
+        }
+        if (v == FULLY_VISIBLE) {
+            planeMask &= ~bit;
+        }
+    }
+    return planeMask == 0 ? FULLY_VISIBLE : PARTIALLY_VISIBLE;
+}
+
 Visibility Frustum::getVisibility(const box3d& bb, const vec4d& plane) const {
     double x0 = bb.xmin * plane.x;
     double x1 = bb.xmax * plane.x;
@@ -1,8 +1,12 @@
 #ifndef _MORK_FRUSTUM_H_
 #define _MORK_FRUSTUM_H_
 
+#include <vector>
+#include <cstddef>
+
 #include <mork/math/vec4.h>
 #include <mork/math/mat4.h>
+#include <mork/math/box3.h>
 
 namespace mork {
 
@@ -16,9 +20,32 @@ namespace mork {
     };
 
 
+    // Bounding boxes in structure of arrays layout, for batched visibility tests
+    struct BoxArrays {
+        std::vector<float> xmin, xmax, ymin, ymax, zmin, zmax;
+
+        void        push_back(const box3d& bb);
+        void        clear();
+        std::size_t size() const;
+    };
+
     class Frustum {
             
         public:
+            // Instruction sets for the batched visibility tests
+            enum Simd {
+                SCALAR,
+                SSE,
+                AVX2,
+                AVX512
+            };
+
+            // Returns the best instruction set supported by this cpu
+            static Simd getSimdLevel();
+
+            // Plane mask with all six planes (left, right, bottom, top, near, far)
+            static const unsigned int ALL_PLANES = 0x3f;
+
             void setPlanes(const mat4d& toScreen);
 
             // Returns wether a point is inside this frustum
@@ -27,6 +54,25 @@ namespace mork {
             // Returns the visibility of a bounding box
             Visibility getVisibility(const box3d& bb) const;
 
+            // Returns the visibility of a bounding sphere
+            Visibility getVisibility(const vec3d& center, double radius) const;
+
+            // Returns the visibility of a bounding box, testing only the planes in
+            // planeMask (bit i for plane i). Planes the box is fully inside are cleared
+            // from planeMask, so boxes contained in this box can skip them.
+            // lastPlane is the plane that rejected the box in a previous test (-1 if
+            // none), which is tested first, and is updated if the box is rejected.
+            Visibility getVisibility(const box3d& bb, unsigned int& planeMask, int& lastPlane) const;
+
+            // Returns the visibility of all the given boxes in result, which must hold
+            // boxes.size() elements. Boxes are tested 4/8/16 at a time with the best
+            // instruction set supported by this cpu, in single precision.
+            void getVisibility(const BoxArrays& boxes, Visibility* result) const;
+
+            // As above, with the given instruction set. SCALAR gives the reference
+            // implementation, the others give identical results where supported.
+            void getVisibility(const BoxArrays& boxes, Visibility* result, Simd simd) const;
+
         private:
 
 			// Returns the visibility of a bb compared to one plane
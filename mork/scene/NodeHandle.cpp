@@ -0,0 +1,66 @@
+#include "mork/scene/NodeHandle.h"
+
+namespace mork {
+
+    NodeRegistry::NodeRegistry() : firstFree(NONE), live(0) {}
+
+    NodeHandle NodeRegistry::acquire(SceneNode* node) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        unsigned int index;
+        if(firstFree != NONE) {
+            index = firstFree;
+            firstFree = slots[index].nextFree;
+        } else {
+            index = slots.size();
+            slots.push_back({nullptr, 1, NONE});
+        }
+
+        Slot& slot = slots[index];
+        slot.node = node;
+        slot.nextFree = NONE;
+        ++live;
+        return NodeHandle(index, slot.generation);
+    }
+
+    void NodeRegistry::release(const NodeHandle& handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(handle.isNull() || handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+            return;
+
+        Slot& slot = slots[handle.index];
+        slot.node = nullptr;
+        // Generation 0 is reserved for null handles
+        if(++slot.generation == 0)
+            slot.generation = 1;
+        slot.nextFree = firstFree;
+        firstFree = handle.index;
+        --live;
+    }
+
+    void NodeRegistry::rebind(const NodeHandle& handle, SceneNode* node) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(handle.isNull() || handle.index >= slots.size() || slots[handle.index].generation != handle.generation)
+            return;
+
+        slots[handle.index].node = node;
+    }
+
+    SceneNode* NodeRegistry::get(const NodeHandle& handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(handle.isNull() || handle.index >= slots.size())
+            return nullptr;
+
+        const Slot& slot = slots[handle.index];
+        return slot.generation == handle.generation ? slot.node : nullptr;
+    }
+
+    unsigned int NodeRegistry::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return live;
+    }
+
+}
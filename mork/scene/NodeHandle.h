@@ -0,0 +1,83 @@
+#ifndef _MORK_NODEHANDLE_H_
+#define _MORK_NODEHANDLE_H_
+
+#include <vector>
+#include <mutex>
+
+namespace mork {
+
+    class SceneNode;
+
+    // A weak reference to a SceneNode: an index into the node registry, and the
+    // generation of the slot when the handle was made. Slots get a new generation
+    // when their node is destroyed, so handles to destroyed nodes are detected
+    // even if the slot has been reused.
+    struct NodeHandle {
+        unsigned int index;
+        unsigned int generation;
+
+        // A null handle, never referring to any node
+        NodeHandle() : index(0), generation(0) {}
+        NodeHandle(unsigned int index, unsigned int generation) : index(index), generation(generation) {}
+
+        bool isNull() const {
+            return generation == 0;
+        }
+
+        bool operator==(const NodeHandle& o) const {
+            return index == o.index && generation == o.generation;
+        }
+
+        bool operator!=(const NodeHandle& o) const {
+            return !(*this == o);
+        }
+    };
+
+    // The global table of live scene nodes by handle. Each SceneNode holds a slot
+    // for its lifetime, so handles can be resolved in O(1).
+    class NodeRegistry {
+        public:
+            static NodeRegistry& getInstance() {
+                static NodeRegistry registry;
+                return registry;
+            }
+
+            NodeRegistry(const NodeRegistry&) = delete;
+            void operator=(const NodeRegistry&) = delete;
+
+            // Returns a handle to a new slot referring to node
+            NodeHandle acquire(SceneNode* node);
+
+            // Frees the slot of handle, so all handles to it dangle
+            void release(const NodeHandle& handle);
+
+            // Makes the slot of handle refer to another node (when nodes are moved)
+            void rebind(const NodeHandle& handle, SceneNode* node);
+
+            // Returns the node of handle, or nullptr if the handle is null or dangling
+            SceneNode* get(const NodeHandle& handle) const;
+
+            // Returns the number of live slots
+            unsigned int size() const;
+
+        private:
+            NodeRegistry();
+
+            static const unsigned int NONE = ~0u;
+
+            struct Slot {
+                SceneNode*      node;
+                unsigned int    generation;
+                // Next slot in the free list, if free
+                unsigned int    nextFree;
+            };
+
+            mutable std::mutex  mutex;
+            std::vector<Slot>   slots;
+            unsigned int        firstFree;
+            unsigned int        live;
+    };
+
+}
+
+#endif
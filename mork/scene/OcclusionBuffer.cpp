@@ -0,0 +1,354 @@
+#include "mork/scene/OcclusionBuffer.h"
+#include "mork/util/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MORK_OCCLUSION_X86
+#include <immintrin.h>
+#endif
+
+namespace mork {
+
+// Number of pixel rows rasterized by one job
+static const int BAND_HEIGHT = 8;
+
+// Margin for an occludee to be considered behind an occluder, so that occluders
+// coinciding with the bounds of their own node do not hide it through rounding
+static const float DEPTH_BIAS = 1e-5f;
+
+OcclusionBuffer::OcclusionBuffer(int width, int height)
+    :   width((std::max(width, 4) + 3) & ~3),
+        height(std::max(height, 1)),
+        viewProjection(mat4d::IDENTITY) {
+
+    // Set up the hierarchy, down to a single texel
+    int w = this->width;
+    int h = this->height;
+    while(true) {
+        levelWidths.push_back(w);
+        levelHeights.push_back(h);
+        minDepths.push_back(std::vector<float>(w*h, 1.0f));
+        maxDepths.push_back(std::vector<float>(w*h, 1.0f));
+        if(w == 1 && h == 1)
+            break;
+        w = (w + 1)/2;
+        h = (h + 1)/2;
+    }
+
+    bins.resize((this->height + BAND_HEIGHT - 1)/BAND_HEIGHT);
+}
+
+int OcclusionBuffer::getWidth() const {
+    return width;
+}
+
+int OcclusionBuffer::getHeight() const {
+    return height;
+}
+
+void OcclusionBuffer::begin(const mat4d& viewProjection) {
+    this->viewProjection = viewProjection;
+    triangles.clear();
+}
+
+void OcclusionBuffer::addOccluder(const std::vector<vec3f>& vertices, const std::vector<unsigned int>& indices,
+        const mat4d& localToWorld) {
+    mat4d m = viewProjection*localToWorld;
+
+    std::vector<vec4d> clip(vertices.size());
+    for(std::size_t i = 0; i < vertices.size(); ++i)
+        clip[i] = m*vec4d(vertices[i].cast<double>(), 1.0);
+
+    for(std::size_t i = 0; i + 2 < indices.size(); i += 3)
+        setupTriangle(clip[indices[i]], clip[indices[i+1]], clip[indices[i+2]]);
+}
+
+void OcclusionBuffer::addOccluder(const box3d& box, const mat4d& localToWorld) {
+    std::vector<vec3f> vertices;
+    for(int i = 0; i < 8; ++i)
+        vertices.push_back(vec3d(i & 1 ? box.xmax : box.xmin, i & 2 ? box.ymax : box.ymin,
+                    i & 4 ? box.zmax : box.zmin).cast<float>());
+
+    // Two triangles per face, both sides are rasterized so winding does not matter
+    static const std::vector<unsigned int> indices = {
+        0, 2, 3, 0, 3, 1,   4, 5, 7, 4, 7, 6,
+        0, 1, 5, 0, 5, 4,   2, 6, 7, 2, 7, 3,
+        0, 4, 6, 0, 6, 2,   1, 3, 7, 1, 7, 5
+    };
+
+    addOccluder(vertices, indices, localToWorld);
+}
+
+__attribute__((optimize("fp-contract=off")))
+void OcclusionBuffer::setupTriangle(const vec4d& v0, const vec4d& v1, const vec4d& v2) {
+    // Skip triangles crossing the near plane instead of clipping them. This only
+    // loses occlusion, never makes it wrong.
+    const vec4d* v[3] = {&v0, &v1, &v2};
+    for(int i = 0; i < 3; ++i) {
+        if(v[i]->w <= 0.0 || v[i]->z < -v[i]->w)
+            return;
+    }
+
+    // To pixel coordinates and window depth
+    double x[3], y[3], z[3];
+    for(int i = 0; i < 3; ++i) {
+        x[i] = (v[i]->x/v[i]->w*0.5 + 0.5)*width;
+        y[i] = (v[i]->y/v[i]->w*0.5 + 0.5)*height;
+        z[i] = v[i]->z/v[i]->w*0.5 + 0.5;
+    }
+
+    double area = (x[1] - x[0])*(y[2] - y[0]) - (x[2] - x[0])*(y[1] - y[0]);
+    if(area == 0.0)
+        return;
+    if(area < 0.0) {
+        // Make counter clockwise
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    Triangle t;
+    t.xmin = std::max(0, static_cast<int>(std::floor(std::min({x[0], x[1], x[2]}))));
+    t.xmax = std::min(width - 1, static_cast<int>(std::floor(std::max({x[0], x[1], x[2]}))));
+    t.ymin = std::max(0, static_cast<int>(std::floor(std::min({y[0], y[1], y[2]}))));
+    t.ymax = std::min(height - 1, static_cast<int>(std::floor(std::max({y[0], y[1], y[2]}))));
+    if(t.xmin > t.xmax || t.ymin > t.ymax)
+        return;
+
+    for(int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        double a = y[i] - y[j];
+        double b = x[j] - x[i];
+        t.a[i] = static_cast<float>(a);
+        t.b[i] = static_cast<float>(b);
+        t.c[i] = static_cast<float>(-(a*x[i] + b*y[i]));
+    }
+
+    double dzdx = ((z[1] - z[0])*(y[2] - y[0]) - (z[2] - z[0])*(y[1] - y[0]))/area;
+    double dzdy = ((z[2] - z[0])*(x[1] - x[0]) - (z[1] - z[0])*(x[2] - x[0]))/area;
+    t.dzdx = static_cast<float>(dzdx);
+    t.dzdy = static_cast<float>(dzdy);
+    t.z0 = static_cast<float>(z[0] - dzdx*x[0] - dzdy*y[0]);
+
+    triangles.push_back(t);
+}
+
+void OcclusionBuffer::rasterize(ThreadPool* pool) {
+    rasterize(pool, Frustum::getSimdLevel());
+}
+
+void OcclusionBuffer::rasterize(ThreadPool* pool, Frustum::Simd simd) {
+    std::fill(maxDepths[0].begin(), maxDepths[0].end(), 1.0f);
+
+    // Bin the triangles to the bands they overlap, so bands can be rasterized independently
+    for(auto& bin : bins)
+        bin.clear();
+    for(unsigned int i = 0; i < triangles.size(); ++i) {
+        const Triangle& t = triangles[i];
+        for(int band = t.ymin/BAND_HEIGHT; band <= t.ymax/BAND_HEIGHT; ++band)
+            bins[band].push_back(i);
+    }
+
+    if(pool && pool->size() > 1) {
+        std::size_t grain = triangles.size()/(2*pool->size()) + 1;
+        pool->runWeighted(bins.size(), grain,
+                [this](std::size_t band) { return bins[band].size() + 1; },
+                [this, simd](std::size_t band) { rasterizeBand(band, simd); });
+    } else {
+        for(std::size_t band = 0; band < bins.size(); ++band)
+            rasterizeBand(band, simd);
+    }
+
+    buildHierarchy();
+}
+
+// Pixels are covered when their center is inside all three edges. The SIMD version
+// evaluates the edge functions and depth with the same operations in the same order
+// as the scalar one, so they give identical buffers.
+__attribute__((optimize("fp-contract=off")))
+static void rasterizeRowScalar(const float* a, const float* b, const float* c, float z0, float dzdx, float dzdy,
+        int xmin, int xmax, float py, float* row) {
+    for(int x = xmin; x <= xmax; ++x) {
+        float px = x + 0.5f;
+        float e0 = a[0]*px + b[0]*py + c[0];
+        float e1 = a[1]*px + b[1]*py + c[1];
+        float e2 = a[2]*px + b[2]*py + c[2];
+        if(e0 >= 0 && e1 >= 0 && e2 >= 0) {
+            float z = z0 + dzdx*px + dzdy*py;
+            row[x] = std::min(row[x], z);
+        }
+    }
+}
+
+#ifdef MORK_OCCLUSION_X86
+__attribute__((target("sse2"), optimize("fp-contract=off")))
+static void rasterizeRowSse(const float* a, const float* b, const float* c, float z0, float dzdx, float dzdy,
+        int xmin, int xmax, float py, float* row) {
+    __m128 vpy = _mm_set1_ps(py);
+    __m128 by[3], vc[3], va[3];
+    for(int i = 0; i < 3; ++i) {
+        va[i] = _mm_set1_ps(a[i]);
+        by[i] = _mm_mul_ps(_mm_set1_ps(b[i]), vpy);
+        vc[i] = _mm_set1_ps(c[i]);
+    }
+    __m128 vz0 = _mm_set1_ps(z0);
+    __m128 vdzdx = _mm_set1_ps(dzdx);
+    __m128 zy = _mm_mul_ps(_mm_set1_ps(dzdy), vpy);
+    __m128 zero = _mm_setzero_ps();
+    __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    __m128 first = _mm_set1_ps(xmin + 0.5f);
+    __m128 last = _mm_set1_ps(xmax + 0.5f);
+
+    // The width is a multiple of 4, so aligned groups never pass the end of a row.
+    // Lanes of the first and last groups outside xmin..xmax are masked, so only the
+    // pixels of the scalar version are written.
+    for(int x = xmin & ~3; x <= xmax; x += 4) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(va[0], px), by[0]), vc[0]), zero);
+        if(x < xmin || x + 3 > xmax)
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmple_ps(px, last)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(va[1], px), by[1]), vc[1]), zero));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(va[2], px), by[2]), vc[2]), zero));
+        if(_mm_movemask_ps(inside) == 0)
+            continue;
+
+        __m128 z = _mm_add_ps(_mm_add_ps(vz0, _mm_mul_ps(vdzdx, px)), zy);
+        __m128 old = _mm_loadu_ps(row + x);
+        __m128 result = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old));
+        _mm_storeu_ps(row + x, result);
+    }
+}
+#endif
+
+void OcclusionBuffer::rasterizeBand(int band, Frustum::Simd simd) {
+    int y0 = band*BAND_HEIGHT;
+    int y1 = std::min(height - 1, y0 + BAND_HEIGHT - 1);
+    float* depth = maxDepths[0].data();
+
+    for(unsigned int i : bins[band]) {
+        const Triangle& t = triangles[i];
+        for(int y = std::max(y0, t.ymin); y <= std::min(y1, t.ymax); ++y) {
+            float py = y + 0.5f;
+            float* row = depth + y*width;
+#ifdef MORK_OCCLUSION_X86
+            if(simd != Frustum::SCALAR) {
+                rasterizeRowSse(t.a, t.b, t.c, t.z0, t.dzdx, t.dzdy, t.xmin, t.xmax, py, row);
+                continue;
+            }
+#endif
+            rasterizeRowScalar(t.a, t.b, t.c, t.z0, t.dzdx, t.dzdy, t.xmin, t.xmax, py, row);
+        }
+    }
+}
+
+void OcclusionBuffer::buildHierarchy() {
+    // Level 0 has a single depth per texel
+    std::copy(maxDepths[0].begin(), maxDepths[0].end(), minDepths[0].begin());
+
+    for(std::size_t level = 1; level < levelWidths.size(); ++level) {
+        int w = levelWidths[level];
+        int h = levelHeights[level];
+        int cw = levelWidths[level-1];
+        int ch = levelHeights[level-1];
+        const std::vector<float>& cmin = minDepths[level-1];
+        const std::vector<float>& cmax = maxDepths[level-1];
+        std::vector<float>& lmin = minDepths[level];
+        std::vector<float>& lmax = maxDepths[level];
+
+        for(int y = 0; y < h; ++y) {
+            int y0 = 2*y;
+            int y1 = std::min(2*y + 1, ch - 1);
+            for(int x = 0; x < w; ++x) {
+                int x0 = 2*x;
+                int x1 = std::min(2*x + 1, cw - 1);
+                lmin[y*w + x] = std::min({cmin[y0*cw + x0], cmin[y0*cw + x1], cmin[y1*cw + x0], cmin[y1*cw + x1]});
+                lmax[y*w + x] = std::max({cmax[y0*cw + x0], cmax[y0*cw + x1], cmax[y1*cw + x0], cmax[y1*cw + x1]});
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::isOccluded(const box3d& worldBounds) const {
+    if(worldBounds.empty())
+        return false;
+
+    // Screen rectangle and nearest depth of the box
+    double sxmin = width, sxmax = 0, symin = height, symax = 0;
+    double zmin = 1.0;
+    for(int i = 0; i < 8; ++i) {
+        vec4d v = viewProjection*vec4d(i & 1 ? worldBounds.xmax : worldBounds.xmin,
+                i & 2 ? worldBounds.ymax : worldBounds.ymin,
+                i & 4 ? worldBounds.zmax : worldBounds.zmin, 1.0);
+
+        // Boxes crossing the near plane are never occluded
+        if(v.w <= 0.0 || v.z < -v.w)
+            return false;
+
+        double sx = (v.x/v.w*0.5 + 0.5)*width;
+        double sy = (v.y/v.w*0.5 + 0.5)*height;
+        sxmin = std::min(sxmin, sx);
+        sxmax = std::max(sxmax, sx);
+        symin = std::min(symin, sy);
+        symax = std::max(symax, sy);
+        zmin = std::min(zmin, v.z/v.w*0.5 + 0.5);
+    }
+
+    int px0 = std::max(0, static_cast<int>(std::floor(sxmin)));
+    int px1 = std::min(width - 1, static_cast<int>(std::floor(sxmax)));
+    int py0 = std::max(0, static_cast<int>(std::floor(symin)));
+    int py1 = std::min(height - 1, static_cast<int>(std::floor(symax)));
+
+    // Outside the screen, which is for the frustum culling to decide
+    if(px0 > px1 || py0 > py1)
+        return false;
+
+    // Start at the level where the rectangle touches at most 2x2 texels
+    int level = 0;
+    while((px1 >> level) - (px0 >> level) > 1 || (py1 >> level) - (py0 >> level) > 1)
+        ++level;
+
+    float z = static_cast<float>(zmin);
+    for(int y = py0 >> level; y <= py1 >> level; ++y) {
+        for(int x = px0 >> level; x <= px1 >> level; ++x) {
+            if(!isOccluded(level, x, y, px0, py0, px1, py1, z))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool OcclusionBuffer::isOccluded(int level, int x, int y, int px0, int py0, int px1, int py1, float zmin) const {
+    int i = y*levelWidths[level] + x;
+
+    // Behind all occluders in the texel
+    if(zmin > maxDepths[level][i] + DEPTH_BIAS)
+        return true;
+
+    // In front of all occluders in the texel, so no texel below can hide the box
+    if(level == 0 || zmin <= minDepths[level][i])
+        return false;
+
+    int l = level - 1;
+    int xe = std::min({2*x + 1, px1 >> l, levelWidths[l] - 1});
+    int ye = std::min({2*y + 1, py1 >> l, levelHeights[l] - 1});
+    for(int cy = std::max(2*y, py0 >> l); cy <= ye; ++cy) {
+        for(int cx = std::max(2*x, px0 >> l); cx <= xe; ++cx) {
+            if(!isOccluded(l, cx, cy, px0, py0, px1, py1, zmin))
+                return false;
+        }
+    }
+    return true;
+}
+
+float OcclusionBuffer::getDepth(int x, int y) const {
+    return maxDepths[0][y*width + x];
+}
+
+unsigned int OcclusionBuffer::getTriangleCount() const {
+    return triangles.size();
+}
+
+}
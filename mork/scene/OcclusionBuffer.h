@@ -0,0 +1,100 @@
+#ifndef _MORK_OCCLUSIONBUFFER_H_
+#define _MORK_OCCLUSIONBUFFER_H_
+
+#include <vector>
+
+#include "mork/math/vec3.h"
+#include "mork/math/vec4.h"
+#include "mork/math/mat4.h"
+#include "mork/math/box3.h"
+#include "mork/scene/Frustum.h"
+
+namespace mork {
+
+    class ThreadPool;
+
+    // A low resolution software depth buffer for occlusion culling on the CPU.
+    //
+    // Occluder triangles are rasterized into the buffer (in parallel over bands of
+    // rows, and four pixels at a time with SIMD), after which a hierarchy holding the
+    // min and max depth of each 2x2 block is built. Bounding boxes are then tested
+    // against the hierarchy, starting at the level where the box covers a few texels
+    // and refining only where the test is inconclusive.
+    //
+    // Depths are window depths in [0, 1], and occluders are only rasterized at pixel
+    // centers, so small occluders may be missed, but an occludee is never rejected
+    // unless it is behind occluders for all pixels its screen rectangle touches.
+    class OcclusionBuffer {
+        public:
+            // The width is rounded up to a multiple of 4
+            OcclusionBuffer(int width = 256, int height = 128);
+
+            int getWidth() const;
+            int getHeight() const;
+
+            // Starts a new frame for the given projection*view matrix, removing all occluders
+            void begin(const mat4d& viewProjection);
+
+            // Adds the triangles of an indexed mesh, transformed by localToWorld.
+            // Triangles crossing the near plane are skipped.
+            void addOccluder(const std::vector<vec3f>& vertices, const std::vector<unsigned int>& indices,
+                    const mat4d& localToWorld);
+
+            // Adds the faces of a box, transformed by localToWorld
+            void addOccluder(const box3d& box, const mat4d& localToWorld);
+
+            // Rasterizes all occluders added since begin, and builds the depth
+            // hierarchy. Uses pool (if not nullptr) to rasterize bands in parallel.
+            void rasterize(ThreadPool* pool = nullptr);
+            // As above, with a given SIMD level. All levels give the same buffer.
+            void rasterize(ThreadPool* pool, Frustum::Simd simd);
+
+            // Returns true if the box (in world coordinates) is hidden behind the occluders
+            bool isOccluded(const box3d& worldBounds) const;
+
+            // Returns the depth at pixel x, y after rasterize (1 where nothing is drawn)
+            float getDepth(int x, int y) const;
+
+            // Returns the number of occluder triangles rasterized by the last rasterize
+            unsigned int getTriangleCount() const;
+
+        private:
+            // A triangle in pixel coordinates, with edge functions and a depth plane
+            struct Triangle {
+                // Edge functions a*x + b*y + c, positive inside
+                float a[3], b[3], c[3];
+                // Depth at x, y is z0 + dzdx*x + dzdy*y
+                float z0, dzdx, dzdy;
+                int xmin, xmax, ymin, ymax;
+            };
+
+            void setupTriangle(const vec4d& v0, const vec4d& v1, const vec4d& v2);
+
+            void rasterizeBand(int band, Frustum::Simd simd);
+
+            void buildHierarchy();
+
+            // Tests texel x, y at level, refining into the texels of the level below
+            // that are touched by the pixel rectangle px0..px1, py0..py1 while inconclusive
+            bool isOccluded(int level, int x, int y, int px0, int py0, int px1, int py1, float zmin) const;
+
+            int width;
+            int height;
+
+            mat4d viewProjection;
+
+            std::vector<Triangle> triangles;
+
+            // Indices of the triangles overlapping each band of rows
+            std::vector<std::vector<unsigned int> > bins;
+
+            // Level 0 is the depth buffer itself, each level above halves the resolution
+            std::vector<std::vector<float> > minDepths;
+            std::vector<std::vector<float> > maxDepths;
+            std::vector<int> levelWidths;
+            std::vector<int> levelHeights;
+    };
+
+}
+
+#endif
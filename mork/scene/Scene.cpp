@@ -2,9 +2,54 @@
 #include "mork/resource/ResourceFactory.h"
 #include "mork/util/Util.h"
 
+#include <algorithm>
+
 namespace mork {
 
-    Scene::Scene() : root("root") {}
+    Scene::Scene() : root("root"), updatedNodes(0), occluderVersion(0), occludersChecked(false), occludedNodes(0), lodThreshold(0.001) {}
+
+    Scene::Scene(Scene&& o)
+        :   transforms(std::move(o.transforms)),
+            root(std::move(o.root)),
+            updatedNodes(o.updatedNodes),
+            pool(std::move(o.pool)),
+            bvh(std::move(o.bvh)),
+            occlusion(std::move(o.occlusion)),
+            occluders(std::move(o.occluders)),
+            occluderVersion(0),
+            occludersChecked(false),
+            occludedNodes(o.occludedNodes),
+            camera(std::move(o.camera)),
+            queue(std::move(o.queue)),
+            frameUniforms(std::move(o.frameUniforms)),
+            lodThreshold(o.lodThreshold) {
+        if(bvh)
+            bvh->clear();
+    }
+
+    Scene& Scene::operator=(Scene&& o) {
+        if(this == &o)
+            return *this;
+
+        // The nodes are moved first, as moving them detaches them from the stores
+        root = std::move(o.root);
+        transforms = std::move(o.transforms);
+        updatedNodes = o.updatedNodes;
+        pool = std::move(o.pool);
+        bvh = std::move(o.bvh);
+        if(bvh)
+            bvh->clear();
+        occlusion = std::move(o.occlusion);
+        occluders = std::move(o.occluders);
+        occludersChecked = false;
+        occludedNodes = o.occludedNodes;
+        camera = std::move(o.camera);
+        queue = std::move(o.queue);
+        frameUniforms = std::move(o.frameUniforms);
+        lodThreshold = o.lodThreshold;
+
+        return *this;
+    }
 
     Scene::~Scene() {
         //debug_logger("Scene DTOR");
@@ -26,11 +71,90 @@ namespace mork {
     }
 
 
+    void Scene::setFlatTransforms(bool enable) {
+        if(enable && !transforms)
+            transforms = std::make_unique<TransformStore>();
+        else if(!enable)
+            transforms.reset();
+    }
+
+    bool Scene::hasFlatTransforms() const {
+        return static_cast<bool>(transforms);
+    }
+
+    void Scene::setThreads(unsigned int threads) {
+        if(threads > 1)
+            pool = std::make_unique<ThreadPool>(threads);
+        else
+            pool.reset();
+    }
+
+    unsigned int Scene::getThreads() const {
+        return pool ? pool->size() : 1;
+    }
+
+    void Scene::setBvhCulling(bool enable) {
+        if(enable && !bvh)
+            bvh = std::make_unique<BoundingVolumeHierarchy>();
+        else if(!enable)
+            bvh.reset();
+    }
+
+    bool Scene::hasBvhCulling() const {
+        return static_cast<bool>(bvh);
+    }
+
+    const BoundingVolumeHierarchy* Scene::getBoundingVolumeHierarchy() const {
+        return bvh.get();
+    }
+
+    void Scene::setOcclusionCulling(bool enable) {
+        if(enable && !occlusion)
+            occlusion = std::make_unique<OcclusionBuffer>();
+        else if(!enable)
+            occlusion.reset();
+    }
+
+    bool Scene::hasOcclusionCulling() const {
+        return static_cast<bool>(occlusion);
+    }
+
+    const OcclusionBuffer* Scene::getOcclusionBuffer() const {
+        return occlusion.get();
+    }
+
+    void Scene::addOccluder(const SceneNode& node, const std::vector<vec3f>& vertices,
+            const std::vector<unsigned int>& indices) {
+        occluders.push_back({node.getHandle(), box3d::ZERO, vertices, indices});
+        occludersChecked = false;
+    }
+
+    void Scene::addOccluder(const SceneNode& node, const box3d& box) {
+        occluders.push_back({node.getHandle(), box, {}, {}});
+        occludersChecked = false;
+    }
+
+    void Scene::clearOccluders() {
+        occluders.clear();
+    }
+
     void Scene::update() {
 
-        // Traverse the node tree from root and up
-        // We give identity as the first mapping for root nodes "parent"
-        root.updateLocalToWorld(mat4d::IDENTITY);
+        if(transforms) {
+            // Rebuild the store if the structure of the hierarchy has changed
+            if(!transforms->isValid())
+                transforms->build(root);
+
+            updatedNodes = transforms->update(mat4d::IDENTITY);
+        } else {
+            // Traverse the node tree from root and up
+            // We give identity as the first mapping for root nodes "parent"
+            // Only dirty subtrees are revisited
+            if(pool)
+                updatedNodes = root.updateLocalToWorld(mat4d::IDENTITY, *pool);
+            else
+                updatedNodes = root.updateLocalToWorld(mat4d::IDENTITY);
+        }
 
     
         // When all nodes are updated, we can update the camera
@@ -41,42 +165,166 @@ namespace mork {
         // This call is moved from the draw method to the end of update as of 04.07.2019
         // This is because exteranl applications may not use the stanfdard draw method,
         // but needs the visibility to be calculated
-        computeVisibility(camera, root, PARTIALLY_VISIBLE);
+        if(bvh) {
+            // Rebuild on structural changes, or when refitting has degraded the tree
+            if(bvh->isOutdated(root) || !bvh->refit())
+                bvh->build(root);
+
+            bvh->computeVisibility(camera.getWorldFrustum());
+        } else if(pool) {
+            unsigned int grain = std::max(64u, root.getSubtreeSize() / (8*pool->size()));
+            std::vector<VisibilityTask> tasks;
+            splitVisibility(camera, root, PARTIALLY_VISIBLE, Frustum::ALL_PLANES, grain, tasks);
+            pool->runWeighted(tasks.size(), grain,
+                    [&tasks](std::size_t i) { return tasks[i].node->getSubtreeSize(); },
+                    [this, &tasks](std::size_t i) {
+                        const VisibilityTask& t = tasks[i];
+                        computeVisibility(camera, *t.node, t.parentVisibility, t.planeMask);
+                    });
+        } else {
+            computeVisibility(camera, root, PARTIALLY_VISIBLE, Frustum::ALL_PLANES);
+        }
+
+        occludedNodes = 0;
+        if(occlusion && !occluders.empty()) {
+            if(!occludersChecked || occluderVersion != root.getStructureVersion())
+                dropOccluders();
+            computeOcclusion();
+        }
 
    }
 
+    unsigned int Scene::getUpdatedNodeCount() const {
+        return updatedNodes;
+    }
+
+    unsigned int Scene::getOccludedNodeCount() const {
+        return occludedNodes;
+    }
+
     void Scene::draw(const Program& prog) {
         // DRAW
         // TODO: Make predicates for drawing in order to be able to do passes
-        prog.use();
         mork::mat4d view = camera.getViewMatrix();
         mork::mat4d proj = camera.getProjectionMatrix(); 
-        
-        prog.getUniform("projection").set(proj.cast<float>());
-        prog.getUniform("view").set(view.cast<float>());
-        // Viewpos is not present in all shaders, so check before setting it:
-        if(prog.queryUniform("viewPos"))
-            prog.getUniform("viewPos").set(camera.getLocalToWorld().translation().cast<float>());
 
+        // An error e at distance d covers e*proj[1][1]/(2*d) of the screen height
+        double lodScale = lodThreshold > 0.0 ? proj[1][1]/(2.0*lodThreshold) : 0.0;
+
+        vec3d viewPos = camera.getLocalToWorld().translation();
+        frameUniforms.setCamera(proj, view, viewPos);
+        frameUniforms.upload();
+
+        queue.begin(viewPos, camera.getFarClippingPlane(), lodScale);
+        root.collectDrawItems(queue, prog);
+        queue.sort();
+        queue.submit(proj, view);
+
+    }
+
+    void Scene::setLodThreshold(double screenFraction) {
+        lodThreshold = screenFraction;
+    }
+
+    double Scene::getLodThreshold() const {
+        return lodThreshold;
+    }
 
-        root.draw(prog);
+    const RenderQueue& Scene::getRenderQueue() const {
+        return queue;
+    }
+
+    RenderQueue& Scene::getRenderQueue() {
+        return queue;
+    }
 
+    const FrameUniforms& Scene::getFrameUniforms() const {
+        return frameUniforms;
     }
 
-    void Scene::computeVisibility(const Camera& cam, SceneNode& node, Visibility v) {
-        // Do explicit calc on visibility of this nod if parent is partially visible
+    FrameUniforms& Scene::getFrameUniforms() {
+        return frameUniforms;
+    }
+
+    void Scene::computeVisibility(const Camera& cam, SceneNode& node, Visibility v, unsigned int planeMask) {
+        // Do explicit calc on visibility of this nod if parent is partially visible.
+        // Planes the parent is fully inside are skipped, as is any plane this node is
+        // fully inside for the children.
         if(v == PARTIALLY_VISIBLE) {
-            v = cam.getWorldFrustum().getVisibility(node.getWorldBounds());
+            v = cam.getWorldFrustum().getVisibility(node.getWorldBounds(), planeMask, node.lastRejectingPlane);
         }
 
         // Set not to visible if partially or fully visible
         node.isVisible( v != INVISIBLE );
 
         for(auto& child : node.getChildren()) {
-            computeVisibility(cam, child, v);
+            computeVisibility(cam, child, v, planeMask);
         }
     }
 
+    void Scene::splitVisibility(const Camera& cam, SceneNode& node, Visibility v, unsigned int planeMask,
+            unsigned int grain, std::vector<VisibilityTask>& tasks) {
+        if(v == PARTIALLY_VISIBLE) {
+            v = cam.getWorldFrustum().getVisibility(node.getWorldBounds(), planeMask, node.lastRejectingPlane);
+        }
+
+        node.isVisible( v != INVISIBLE );
+
+        for(SceneNode& child : node.getChildren()) {
+            if(child.getSubtreeSize() <= grain)
+                tasks.push_back({&child, v, planeMask});
+            else
+                splitVisibility(cam, child, v, planeMask, grain, tasks);
+        }
+    }
+
+    void Scene::computeOcclusion() {
+        occlusion->begin(camera.getProjectionMatrix()*camera.getViewMatrix());
+        for(const Occluder& o : occluders) {
+            const SceneNode* node = SceneNode::fromHandle(o.node);
+            if(!node->isVisible())
+                continue;
+
+            if(o.vertices.empty())
+                occlusion->addOccluder(o.box, node->getLocalToWorld());
+            else
+                occlusion->addOccluder(o.vertices, o.indices, node->getLocalToWorld());
+        }
+        occlusion->rasterize(pool.get());
+
+        cullOccluded(root);
+    }
+
+    void Scene::dropOccluders() {
+        // Nodes can only be destroyed or removed through structural changes, so
+        // the remaining occluders are valid until the structure changes again
+        occluders.erase(std::remove_if(occluders.begin(), occluders.end(),
+                    [this](const Occluder& o) {
+                        const SceneNode* node = SceneNode::fromHandle(o.node);
+                        while(node != nullptr && node != &root)
+                            node = node->getParent();
+                        return node == nullptr;
+                    }), occluders.end());
+
+        occluderVersion = root.getStructureVersion();
+        occludersChecked = true;
+    }
+
+    void Scene::cullOccluded(SceneNode& node) {
+        if(!node.isVisible())
+            return;
+
+        // Hiding a node hides its whole subtree, as its world bounds hold the children
+        if(occlusion->isOccluded(node.getWorldBounds())) {
+            node.isVisible(false);
+            ++occludedNodes;
+            return;
+        }
+
+        for(SceneNode& child : node.getChildren())
+            cullOccluded(child);
+    }
+
     inline json sceneSchema = R"(
     {
         "$schema": "http://json-schema.org/draft-07/schema#",
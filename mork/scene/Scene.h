@@ -2,10 +2,17 @@
 #define _MORK_SCENE_H_
 
 #include <vector>
+#include <memory>
 
 #include "mork/math/mat4.h" 
 #include "mork/scene/SceneNode.h"
 #include "mork/scene/Camera.h"
+#include "mork/scene/TransformStore.h"
+#include "mork/scene/BoundingVolumeHierarchy.h"
+#include "mork/scene/OcclusionBuffer.h"
+#include "mork/render/RenderQueue.h"
+#include "mork/render/FrameUniforms.h"
+#include "mork/util/ThreadPool.h"
 
 namespace mork {
 
@@ -15,8 +22,10 @@ namespace mork {
             Scene(Scene& o) = delete;
             Scene& operator=(Scene& o) = delete;
 
-            Scene(Scene&& o) = default;
-            Scene& operator=(Scene&& o) = default;
+            // The bounding volume hierarchy is built again on next update, as it
+            // refers to the nodes by address
+            Scene(Scene&& o);
+            Scene& operator=(Scene&& o);
 
             ~Scene();
 
@@ -29,19 +38,127 @@ namespace mork {
             Camera& getCamera();
 
 
+            // Enables/disables propagation of transforms through a flat, depth-first
+            // store of the node hierarchy instead of recursive traversal of the nodes.
+            // Off by default.
+            void    setFlatTransforms(bool enable);
+            bool    hasFlatTransforms() const;
+
+            // Sets the number of worker threads used to update transforms and visibility
+            // of independent subtrees in parallel. 0 or 1 gives a serial update (default).
+            void    setThreads(unsigned int threads);
+            unsigned int getThreads() const;
+
+            // Enables/disables visibility culling through a spatial bounding volume
+            // hierarchy over the nodes with bounds of their own, instead of traversing
+            // the logical node hierarchy. Off by default.
+            void    setBvhCulling(bool enable);
+            bool    hasBvhCulling() const;
+
+            // Returns the bounding volume hierarchy, or nullptr if BVH culling is off
+            const BoundingVolumeHierarchy* getBoundingVolumeHierarchy() const;
+
+            // Enables/disables occlusion culling: after frustum culling, the visible
+            // occluders are rasterized into a software depth buffer, and visible nodes
+            // hidden behind them are made invisible. Off by default.
+            void    setOcclusionCulling(bool enable);
+            bool    hasOcclusionCulling() const;
+
+            // Returns the occlusion buffer, or nullptr if occlusion culling is off
+            const OcclusionBuffer* getOcclusionBuffer() const;
+
+            // Adds occluder geometry (in local coordinates of node), e.g. a simplified
+            // version of the mesh drawn by node. The occluder is dropped when the node
+            // is destroyed or removed from the scene.
+            void    addOccluder(const SceneNode& node, const std::vector<vec3f>& vertices,
+                        const std::vector<unsigned int>& indices);
+            // As above, with a box (in local coordinates of node) as occluder geometry
+            void    addOccluder(const SceneNode& node, const box3d& box);
+            void    clearOccluders();
+
             void    update();
 
+            // Returns the number of nodes visited by the last update
+            unsigned int getUpdatedNodeCount() const;
+
+            // Returns the number of subtrees culled by occlusion in the last update
+            unsigned int getOccludedNodeCount() const;
+
+            // Sets the largest error allowed when selecting mesh levels of detail, as a
+            // fraction of the screen height (default 0.001, about a pixel). 0 always
+            // draws the full meshes.
+            void    setLodThreshold(double screenFraction);
+            double  getLodThreshold() const;
+
+            // Draws all visible nodes through the render queue, sorted to minimize state changes.
+            // The camera is written to the frame uniforms, which are uploaded before drawing.
             void    draw(const Program& prog);
 
+            // Returns the camera and light uniform blocks shared by the programs of a
+            // frame. Lights set here are used by programs declaring the Lights block.
+            const FrameUniforms& getFrameUniforms() const;
+            FrameUniforms& getFrameUniforms();
+
+            // Returns the queue holding the draw items of the last draw
+            const RenderQueue& getRenderQueue() const;
+            RenderQueue& getRenderQueue();
 
         private:
 
-            void computeVisibility(const Camera& cam, SceneNode& node, Visibility parentVisibility);
+            // Only the planes in planeMask are tested, as the parent is fully inside the others
+            void computeVisibility(const Camera& cam, SceneNode& node, Visibility parentVisibility, unsigned int planeMask);
+
+            // A subtree to be culled by a worker in the parallel visibility computation
+            struct VisibilityTask {
+                SceneNode*      node;
+                Visibility      parentVisibility;
+                unsigned int    planeMask;
+            };
+
+            // Computes visibility of all nodes with subtrees larger than grain, and
+            // collects the smaller subtrees below them for the workers
+            void splitVisibility(const Camera& cam, SceneNode& node, Visibility parentVisibility, unsigned int planeMask,
+                    unsigned int grain, std::vector<VisibilityTask>& tasks);
+
+            // Rasterizes the visible occluders, and hides the visible nodes behind them
+            void computeOcclusion();
+            void cullOccluded(SceneNode& node);
+
+            // Drops the occluders of nodes destroyed or removed from the scene
+            void dropOccluders();
+
+            // Box occluders have no vertices
+            struct Occluder {
+                NodeHandle                  node;
+                box3d                       box;
+                std::vector<vec3f>          vertices;
+                std::vector<unsigned int>   indices;
+            };
+
+            // Declared before root, so attached nodes are destroyed before the store
+            std::unique_ptr<TransformStore> transforms;
 
             SceneNode   root;            
 
+            unsigned int updatedNodes;
+
+            std::unique_ptr<ThreadPool> pool;
+
+            std::unique_ptr<BoundingVolumeHierarchy> bvh;
+
+            std::unique_ptr<OcclusionBuffer> occlusion;
+            std::vector<Occluder> occluders;
+            // The structure version of root when the occluders were last checked
+            unsigned int occluderVersion;
+            bool        occludersChecked;
+            unsigned int occludedNodes;
+
             Camera      camera;
 
+            RenderQueue queue;
+            FrameUniforms frameUniforms;
+            double      lodThreshold;
+
     };
 
     
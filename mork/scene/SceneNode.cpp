@@ -1,65 +1,209 @@
 #include "mork/scene/SceneNode.h"
+#include "mork/scene/TransformStore.h"
+#include "mork/util/ThreadPool.h"
 #include "mork/core/Log.h"
-#include "mork/util/Util.h"
+
+#include <algorithm>
+
 namespace mork {
 
     SceneNode::SceneNode(const std::string& name) 
+        :   SceneNode(NameTable::getInstance().intern(name)) {
+        // Both intern and the delegated constructor add a reference
+        NameTable::getInstance().release(this->name);
+    }
+
+    SceneNode::SceneNode(NameId name) 
         :   name(name),
+            handle(),
+            visible(true),
             localToParent(mat4d::IDENTITY),
             localToWorld(mat4d::IDENTITY),
             localBounds(box3d::ZERO),
             worldBounds(box3d::ZERO),
-            worldPos(vec3d::ZERO) {
+            worldPos(vec3d::ZERO),
+            transformDirty(true),
+            boundsDirty(true),
+            childDirty(false),
+            subtreeSize(1),
+            worldVersion(0),
+            structureVersion(0),
+            childIndex(0),
+            lastRejectingPlane(-1),
+            parent(nullptr),
+            store(nullptr),
+            storeIndex(-1) {
+        NameTable::getInstance().acquire(name);
+        handle = NodeRegistry::getInstance().acquire(this);
     }
 
     SceneNode::SceneNode()
-        : SceneNode(random_string(8)) {
+        : SceneNode(NameTable::getInstance().anonymous()) {
+        // Both anonymous and the delegated constructor add a reference
+        NameTable::getInstance().release(name);
+    }
 
+    SceneNode::SceneNode(SceneNode&& o)
+        :   name(NameTable::getInstance().anonymous()),
+            handle(),
+            transformDirty(true),
+            boundsDirty(true),
+            childDirty(false),
+            subtreeSize(1),
+            worldVersion(0),
+            structureVersion(0),
+            childIndex(0),
+            lastRejectingPlane(-1),
+            parent(nullptr),
+            store(nullptr),
+            storeIndex(-1) {
+        *this = std::move(o);
+    }
+
+    SceneNode& SceneNode::operator=(SceneNode&& o) {
+        if(this == &o)
+            return *this;
+
+        // The flat store holds addresses of its nodes, so both nodes are detached
+        // (which also invalidates the store) before the state is moved.
+        detachFromStore();
+        o.detachFromStore();
+
+        // The reference to the name moves along with it
+        NameTable& names = NameTable::getInstance();
+        names.release(name);
+        name = o.name;
+        o.name = names.anonymous();
+
+        // Handles follow the moved state, the moved from node gets a new handle
+        NodeRegistry& registry = NodeRegistry::getInstance();
+        registry.release(handle);
+        handle = o.handle;
+        registry.rebind(handle, this);
+        o.handle = registry.acquire(&o);
+
+        visible = o.visible;
+        localToParent = o.localToParent;
+        localToWorld = o.localToWorld;
+        worldPos = o.worldPos;
+        localBounds = o.localBounds;
+        worldBounds = o.worldBounds;
+        children = std::move(o.children);
+        childrenMap = std::move(o.childrenMap);
+        childrenRefs = std::move(o.childrenRefs);
+        o.children.clear();
+        o.childrenMap.clear();
+        o.childrenRefs.clear();
+
+        unsigned int size = 1;
+        for(SceneNode& child : childrenRefs) {
+            child.parent = this;
+            size += child.subtreeSize;
+        }
+        structureChanged(static_cast<int>(size) - static_cast<int>(subtreeSize));
+        o.structureChanged(1 - static_cast<int>(o.subtreeSize));
+
+        // Everything must be revisited in next update
+        transformDirty = true;
+        boundsDirty = true;
+        childDirty = true;
+        markAncestorsDirty();
+
+        return *this;
     }
 
 	SceneNode::~SceneNode() {
+        if(store)
+            store->release(storeIndex);
+        NodeRegistry::getInstance().release(handle);
+        NameTable::getInstance().release(name);
 	}
+
+    void SceneNode::detachFromStore() {
+        if(!store)
+            return;
+
+        // Copy back the transform state from the store
+        localToParent = store->getLocalToParent(storeIndex);
+        localToWorld = store->getLocalToWorld(storeIndex);
+        worldPos = store->getWorldPos(storeIndex);
+        localBounds = store->getLocalBounds(storeIndex);
+        worldBounds = store->getWorldBounds(storeIndex);
+        worldVersion = store->getWorldVersion(storeIndex);
+
+        store->release(storeIndex);
+        store = nullptr;
+        storeIndex = -1;
+        transformDirty = true;
+        boundsDirty = true;
+        childDirty = true;
+
+        for(SceneNode& child : childrenRefs)
+            child.detachFromStore();
+    }
+
     SceneNode& SceneNode::addChild(SceneNode&& child) {
-        std::string name = child.getName();
-        
         // Check that the child name does not allready exist
-        auto it = childrenMap.find(name);
-        if(it != childrenMap.end()) {
-           error_logger("Allready existing Child element " + name + " requested to be inserted in node " + this->getName());
+        if(childrenMap.count(child.name)) {
+           error_logger("Allready existing Child element " + child.getName() + " requested to be inserted in node " + this->getName());
            throw std::runtime_error("Child name allready existing");
         }
 
-        auto& ret = childrenMap[name] = std::make_unique<SceneNode>(std::move(child));
-
-        // Push to childrenRefs
-        childrenRefs.push_back(*ret);
-
-        return *ret;
+        return insertChild(std::make_unique<SceneNode>(std::move(child)));
     }
 
     SceneNode& SceneNode::addChild(std::unique_ptr<SceneNode> child) {
         // Check that the child name does not allready exist
-        auto it = childrenMap.find(child->getName());
-        if(it != childrenMap.end()) {
+        if(childrenMap.count(child->name)) {
            error_logger("Allready existing Child element " + child->getName() + " requested to be inserted in node " + this->getName());
            throw std::runtime_error("Child name allready existing");
         }
-        
-        auto& ret = childrenMap[child->getName()] = std::move(child);
-         
+
+        return insertChild(std::move(child));
+    }
+
+    SceneNode& SceneNode::insertChild(std::unique_ptr<SceneNode> child) {
+        SceneNode& ret = *child;
+        ret.parent = this;
+        ret.childIndex = children.size();
+        childrenMap[ret.name] = &ret;
+        children.push_back(std::move(child));
+
         // Push to childrenRefs:
-        childrenRefs.push_back(*ret);
+        childrenRefs.push_back(ret);
 
-        return *ret;
+        structureChanged(ret.subtreeSize);
+
+        // The new child must be updated, and the bounds of this node recomputed
+        ret.transformDirty = true;
+        boundsDirty = true;
+        childDirty = true;
+        markAncestorsDirty();
+
+        // The structure changed, so any flat store must be rebuilt
+        if(store)
+            store->invalidate();
+
+        return ret;
     }
    
     SceneNode& SceneNode::getChild(const std::string& name) {
+        // Names never interned cannot be the name of any child
+        NameId id;
+        if(!NameTable::getInstance().find(name, id) || !childrenMap.count(id)) {
+           error_logger("Non-existing Child element " + name + " requested from node " + this->getName());
+           throw std::runtime_error("Child element not found");
+        }
+        return *childrenMap[id];
+    }
+
+    SceneNode& SceneNode::getChild(NameId name) {
         auto it = childrenMap.find(name);
         if(it == childrenMap.end()) {
-           error_logger("Non-existing Child element " + name + " requested from node " + this->getName());
+           error_logger("Non-existing Child element " + NameTable::getInstance().getString(name) + " requested from node " + this->getName());
            throw std::runtime_error("Child element not found");
         }
-        return *((*it).second);
+        return *it->second;
     }
     
     const std::vector<std::reference_wrapper<SceneNode> > & SceneNode::getChildren() const {
@@ -67,8 +211,13 @@ namespace mork {
     }
 
     void SceneNode::clearChildren() {
+        structureChanged(1 - static_cast<int>(subtreeSize));
         childrenRefs.clear();
         childrenMap.clear();
+        children.clear();
+
+        boundsDirty = true;
+        markAncestorsDirty();
     }
 
 
@@ -82,52 +231,26 @@ namespace mork {
         return false; 
     }
   */  
-    // Improved search, using the hasmap lookup O(1)
+    // Constant time, the node knows its parent
     bool SceneNode::hasChild(const SceneNode& node) const {
-        auto it = childrenMap.find(node.getName());
-
-        if(it != childrenMap.end()) {
-            // Compare adresses
-            if(((*it).second).get() == &node)
-                return true;
-            else // they just had the same name, not adress..
-                return false;
-        } else
-            return false;
+        return node.parent == this;
     }
 
 
     bool SceneNode::hasChild(const std::string& name) const {
-        auto it = childrenMap.find(name);
-        if(it != childrenMap.end())
-            return true;
-        else
-            return false;
- 
+        NameId id;
+        return NameTable::getInstance().find(name, id) && hasChild(id);
+    }
+
+    bool SceneNode::hasChild(NameId name) const {
+        return childrenMap.count(name) > 0;
     }
 
 
     // Removes the given SceneNode from the internal store of children, and returns the object by move.
     // If the object is not in the children pool, an exception is thrown
     std::unique_ptr<SceneNode> SceneNode::removeChild(const SceneNode& node) {
-        // First we create a raw pointer to the object and release it from the ownership of the uniqu_ptr
-        // in the children hashmap store:
-        auto it = childrenMap.find(node.getName());
-
-        std::unique_ptr<SceneNode> extracted_ptr = nullptr;
-
-        bool found = false;
-        if(it != childrenMap.end()) {
-            // Compare adresses
-            if(((*it).second).get() == &node) {
-               found = true;
-            }
-            else // they just had the same name, not adress..
-                found = false;
-        } else // Not even the same name
-            found = false;
-
-        if(!found) {
+        if(node.parent != this) {
             error_logger("Tried removing nonesiting child from node: ", this->getName());
             error_logger("Attempted removal: ", node.getName());
             error_logger("While this node have only the following children");
@@ -137,39 +260,67 @@ namespace mork {
             throw std::runtime_error("Tried removing nonexstiing child from node");
         }
 
-        // removing from childrenRefs is actually O(n), so this operations should not be performed often,
-        // especially on nodes with many children.
-        // We have to do this before extacting from the ctual store (childrenMap), since that will invalidate
-        // the ref to the child that is being removed.
-        for(auto it2 = childrenRefs.begin(); it2 != childrenRefs.end(); ++it2)
-            if( (*it2).get().getName() == node.getName()) {
-                childrenRefs.erase(it2);
-                break;
-            }
-        
-        // Transfer ownership:
-        extracted_ptr = std::move((*it).second);
-        
-        // We can now remove this entry from the internal vectors:
-        childrenMap.erase(it);
+        // Transfer ownership, and move the last child into the free place
+        unsigned int index = node.childIndex;
+        std::unique_ptr<SceneNode> extracted_ptr = std::move(children[index]);
+        if(index + 1 != children.size()) {
+            children[index] = std::move(children.back());
+            childrenRefs[index] = childrenRefs.back();
+            children[index]->childIndex = index;
+        }
+        children.pop_back();
+        childrenRefs.pop_back();
+        childrenMap.erase(extracted_ptr->name);
+
+        // The removed subtree lives on outside this hierarchy, so it can no longer
+        // refer to the flat store of this hierarchy
+        extracted_ptr->detachFromStore();
+        extracted_ptr->parent = nullptr;
+        structureChanged(-static_cast<int>(extracted_ptr->subtreeSize));
+        extracted_ptr->transformDirty = true;
+        boundsDirty = true;
+        markAncestorsDirty();
+        if(store)
+            store->invalidate();
 
         return extracted_ptr;
     }
 
+    std::unique_ptr<SceneNode> SceneNode::removeChild(const NodeHandle& handle) {
+        SceneNode* node = fromHandle(handle);
+        if(node == nullptr) {
+            error_logger("Tried removing a child by a dangling handle from node: ", this->getName());
+            throw std::runtime_error(error_logger.last());
+        }
+        return removeChild(*node);
+    }
+
 
     std::vector<std::string> SceneNode::listChildren() const {
         std::vector<std::string> list;
-        for(const auto& entity : childrenMap)
-            list.push_back(entity.first);
+        for(const SceneNode& child : childrenRefs)
+            list.push_back(child.getName());
         return list;
     }
 
     const std::string& SceneNode::getName() const {
+        return NameTable::getInstance().getString(name);
+    }
+
+    NameId SceneNode::getNameId() const {
         return name;
     }
+
+    NodeHandle SceneNode::getHandle() const {
+        return handle;
+    }
+
+    SceneNode* SceneNode::fromHandle(const NodeHandle& handle) {
+        return NodeRegistry::getInstance().get(handle);
+    }
     
     bool SceneNode::operator==(const SceneNode& other) const {
-        if(this->getName() == other.getName() && this == &other)
+        if(name == other.name && this == &other)
             return true;
         else
             return false;
@@ -182,49 +333,215 @@ namespace mork {
 
 
     mat4d   SceneNode::getLocalToParent() const{
-        return localToParent;
+        return store ? store->getLocalToParent(storeIndex) : localToParent;
     }
 
     void    SceneNode::setLocalToParent(const mat4d& m) {
-        localToParent = m;
+        if(store) {
+            store->setLocalToParent(storeIndex, m);
+        } else {
+            localToParent = m;
+            transformDirty = true;
+            markAncestorsDirty();
+        }
     }
 
     mat4d   SceneNode::getLocalToWorld() const {
-        return localToWorld;
+        return store ? store->getLocalToWorld(storeIndex) : localToWorld;
     }
     
     mat4d   SceneNode::getWorldToLocal() const {
-        return localToWorld.inverse();
+        return getLocalToWorld().inverse();
     }
 
     vec3d   SceneNode::getWorldPos() const {
-        return worldPos;
+        return store ? store->getWorldPos(storeIndex) : worldPos;
     }
 
     box3d   SceneNode::getWorldBounds() const {
-        return worldBounds;
+        return store ? store->getWorldBounds(storeIndex) : worldBounds;
+    }
+
+    box3d   SceneNode::getLocalBounds() const {
+        return store ? store->getLocalBounds(storeIndex) : localBounds;
+    }
+
+    bool SceneNode::hasLocalBounds() const {
+        box3d bounds = getLocalBounds();
+        return !bounds.empty() && bounds != box3d::ZERO;
     }
 
     void SceneNode::setLocalBounds(const box3d& bounds) {
-        localBounds = bounds;
+        // Nodes with and without bounds are treated differently by the culling
+        if(hasLocalBounds() != (!bounds.empty() && bounds != box3d::ZERO))
+            structureChanged(0);
+
+        if(store) {
+            store->setLocalBounds(storeIndex, bounds);
+        } else {
+            localBounds = bounds;
+            boundsDirty = true;
+            markAncestorsDirty();
+        }
     }
 
     void SceneNode::enlargeLocalBounds(const box3d& bounds) {
-        localBounds = localBounds.enlarge(bounds);
+        setLocalBounds(getLocalBounds().enlarge(bounds));
+    }
+
+
+    unsigned int SceneNode::updateLocalToWorld(const mat4d& parentLocalToWorld) {
+        // While attached to a flat store, the transform state lives in the store
+        if(store)
+            return store->update(storeIndex, parentLocalToWorld);
+
+        // The parent transform is unknown, so this node is always recomputed
+        unsigned int touched = 0;
+        updateWorld(parentLocalToWorld, true, touched);
+        return touched;
+    }
+
+    unsigned int SceneNode::updateLocalToWorld(const mat4d& parentLocalToWorld, ThreadPool& pool) {
+        if(store)
+            return store->update(storeIndex, parentLocalToWorld);
+
+        // Aim for a few tasks per worker, but not too small ones
+        unsigned int grain = std::max(64u, subtreeSize / (8*pool.size()));
+
+        // Serial top-down pass over the large subtrees, collecting the small ones
+        std::vector<std::pair<SceneNode*, bool> > spine;
+        std::vector<UpdateTask> tasks;
+        splitUpdate(parentLocalToWorld, true, grain, spine, tasks);
+
+        // The small subtrees are independent, and only read the world transform of
+        // their parent, which is complete at this point
+        pool.runWeighted(tasks.size(), grain,
+                [&tasks](std::size_t i) { return tasks[i].node->subtreeSize; },
+                [&tasks](std::size_t i) {
+                    UpdateTask& t = tasks[i];
+                    t.node->updateWorld(t.node->parent->localToWorld, t.parentChanged, t.touched);
+                });
+
+        // Serial bottom-up pass over the large subtrees. Their bounds are always
+        // recomputed, which gives the same result as the serial update.
+        for(auto it = spine.rbegin(); it != spine.rend(); ++it)
+            it->first->updateBounds(it->second, true);
+
+        unsigned int touched = spine.size();
+        for(const UpdateTask& t : tasks)
+            touched += t.touched;
+        return touched;
+    }
+
+    void SceneNode::splitUpdate(const mat4d& parentLocalToWorld, bool parentChanged, unsigned int grain,
+            std::vector<std::pair<SceneNode*, bool> >& spine, std::vector<UpdateTask>& tasks) {
+        if(!parentChanged && !isDirty())
+            return;
+
+        bool worldChanged = updateTransform(parentLocalToWorld, parentChanged);
+        spine.emplace_back(this, worldChanged);
+
+        if(worldChanged || childDirty) {
+            for(SceneNode& child : childrenRefs) {
+                if(!worldChanged && !child.isDirty())
+                    continue;
+
+                if(child.subtreeSize <= grain)
+                    tasks.push_back({&child, worldChanged, 0});
+                else
+                    child.splitUpdate(localToWorld, worldChanged, grain, spine, tasks);
+            }
+        }
+    }
+
+    bool SceneNode::updateWorld(const mat4d& parentLocalToWorld, bool parentChanged, unsigned int& touched) {
+        if(!parentChanged && !isDirty())
+            return false;
+
+        ++touched;
+
+        bool worldChanged = updateTransform(parentLocalToWorld, parentChanged);
+
+        // Children are only revisited if this node moved, or any of them are dirty
+        bool childBoundsChanged = false;
+        if(worldChanged || childDirty) {
+            for(SceneNode& child : childrenRefs)
+                childBoundsChanged |= child.updateWorld(localToWorld, worldChanged, touched);
+        }
+
+        return updateBounds(worldChanged, childBoundsChanged);
+    }
+
+    bool SceneNode::updateTransform(const mat4d& parentLocalToWorld, bool parentChanged) {
+        bool worldChanged = false;
+        if(parentChanged || transformDirty) {
+            mat4d l2w = parentLocalToWorld*localToParent;
+            worldChanged = l2w != localToWorld;
+            if(worldChanged) {
+                localToWorld = l2w;
+                worldPos = l2w * vec3d::ZERO;
+                ++worldVersion;
+            }
+        }
+        return worldChanged;
+    }
+
+    bool SceneNode::updateBounds(bool worldChanged, bool childBoundsChanged) {
+        bool boundsChanged = false;
+        if(boundsDirty)
+            ++worldVersion;
+
+        if(worldChanged || boundsDirty || childBoundsChanged) {
+            box3d bounds = localToWorld * localBounds;
+            for(const SceneNode& child : childrenRefs)
+                bounds = bounds.enlarge(child.getWorldBounds());
+
+            boundsChanged = bounds != worldBounds;
+            worldBounds = bounds;
+        }
+
+        transformDirty = false;
+        boundsDirty = false;
+        childDirty = false;
+
+        return boundsChanged;
+    }
+
+    bool SceneNode::isDirty() const {
+        return transformDirty || boundsDirty || childDirty;
+    }
+
+    unsigned int SceneNode::getSubtreeSize() const {
+        return subtreeSize;
+    }
+
+    unsigned int SceneNode::getWorldVersion() const {
+        return store ? store->getWorldVersion(storeIndex) : worldVersion;
     }
 
+    unsigned int SceneNode::getStructureVersion() const {
+        return structureVersion;
+    }
 
-    void   SceneNode::updateLocalToWorld(const mat4d& parentLocalToWorld) {
-        localToWorld = parentLocalToWorld*localToParent;
+    SceneNode* SceneNode::getParent() {
+        return parent;
+    }
 
-        for(auto& entity : childrenMap)
-            entity.second->updateLocalToWorld(localToWorld);
+    const SceneNode* SceneNode::getParent() const {
+        return parent;
+    }
 
-        worldPos = localToWorld * vec3d::ZERO;
+    void SceneNode::structureChanged(int sizeDelta) {
+        for(SceneNode* n = this; n != nullptr; n = n->parent) {
+            n->subtreeSize += sizeDelta;
+            ++n->structureVersion;
+        }
+    }
 
-        worldBounds = localToWorld * localBounds;
-        for(auto& entity : childrenMap)
-           worldBounds = worldBounds.enlarge(entity.second->getWorldBounds()); 
+    void SceneNode::markAncestorsDirty() {
+        // Ancestors of a flagged node are always flagged, so stop at the first one
+        for(SceneNode* p = parent; p != nullptr && !p->childDirty; p = p->parent)
+            p->childDirty = true;
     }
 
     bool SceneNode::isVisible() const {
@@ -247,4 +564,15 @@ namespace mork {
 
         }
     }
+
+    void SceneNode::collectDrawItems(RenderQueue& queue, const Program& prog) const {
+        if(!isVisible())
+            return;
+
+        // Nothing to draw for SceneNode base class...
+
+        for(const SceneNode& child : childrenRefs) {
+            child.collectDrawItems(queue, prog);
+        }
+    }
 }
@@ -9,23 +9,32 @@
 #include "mork/math/mat4.h" 
 
 #include "mork/scene/Frustum.h"
+#include "mork/scene/NodeHandle.h"
 #include "mork/render/Program.h"
+#include "mork/util/NameTable.h"
 namespace mork {
 
+    class TransformStore;
+    class ThreadPool;
+    class RenderQueue;
 
     class SceneNode {
         public:
             // Initialize a SceneNode with the given ame
             SceneNode(const std::string& name);
+
+            // Initialize a SceneNode with an interned name, adding a reference to it
+            explicit SceneNode(NameId name);
             
-            // Initialize a SceneNode with a random name
+            // Initialize a SceneNode with a unique name. The name string is only
+            // created if asked for.
             SceneNode();
           	
 			SceneNode(SceneNode& o) = delete;
             SceneNode& operator=(SceneNode& o) = delete;
 
-            SceneNode(SceneNode&& o) = default;
-            SceneNode& operator=(SceneNode&& o) = default;
+            SceneNode(SceneNode&& o);
+            SceneNode& operator=(SceneNode&& o);
  
 			virtual ~SceneNode(); 
 
@@ -40,6 +49,7 @@ namespace mork {
             // Returns a refernce to a named child. Throw exception if the name is not a child
             // of this SceneNode.
             virtual SceneNode& getChild(const std::string& name);
+            SceneNode& getChild(NameId name);
 
             // Returns a refernce to a vector of children references.
             virtual const std::vector<std::reference_wrapper<SceneNode> > & getChildren() const;
@@ -48,12 +58,16 @@ namespace mork {
             virtual void clearChildren();
 
 
-            // Removes the given SceneNode from the internal store of children, and returns the objecte
+            // Removes the given SceneNode from the internal store of children, and returns the objecte.
+            // Removal is O(1), and moves the last child into the place of the removed one.
             virtual std::unique_ptr<SceneNode> removeChild(const SceneNode& node);
+            // As above, for the node of a handle. Throws if the handle dangles.
+            std::unique_ptr<SceneNode> removeChild(const NodeHandle& handle);
 
             virtual bool hasChild(const SceneNode& node) const;
             //virtual bool hasChild2(const SceneNode& node) const;
             virtual bool hasChild(const std::string& name) const;
+            bool hasChild(NameId name) const;
 
             virtual bool operator==(const SceneNode& other) const;
             virtual bool operator!=(const SceneNode& other) const;
@@ -63,6 +77,15 @@ namespace mork {
 
             virtual const std::string& getName() const;
 
+            NameId getNameId() const;
+
+            // Returns a handle to this node, valid until the node is destroyed. Moving a
+            // node moves its handle along with it.
+            NodeHandle getHandle() const;
+
+            // Returns the node of a handle, or nullptr if the node has been destroyed
+            static SceneNode* fromHandle(const NodeHandle& handle);
+
             virtual mat4d   getLocalToParent() const;
 
             virtual void    setLocalToParent(const mat4d& m);
@@ -74,10 +97,39 @@ namespace mork {
 
             virtual box3d   getWorldBounds() const;
 
+            virtual box3d   getLocalBounds() const;
+
+            // Returns true if this node has bounds of its own, i.e. other than the default
+            // zero size box at its origin
+            bool            hasLocalBounds() const;
+
             virtual void    setLocalBounds(const box3d& bounds);
             virtual void    enlargeLocalBounds(const box3d& bounds);
 
-            virtual void    updateLocalToWorld(const mat4d& parentLocalToWorld);
+            // Updates local to world transforms and world bounds of this node and its
+            // children. Only subtrees flagged dirty by the setters (or structural changes)
+            // are revisited, and changes only propagate while the world transforms/bounds
+            // actually change. Returns the number of nodes that were visited.
+            virtual unsigned int updateLocalToWorld(const mat4d& parentLocalToWorld);
+
+            // As above, but independent subtrees are updated in parallel on the given pool.
+            // Gives exactly the same result as the serial update.
+            unsigned int updateLocalToWorld(const mat4d& parentLocalToWorld, ThreadPool& pool);
+
+            // Returns the number of nodes in the hierarchy below and including this node
+            unsigned int getSubtreeSize() const;
+
+            // Returns a counter that changes whenever the world transform or the local
+            // bounds of this node changes
+            unsigned int getWorldVersion() const;
+
+            // Returns a counter that changes whenever nodes are added/removed anywhere in the
+            // hierarchy below this node, or a node gets or loses its local bounds
+            unsigned int getStructureVersion() const;
+
+            // Returns the node owning this node as a child, nullptr if none
+            SceneNode*          getParent();
+            const SceneNode*    getParent() const;
 
             virtual bool isVisible() const;
 
@@ -85,8 +137,53 @@ namespace mork {
 
             virtual void draw(const Program& prog) const;
 
+            // Adds the draws of this node and its visible children to queue, to be
+            // drawn with prog
+            virtual void collectDrawItems(RenderQueue& queue, const Program& prog) const;
+
         protected:
-            std::string name;
+            friend class TransformStore;
+            friend class Scene;
+
+            // Detaches this node and all its children from the transform store (if any),
+            // copying the transform state back to the nodes
+            void detachFromStore();
+
+            // Recursive part of updateLocalToWorld. Returns true if the world bounds changed.
+            bool updateWorld(const mat4d& parentLocalToWorld, bool parentChanged, unsigned int& touched);
+
+            // The two halves of updateWorld for a single node: returns true if the world
+            // transform changed/the world bounds changed
+            bool updateTransform(const mat4d& parentLocalToWorld, bool parentChanged);
+            bool updateBounds(bool worldChanged, bool childBoundsChanged);
+
+            bool isDirty() const;
+
+            // A subtree to be updated by a worker in the parallel update
+            struct UpdateTask {
+                SceneNode*      node;
+                bool            parentChanged;
+                unsigned int    touched;
+            };
+
+            // Updates the transforms of all nodes with subtrees larger than grain, and
+            // collects the smaller subtrees below them as tasks
+            void splitUpdate(const mat4d& parentLocalToWorld, bool parentChanged, unsigned int grain,
+                    std::vector<std::pair<SceneNode*, bool> >& spine, std::vector<UpdateTask>& tasks);
+
+            // Adds sizeDelta to the subtree size of this node and its ancestors, and
+            // bumps their structure versions
+            void structureChanged(int sizeDelta);
+
+            // Flags the ancestors of this node for revisit in next update
+            void markAncestorsDirty();
+
+            // Adds a child, after the checks of the addChild overloads
+            SceneNode& insertChild(std::unique_ptr<SceneNode> child);
+
+            NameId name;
+
+            NodeHandle handle;
 
             bool visible;
 
@@ -100,11 +197,42 @@ namespace mork {
 
             box3d   worldBounds;
 
-            // This is the hash map of the actual children store
-            std::unordered_map<std::string, std::unique_ptr<SceneNode> > childrenMap;
+            // This is the actual children store
+            std::vector<std::unique_ptr<SceneNode> > children;
+
+            // Children by name
+            std::unordered_map<NameId, SceneNode*> childrenMap;
 
-            // This vector provides a convenience list of children references for iterating over children
+            // This vector provides a convenience list of children references for iterating over children,
+            // in the same order as children
             std::vector<std::reference_wrapper<SceneNode> > childrenRefs;
+
+            // Dirty flags: local transform changed, local bounds (or the set of children)
+            // changed, and any descendant dirty
+            bool    transformDirty;
+            bool    boundsDirty;
+            bool    childDirty;
+
+            unsigned int subtreeSize;
+
+            unsigned int worldVersion;
+            unsigned int structureVersion;
+
+            // The index of this node in the children of its parent
+            unsigned int childIndex;
+
+            // The frustum plane that rejected this node in the last visibility test,
+            // tested first next time. -1 if none.
+            int     lastRejectingPlane;
+
+            // The node owning this node as a child, nullptr if none
+            SceneNode*  parent;
+
+            // The flat transform store this node is attached to (if any), and the index
+            // of this node in the store. While attached, the transform members above are
+            // not used, and all transforms are read/written through the store.
+            TransformStore* store;
+            int             storeIndex;
            
     };
 
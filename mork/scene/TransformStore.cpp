@@ -0,0 +1,221 @@
+#include "mork/scene/TransformStore.h"
+#include "mork/scene/SceneNode.h"
+
+namespace mork {
+
+    TransformStore::TransformStore()
+        : valid(false) {
+    }
+
+    TransformStore::~TransformStore() {
+        clear();
+    }
+
+    void TransformStore::build(SceneNode& root) {
+        clear();
+        flatten(root, -1);
+        valid = true;
+    }
+
+    void TransformStore::flatten(SceneNode& node, int parent) {
+        int index = static_cast<int>(nodes.size());
+
+        // Read through the getters, the node may be attached to another store
+        localToParent.push_back(node.getLocalToParent());
+        localToWorld.push_back(node.getLocalToWorld());
+        worldPos.push_back(node.getWorldPos());
+        localBounds.push_back(node.getLocalBounds());
+        worldBounds.push_back(node.getWorldBounds());
+        worldVersions.push_back(node.getWorldVersion());
+        parents.push_back(parent);
+        nodes.push_back(&node);
+        ends.push_back(0);
+        transformDirty.push_back(1);
+        boundsDirty.push_back(1);
+        childDirty.push_back(1);
+        worldChanged.push_back(0);
+        boundsChanged.push_back(0);
+
+        if(node.store)
+            node.store->release(node.storeIndex);
+        node.store = this;
+        node.storeIndex = index;
+
+        for(SceneNode& child : node.getChildren())
+            flatten(child, index);
+
+        ends[index] = static_cast<int>(nodes.size());
+    }
+
+    void TransformStore::clear() {
+        for(unsigned int i = 0; i < nodes.size(); ++i) {
+            SceneNode* node = nodes[i];
+            if(!node)
+                continue;
+
+            node->localToParent = localToParent[i];
+            node->localToWorld = localToWorld[i];
+            node->worldPos = worldPos[i];
+            node->localBounds = localBounds[i];
+            node->worldBounds = worldBounds[i];
+            node->worldVersion = worldVersions[i];
+            node->store = nullptr;
+            node->storeIndex = -1;
+            node->transformDirty = true;
+            node->boundsDirty = true;
+            node->childDirty = true;
+        }
+
+        localToParent.clear();
+        localToWorld.clear();
+        worldPos.clear();
+        localBounds.clear();
+        worldBounds.clear();
+        worldVersions.clear();
+        parents.clear();
+        nodes.clear();
+        ends.clear();
+        transformDirty.clear();
+        boundsDirty.clear();
+        childDirty.clear();
+        worldChanged.clear();
+        boundsChanged.clear();
+        touched.clear();
+        valid = false;
+    }
+
+    unsigned int TransformStore::update(const mat4d& rootParentLocalToWorld) {
+        if(nodes.empty())
+            return 0;
+
+        return update(0, rootParentLocalToWorld);
+    }
+
+    unsigned int TransformStore::update(int index, const mat4d& parentLocalToWorld) {
+        const int end = ends[index];
+        touched.clear();
+
+        // Forward sweep: parents are stored before their children. The first node
+        // is always recomputed, as its parent transform is unknown to the store.
+        int i = index;
+        while(i < end) {
+            int p = parents[i];
+            bool parentChanged = i == index || worldChanged[p];
+
+            if(!parentChanged && !transformDirty[i] && !boundsDirty[i] && !childDirty[i]) {
+                // Nothing changed in this subtree, skip it
+                i = ends[i];
+                continue;
+            }
+
+            touched.push_back(i);
+
+            bool changed = false;
+            if(parentChanged || transformDirty[i]) {
+                mat4d l2w = (i == index ? parentLocalToWorld : localToWorld[p])*localToParent[i];
+                changed = l2w != localToWorld[i];
+                if(changed) {
+                    localToWorld[i] = l2w;
+                    worldPos[i] = l2w*vec3d::ZERO;
+                    ++worldVersions[i];
+                }
+            }
+            worldChanged[i] = changed;
+            boundsChanged[i] = 0;
+            ++i;
+        }
+
+        // Backward sweep over the visited nodes: a subtree is stored after its root,
+        // so all children are complete before their parent is recomputed
+        for(auto it = touched.rbegin(); it != touched.rend(); ++it) {
+            i = *it;
+            if(boundsDirty[i])
+                ++worldVersions[i];
+
+            if(worldChanged[i] || boundsDirty[i] || boundsChanged[i]) {
+                box3d bounds = localToWorld[i]*localBounds[i];
+                for(int c = i + 1; c < ends[i]; c = ends[c])
+                    bounds = bounds.enlarge(worldBounds[c]);
+
+                if(bounds != worldBounds[i]) {
+                    worldBounds[i] = bounds;
+                    if(i != index)
+                        boundsChanged[parents[i]] = 1;
+                }
+            }
+            transformDirty[i] = 0;
+            boundsDirty[i] = 0;
+            childDirty[i] = 0;
+        }
+
+        return touched.size();
+    }
+
+    bool TransformStore::isValid() const {
+        return valid;
+    }
+
+    void TransformStore::invalidate() {
+        valid = false;
+    }
+
+    unsigned int TransformStore::size() const {
+        return nodes.size();
+    }
+
+    const mat4d& TransformStore::getLocalToParent(int index) const {
+        return localToParent[index];
+    }
+
+    void TransformStore::setLocalToParent(int index, const mat4d& m) {
+        localToParent[index] = m;
+        transformDirty[index] = 1;
+        markAncestorsDirty(index);
+    }
+
+    const mat4d& TransformStore::getLocalToWorld(int index) const {
+        return localToWorld[index];
+    }
+
+    const vec3d& TransformStore::getWorldPos(int index) const {
+        return worldPos[index];
+    }
+
+    const box3d& TransformStore::getLocalBounds(int index) const {
+        return localBounds[index];
+    }
+
+    void TransformStore::setLocalBounds(int index, const box3d& bounds) {
+        localBounds[index] = bounds;
+        boundsDirty[index] = 1;
+        markAncestorsDirty(index);
+    }
+
+    const box3d& TransformStore::getWorldBounds(int index) const {
+        return worldBounds[index];
+    }
+
+    unsigned int TransformStore::getWorldVersion(int index) const {
+        return worldVersions[index];
+    }
+
+    int TransformStore::getParent(int index) const {
+        return parents[index];
+    }
+
+    SceneNode* TransformStore::getNode(int index) const {
+        return nodes[index];
+    }
+
+    void TransformStore::markAncestorsDirty(int index) {
+        // Ancestors of a flagged node are always flagged, so stop at the first one
+        for(int p = parents[index]; p >= 0 && !childDirty[p]; p = parents[p])
+            childDirty[p] = 1;
+    }
+
+    void TransformStore::release(int index) {
+        nodes[index] = nullptr;
+        valid = false;
+    }
+
+}
@@ -0,0 +1,112 @@
+#ifndef _MORK_TRANSFORMSTORE_H_
+#define _MORK_TRANSFORMSTORE_H_
+
+#include <vector>
+
+#include "mork/math/mat4.h"
+#include "mork/math/box3.h"
+
+namespace mork {
+
+    class SceneNode;
+
+    // A flat, data oriented store of the transform state of a node hierarchy.
+    // Nodes are stored in depth-first order, so a parent is always stored before
+    // any of its children. World transforms can then be propagated with a single
+    // forward sweep, and world bounds with a single backward sweep, without
+    // chasing pointers through the hierarchy.
+    //
+    // Nodes attached to a store keep only their index into it, and all transform
+    // related getters/setters on SceneNode are redirected to the store.
+    //
+    // As for SceneNode, setters flag the changed node dirty and its ancestors for
+    // revisit, and an update skips every subtree without changes.
+    class TransformStore {
+        public:
+            TransformStore();
+            ~TransformStore();
+
+            TransformStore(const TransformStore&) = delete;
+            TransformStore& operator=(const TransformStore&) = delete;
+
+            // Flattens the hierarchy below (and including) root into this store,
+            // and attaches all the nodes to it. Any nodes already attached are
+            // detached first.
+            void build(SceneNode& root);
+
+            // Detaches all nodes from this store, copying their transform state
+            // back to the nodes themselves.
+            void clear();
+
+            // Propagates local to world transforms and world bounds for all nodes,
+            // using the given transform as the parent of the root node.
+            // Returns the number of nodes that were visited.
+            unsigned int update(const mat4d& rootParentLocalToWorld);
+
+            // As above, but only for the subtree starting at index
+            unsigned int update(int index, const mat4d& parentLocalToWorld);
+
+            // A store is invalidated whenever the structure of the attached
+            // hierarchy changes, and must be rebuilt before next update.
+            bool isValid() const;
+            void invalidate();
+
+            unsigned int size() const;
+
+            const mat4d&    getLocalToParent(int index) const;
+            void            setLocalToParent(int index, const mat4d& m);
+
+            const mat4d&    getLocalToWorld(int index) const;
+            const vec3d&    getWorldPos(int index) const;
+
+            const box3d&    getLocalBounds(int index) const;
+            void            setLocalBounds(int index, const box3d& bounds);
+
+            const box3d&    getWorldBounds(int index) const;
+
+            unsigned int    getWorldVersion(int index) const;
+
+            // Returns the index of the parent of the given node, or -1 for the root
+            int             getParent(int index) const;
+
+            // Returns the node stored at index, or nullptr if it was released
+            SceneNode*      getNode(int index) const;
+
+        private:
+            friend class SceneNode;
+
+            // Called by SceneNode when an attached node is moved or destroyed
+            void release(int index);
+
+            void flatten(SceneNode& node, int parent);
+
+            // Flags the ancestors of index for revisit in next update
+            void markAncestorsDirty(int index);
+
+            bool valid;
+
+            std::vector<mat4d>      localToParent;
+            std::vector<mat4d>      localToWorld;
+            std::vector<vec3d>      worldPos;
+            std::vector<box3d>      localBounds;
+            std::vector<box3d>      worldBounds;
+            std::vector<unsigned int> worldVersions;
+            std::vector<int>        parents;
+            std::vector<SceneNode*> nodes;
+
+            // One past the last index of the subtree starting at each index
+            std::vector<int>        ends;
+
+            std::vector<char>       transformDirty;
+            std::vector<char>       boundsDirty;
+            std::vector<char>       childDirty;
+
+            // Scratch state for update
+            std::vector<char>       worldChanged;
+            std::vector<char>       boundsChanged;
+            std::vector<int>        touched;
+    };
+
+}
+
+#endif
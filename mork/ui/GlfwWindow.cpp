@@ -2,6 +2,7 @@
 #include "mork/core/Log.h"
 #include "mork/core/DebugMessageCallback.h"
 #include "mork/render/Framebuffer.h"
+#include "mork/render/GLState.h"
 
 #include <assert.h>
 #include <stdexcept>
@@ -121,6 +122,9 @@ GlfwWindow::GlfwWindow(const Parameters &params) : Window(params), glfwWindowHan
         throw std::runtime_error("");
     }    
 
+    // Bindings cached for a previous context are not valid in this one
+    GLState::getInstance().reset();
+
     GLint flags; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
 	if (flags & GL_CONTEXT_FLAG_DEBUG_BIT)
 	{
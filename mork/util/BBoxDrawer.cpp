@@ -2,6 +2,8 @@
 
 #include "mork/render/Material.h"
 
+#include <algorithm>
+
 
 namespace mork {
     const char *vertexShaderSource = 
@@ -28,21 +30,20 @@ namespace mork {
     
     std::unique_ptr<VertexArrayObject>   BBoxDrawer::vao;
     
-    std::unique_ptr<DynamicVertexBuffer<vertex_pos3> > BBoxDrawer::buf;
+    std::unique_ptr<StreamBuffer> BBoxDrawer::buf;
  
     void BBoxDrawer::drawBox(const box3d& box, const mat4d& projection, const mat4d& view) {
 
         if(!initialized) {
             vao = std::make_unique<VertexArrayObject>();
-            buf = std::make_unique<DynamicVertexBuffer<vertex_pos3> >(); 
+            buf = std::make_unique<StreamBuffer>(1 << 16); 
             prog = std::make_unique<Program>(vertexShaderSource, fragmentShaderSource);
             vao->bind();
-            buf->bind();
+            buf->bind(GL_ARRAY_BUFFER);
             
-            buf->setAttributes();
-            buf->setBufferSize(sizeof(vertex_pos3)*24);
+            vertex_pos3::setAttributes();
              
-            buf->unbind();
+            buf->unbind(GL_ARRAY_BUFFER);
             vao->unbind();    
 
             initialized = true;
@@ -100,11 +101,13 @@ namespace mork {
             //vec3f(xp, ym, zp),
         };
         
-        buf->setData(verts);
+        size_t first;
+        vertex_pos3* dst = buf->allocate<vertex_pos3>(verts.size(), first);
+        std::copy(verts.begin(), verts.end(), dst);
 
         // Prepare drawing:
         vao->bind();
-        glDrawArrays(GL_LINES, 0, 24);        
+        glDrawArrays(GL_LINES, first, 24);        
 
 
     }
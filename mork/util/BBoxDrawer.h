@@ -5,6 +5,7 @@
 #include "mork/render/Program.h"
 #include "mork/render/VertexBuffer.h"
 #include "mork/render/VertexArrayObject.h"
+#include "mork/render/StreamBuffer.h"
 
 namespace mork {
 
@@ -15,7 +16,7 @@ namespace mork {
 
         private:
             static std::unique_ptr<VertexArrayObject>   vao;
-            static std::unique_ptr<DynamicVertexBuffer<vertex_pos3> > buf;
+            static std::unique_ptr<StreamBuffer> buf;
             static std::unique_ptr<Program> prog;
             static bool initialized;
     };
@@ -0,0 +1,111 @@
+#include "mork/util/MappedFile.h"
+#include "mork/core/Log.h"
+
+#include <stdexcept>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#warn THIS CODE IS NOT TESTED ON WINDOWS
+#endif
+
+namespace mork {
+
+#ifndef WIN32
+    MappedFile::MappedFile(const std::string& file) : address(nullptr), length(0) {
+        int fd = open(file.c_str(), O_RDONLY);
+        if(fd < 0) {
+            error_logger("File \"", file, "\" could not be opened");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0) {
+            close(fd);
+            error_logger("File \"", file, "\" could not be read");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        length = st.st_size;
+        // Empty files can not be mapped, and have no data to read
+        if(length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED) {
+                close(fd);
+                error_logger("File \"", file, "\" could not be mapped");
+                throw std::runtime_error(error_logger.last());
+            }
+            // Files are mostly read front to back, once
+            madvise(p, length, MADV_SEQUENTIAL);
+            madvise(p, length, MADV_WILLNEED);
+            address = static_cast<const unsigned char*>(p);
+        }
+        // The mapping stays valid after closing
+        close(fd);
+    }
+
+    void MappedFile::unmap() {
+        if(address != nullptr)
+            munmap(const_cast<unsigned char*>(address), length);
+        address = nullptr;
+        length = 0;
+    }
+#else
+    MappedFile::MappedFile(const std::string& file) : address(nullptr), length(0) {
+        std::ifstream in(file, std::ios::binary);
+        if(!in) {
+            error_logger("File \"", file, "\" could not be opened");
+            throw std::runtime_error(error_logger.last());
+        }
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        address = contents.data();
+        length = contents.size();
+    }
+
+    void MappedFile::unmap() {
+        contents.clear();
+        address = nullptr;
+        length = 0;
+    }
+#endif
+
+    MappedFile::~MappedFile() {
+        unmap();
+    }
+
+    MappedFile::MappedFile(MappedFile&& o) noexcept : address(o.address), length(o.length) {
+#ifdef WIN32
+        contents = std::move(o.contents);
+#endif
+        o.address = nullptr;
+        o.length = 0;
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+        if(this != &o) {
+            unmap();
+            address = o.address;
+            length = o.length;
+#ifdef WIN32
+            contents = std::move(o.contents);
+#endif
+            o.address = nullptr;
+            o.length = 0;
+        }
+        return *this;
+    }
+
+    const unsigned char* MappedFile::data() const {
+        return address;
+    }
+
+    size_t MappedFile::size() const {
+        return length;
+    }
+
+}
@@ -0,0 +1,40 @@
+#ifndef _MORK_MAPPEDFILE_H_
+#define _MORK_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mork {
+
+    // A file mapped read only into memory, so its contents can be read (e.g.
+    // uploaded to the GPU) without copying them into buffers first. Pages are
+    // read by the OS as they are touched. Unmapped on destruction.
+    class MappedFile {
+        public:
+            // Maps file, throws if it can not be opened or mapped
+            MappedFile(const std::string& file);
+            ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            MappedFile(MappedFile&& o) noexcept;
+            MappedFile& operator=(MappedFile&& o) noexcept;
+
+            const unsigned char* data() const;
+            size_t size() const;
+
+        private:
+            void unmap();
+
+            const unsigned char*    address;
+            size_t                  length;
+#ifdef WIN32
+            // Not mapped on Windows, the file is read instead
+            std::vector<unsigned char> contents;
+#endif
+    };
+
+}
+
+#endif
@@ -1,4 +1,14 @@
 #include "MeshUtil.h"
+#include "mork/core/Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
 
 namespace mork {
     
@@ -115,6 +125,992 @@ namespace mork {
 
     }
 
+    // Symmetric 4x4 matrix summing the squared distances to a set of planes, weighted
+    // by triangle area, with the total weight to normalize the error
+    struct Quadric {
+        double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+        double w;
+
+        Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), w(0) {}
+
+        void addPlane(const vec3d& n, double d, double weight) {
+            a00 += weight*n.x*n.x; a01 += weight*n.x*n.y; a02 += weight*n.x*n.z; a03 += weight*n.x*d;
+            a11 += weight*n.y*n.y; a12 += weight*n.y*n.z; a13 += weight*n.y*d;
+            a22 += weight*n.z*n.z; a23 += weight*n.z*d;
+            a33 += weight*d*d;
+            w += weight;
+        }
+
+        Quadric& operator+=(const Quadric& q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            w += q.w;
+            return *this;
+        }
+
+        // Mean squared distance from p to the planes
+        double error(const vec3d& p) const {
+            double e = a00*p.x*p.x + a11*p.y*p.y + a22*p.z*p.z + a33
+                + 2*(a01*p.x*p.y + a02*p.x*p.z + a12*p.y*p.z + a03*p.x + a13*p.y + a23*p.z);
+            return w > 0 ? std::max(e, 0.0)/w : 0.0;
+        }
+    };
+
+    // Length of the bounding box diagonal
+    static double meshExtent(const std::vector<vec3f>& positions) {
+        if(positions.empty())
+            return 0.0;
+
+        vec3d lo = positions[0].cast<double>();
+        vec3d hi = lo;
+        for(const vec3f& p : positions) {
+            lo = vec3d(std::min(lo.x, (double)p.x), std::min(lo.y, (double)p.y), std::min(lo.z, (double)p.z));
+            hi = vec3d(std::max(hi.x, (double)p.x), std::max(hi.y, (double)p.y), std::max(hi.z, (double)p.z));
+        }
+        return (hi - lo).length();
+    }
+
+    // Checks that collapsing from into to keeps the surface manifold (the link
+    // condition), and does not flip or fold any of the remaining triangles around from
+    static bool isValidCollapse(unsigned int from, unsigned int to,
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            const std::vector<std::vector<unsigned int> >& vertexTriangles) {
+
+        std::vector<unsigned int> fromNeighbours, toNeighbours;
+        unsigned int shared = 0;
+        for(unsigned int t : vertexTriangles[from]) {
+            const unsigned int* tri = &indices[3*t];
+            bool hasTo = tri[0] == to || tri[1] == to || tri[2] == to;
+            if(hasTo) {
+                ++shared;
+            } else {
+                // The triangle is kept with from replaced by to, so it must not flip
+                vec3f p[3], q[3];
+                for(int k = 0; k < 3; ++k) {
+                    p[k] = positions[tri[k]];
+                    q[k] = tri[k] == from ? positions[to] : p[k];
+                }
+                vec3f n0 = (p[1] - p[0]).crossProduct(p[2] - p[0]);
+                vec3f n1 = (q[1] - q[0]).crossProduct(q[2] - q[0]);
+                // Also rejects normals turning by more than about 75 degrees, as for
+                // slivers standing on edge
+                if(n0.dotproduct(n1) <= 0.25f*n0.length()*n1.length())
+                    return false;
+            }
+            for(int k = 0; k < 3; ++k) {
+                if(tri[k] != from && tri[k] != to)
+                    fromNeighbours.push_back(tri[k]);
+            }
+        }
+        for(unsigned int t : vertexTriangles[to]) {
+            const unsigned int* tri = &indices[3*t];
+            for(int k = 0; k < 3; ++k) {
+                if(tri[k] != from && tri[k] != to)
+                    toNeighbours.push_back(tri[k]);
+            }
+        }
+
+        std::sort(fromNeighbours.begin(), fromNeighbours.end());
+        fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+        std::sort(toNeighbours.begin(), toNeighbours.end());
+        toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+
+        std::vector<unsigned int> common;
+        std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(),
+                toNeighbours.begin(), toNeighbours.end(), std::back_inserter(common));
+
+        return common.size() == shared;
+    }
+
+    std::vector<unsigned int> MeshUtil::simplify(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            std::size_t targetIndexCount,
+            float targetError,
+            float* resultError) {
+
+        std::vector<unsigned int> result(indices.begin(), indices.begin() + indices.size()/3*3);
+        if(resultError)
+            *resultError = 0.0f;
+
+        double extent = meshExtent(positions);
+        if(result.size() <= targetIndexCount || extent == 0.0)
+            return result;
+
+        std::size_t n = positions.size();
+
+        // Vertices on open or non-manifold edges are locked. As split vertices do not
+        // share edges, this also keeps UV seams and normal creases.
+        std::unordered_map<uint64_t, int> edges;
+        for(std::size_t i = 0; i < result.size(); i += 3) {
+            for(int k = 0; k < 3; ++k) {
+                uint64_t a = result[i + k];
+                uint64_t b = result[i + (k + 1)%3];
+                ++edges[std::min(a, b) << 32 | std::max(a, b)];
+            }
+        }
+        std::vector<char> locked(n, 0);
+        for(const auto& e : edges) {
+            if(e.second != 2) {
+                locked[e.first >> 32] = 1;
+                locked[e.first & 0xffffffff] = 1;
+            }
+        }
+
+        std::vector<Quadric> quadrics(n);
+        for(std::size_t i = 0; i < result.size(); i += 3) {
+            vec3d p0 = positions[result[i]].cast<double>();
+            vec3d p1 = positions[result[i+1]].cast<double>();
+            vec3d p2 = positions[result[i+2]].cast<double>();
+            vec3d normal = (p1 - p0).crossProduct(p2 - p0);
+            double len = normal.length();
+            if(len == 0.0)
+                continue;
+            normal = normal/len;
+            for(int k = 0; k < 3; ++k)
+                quadrics[result[i+k]].addPlane(normal, -normal.dotproduct(p0), 0.5*len);
+        }
+
+        double maxCost = std::numeric_limits<double>::max();
+        if(targetError < std::numeric_limits<float>::max())
+            maxCost = (targetError*extent)*(targetError*extent);
+
+        struct Collapse {
+            unsigned int    from;
+            unsigned int    to;
+            double          cost;
+        };
+
+        std::size_t triangles = result.size()/3;
+        std::size_t targetTriangles = targetIndexCount/3;
+        double reached = 0.0;
+
+        std::vector<std::vector<unsigned int> > vertexTriangles(n);
+        std::vector<Collapse> collapses;
+        std::vector<char> touched(n);
+
+        // Each pass collapses the cheapest edges in non-overlapping neighbourhoods,
+        // so the adjacency only has to be rebuilt once per pass
+        while(triangles > targetTriangles) {
+            for(auto& vt : vertexTriangles)
+                vt.clear();
+            for(unsigned int t = 0; t < triangles; ++t) {
+                for(int k = 0; k < 3; ++k)
+                    vertexTriangles[result[3*t + k]].push_back(t);
+            }
+
+            collapses.clear();
+            for(std::size_t i = 0; i < result.size(); i += 3) {
+                for(int k = 0; k < 3; ++k) {
+                    unsigned int a = result[i + k];
+                    unsigned int b = result[i + (k + 1)%3];
+                    for(int dir = 0; dir < 2; ++dir) {
+                        unsigned int from = dir ? b : a;
+                        unsigned int to = dir ? a : b;
+                        if(locked[from])
+                            continue;
+                        Quadric q = quadrics[from];
+                        q += quadrics[to];
+                        collapses.push_back({from, to, q.error(positions[to].cast<double>())});
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(),
+                    [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+            std::fill(touched.begin(), touched.end(), 0);
+            unsigned int performed = 0;
+            for(const Collapse& c : collapses) {
+                if(triangles <= targetTriangles || c.cost > maxCost)
+                    break;
+                if(touched[c.from] || touched[c.to])
+                    continue;
+                if(!isValidCollapse(c.from, c.to, positions, result, vertexTriangles))
+                    continue;
+
+                for(unsigned int t : vertexTriangles[c.from]) {
+                    unsigned int* tri = &result[3*t];
+                    if(tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                        --triangles;
+                    for(int k = 0; k < 3; ++k) {
+                        touched[tri[k]] = 1;
+                        if(tri[k] == c.from)
+                            tri[k] = c.to;
+                    }
+                }
+                quadrics[c.to] += quadrics[c.from];
+                reached = std::max(reached, c.cost);
+                ++performed;
+            }
+
+            // Remove the collapsed triangles
+            std::size_t out = 0;
+            for(std::size_t i = 0; i < result.size(); i += 3) {
+                unsigned int a = result[i], b = result[i+1], c = result[i+2];
+                if(a == b || b == c || a == c)
+                    continue;
+                result[out++] = a;
+                result[out++] = b;
+                result[out++] = c;
+            }
+            result.resize(out);
+
+            if(performed == 0)
+                break;
+        }
+
+        if(resultError)
+            *resultError = static_cast<float>(std::sqrt(reached)/extent);
+
+        return result;
+    }
+
+    std::vector<std::vector<unsigned int> > MeshUtil::generateLodChain(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            unsigned int levels,
+            float ratio,
+            std::vector<float>* errors) {
+
+        std::vector<std::vector<unsigned int> > chain;
+        chain.push_back(indices);
+        if(errors) {
+            errors->clear();
+            errors->push_back(0.0f);
+        }
+
+        double extent = meshExtent(positions);
+        float lastError = 0.0f;
+        std::size_t target = indices.size();
+        for(unsigned int level = 1; level < levels; ++level) {
+            target = static_cast<std::size_t>(target/3*ratio)*3;
+            if(target < 3)
+                break;
 
+            // Each level is simplified from the full mesh, so the quadrics hold the
+            // error against the original surface
+            float error;
+            std::vector<unsigned int> lod = simplify(positions, indices, target,
+                    std::numeric_limits<float>::max(), &error);
+            if(lod.size() >= chain.back().size())
+                break;
+
+            lastError = std::max(lastError, static_cast<float>(error*extent));
+            chain.push_back(std::move(lod));
+            if(errors)
+                errors->push_back(lastError);
+        }
+
+        return chain;
+    }
+
+    unsigned int MeshUtil::generateLods(Mesh<vertex_pos_norm_tang_bitang_uv>& mesh, unsigned int levels, float ratio) {
+        if(!mesh.isIndexed()) {
+            error_logger("LODs can only be generated for indexed meshes");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        // Read back the vertices and the indices of the full mesh
+        std::vector<vec3f> positions(mesh.getNumVertices());
+        std::vector<unsigned int> indices(mesh.getNumIndices());
+        {
+            auto vb_bw = ConstBufferView<VertexBuffer<vertex_pos_norm_tang_bitang_uv> >(mesh.getVertexBuffer());
+            const auto* vertices = static_cast<const vertex_pos_norm_tang_bitang_uv*>(vb_bw.get());
+            for(std::size_t i = 0; i < positions.size(); ++i)
+                positions[i] = vertices[i].pos;
+        }
+        {
+            auto ib_bw = ConstBufferView<IndexBuffer>(mesh.getIndexBuffer());
+            std::memcpy(indices.data(), ib_bw.get(), indices.size()*sizeof(unsigned int));
+        }
+
+        std::vector<float> errors;
+        auto chain = generateLodChain(positions, indices, levels, ratio, &errors);
+        mesh.setLods(chain, errors);
+
+        return chain.size();
+    }
+
+    // A FIFO vertex cache, by the time each vertex entered it. Returns true on
+    // a miss, which adds the vertex.
+    class VertexCache {
+        public:
+            VertexCache(std::size_t vertexCount, unsigned int size)
+                : times(vertexCount, 0), time(size + 1), size(size) {}
+
+            bool miss(unsigned int v) {
+                if(time - times[v] <= size)
+                    return false;
+                times[v] = time++;
+                return true;
+            }
+
+            // Empties the cache
+            void flush() {
+                time += size + 1;
+            }
+
+        private:
+            std::vector<unsigned int>   times;
+            unsigned int                time;
+            unsigned int                size;
+    };
+
+    MeshUtil::VertexCacheStats MeshUtil::analyzeVertexCache(
+            const std::vector<unsigned int>& indices,
+            std::size_t vertexCount,
+            unsigned int cacheSize) {
+
+        VertexCacheStats stats = {0, 0.0f, 0.0f};
+        VertexCache cache(vertexCount, cacheSize);
+        std::vector<char> used(vertexCount, 0);
+        std::size_t referenced = 0;
+        for(unsigned int v : indices) {
+            if(cache.miss(v))
+                ++stats.transformed;
+            if(!used[v]) {
+                used[v] = 1;
+                ++referenced;
+            }
+        }
+
+        std::size_t triangles = indices.size()/3;
+        stats.acmr = triangles > 0 ? float(stats.transformed)/triangles : 0.0f;
+        stats.atvr = referenced > 0 ? float(stats.transformed)/referenced : 0.0f;
+        return stats;
+    }
+
+    std::vector<unsigned int> MeshUtil::generateWeldRemap(
+            const void* vertices,
+            std::size_t vertexCount,
+            std::size_t vertexSize,
+            std::size_t* uniqueCount) {
+
+        const char* data = static_cast<const char*>(vertices);
+        std::unordered_map<std::string_view, unsigned int> unique;
+        unique.reserve(vertexCount);
+
+        std::vector<unsigned int> remap(vertexCount);
+        for(std::size_t i = 0; i < vertexCount; ++i) {
+            auto r = unique.emplace(std::string_view(data + i*vertexSize, vertexSize), unique.size());
+            remap[i] = r.first->second;
+        }
+
+        if(uniqueCount)
+            *uniqueCount = unique.size();
+        return remap;
+    }
+
+    std::vector<unsigned int> MeshUtil::optimizeVertexCache(
+            const std::vector<unsigned int>& indices,
+            std::size_t vertexCount,
+            unsigned int cacheSize) {
+
+        std::size_t triangles = indices.size()/3;
+        std::vector<unsigned int> result;
+        result.reserve(triangles*3);
+        if(triangles == 0 || vertexCount == 0)
+            return result;
+
+        // The triangles of each vertex
+        std::vector<unsigned int> offsets(vertexCount + 1, 0);
+        for(std::size_t i = 0; i < triangles*3; ++i)
+            ++offsets[indices[i] + 1];
+        for(std::size_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<unsigned int> vertexTriangles(triangles*3);
+        {
+            std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+            for(std::size_t i = 0; i < triangles*3; ++i)
+                vertexTriangles[fill[indices[i]]++] = i/3;
+        }
+
+        // Triangles not emitted yet, per vertex
+        std::vector<unsigned int> live(vertexCount);
+        for(std::size_t v = 0; v < vertexCount; ++v)
+            live[v] = offsets[v + 1] - offsets[v];
+
+        std::vector<unsigned int> cacheTimes(vertexCount, 0);
+        std::vector<char> emitted(triangles, 0);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        unsigned int time = cacheSize + 1;
+        std::size_t cursor = 0;
+
+        long fanning = 0;
+        while(fanning >= 0) {
+            candidates.clear();
+            for(unsigned int k = offsets[fanning]; k < offsets[fanning + 1]; ++k) {
+                unsigned int t = vertexTriangles[k];
+                if(emitted[t])
+                    continue;
+                emitted[t] = 1;
+                for(int c = 0; c < 3; ++c) {
+                    unsigned int v = indices[3*t + c];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if(time - cacheTimes[v] > cacheSize)
+                        cacheTimes[v] = time++;
+                }
+            }
+
+            // The candidate staying longest in the cache after its remaining
+            // triangles are emitted
+            long next = -1;
+            long best = -1;
+            for(unsigned int v : candidates) {
+                if(live[v] == 0)
+                    continue;
+                long priority = 0;
+                if(time - cacheTimes[v] + 2*live[v] <= cacheSize)
+                    priority = time - cacheTimes[v];
+                if(priority > best) {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            // A dead end: continue with a recently used vertex, or the next one
+            // with triangles left
+            while(next < 0 && !deadEnd.empty()) {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if(live[v] > 0)
+                    next = v;
+            }
+            while(next < 0 && cursor < vertexCount) {
+                if(live[cursor] > 0)
+                    next = cursor;
+                ++cursor;
+            }
+            fanning = next;
+        }
+
+        return result;
+    }
+
+    std::vector<unsigned int> MeshUtil::optimizeOverdraw(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            float threshold,
+            unsigned int cacheSize) {
+
+        std::size_t triangles = indices.size()/3;
+        if(triangles == 0)
+            return std::vector<unsigned int>(indices.begin(), indices.begin() + triangles*3);
+
+        // Hard boundaries, where all vertices of a triangle miss the cache
+        std::vector<std::size_t> hard;
+        {
+            VertexCache cache(positions.size(), cacheSize);
+            for(std::size_t t = 0; t < triangles; ++t) {
+                int misses = 0;
+                for(int c = 0; c < 3; ++c)
+                    misses += cache.miss(indices[3*t + c]);
+                if(t == 0 || misses == 3)
+                    hard.push_back(t);
+            }
+            hard.push_back(triangles);
+        }
+
+        // Soft boundaries, where the run so far has an ACMR close enough to that of
+        // the whole hard cluster
+        std::vector<std::size_t> clusters;
+        {
+            VertexCache cache(positions.size(), cacheSize);
+            for(std::size_t h = 0; h + 1 < hard.size(); ++h) {
+                std::size_t start = hard[h], end = hard[h + 1];
+
+                cache.flush();
+                unsigned int misses = 0;
+                for(std::size_t t = start; t < end; ++t)
+                    for(int c = 0; c < 3; ++c)
+                        misses += cache.miss(indices[3*t + c]);
+                float clusterThreshold = threshold*float(misses)/float(end - start);
+
+                cache.flush();
+                clusters.push_back(start);
+                unsigned int runMisses = 0, runTriangles = 0;
+                for(std::size_t t = start; t < end; ++t) {
+                    for(int c = 0; c < 3; ++c)
+                        runMisses += cache.miss(indices[3*t + c]);
+                    ++runTriangles;
+                    if(t + 1 < end && float(runMisses) <= clusterThreshold*runTriangles) {
+                        clusters.push_back(t + 1);
+                        cache.flush();
+                        runMisses = 0;
+                        runTriangles = 0;
+                    }
+                }
+            }
+            clusters.push_back(triangles);
+        }
+
+        // Area weighted centroids and normals of the clusters and the mesh
+        std::size_t numClusters = clusters.size() - 1;
+        std::vector<vec3d> centroids(numClusters, vec3d::ZERO), normals(numClusters, vec3d::ZERO);
+        std::vector<double> areas(numClusters, 0.0);
+        vec3d meshCentroid = vec3d::ZERO;
+        double meshArea = 0.0;
+        for(std::size_t c = 0; c < numClusters; ++c) {
+            for(std::size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+                vec3d p0 = positions[indices[3*t]].cast<double>();
+                vec3d p1 = positions[indices[3*t + 1]].cast<double>();
+                vec3d p2 = positions[indices[3*t + 2]].cast<double>();
+                vec3d n = (p1 - p0).crossProduct(p2 - p0);
+                double area = n.length();
+                normals[c] += n;
+                centroids[c] += (p0 + p1 + p2)*(area/3.0);
+                areas[c] += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += areas[c];
+        }
+        if(meshArea > 0.0)
+            meshCentroid = meshCentroid/meshArea;
+
+        // Clusters facing away from the center are drawn first
+        std::vector<double> sortKeys(numClusters, 0.0);
+        for(std::size_t c = 0; c < numClusters; ++c) {
+            double length = normals[c].length();
+            if(areas[c] > 0.0 && length > 0.0)
+                sortKeys[c] = (centroids[c]/areas[c] - meshCentroid).dotproduct(normals[c])/length;
+        }
+        std::vector<std::size_t> order(numClusters);
+        for(std::size_t c = 0; c < numClusters; ++c)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<unsigned int> result;
+        result.reserve(triangles*3);
+        for(std::size_t c : order)
+            result.insert(result.end(), indices.begin() + 3*clusters[c], indices.begin() + 3*clusters[c + 1]);
+        return result;
+    }
+
+    std::vector<unsigned int> MeshUtil::generateFetchRemap(
+            const std::vector<unsigned int>& indices,
+            std::size_t vertexCount,
+            std::size_t* usedCount) {
+
+        std::vector<unsigned int> remap(vertexCount, ~0u);
+        unsigned int next = 0;
+        for(unsigned int v : indices) {
+            if(remap[v] == ~0u)
+                remap[v] = next++;
+        }
+
+        if(usedCount)
+            *usedCount = next;
+        return remap;
+    }
+
+    unsigned short MeshUtil::floatToHalf(float f) {
+        uint32_t x;
+        std::memcpy(&x, &f, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t bits = x & 0x7fffffff;
+
+        // Infinity and NaN
+        if(bits >= 0x7f800000)
+            return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+        // Rounds to 65536 or more
+        if(bits >= 0x477ff000)
+            return sign | 0x7c00;
+        // Normal halfs, the rounding may carry into the exponent
+        if(bits >= 0x38800000)
+            return sign | ((bits - 0x38000000 + 0xfff + ((bits >> 13) & 1)) >> 13);
+        // Subnormal halfs, or zero
+        uint32_t exponent = bits >> 23;
+        if(exponent < 102)
+            return sign;
+        uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if(rest > half || (rest == half && (h & 1)))
+            ++h;
+        return sign | h;
+    }
+
+    float MeshUtil::halfToFloat(unsigned short h) {
+        uint32_t sign = uint32_t(h & 0x8000) << 16;
+        uint32_t exponent = (h >> 10) & 0x1f;
+        uint32_t mantissa = h & 0x3ff;
+
+        if(exponent == 0) {
+            float f = std::ldexp(float(mantissa), -24);
+            return sign ? -f : f;
+        }
+
+        uint32_t x;
+        if(exponent == 31)
+            x = sign | 0x7f800000 | (mantissa << 13);
+        else
+            x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        float f;
+        std::memcpy(&f, &x, sizeof(f));
+        return f;
+    }
+
+    static float toSnorm(short q) {
+        return std::max(q/32767.0f, -1.0f);
+    }
+
+    vec3f MeshUtil::decodeOctahedral(short x, short y) {
+        vec3f v(toSnorm(x), toSnorm(y), 0.0f);
+        v.z = 1.0f - std::abs(v.x) - std::abs(v.y);
+        // The lower hemisphere is folded over the diagonals
+        float t = std::max(-v.z, 0.0f);
+        v.x += v.x >= 0.0f ? -t : t;
+        v.y += v.y >= 0.0f ? -t : t;
+        return v.normalize();
+    }
+
+    void MeshUtil::encodeOctahedral(const vec3f& v, short& x, short& y) {
+        float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+        if(l1 == 0.0f) {
+            x = y = 0;
+            return;
+        }
+
+        float px = v.x/l1;
+        float py = v.y/l1;
+        if(v.z < 0.0f) {
+            float fx = (1.0f - std::abs(py))*(px >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - std::abs(px))*(py >= 0.0f ? 1.0f : -1.0f);
+            px = fx;
+            py = fy;
+        }
+
+        // Rounding each coordinate separately is not the closest encoding, try
+        // all neighbours. Compared by the sine of the error, as its cosine is 1 in
+        // float precision
+        vec3f n = v.normalize();
+        float best = std::numeric_limits<float>::max();
+        float bx = std::floor(std::clamp(px, -1.0f, 1.0f)*32767.0f);
+        float by = std::floor(std::clamp(py, -1.0f, 1.0f)*32767.0f);
+        for(int i = 0; i < 4; ++i) {
+            short qx = static_cast<short>(std::clamp(bx + (i & 1), -32767.0f, 32767.0f));
+            short qy = static_cast<short>(std::clamp(by + (i >> 1), -32767.0f, 32767.0f));
+            float error = decodeOctahedral(qx, qy).crossProduct(n).length();
+            if(error < best) {
+                best = error;
+                x = qx;
+                y = qy;
+            }
+        }
+    }
+
+    // Precise for small angles too, unlike the acos of the dot product
+    static float angleBetween(const vec3f& a, const vec3f& b) {
+        return std::atan2(a.crossProduct(b).length(), a.dotproduct(b));
+    }
+
+    std::vector<vertex_pos_norm_tang_uv_packed> MeshUtil::packVertices(
+            const std::vector<vertex_pos_norm_tang_bitang_uv>& vertices,
+            VertexPacking& packing) {
+
+        packing.offset = vec3f::ZERO;
+        packing.scale = vec3f::ZERO;
+        packing.positionError = 0.0f;
+        packing.normalError = 0.0f;
+        packing.tangentError = 0.0f;
+        packing.uvError = 0.0f;
+
+        std::vector<vertex_pos_norm_tang_uv_packed> packed(vertices.size());
+        if(vertices.empty())
+            return packed;
+
+        vec3f lo = vertices[0].pos, hi = vertices[0].pos;
+        for(const auto& v : vertices) {
+            lo = vec3f(std::min(lo.x, v.pos.x), std::min(lo.y, v.pos.y), std::min(lo.z, v.pos.z));
+            hi = vec3f(std::max(hi.x, v.pos.x), std::max(hi.y, v.pos.y), std::max(hi.z, v.pos.z));
+        }
+        packing.offset = lo;
+        packing.scale = hi - lo;
+
+        auto quantize = [](float p, float lo, float extent) {
+            if(extent <= 0.0f)
+                return static_cast<unsigned short>(0);
+            return static_cast<unsigned short>(std::lround(std::clamp((p - lo)/extent, 0.0f, 1.0f)*65535.0f));
+        };
+
+        for(std::size_t i = 0; i < vertices.size(); ++i) {
+            const auto& v = vertices[i];
+            auto& p = packed[i];
+
+            p.pos.x = quantize(v.pos.x, lo.x, packing.scale.x);
+            p.pos.y = quantize(v.pos.y, lo.y, packing.scale.y);
+            p.pos.z = quantize(v.pos.z, lo.z, packing.scale.z);
+            // A missing bitangent is taken as a right handed frame
+            bool leftHanded = v.norm.crossProduct(v.tang).dotproduct(v.bitang) < 0.0f;
+            p.pos.w = leftHanded ? 0 : 65535;
+
+            encodeOctahedral(v.norm, p.normTang[0], p.normTang[1]);
+            encodeOctahedral(v.tang, p.normTang[2], p.normTang[3]);
+            p.uv[0] = floatToHalf(v.uv.x);
+            p.uv[1] = floatToHalf(v.uv.y);
+
+            // Measured errors, zero vectors (e.g. missing tangents) are not counted
+            packing.positionError = std::max(packing.positionError, (packing.decode(vec3f(p.pos)) - v.pos).length());
+            if(v.norm.length() > 0.0f)
+                packing.normalError = std::max(packing.normalError, angleBetween(decodeOctahedral(p.normTang[0], p.normTang[1]), v.norm));
+            if(v.tang.length() > 0.0f)
+                packing.tangentError = std::max(packing.tangentError, angleBetween(decodeOctahedral(p.normTang[2], p.normTang[3]), v.tang));
+            packing.uvError = std::max(packing.uvError, std::max(std::abs(halfToFloat(p.uv[0]) - v.uv.x), std::abs(halfToFloat(p.uv[1]) - v.uv.y)));
+        }
+
+        return packed;
+    }
+
+    std::vector<vertex_pos_norm_tang_bitang_uv> MeshUtil::unpackVertices(
+            const std::vector<vertex_pos_norm_tang_uv_packed>& vertices,
+            const VertexPacking& packing) {
+
+        std::vector<vertex_pos_norm_tang_bitang_uv> unpacked;
+        unpacked.reserve(vertices.size());
+        for(const auto& p : vertices) {
+            vec3f norm = decodeOctahedral(p.normTang[0], p.normTang[1]);
+            vec3f tang = decodeOctahedral(p.normTang[2], p.normTang[3]);
+            vec3f bitang = norm.crossProduct(tang)*(p.pos.w != 0 ? 1.0f : -1.0f);
+            vec2f uv(halfToFloat(p.uv[0]), halfToFloat(p.uv[1]));
+            unpacked.push_back(vertex_pos_norm_tang_bitang_uv(packing.decode(vec3f(p.pos)), norm, tang, bitang, uv));
+        }
+        return unpacked;
+    }
+
+    std::vector<Meshlet> MeshUtil::buildMeshlets(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            std::vector<unsigned int>& meshletIndices,
+            unsigned int maxVertices,
+            unsigned int maxTriangles) {
+
+        if(maxVertices < 3 || maxTriangles < 1) {
+            error_logger("Meshlets must hold at least 3 vertices and 1 triangle");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        std::size_t triangles = indices.size()/3;
+        std::size_t vertexCount = positions.size();
+        std::vector<Meshlet> meshlets;
+        meshletIndices.clear();
+        meshletIndices.reserve(triangles*3);
+
+        // The triangles of each vertex
+        std::vector<unsigned int> offsets(vertexCount + 1, 0);
+        for(std::size_t i = 0; i < triangles*3; ++i)
+            ++offsets[indices[i] + 1];
+        for(std::size_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<unsigned int> vertexTriangles(triangles*3);
+        {
+            std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+            for(std::size_t i = 0; i < triangles*3; ++i)
+                vertexTriangles[fill[indices[i]]++] = i/3;
+        }
+
+        // Unit normals, zero for degenerate triangles
+        std::vector<vec3f> normals(triangles);
+        for(std::size_t t = 0; t < triangles; ++t) {
+            const vec3f& p0 = positions[indices[3*t]];
+            vec3f n = (positions[indices[3*t + 1]] - p0).crossProduct(positions[indices[3*t + 2]] - p0);
+            float length = n.length();
+            normals[t] = length > 0.0f ? n/length : vec3f::ZERO;
+        }
+
+        std::vector<char> assigned(triangles, 0);
+        // The meshlet (+1) a vertex is in, or a triangle is a candidate of
+        std::vector<unsigned int> vertexMeshlet(vertexCount, 0);
+        std::vector<unsigned int> candidateMeshlet(triangles, 0);
+        std::vector<unsigned int> vertices, candidates, meshletTriangles;
+        std::size_t cursor = 0;
+
+        while(true) {
+            unsigned int stamp = meshlets.size() + 1;
+
+            // Continue next to the last meshlet, or with the next triangle left
+            long seed = -1;
+            for(std::size_t i = 0; i < vertices.size() && seed < 0; ++i) {
+                unsigned int v = vertices[i];
+                for(unsigned int k = offsets[v]; k < offsets[v + 1]; ++k) {
+                    if(!assigned[vertexTriangles[k]]) {
+                        seed = vertexTriangles[k];
+                        break;
+                    }
+                }
+            }
+            while(seed < 0 && cursor < triangles) {
+                if(!assigned[cursor])
+                    seed = cursor;
+                ++cursor;
+            }
+            if(seed < 0)
+                break;
+
+            Meshlet meshlet;
+            meshlet.firstIndex = meshletIndices.size();
+            vertices.clear();
+            candidates.clear();
+            meshletTriangles.clear();
+            vec3f normalSum = vec3f::ZERO;
+
+            long next = seed;
+            unsigned int numTriangles = 0;
+            while(next >= 0) {
+                unsigned int t = next;
+                assigned[t] = 1;
+                meshletTriangles.push_back(t);
+                ++numTriangles;
+                normalSum += normals[t];
+                for(int c = 0; c < 3; ++c) {
+                    unsigned int v = indices[3*t + c];
+                    meshletIndices.push_back(v);
+                    if(vertexMeshlet[v] == stamp)
+                        continue;
+                    vertexMeshlet[v] = stamp;
+                    vertices.push_back(v);
+                    for(unsigned int k = offsets[v]; k < offsets[v + 1]; ++k) {
+                        unsigned int n = vertexTriangles[k];
+                        if(!assigned[n] && candidateMeshlet[n] != stamp) {
+                            candidateMeshlet[n] = stamp;
+                            candidates.push_back(n);
+                        }
+                    }
+                }
+                if(numTriangles == maxTriangles)
+                    break;
+
+                // The candidate adding the fewest vertices, then the one closest to
+                // the average normal
+                next = -1;
+                int bestAdded = 4;
+                float bestFacing = -2.0f;
+                vec3f axis = normalSum.length() > 0.0f ? normalSum.normalize() : vec3f::ZERO;
+                std::size_t kept = 0;
+                for(unsigned int n : candidates) {
+                    if(assigned[n])
+                        continue;
+                    candidates[kept++] = n;
+                    int added = 0;
+                    for(int c = 0; c < 3; ++c)
+                        added += vertexMeshlet[indices[3*n + c]] != stamp;
+                    if(vertices.size() + added > maxVertices)
+                        continue;
+                    float facing = normals[n].dotproduct(axis);
+                    if(added < bestAdded || (added == bestAdded && facing > bestFacing)) {
+                        bestAdded = added;
+                        bestFacing = facing;
+                        next = n;
+                    }
+                }
+                candidates.resize(kept);
+            }
+
+            meshlet.numIndices = numTriangles*3;
+            meshlet.numVertices = vertices.size();
+
+            // Bounding sphere around the center of the bounding box
+            vec3f lo = positions[vertices[0]], hi = lo;
+            for(unsigned int v : vertices) {
+                const vec3f& p = positions[v];
+                lo = vec3f(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+                hi = vec3f(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+            }
+            meshlet.center = (lo + hi)*0.5f;
+            meshlet.radius = 0.0f;
+            for(unsigned int v : vertices)
+                meshlet.radius = std::max(meshlet.radius, (positions[v] - meshlet.center).length());
+
+            // The normal cone. Degenerate triangles are not drawn, and do not count.
+            meshlet.coneAxis = vec3f::ZERO;
+            meshlet.coneCutoff = 1.0f;
+            if(normalSum.length() > 0.0f) {
+                meshlet.coneAxis = normalSum.normalize();
+                float minDot = 1.0f;
+                for(unsigned int t : meshletTriangles) {
+                    if(normals[t].squaredLength() > 0.0f)
+                        minDot = std::min(minDot, normals[t].dotproduct(meshlet.coneAxis));
+                }
+                // Cones of a hemisphere or wider can always be seen from the front
+                if(minDot > 0.0f)
+                    meshlet.coneCutoff = std::sqrt(1.0f - minDot*minDot);
+            }
+
+            meshlets.push_back(meshlet);
+        }
+
+        return meshlets;
+    }
+
+    unsigned int MeshUtil::generateMeshlets(Mesh<vertex_pos_norm_tang_bitang_uv>& mesh, unsigned int maxVertices, unsigned int maxTriangles) {
+        if(!mesh.isIndexed()) {
+            error_logger("Meshlets can only be generated for indexed meshes");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        // Read back the vertices and the indices of the full mesh
+        std::vector<vec3f> positions(mesh.getNumVertices());
+        std::vector<unsigned int> indices(mesh.getNumIndices());
+        {
+            auto vb_bw = ConstBufferView<VertexBuffer<vertex_pos_norm_tang_bitang_uv> >(mesh.getVertexBuffer());
+            const auto* vertices = static_cast<const vertex_pos_norm_tang_bitang_uv*>(vb_bw.get());
+            for(std::size_t i = 0; i < positions.size(); ++i)
+                positions[i] = vertices[i].pos;
+        }
+        {
+            auto ib_bw = ConstBufferView<IndexBuffer>(mesh.getIndexBuffer());
+            std::memcpy(indices.data(), ib_bw.get(), indices.size()*sizeof(unsigned int));
+        }
+
+        std::vector<unsigned int> meshletIndices;
+        auto meshlets = buildMeshlets(positions, indices, meshletIndices, maxVertices, maxTriangles);
+        mesh.setMeshlets(meshletIndices, meshlets);
+
+        return meshlets.size();
+    }
+
+    unsigned int MeshUtil::cullMeshlets(
+            const std::vector<Meshlet>& meshlets,
+            const Frustum& frustum,
+            const vec3d& viewPos,
+            std::vector<DrawElementsIndirectCommand>& commands,
+            unsigned int firstIndex,
+            int baseVertex) {
+
+        vec3f view = viewPos.cast<float>();
+        unsigned int visible = 0;
+        // The command of the previous meshlet if it was visible, to extend
+        long last = -1;
+        for(const Meshlet& m : meshlets) {
+            // Back facing if the direction to all of the bounding sphere is within the
+            // cone
+            vec3f toCenter = m.center - view;
+            bool backFacing = m.coneCutoff < 1.0f &&
+                toCenter.dotproduct(m.coneAxis) >= m.coneCutoff*toCenter.length() + m.radius;
+            if(backFacing || frustum.getVisibility(m.center.cast<double>(), m.radius) == INVISIBLE) {
+                last = -1;
+                continue;
+            }
+
+            ++visible;
+            if(last >= 0 && commands[last].firstIndex + commands[last].count == firstIndex + m.firstIndex) {
+                commands[last].count += m.numIndices;
+            } else {
+                last = commands.size();
+                commands.push_back({m.numIndices, 1, firstIndex + m.firstIndex, baseVertex, 0});
+            }
+        }
+        return visible;
+    }
 
 }
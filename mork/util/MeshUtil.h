@@ -2,6 +2,10 @@
 #define _MORK_UTIL_MESHUTIL_H_
 
 #include <mork/render/Mesh.h>
+#include <mork/scene/Frustum.h>
+
+#include <cstddef>
+#include <vector>
 
 namespace mork {
 
@@ -14,6 +18,192 @@ namespace mork {
         static std::vector<vertex_pos_norm_tang_bitang_uv> calculateTangentSpace(
             const std::vector<vertex_pos_norm_uv>& vertices, 
             const std::vector<unsigned int>& indices);
+
+        // Simplifies a triangle mesh by quadric error metric edge collapses, until at most
+        // targetIndexCount indices remain, or no collapse has an error below targetError
+        // (relative to the extent of the mesh). Vertices are only removed, never moved,
+        // so the result indexes the same vertex array.
+        // Vertices on open edges are kept, which includes UV seams and normal creases where
+        // vertices are split, and collapses that flip a triangle are rejected.
+        // The reached relative error is returned in resultError if not nullptr.
+        static std::vector<unsigned int> simplify(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            std::size_t targetIndexCount,
+            float targetError,
+            float* resultError = nullptr);
+
+        // Builds up to levels levels of detail, level 0 being the given indices, and each
+        // level having about ratio times the triangles of the one before. Stops early when
+        // the mesh cannot be simplified further. The error of each level, in the units of
+        // the positions, is returned in errors if not nullptr.
+        static std::vector<std::vector<unsigned int> > generateLodChain(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            unsigned int levels,
+            float ratio,
+            std::vector<float>* errors = nullptr);
+
+        // Generates a LOD chain for an indexed mesh and sets it on the mesh.
+        // Returns the number of levels, including the full mesh.
+        static unsigned int generateLods(Mesh<vertex_pos_norm_tang_bitang_uv>& mesh, unsigned int levels, float ratio = 0.5f);
+
+        // Post-transform vertex cache use of a triangle list, simulating a FIFO cache
+        // of cacheSize vertices. ACMR is the vertices transformed per triangle (3 at
+        // worst, about 0.5 for large regular meshes), ATVR the vertices transformed per
+        // referenced vertex (1 at best).
+        struct VertexCacheStats {
+            unsigned int    transformed;
+            float           acmr;
+            float           atvr;
+        };
+
+        static VertexCacheStats analyzeVertexCache(
+            const std::vector<unsigned int>& indices,
+            std::size_t vertexCount,
+            unsigned int cacheSize = 16);
+
+        // Returns the new index of each of vertexCount vertices of vertexSize bytes,
+        // where bitwise equal vertices get the same index, in order of first
+        // occurrence. The number of distinct vertices is returned in uniqueCount.
+        static std::vector<unsigned int> generateWeldRemap(
+            const void* vertices,
+            std::size_t vertexCount,
+            std::size_t vertexSize,
+            std::size_t* uniqueCount);
+
+        // Reorders the triangles for the post-transform vertex cache (Tipsify, Sander
+        // et al. 2007): triangles are emitted in fans around vertices, moving to the
+        // next vertex still in the cache. Triangles keep their winding.
+        static std::vector<unsigned int> optimizeVertexCache(
+            const std::vector<unsigned int>& indices,
+            std::size_t vertexCount,
+            unsigned int cacheSize = 16);
+
+        // Reorders clusters of cache optimized triangles so outward facing clusters
+        // are drawn first, and occlude more of the rest. Clusters are split where the
+        // cache was flushed, and where their ACMR is within threshold times the
+        // ACMR of the whole flushed run, so the cache use gets at most threshold
+        // times worse.
+        static std::vector<unsigned int> optimizeOverdraw(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            float threshold = 1.05f,
+            unsigned int cacheSize = 16);
+
+        // Returns the new index of each vertex, numbering them in the order they are
+        // first used by indices, so the vertex fetch reads the buffer in order.
+        // Unused vertices get ~0u. The number of used vertices is returned in usedCount.
+        static std::vector<unsigned int> generateFetchRemap(
+            const std::vector<unsigned int>& indices,
+            std::size_t vertexCount,
+            std::size_t* usedCount);
+
+        // Moves vertex i to remap[i] (dropping it for ~0u), and renumbers the indices
+        template<typename vertex>
+        static void remapVertices(std::vector<vertex>& vertices, std::vector<unsigned int>& indices,
+            const std::vector<unsigned int>& remap, std::size_t count) {
+            std::vector<vertex> remapped(count);
+            for(std::size_t i = 0; i < vertices.size(); ++i) {
+                if(remap[i] != ~0u)
+                    remapped[remap[i]] = vertices[i];
+            }
+            for(unsigned int& index : indices)
+                index = remap[index];
+            vertices.swap(remapped);
+        }
+
+        struct OptimizeStats {
+            VertexCacheStats    before;
+            VertexCacheStats    after;
+            std::size_t         verticesBefore;
+            std::size_t         verticesAfter;
+        };
+
+        // Optimizes a triangle list for drawing: welds equal vertices, reorders the
+        // triangles for the vertex cache and then for overdraw, and the vertices in
+        // the order they are fetched. Returns the vertex cache use before and after.
+        template<typename vertex>
+        static OptimizeStats optimize(std::vector<vertex>& vertices, std::vector<unsigned int>& indices,
+            float overdrawThreshold = 1.05f) {
+            OptimizeStats stats;
+            stats.verticesBefore = vertices.size();
+            stats.before = analyzeVertexCache(indices, vertices.size());
+
+            std::size_t count;
+            std::vector<unsigned int> remap = generateWeldRemap(vertices.data(), vertices.size(), sizeof(vertex), &count);
+            remapVertices(vertices, indices, remap, count);
+
+            indices = optimizeVertexCache(indices, vertices.size());
+
+            std::vector<vec3f> positions(vertices.size());
+            for(std::size_t i = 0; i < vertices.size(); ++i)
+                positions[i] = mork::vec3f(vertices[i].pos);
+            indices = optimizeOverdraw(positions, indices, overdrawThreshold);
+
+            remap = generateFetchRemap(indices, vertices.size(), &count);
+            remapVertices(vertices, indices, remap, count);
+
+            stats.verticesAfter = vertices.size();
+            stats.after = analyzeVertexCache(indices, vertices.size());
+            return stats;
+        }
+
+        // See mork/render/Mesh.h, where meshes keep their packing
+        using VertexPacking = mork::VertexPacking;
+
+        // Packs vertices into vertex_pos_norm_tang_uv_packed, quantizing the positions
+        // in their bounds. The bitangent is replaced by the handedness of the tangent
+        // frame. The decoding and the errors of the packing are returned in packing.
+        static std::vector<vertex_pos_norm_tang_uv_packed> packVertices(
+            const std::vector<vertex_pos_norm_tang_bitang_uv>& vertices,
+            VertexPacking& packing);
+
+        static std::vector<vertex_pos_norm_tang_bitang_uv> unpackVertices(
+            const std::vector<vertex_pos_norm_tang_uv_packed>& vertices,
+            const VertexPacking& packing);
+
+        // Partitions a triangle list into meshlets of at most maxVertices vertices and
+        // maxTriangles triangles. Each meshlet grows from a seed triangle over adjacent
+        // triangles, preferring those adding the fewest vertices, then those facing
+        // the same way, to keep the normal cones narrow. The indices are returned in
+        // meshletIndices, reordered so the triangles of each meshlet are consecutive.
+        static std::vector<Meshlet> buildMeshlets(
+            const std::vector<vec3f>& positions,
+            const std::vector<unsigned int>& indices,
+            std::vector<unsigned int>& meshletIndices,
+            unsigned int maxVertices = 64,
+            unsigned int maxTriangles = 124);
+
+        // Builds meshlets for an indexed mesh and sets them on the mesh, replacing its
+        // levels of detail. Returns the number of meshlets.
+        static unsigned int generateMeshlets(Mesh<vertex_pos_norm_tang_bitang_uv>& mesh,
+            unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+
+        // Appends draw commands of the meshlets that may be visible to commands, with
+        // consecutive visible meshlets merged into one command. Meshlets outside the
+        // frustum, or back facing seen from viewPos, are skipped. The frustum and
+        // viewPos must be in the object space of the mesh, e.g. the frustum of
+        // projection*view*localToWorld (see RenderQueue::getVisibleMeshlets).
+        // firstIndex and baseVertex are added to the commands, e.g. for meshes in a
+        // GeometryArena.
+        // Returns the number of visible meshlets.
+        static unsigned int cullMeshlets(
+            const std::vector<Meshlet>& meshlets,
+            const Frustum& frustum,
+            const vec3d& viewPos,
+            std::vector<DrawElementsIndirectCommand>& commands,
+            unsigned int firstIndex = 0,
+            int baseVertex = 0);
+
+        // Octahedral encoding of a unit vector as two 16 bit snorms, rounded to the
+        // closest of the neighbouring encodings
+        static void encodeOctahedral(const vec3f& v, short& x, short& y);
+        static vec3f decodeOctahedral(short x, short y);
+
+        // IEEE 754 half floats, rounded to nearest even
+        static unsigned short floatToHalf(float f);
+        static float halfToFloat(unsigned short h);
  
     };
 
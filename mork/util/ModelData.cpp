@@ -0,0 +1,468 @@
+#include "mork/util/ModelData.h"
+#include "mork/render/CompressedImage.h"
+#include "mork/render/ImageDecoder.h"
+#include "mork/render/TextureCache.h"
+#include "mork/core/Log.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mork {
+
+    namespace {
+
+        // The records of cooked files, all naturally aligned
+        struct Header {
+            char        magic[4];
+            uint32_t    version;
+            // sizeof(VTBN) when cooked, to reject files of another vertex layout
+            uint32_t    vertexSize;
+            uint32_t    numNodes;
+            uint32_t    numMeshes;
+            uint32_t    numMaterials;
+            uint32_t    numLayers;
+            uint32_t    numNodeMeshes;
+            uint64_t    nodesOffset;
+            uint64_t    meshesOffset;
+            uint64_t    materialsOffset;
+            uint64_t    layersOffset;
+            uint64_t    nodeMeshesOffset;
+            uint64_t    stringsOffset;
+            uint64_t    stringsSize;
+            uint64_t    fileSize;
+        };
+
+        struct NodeRecord {
+            int32_t     parent;
+            uint32_t    firstMesh;
+            uint32_t    numMeshes;
+            uint32_t    pad;
+            // Row major, as mat4d
+            double      localToParent[16];
+            double      bounds[6];
+        };
+
+        struct MeshRecord {
+            uint32_t    material;
+            uint32_t    numVertices;
+            uint32_t    numIndices;
+            uint32_t    pad;
+            uint64_t    verticesOffset;
+            uint64_t    indicesOffset;
+            double      bounds[6];
+        };
+
+        struct MaterialRecord {
+            float       ambientColor[3];
+            float       diffuseColor[3];
+            float       specularColor[3];
+            float       emissiveColor[3];
+            float       shininess;
+            float       opacity;
+            uint32_t    firstLayer;
+            uint32_t    numLayers;
+        };
+
+        struct LayerRecord {
+            uint32_t    type;
+            uint32_t    op;
+            float       blendFactor;
+            uint32_t    fileOffset;
+            uint32_t    fileLength;
+            uint32_t    pad;
+        };
+
+        const char MAGIC[4] = {'M', 'M', 'S', 'H'};
+
+        uint64_t align(uint64_t offset, uint64_t alignment) {
+            return (offset + alignment - 1)/alignment*alignment;
+        }
+
+        void writeBox(const box3d& b, double out[6]) {
+            out[0] = b.xmin; out[1] = b.xmax;
+            out[2] = b.ymin; out[3] = b.ymax;
+            out[4] = b.zmin; out[5] = b.zmax;
+        }
+
+        box3d readBox(const double in[6]) {
+            return box3d(in[0], in[1], in[2], in[3], in[4], in[5]);
+        }
+
+        void writeColor(const vec3f& c, float out[3]) {
+            out[0] = c.x; out[1] = c.y; out[2] = c.z;
+        }
+
+        // Writes zeros up to offset, then size bytes of data
+        void writeAt(std::ofstream& out, uint64_t& pos, uint64_t offset, const void* data, size_t size) {
+            static const char zeros[16] = {};
+            while(pos < offset) {
+                size_t n = std::min<uint64_t>(offset - pos, sizeof(zeros));
+                out.write(zeros, n);
+                pos += n;
+            }
+            if(size > 0)
+                out.write(static_cast<const char*>(data), size);
+            pos += size;
+        }
+
+        // Reads the records of a mapped file, checking that they are in the file
+        class Reader {
+            public:
+                Reader(const std::string& file, const MappedFile& mapping) : file(file), mapping(mapping) {}
+
+                const unsigned char* at(uint64_t offset, uint64_t count, uint64_t size) const {
+                    if(offset > mapping.size() || (size > 0 && count > (mapping.size() - offset)/size)) {
+                        error_logger("ModelData: File \"", file, "\" is truncated");
+                        throw std::runtime_error(error_logger.last());
+                    }
+                    return mapping.data() + offset;
+                }
+
+                template<typename T>
+                T read(uint64_t offset, uint64_t index) const {
+                    T t;
+                    std::memcpy(&t, at(offset + index*sizeof(T), 1, sizeof(T)), sizeof(T));
+                    return t;
+                }
+
+            private:
+                const std::string& file;
+                const MappedFile& mapping;
+        };
+
+        std::vector<TextureLayer>& getLayers(Material& material, LayerType type) {
+            switch(type) {
+                case LayerType::AMBIENT:
+                    return material.ambientLayers;
+                case LayerType::DIFFUSE:
+                    return material.diffuseLayers;
+                case LayerType::SPECULAR:
+                    return material.specularLayers;
+                case LayerType::EMISSIVE:
+                    return material.emissiveLayers;
+                case LayerType::NORMAL:
+                    return material.normalLayers;
+                default:
+                    return material.heightLayers;
+            }
+        }
+    }
+
+    ModelData::MaterialDesc::MaterialDesc() :
+        ambientColor(vec3f::ZERO),
+        diffuseColor(vec3f::ZERO),
+        specularColor(vec3f::ZERO),
+        emissiveColor(vec3f::ZERO),
+        shininess(32.0f),
+        opacity(1.0f) {}
+
+    ModelData::ModelData() {
+    }
+
+    bool ModelData::isCookedFile(const std::string& file) {
+        static const std::string ext = ".mmesh";
+        return file.size() >= ext.size() && file.compare(file.size() - ext.size(), ext.size(), ext) == 0;
+    }
+
+    unsigned int ModelData::addMesh(std::vector<VTBN>&& vertices, std::vector<unsigned int>&& indices, unsigned int material) {
+        box3d b = box3d::ZERO;
+        if(!vertices.empty()) {
+            b = box3d(vertices[0].pos.cast<double>(), vertices[0].pos.cast<double>());
+            for(const VTBN& v : vertices)
+                b = b.enlarge(v.pos.cast<double>());
+        }
+
+        vertexData.push_back(std::move(vertices));
+        indexData.push_back(std::move(indices));
+        // Moving the vectors keeps their data where it is
+        MeshDesc m;
+        m.vertices = vertexData.back().data();
+        m.numVertices = vertexData.back().size();
+        m.indices = indexData.back().data();
+        m.numIndices = indexData.back().size();
+        m.material = material;
+        m.bounds = b;
+        meshes.push_back(m);
+        return meshes.size() - 1;
+    }
+
+    const std::vector<ModelData::MeshDesc>& ModelData::getMeshes() const {
+        return meshes;
+    }
+
+    void ModelData::save(const std::string& file) const {
+        Header h = {};
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.vertexSize = sizeof(VTBN);
+        h.numNodes = nodes.size();
+        h.numMeshes = meshes.size();
+        h.numMaterials = materials.size();
+
+        std::vector<NodeRecord> nodeRecords;
+        std::vector<uint32_t> nodeMeshes;
+        for(const Node& n : nodes) {
+            NodeRecord r = {};
+            r.parent = n.parent;
+            r.firstMesh = nodeMeshes.size();
+            r.numMeshes = n.meshes.size();
+            std::memcpy(r.localToParent, n.localToParent.coefficients(), sizeof(r.localToParent));
+            writeBox(n.bounds, r.bounds);
+            nodeMeshes.insert(nodeMeshes.end(), n.meshes.begin(), n.meshes.end());
+            nodeRecords.push_back(r);
+        }
+
+        std::vector<MaterialRecord> materialRecords;
+        std::vector<LayerRecord> layerRecords;
+        std::string strings;
+        for(const MaterialDesc& m : materials) {
+            MaterialRecord r = {};
+            writeColor(m.ambientColor, r.ambientColor);
+            writeColor(m.diffuseColor, r.diffuseColor);
+            writeColor(m.specularColor, r.specularColor);
+            writeColor(m.emissiveColor, r.emissiveColor);
+            r.shininess = m.shininess;
+            r.opacity = m.opacity;
+            r.firstLayer = layerRecords.size();
+            r.numLayers = m.layers.size();
+            for(const Layer& l : m.layers) {
+                LayerRecord lr = {};
+                lr.type = static_cast<uint32_t>(l.type);
+                lr.op = l.op;
+                lr.blendFactor = l.blendFactor;
+                lr.fileOffset = strings.size();
+                lr.fileLength = l.file.size();
+                strings += l.file;
+                layerRecords.push_back(lr);
+            }
+            materialRecords.push_back(r);
+        }
+        h.numLayers = layerRecords.size();
+        h.numNodeMeshes = nodeMeshes.size();
+
+        // Lay out the sections
+        uint64_t offset = sizeof(Header);
+        h.nodesOffset = offset = align(offset, 8);
+        offset += nodeRecords.size()*sizeof(NodeRecord);
+        h.meshesOffset = offset = align(offset, 8);
+        offset += meshes.size()*sizeof(MeshRecord);
+        h.materialsOffset = offset = align(offset, 8);
+        offset += materialRecords.size()*sizeof(MaterialRecord);
+        h.layersOffset = offset = align(offset, 8);
+        offset += layerRecords.size()*sizeof(LayerRecord);
+        h.nodeMeshesOffset = offset = align(offset, 8);
+        offset += nodeMeshes.size()*sizeof(uint32_t);
+        h.stringsOffset = offset;
+        h.stringsSize = strings.size();
+        offset += strings.size();
+
+        std::vector<MeshRecord> meshRecords;
+        for(const MeshDesc& m : meshes) {
+            MeshRecord r = {};
+            r.material = m.material;
+            r.numVertices = m.numVertices;
+            r.numIndices = m.numIndices;
+            r.verticesOffset = offset = align(offset, 16);
+            offset += uint64_t(m.numVertices)*sizeof(VTBN);
+            r.indicesOffset = offset = align(offset, 16);
+            offset += uint64_t(m.numIndices)*sizeof(uint32_t);
+            writeBox(m.bounds, r.bounds);
+            meshRecords.push_back(r);
+        }
+        h.fileSize = offset;
+
+        std::ofstream out(file, std::ios::binary);
+        if(!out) {
+            error_logger("ModelData: File \"", file, "\" could not be created");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        uint64_t pos = 0;
+        writeAt(out, pos, 0, &h, sizeof(h));
+        writeAt(out, pos, h.nodesOffset, nodeRecords.data(), nodeRecords.size()*sizeof(NodeRecord));
+        writeAt(out, pos, h.meshesOffset, meshRecords.data(), meshRecords.size()*sizeof(MeshRecord));
+        writeAt(out, pos, h.materialsOffset, materialRecords.data(), materialRecords.size()*sizeof(MaterialRecord));
+        writeAt(out, pos, h.layersOffset, layerRecords.data(), layerRecords.size()*sizeof(LayerRecord));
+        writeAt(out, pos, h.nodeMeshesOffset, nodeMeshes.data(), nodeMeshes.size()*sizeof(uint32_t));
+        writeAt(out, pos, h.stringsOffset, strings.data(), strings.size());
+        for(unsigned int i = 0; i < meshes.size(); ++i) {
+            writeAt(out, pos, meshRecords[i].verticesOffset, meshes[i].vertices, meshes[i].numVertices*sizeof(VTBN));
+            writeAt(out, pos, meshRecords[i].indicesOffset, meshes[i].indices, meshes[i].numIndices*sizeof(uint32_t));
+        }
+
+        if(!out) {
+            error_logger("ModelData: File \"", file, "\" could not be written");
+            throw std::runtime_error(error_logger.last());
+        }
+    }
+
+    ModelData ModelData::load(const std::string& file) {
+        ModelData data;
+        data.mapping = std::make_unique<MappedFile>(file);
+        Reader reader(file, *data.mapping);
+
+        Header h = reader.read<Header>(0, 0);
+        if(std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) {
+            error_logger("ModelData: File \"", file, "\" is not a cooked model");
+            throw std::runtime_error(error_logger.last());
+        }
+        if(h.version != VERSION || h.vertexSize != sizeof(VTBN)) {
+            error_logger("ModelData: File \"", file, "\" has version ", h.version, " and vertex size ", h.vertexSize,
+                    ", expected ", VERSION, " and ", sizeof(VTBN), ". Cook the model again.");
+            throw std::runtime_error(error_logger.last());
+        }
+        if(h.fileSize != data.mapping->size()) {
+            error_logger("ModelData: File \"", file, "\" is truncated");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        const char* strings = reinterpret_cast<const char*>(reader.at(h.stringsOffset, h.stringsSize, 1));
+        reader.at(h.nodeMeshesOffset, h.numNodeMeshes, sizeof(uint32_t));
+
+        for(uint32_t i = 0; i < h.numMaterials; ++i) {
+            MaterialRecord r = reader.read<MaterialRecord>(h.materialsOffset, i);
+            MaterialDesc m;
+            m.ambientColor = vec3f(r.ambientColor[0], r.ambientColor[1], r.ambientColor[2]);
+            m.diffuseColor = vec3f(r.diffuseColor[0], r.diffuseColor[1], r.diffuseColor[2]);
+            m.specularColor = vec3f(r.specularColor[0], r.specularColor[1], r.specularColor[2]);
+            m.emissiveColor = vec3f(r.emissiveColor[0], r.emissiveColor[1], r.emissiveColor[2]);
+            m.shininess = r.shininess;
+            m.opacity = r.opacity;
+            for(uint32_t j = 0; j < r.numLayers; ++j) {
+                LayerRecord lr = reader.read<LayerRecord>(h.layersOffset, uint64_t(r.firstLayer) + j);
+                if(uint64_t(lr.fileOffset) + lr.fileLength > h.stringsSize) {
+                    error_logger("ModelData: File \"", file, "\" has a bad texture file name");
+                    throw std::runtime_error(error_logger.last());
+                }
+                if(lr.type > static_cast<uint32_t>(LayerType::HEIGHT) || (lr.op != Op::ADD && lr.op != Op::MULTIPLY)) {
+                    error_logger("ModelData: File \"", file, "\" has a bad texture layer");
+                    throw std::runtime_error(error_logger.last());
+                }
+                Layer l;
+                l.type = static_cast<LayerType>(lr.type);
+                l.op = static_cast<Op>(lr.op);
+                l.blendFactor = lr.blendFactor;
+                l.file = std::string(strings + lr.fileOffset, lr.fileLength);
+                m.layers.push_back(l);
+            }
+            data.materials.push_back(m);
+        }
+
+        for(uint32_t i = 0; i < h.numMeshes; ++i) {
+            MeshRecord r = reader.read<MeshRecord>(h.meshesOffset, i);
+            if(r.verticesOffset%16 != 0 || r.indicesOffset%16 != 0) {
+                error_logger("ModelData: File \"", file, "\" has unaligned mesh data");
+                throw std::runtime_error(error_logger.last());
+            }
+            if(r.material >= h.numMaterials) {
+                error_logger("ModelData: File \"", file, "\" has a bad mesh ", i);
+                throw std::runtime_error(error_logger.last());
+            }
+            MeshDesc m;
+            m.vertices = reinterpret_cast<const VTBN*>(reader.at(r.verticesOffset, r.numVertices, sizeof(VTBN)));
+            m.numVertices = r.numVertices;
+            m.indices = reinterpret_cast<const unsigned int*>(reader.at(r.indicesOffset, r.numIndices, sizeof(uint32_t)));
+            m.numIndices = r.numIndices;
+            m.material = r.material;
+            m.bounds = readBox(r.bounds);
+            data.meshes.push_back(m);
+        }
+
+        for(uint32_t i = 0; i < h.numNodes; ++i) {
+            NodeRecord r = reader.read<NodeRecord>(h.nodesOffset, i);
+            if(r.parent < -1 || r.parent >= static_cast<int32_t>(i) || uint64_t(r.firstMesh) + r.numMeshes > h.numNodeMeshes) {
+                error_logger("ModelData: File \"", file, "\" has a bad node ", i);
+                throw std::runtime_error(error_logger.last());
+            }
+            Node n;
+            n.parent = r.parent;
+            n.localToParent = mat4d(r.localToParent);
+            n.bounds = readBox(r.bounds);
+            for(uint32_t j = 0; j < r.numMeshes; ++j) {
+                uint32_t mesh = reader.read<uint32_t>(h.nodeMeshesOffset, uint64_t(r.firstMesh) + j);
+                if(mesh >= h.numMeshes) {
+                    error_logger("ModelData: File \"", file, "\" has a bad node ", i);
+                    throw std::runtime_error(error_logger.last());
+                }
+                n.meshes.push_back(mesh);
+            }
+            data.nodes.push_back(n);
+        }
+
+        return data;
+    }
+
+    Model ModelData::createModel(const std::string& name, const std::string& basePath, TextureArrayPool* pool) const {
+        Model model(name);
+
+        // Starts decoding the textures of all materials on the ImageDecoder, so
+        // they are decoded concurrently while the materials are built. Block
+        // compressed files are uploaded as they are, and files already loaded are
+        // shared from the TextureCache.
+        std::unordered_map<std::string, std::shared_future<Image> > images;
+        for(const MaterialDesc& m : materials) {
+            for(const Layer& l : m.layers) {
+                std::string file = basePath + l.file;
+                if(!CompressedImage::isCompressedFile(file) && images.find(file) == images.end()
+                        && !TextureCache::getInstance().find(file, true))
+                    images.emplace(file, ImageDecoder::getInstance().decode(file, true).share());
+            }
+        }
+
+        std::vector<Material> built;
+        for(const MaterialDesc& m : materials) {
+            Material material;
+            material.ambientColor = m.ambientColor;
+            material.diffuseColor = m.diffuseColor;
+            material.specularColor = m.specularColor;
+            material.emissiveColor = m.emissiveColor;
+            material.shininess = m.shininess;
+            material.opacity = m.opacity;
+
+            for(const Layer& l : m.layers) {
+                // Layers using the same file, in this and other models, share the texture
+                std::string file = basePath + l.file;
+                TextureCache::Handle texture;
+                auto image = images.find(file);
+                if(image != images.end())
+                    texture = TextureCache::getInstance().load(file, true, true, image->second.get());
+                else
+                    texture = TextureCache::getInstance().load(file, true);
+                getLayers(material, l.type).push_back(TextureLayer(texture, l.op, l.blendFactor));
+            }
+            built.push_back(std::move(material));
+        }
+
+        // Packed after all materials hold their textures, so shared textures are
+        // packed once
+        for(Material& material : built) {
+            if(pool != nullptr)
+                pool->pack(material);
+            model.addMaterial(std::move(material));
+        }
+
+        for(const MeshDesc& m : meshes)
+            model.addMesh(Mesh<VTBN>(m.vertices, m.numVertices, m.indices, m.numIndices, m.material));
+
+        // Parents are created before their children
+        std::vector<SceneNode*> created;
+        for(const Node& n : nodes) {
+            std::unique_ptr<ModelNode> node = std::make_unique<ModelNode>();
+            if(!n.meshes.empty())
+                node->setLocalBounds(n.bounds);
+            for(unsigned int mesh : n.meshes)
+                node->addMeshIndex(mesh);
+            node->setLocalToParent(n.localToParent);
+
+            SceneNode& parent = n.parent < 0 ? static_cast<SceneNode&>(model) : *created[n.parent];
+            created.push_back(&parent.addChild(std::move(node)));
+        }
+
+        return model;
+    }
+
+}
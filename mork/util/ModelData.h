@@ -0,0 +1,116 @@
+#ifndef _MORK_MODELDATA_H_
+#define _MORK_MODELDATA_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mork/math/box3.h"
+#include "mork/math/mat4.h"
+#include "mork/math/vec3.h"
+#include "mork/render/Model.h"
+#include "mork/render/TextureArrayPool.h"
+#include "mork/util/MappedFile.h"
+
+namespace mork {
+
+    // The layer list of a material a texture layer goes to
+    enum class LayerType : unsigned int { AMBIENT, DIFFUSE, SPECULAR, EMISSIVE, NORMAL, HEIGHT };
+
+    // A model as plain data on the CPU: its node hierarchy, meshes in GPU vertex
+    // layout and materials referring to texture files. ModelImporter builds it from
+    // the files assimp reads, and cooked .mmesh files store it as it is.
+    //
+    // Cooked files are memory mapped when loaded, and the meshes point into the
+    // mapping, so they are uploaded to the GPU without being parsed or copied.
+    //
+    // A .mmesh file (little endian, version VERSION) has a header with the counts
+    // and offsets of its sections, followed by fixed size node, mesh, material and
+    // layer records, the mesh index lists of the nodes, the texture file names,
+    // and the vertex and index blobs (16 byte aligned).
+    class ModelData {
+        public:
+            static constexpr unsigned int VERSION = 1;
+
+            struct Layer {
+                LayerType       type;
+                Op              op;
+                float           blendFactor;
+                // Relative to the directory of the model
+                std::string     file;
+            };
+
+            struct MaterialDesc {
+                vec3f           ambientColor;
+                vec3f           diffuseColor;
+                vec3f           specularColor;
+                vec3f           emissiveColor;
+                float           shininess;
+                float           opacity;
+                std::vector<Layer> layers;
+
+                MaterialDesc();
+            };
+
+            // Nodes are stored with parents before their children
+            struct Node {
+                // The index of the parent node, or -1 for children of the model
+                int             parent;
+                mat4d           localToParent;
+                // The bounds of the meshes of the node, if it has meshes
+                box3d           bounds;
+                std::vector<unsigned int> meshes;
+            };
+
+            struct MeshDesc {
+                const VTBN*             vertices;
+                unsigned int            numVertices;
+                const unsigned int*     indices;
+                unsigned int            numIndices;
+                unsigned int            material;
+                box3d                   bounds;
+            };
+
+            ModelData();
+            ModelData(const ModelData&) = delete;
+            ModelData& operator=(const ModelData&) = delete;
+            ModelData(ModelData&&) = default;
+            ModelData& operator=(ModelData&&) = default;
+
+            // Returns true for files with the .mmesh extension
+            static bool isCookedFile(const std::string& file);
+
+            // Maps a cooked file. Throws if the file is not a cooked model of this
+            // version, or is truncated.
+            static ModelData load(const std::string& file);
+
+            // Writes a cooked file
+            void save(const std::string& file) const;
+
+            // Adds a mesh owning its data, and returns its index
+            unsigned int addMesh(std::vector<VTBN>&& vertices, std::vector<unsigned int>&& indices, unsigned int material);
+
+            const std::vector<MeshDesc>& getMeshes() const;
+
+            // Uploads the meshes and loads the textures of the materials (from
+            // basePath + the layer files, through the TextureCache). If pool is not
+            // nullptr, the texture layers are packed in it.
+            Model createModel(const std::string& name, const std::string& basePath, TextureArrayPool* pool = nullptr) const;
+
+            std::vector<MaterialDesc>   materials;
+            std::vector<Node>           nodes;
+
+        private:
+            std::vector<MeshDesc>       meshes;
+
+            // The data of added meshes, which the MeshDescs point to
+            std::vector<std::vector<VTBN> >             vertexData;
+            std::vector<std::vector<unsigned int> >     indexData;
+
+            // The file of a loaded model, which the MeshDescs point into
+            std::unique_ptr<MappedFile>     mapping;
+    };
+
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include "mork/math/vec3.h"
 #include "mork/render/VertexBuffer.h"
 #include "mork/render/Material.h"
+#include "mork/util/MeshUtil.h"
+#include "mork/util/ModelData.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -16,16 +18,13 @@ namespace mork {
     namespace ModelImporterInternal { 
        
 
-        template<typename Vertex>
-        Mesh<Vertex> processMesh(const aiMesh* imesh, const aiScene* scene) {
-        }
-
-        template<>
-        Mesh<vertex_pos_norm_tang_bitang_uv> processMesh(const aiMesh* imesh, const aiScene* scene) {
+        void processMesh(const aiMesh* imesh, ModelData& data) {
 
 
             std::vector<vertex_pos_norm_tang_bitang_uv> vertices;
 			std::vector<unsigned int> indices;
+            vertices.reserve(imesh->mNumVertices);
+            indices.reserve(imesh->mNumFaces*3);
             for(unsigned int i = 0; i < imesh->mNumVertices; i++)
 			{
 				// process vertex positions, normals and texture coordinates
@@ -67,49 +66,54 @@ namespace mork {
 			}  
 
             unsigned int materialIndex = imesh->mMaterialIndex;
+
+            MeshUtil::OptimizeStats stats = MeshUtil::optimize(vertices, indices);
+            debug_logger("Mesh ", imesh->mName.C_Str(), ": vertices ", stats.verticesBefore, " => ", stats.verticesAfter,
+                    ", ACMR ", stats.before.acmr, " => ", stats.after.acmr, ", ATVR ", stats.before.atvr, " => ", stats.after.atvr);
                
-            return Mesh(vertices, indices, materialIndex); 
+            data.addMesh(std::move(vertices), std::move(indices), materialIndex); 
 			
         }
         
         
-        void processNode(const aiNode* inode, const aiScene* iscene, const Model& model, SceneNode& parent) {
+        void processNode(const aiNode* inode, ModelData& data, int parent) {
             
-            std::unique_ptr<ModelNode> node = std::make_unique<ModelNode>();
+            ModelData::Node node;
+            node.parent = parent;
 
             // Set initial localbounds with the first mesh
             // This is to handle a case where all meshes are offset from zero and theire
             // local bounds does not include 0,0,0. If only enlarge is applied with a default box of 0,0,0
             // the bounding box will include 0,0,0 which is not what we want
             if(inode->mNumMeshes>0)
-                node->setLocalBounds(model.getMesh(inode->mMeshes[0]).getBounds());
+                node.bounds = data.getMeshes()[inode->mMeshes[0]].bounds;
 
             // Process meshes:
             for(int i = 0; i < inode->mNumMeshes; ++i) {
                 // Set the model mesh index:
-                node->addMeshIndex(inode->mMeshes[i]);
+                node.meshes.push_back(inode->mMeshes[i]);
                 
                 // Add bounds
-                node->enlargeLocalBounds(model.getMesh(inode->mMeshes[i]).getBounds());
+                node.bounds = node.bounds.enlarge(data.getMeshes()[inode->mMeshes[i]].bounds);
             }
             
             // Get the transformation to parent:
             // This aiMatrix4x4 uses same storage as mork::Mat4<>,
             // so its basically just to copy tje individual fields: 
             aiMatrix4x4 m = inode->mTransformation;
-            mat4d m2 = mat4f(m.a1, m.a2, m.a3, m.a4,
+            node.localToParent = mat4f(m.a1, m.a2, m.a3, m.a4,
                         m.b1, m.b2, m.b3, m.b4,
                         m.c1, m.c2, m.c3, m.c4,
                         m.d1, m.d2, m.d3, m.d4).cast<double>();
-            node->setLocalToParent(m2);
  
-            // Add this node to its parent:
-            SceneNode& ref = parent.addChild(std::move(node));
+            // Add this node after its parent:
+            data.nodes.push_back(node);
+            int index = data.nodes.size() - 1;
 
             // then do the same for each of its children
             for(unsigned int i = 0; i < inode->mNumChildren; i++)
             {
-                processNode(inode->mChildren[i], iscene, model, ref);
+                processNode(inode->mChildren[i], data, index);
             }
         
         }
@@ -133,25 +137,48 @@ namespace mork {
 
         }
 
-        std::vector<TextureLayer> getTextureLayers(const aiMaterial* mat, aiTextureType type, const std::string& basePath, Material& material) {
+        // The texture types loaded as material layers
+        static const aiTextureType LAYER_TYPES[] = {aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+            aiTextureType_AMBIENT, aiTextureType_EMISSIVE, aiTextureType_NORMALS, aiTextureType_HEIGHT};
+
+        LayerType translateType(aiTextureType type) {
+            switch(type) {
+                case(aiTextureType_AMBIENT):
+                    return LayerType::AMBIENT;
+                case(aiTextureType_SPECULAR):
+                    return LayerType::SPECULAR;
+                case(aiTextureType_EMISSIVE):
+                    return LayerType::EMISSIVE;
+                case(aiTextureType_NORMALS):
+                    return LayerType::NORMAL;
+                case(aiTextureType_HEIGHT):
+                    return LayerType::HEIGHT;
+                default:
+                    return LayerType::DIFFUSE;
+            }
+        }
+
+        // Returns the texture file, relative to the model
+        std::string getTexturePath(const aiMaterial* mat, aiTextureType type, int j) {
+            aiString path;
+            // We skip reading the other properties to the right of path in the following function.
+            // We read these manually in getTextureLayers since thay are not allways present
+            if( aiReturn_SUCCESS != mat->GetTexture(type, j, &path)) {
+                error_logger("Could not read type=", type, ", tecture=", j, " of ", mat->GetTextureCount(type));
+                throw std::runtime_error("Error reading texture");
+            }
+            return path.C_Str();
+        }
+
+        void getTextureLayers(const aiMaterial* mat, aiTextureType type, ModelData::MaterialDesc& material) {
             debug_logger("TextureLayers loader, Num Textures for type", type, ", : ", mat->GetTextureCount(type));
             
-            std::vector<TextureLayer> layers;
-
             int tc = mat->GetTextureCount(type);
             
             for(int j = 0; j < tc; ++j) {
-                    
-                aiString path;
-                aiTextureMapping mapping;
-                unsigned int uvIndex;
-               aiTextureMapMode mapMode;
-                // We skip reading the other properties to the right of path in the following function.
-                // We read these manually below wince thay are not allways present
-                if( aiReturn_SUCCESS != mat->GetTexture(aiTextureType_DIFFUSE, j, &path)) {
-                    error_logger("Could not read type=", type, ", tecture=", j, " of ", tc);
-                    throw std::runtime_error("Error reading texture");
-                }
+                ModelData::Layer layer;
+                layer.type = translateType(type);
+                layer.file = getTexturePath(mat, type, j);
 
                 // Try to fetch these, initialized values will be kept if they do not exist in the texture
                 // We set default behaviour to multiply the texture values with the base color
@@ -163,14 +190,11 @@ namespace mork {
 
                 // TODO: Get texture warp modes and other relevant stuff 
 
-                Op op = translateOp(iop);
-                Texture<2> texture;
-                texture.loadTexture(std::string(basePath + path.C_Str()), true);
+                layer.op = translateOp(iop);
+                layer.blendFactor = blendFactor;
 
-                layers.push_back(TextureLayer(std::move(texture), op, blendFactor));
+                material.layers.push_back(layer);
             }
-
-            return layers;
         }
 
         std::string getMatProperties(const aiMaterial* mat) {
@@ -193,12 +217,11 @@ namespace mork {
 
         }
         
-        void loadMeshes(const aiScene* iscene, Model& model){
+        void loadMeshes(const aiScene* iscene, ModelData& data){
             debug_logger("Num Meshes: ", iscene->mNumMeshes);
             for(int i = 0; i < iscene->mNumMeshes; ++i) {
                 const aiMesh* imesh = iscene->mMeshes[i];
-                auto mesh = processMesh<vertex_pos_norm_tang_bitang_uv>(imesh, iscene);
-                model.addMesh(std::move(mesh));
+                processMesh(imesh, data);
 
 
             }
@@ -206,15 +229,16 @@ namespace mork {
 
         }
  
-        void loadMaterials(const aiScene* scene, Model& model, const std::string& basePath){
+        void loadMaterials(const aiScene* scene, ModelData& data){
             debug_logger("Num Materials: ", scene->mNumMaterials);
+
             for(int i = 0; i < scene->mNumMaterials; ++i)
             {
                 // The material we are extracting from
                 const aiMaterial* mat = scene->mMaterials[i];
               
                 // The mork material we are building:
-                mork::Material material;
+                ModelData::MaterialDesc material;
                 
 
                 // Get base colors (if defined). Default values are untouched if the material does not contai them
@@ -241,22 +265,10 @@ namespace mork {
                 mat->Get(AI_MATKEY_SHININESS, shininess);
                 material.shininess = shininess;
 
-                material.diffuseLayers = std::move(getTextureLayers(mat, aiTextureType_DIFFUSE, basePath, material));
-
-                material.specularLayers = std::move(getTextureLayers(mat, aiTextureType_SPECULAR, basePath, material));
-
-                material.ambientLayers = std::move(getTextureLayers(mat, aiTextureType_AMBIENT, basePath, material));
-
-                material.emissiveLayers = std::move(getTextureLayers(mat, aiTextureType_EMISSIVE, basePath, material));
-
-                material.normalLayers = std::move(getTextureLayers(mat, aiTextureType_NORMALS, basePath, material));
-
-                material.heightLayers = std::move(getTextureLayers(mat, aiTextureType_HEIGHT, basePath, material));
-
+                for(aiTextureType type : LAYER_TYPES)
+                    getTextureLayers(mat, type, material);
 
-                model.addMaterial(std::move(material));
-
-               
+                data.materials.push_back(material);
            }
 
         }
@@ -264,7 +276,7 @@ namespace mork {
 
     }
 
-    Model ModelImporter::loadModel(const std::string& path, const std::string& file, const std::string& nodeName) {
+    ModelData ModelImporter::importModel(const std::string& path, const std::string& file) {
 
         Assimp::Importer importer;
         std::string filepath = path + file;
@@ -277,18 +289,27 @@ namespace mork {
             throw std::runtime_error("Failed loading model");
         }
 
-        Model model(nodeName);
+        ModelData data;
 
         // Load common materials:
-        ModelImporterInternal::loadMaterials(scene, model, path);
+        ModelImporterInternal::loadMaterials(scene, data);
 
         // Load all meshes
-        ModelImporterInternal::loadMeshes(scene, model);
+        ModelImporterInternal::loadMeshes(scene, data);
         
         // Create the node tree
-        ModelImporterInternal::processNode(scene->mRootNode, scene, model, model);
+        ModelImporterInternal::processNode(scene->mRootNode, data, -1);
+
+        return data;
+    }
+
+    Model ModelImporter::loadModel(const std::string& path, const std::string& file, const std::string& nodeName, TextureArrayPool* pool) {
+        ModelData data = ModelData::isCookedFile(file) ? ModelData::load(path + file) : importModel(path, file);
+        return data.createModel(nodeName, path, pool);
+    }
 
-        return model;
+    void ModelImporter::cookModel(const std::string& path, const std::string& file, const std::string& destination) {
+        importModel(path, file).save(destination);
     }
 
     
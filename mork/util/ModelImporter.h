@@ -4,13 +4,26 @@
 #include <string>
 
 #include "mork/render/Model.h"
+#include "mork/render/TextureArrayPool.h"
+#include "mork/util/ModelData.h"
 
 
 namespace mork {
 
     class ModelImporter {
         public:
-            static Model   loadModel(const std::string& path, const std::string& file, const std::string& nodeName);
+            // Loads a model file read by assimp, or a .mmesh file cooked by cookModel.
+            // If pool is not nullptr, the texture layers of the materials are packed in it
+            static Model   loadModel(const std::string& path, const std::string& file, const std::string& nodeName,
+                    TextureArrayPool* pool = nullptr);
+
+            // Reads a model file with assimp, triangulating it and generating normals
+            static ModelData importModel(const std::string& path, const std::string& file);
+
+            // Imports a model file and saves it as a cooked .mmesh file at destination,
+            // which loads without assimp. Texture files are referred to relative to
+            // path, so destination should be in the same directory.
+            static void cookModel(const std::string& path, const std::string& file, const std::string& destination);
  
 
     };
@@ -0,0 +1,132 @@
+#include "mork/util/NameTable.h"
+#include "mork/core/Log.h"
+
+#include <stdexcept>
+
+namespace mork {
+
+    NameTable::NameTable() : nextAnonymous(0) {}
+
+    NameId NameTable::intern(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = ids.find(name);
+        if(it != ids.end()) {
+            acquireLocked(it->second);
+            return it->second;
+        }
+
+        NameId id;
+        if(!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+            strings[id] = name;
+            refs[id] = 1;
+        } else {
+            if(strings.size() == ANONYMOUS_BIT) {
+                error_logger("NameTable: Out of ids, interning ", name);
+                throw std::runtime_error(error_logger.last());
+            }
+            id = strings.size();
+            strings.push_back(name);
+            refs.push_back(1);
+        }
+        ids.emplace(strings[id], id);
+        return id;
+    }
+
+    bool NameTable::find(const std::string& name, NameId& id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = ids.find(name);
+        if(it == ids.end())
+            return false;
+
+        id = it->second;
+        return true;
+    }
+
+    NameId NameTable::anonymous() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(!freeAnonymous.empty()) {
+            NameId id = freeAnonymous.back();
+            freeAnonymous.pop_back();
+            return id;
+        }
+
+        if(nextAnonymous == ANONYMOUS_BIT) {
+            error_logger("NameTable: Out of anonymous ids");
+            throw std::runtime_error(error_logger.last());
+        }
+        return ANONYMOUS_BIT | nextAnonymous++;
+    }
+
+    void NameTable::acquire(NameId id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        acquireLocked(id);
+    }
+
+    void NameTable::acquireLocked(NameId id) {
+        if(id & ANONYMOUS_BIT)
+            ++anonymousRefs[id];
+        else
+            ++refs[id];
+    }
+
+    void NameTable::release(NameId id) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(id & ANONYMOUS_BIT) {
+            auto it = anonymousRefs.find(id);
+            if(it != anonymousRefs.end()) {
+                if(--it->second == 0)
+                    anonymousRefs.erase(it);
+                return;
+            }
+
+            auto str = anonymousStrings.find(id);
+            if(str != anonymousStrings.end()) {
+                ids.erase(str->second);
+                anonymousStrings.erase(str);
+            }
+            freeAnonymous.push_back(id);
+            return;
+        }
+
+        if(--refs[id] > 0)
+            return;
+
+        ids.erase(strings[id]);
+        // Frees the memory of long strings
+        std::string().swap(strings[id]);
+        freeIds.push_back(id);
+    }
+
+    const std::string& NameTable::getString(NameId id) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(!(id & ANONYMOUS_BIT))
+            return strings[id];
+
+        auto it = anonymousStrings.find(id);
+        if(it != anonymousStrings.end())
+            return it->second;
+
+        // Name it by its number, avoiding any name already taken. The string is
+        // interned to the anonymous id, so lookups by the string find this id.
+        std::string name = "#" + std::to_string(id & ~ANONYMOUS_BIT);
+        while(ids.count(name))
+            name += "#";
+
+        const std::string& str = anonymousStrings.emplace(id, name).first->second;
+        ids.emplace(str, id);
+        return str;
+    }
+
+    unsigned int NameTable::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return ids.size();
+    }
+
+}
@@ -0,0 +1,90 @@
+#ifndef _MORK_NAMETABLE_H_
+#define _MORK_NAMETABLE_H_
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace mork {
+
+    // An interned string, compared and hashed as an integer
+    using NameId = unsigned int;
+
+    // A global table of interned names. Each distinct string gets a single id, so
+    // names can be compared, hashed and stored without touching the strings.
+    //
+    // Anonymous ids are handed out without creating any string. A string is only
+    // created (and interned) the first time the name of an anonymous id is asked for.
+    //
+    // Ids are reference counted: intern and anonymous return an id holding a
+    // reference, and each reference must be released. The string of an id is freed
+    // with its last reference, and the id reused. Running out of ids throws.
+    class NameTable {
+        public:
+            static NameTable& getInstance() {
+                static NameTable table;
+                return table;
+            }
+
+            NameTable(const NameTable&) = delete;
+            void operator=(const NameTable&) = delete;
+
+            // Returns the id of name with a new reference, adding it if not already
+            // present
+            NameId intern(const std::string& name);
+
+            // Looks up the id of name without adding it. Returns false if not present.
+            bool find(const std::string& name, NameId& id) const;
+
+            // Returns a new unique id holding one reference, without a string until
+            // getString is called
+            NameId anonymous();
+
+            // Adds a reference to a referenced id
+            void acquire(NameId id);
+
+            // Releases a reference to id, freeing it with its string on the last one
+            void release(NameId id);
+
+            // Returns the string of an id. The reference stays valid while the id is
+            // referenced.
+            const std::string& getString(NameId id);
+
+            // Returns the number of ids with a string, i.e. interned or named
+            unsigned int size() const;
+
+        private:
+            NameTable();
+
+            // Anonymous ids have this bit set
+            static const NameId ANONYMOUS_BIT = 0x80000000u;
+
+            void acquireLocked(NameId id);
+
+            mutable std::mutex mutex;
+
+            // Strings of interned ids by id, and of anonymous ids that have been named.
+            // Both containers keep their strings in place as they grow.
+            std::deque<std::string>                         strings;
+            std::unordered_map<NameId, std::string>         anonymousStrings;
+
+            std::unordered_map<std::string_view, NameId>    ids;
+
+            // References to interned ids by id. Anonymous ids have one reference
+            // unless they are in anonymousRefs, which holds the count beyond that.
+            std::deque<unsigned int>                        refs;
+            std::unordered_map<NameId, unsigned int>        anonymousRefs;
+
+            // Released ids, to be reused
+            std::vector<NameId>                             freeIds;
+            std::vector<NameId>                             freeAnonymous;
+
+            NameId nextAnonymous;
+    };
+
+}
+
+#endif
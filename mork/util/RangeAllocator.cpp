@@ -0,0 +1,160 @@
+#include "mork/util/RangeAllocator.h"
+#include "mork/core/Log.h"
+
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace mork {
+
+    RangeAllocator::RangeAllocator(unsigned int capacity) : capacity(0), used(0) {
+        grow(capacity);
+    }
+
+    unsigned int RangeAllocator::allocate(unsigned int size) {
+        if(size == 0) {
+            error_logger("RangeAllocator: Tried to allocate an empty range");
+            throw std::runtime_error(error_logger.last());
+        }
+
+        auto it = freeBySize.lower_bound(size);
+        if(it == freeBySize.end())
+            return INVALID;
+
+        unsigned int offset = it->second;
+        unsigned int freeSize = it->first;
+        removeFree(freeByOffset.find(offset));
+
+        if(freeSize > size)
+            addFree(offset + size, freeSize - size);
+
+        allocated.emplace(offset, size);
+        used += size;
+        return offset;
+    }
+
+    void RangeAllocator::free(unsigned int offset) {
+        auto it = allocated.find(offset);
+        if(it == allocated.end()) {
+            error_logger("RangeAllocator: No range allocated at offset ", offset);
+            throw std::runtime_error(error_logger.last());
+        }
+
+        unsigned int size = it->second;
+        allocated.erase(it);
+        used -= size;
+
+        // Merge with the free ranges before and after
+        auto next = freeByOffset.lower_bound(offset);
+        if(next != freeByOffset.end() && next->first == offset + size) {
+            size += next->second;
+            next = std::next(next);
+            removeFree(std::prev(next));
+        }
+        if(next != freeByOffset.begin()) {
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == offset) {
+                offset = prev->first;
+                size += prev->second;
+                removeFree(prev);
+            }
+        }
+        addFree(offset, size);
+    }
+
+    void RangeAllocator::clear() {
+        freeByOffset.clear();
+        freeBySize.clear();
+        allocated.clear();
+        used = 0;
+        if(capacity > 0)
+            addFree(0, capacity);
+    }
+
+    void RangeAllocator::grow(unsigned int newCapacity) {
+        if(newCapacity <= capacity)
+            return;
+
+        unsigned int offset = capacity;
+        unsigned int size = newCapacity - capacity;
+        capacity = newCapacity;
+
+        // Merge with a free range at the end
+        if(!freeByOffset.empty()) {
+            auto last = std::prev(freeByOffset.end());
+            if(last->first + last->second == offset) {
+                offset = last->first;
+                size += last->second;
+                removeFree(last);
+            }
+        }
+        addFree(offset, size);
+    }
+
+    std::vector<RangeAllocator::Move> RangeAllocator::compact() {
+        std::vector<Move> moves;
+        std::map<unsigned int, unsigned int> packed;
+
+        unsigned int offset = 0;
+        for(const auto& range : allocated) {
+            if(range.first != offset)
+                moves.push_back({range.first, offset, range.second});
+            packed.emplace_hint(packed.end(), offset, range.second);
+            offset += range.second;
+        }
+
+        allocated.swap(packed);
+        freeByOffset.clear();
+        freeBySize.clear();
+        if(offset < capacity)
+            addFree(offset, capacity - offset);
+
+        return moves;
+    }
+
+    unsigned int RangeAllocator::getSize(unsigned int offset) const {
+        auto it = allocated.find(offset);
+        if(it == allocated.end()) {
+            error_logger("RangeAllocator: No range allocated at offset ", offset);
+            throw std::runtime_error(error_logger.last());
+        }
+        return it->second;
+    }
+
+    unsigned int RangeAllocator::getCapacity() const {
+        return capacity;
+    }
+
+    unsigned int RangeAllocator::getUsed() const {
+        return used;
+    }
+
+    unsigned int RangeAllocator::getLargestFree() const {
+        return freeBySize.empty() ? 0 : std::prev(freeBySize.end())->first;
+    }
+
+    unsigned int RangeAllocator::getNumFreeRanges() const {
+        return freeByOffset.size();
+    }
+
+    unsigned int RangeAllocator::getNumAllocations() const {
+        return allocated.size();
+    }
+
+    void RangeAllocator::addFree(unsigned int offset, unsigned int size) {
+        freeByOffset.emplace(offset, size);
+        freeBySize.emplace(size, offset);
+    }
+
+    void RangeAllocator::removeFree(std::map<unsigned int, unsigned int>::iterator it) {
+        auto range = freeBySize.equal_range(it->second);
+        for(auto s = range.first; s != range.second; ++s) {
+            if(s->second == it->first) {
+                freeBySize.erase(s);
+                break;
+            }
+        }
+        freeByOffset.erase(it);
+    }
+
+}
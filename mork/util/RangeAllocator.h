@@ -0,0 +1,74 @@
+#ifndef _MORK_RANGEALLOCATOR_H_
+#define _MORK_RANGEALLOCATOR_H_
+
+#include <map>
+#include <vector>
+
+namespace mork {
+
+    // Sub-allocates ranges of [0, capacity), e.g. elements of a large GPU buffer.
+    // Free ranges are kept by offset and by size, so allocation is best fit and
+    // freeing merges with the neighbouring free ranges, both in O(log n).
+    // The allocator only does the bookkeeping, it owns no memory.
+    class RangeAllocator {
+        public:
+            // A range moved by compact
+            struct Move {
+                unsigned int from;
+                unsigned int to;
+                unsigned int size;
+            };
+
+            static constexpr unsigned int INVALID = ~0u;
+
+            RangeAllocator(unsigned int capacity = 0);
+
+            // Returns the offset of a new range of size elements, or INVALID if
+            // there is no free range large enough. Size must be > 0
+            unsigned int allocate(unsigned int size);
+
+            // Frees the range allocated at offset
+            void free(unsigned int offset);
+
+            // Frees all ranges
+            void clear();
+
+            // Extends the capacity, adding the new space at the end
+            void grow(unsigned int capacity);
+
+            // Moves all allocated ranges to the start, keeping their order, so all
+            // free space is one range at the end. Returns the moves, in increasing
+            // offset order (so moves can be done in order without overwriting
+            // ranges not yet moved).
+            std::vector<Move> compact();
+
+            // Returns the size of the range allocated at offset
+            unsigned int getSize(unsigned int offset) const;
+
+            unsigned int getCapacity() const;
+            unsigned int getUsed() const;
+            unsigned int getLargestFree() const;
+
+            // Returns the number of free ranges, 1 (or 0 if full) when not fragmented
+            unsigned int getNumFreeRanges() const;
+
+            unsigned int getNumAllocations() const;
+
+        private:
+            void addFree(unsigned int offset, unsigned int size);
+            void removeFree(std::map<unsigned int, unsigned int>::iterator it);
+
+            unsigned int capacity;
+            unsigned int used;
+
+            // Free ranges, offset -> size and size -> offset
+            std::map<unsigned int, unsigned int>        freeByOffset;
+            std::multimap<unsigned int, unsigned int>   freeBySize;
+
+            // Allocated ranges, offset -> size
+            std::map<unsigned int, unsigned int>        allocated;
+    };
+
+}
+
+#endif
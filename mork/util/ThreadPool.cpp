@@ -0,0 +1,47 @@
+#include "mork/util/ThreadPool.h"
+
+#include <algorithm>
+
+namespace mork {
+
+    ThreadPool::ThreadPool(unsigned int threads)
+        : stopping(false) {
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for(unsigned int i = 0; i < threads; ++i)
+            workers.emplace_back(&ThreadPool::worker, this);
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+
+        for(auto& w : workers)
+            w.join();
+    }
+
+    unsigned int ThreadPool::size() const {
+        return workers.size();
+    }
+
+    void ThreadPool::worker() {
+        while(true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if(jobs.empty())
+                    return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+}
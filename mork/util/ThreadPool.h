@@ -0,0 +1,93 @@
+#ifndef _MORK_THREADPOOL_H_
+#define _MORK_THREADPOOL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace mork {
+
+    // A fixed size pool of worker threads executing submitted jobs in FIFO order
+    class ThreadPool {
+        public:
+            // Creates a pool with the given number of worker threads.
+            // 0 gives one worker per hardware thread.
+            ThreadPool(unsigned int threads = 0);
+
+            // Waits for all queued jobs to complete before joining the workers
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            unsigned int size() const;
+
+            // Queues a job, and returns a future for its result
+            template<typename F>
+            auto submit(F&& f) -> std::future<decltype(f())>;
+
+            // Runs fn(i) for all i in [0, count), grouping consecutive indices into
+            // jobs with a total weight(i) of roughly grain, and waits for all of them
+            // to complete. Exceptions thrown by fn are rethrown.
+            template<typename Weight, typename Func>
+            void runWeighted(std::size_t count, std::size_t grain, Weight weight, Func fn);
+
+        private:
+            void worker();
+
+            std::vector<std::thread>            workers;
+            std::deque<std::function<void()> >  jobs;
+            std::mutex                          mutex;
+            std::condition_variable             condition;
+            bool                                stopping;
+    };
+
+    template<typename F>
+    auto ThreadPool::submit(F&& f) -> std::future<decltype(f())> {
+        using R = decltype(f());
+
+        // std::function requires copyable targets, so the task is shared
+        auto task = std::make_shared<std::packaged_task<R()> >(std::forward<F>(f));
+        std::future<R> ret = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return ret;
+    }
+
+    template<typename Weight, typename Func>
+    void ThreadPool::runWeighted(std::size_t count, std::size_t grain, Weight weight, Func fn) {
+        std::vector<std::future<void> > futures;
+
+        std::size_t begin = 0;
+        std::size_t accumulated = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            accumulated += weight(i);
+            if(accumulated >= grain || i + 1 == count) {
+                std::size_t end = i + 1;
+                futures.push_back(submit([&fn, begin, end]() {
+                    for(std::size_t j = begin; j < end; ++j)
+                        fn(j);
+                }));
+                begin = end;
+                accumulated = 0;
+            }
+        }
+
+        // Wait for all before rethrowing, as the jobs refer to fn
+        for(auto& f : futures)
+            f.wait();
+        for(auto& f : futures)
+            f.get();
+    }
+
+}
+
+#endif
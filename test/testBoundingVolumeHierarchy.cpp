@@ -0,0 +1,216 @@
+#include "../mork/scene/BoundingVolumeHierarchy.h"
+#include "../mork/scene/Scene.h"
+#include "../mork/scene/SceneNode.h"
+#include "../mork/math/mat4.h"
+
+#include <gtest/gtest.h>
+
+using mork::SceneNode;
+using mork::mat4d;
+using mork::vec3d;
+using mork::box3d;
+using mork::Scene;
+using mork::Frustum;
+
+class BoundingVolumeHierarchyTest : public ::testing::Test {
+
+protected:
+    BoundingVolumeHierarchyTest();
+
+    virtual ~BoundingVolumeHierarchyTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+BoundingVolumeHierarchyTest::BoundingVolumeHierarchyTest()
+{
+
+}
+
+BoundingVolumeHierarchyTest::~BoundingVolumeHierarchyTest()
+{
+
+}
+
+void BoundingVolumeHierarchyTest::SetUp()
+{
+}
+
+void BoundingVolumeHierarchyTest::TearDown()
+{
+}
+
+// A sprawling model: one group node with a grid of small mesh nodes below
+void buildGrid(SceneNode& root, int n) {
+    SceneNode& model = root.addChild(SceneNode("model"));
+    for(int i = 0; i < n; ++i) {
+        SceneNode& row = model.addChild(SceneNode("row" + std::to_string(i)));
+        for(int j = 0; j < n; ++j) {
+            SceneNode& mesh = row.addChild(SceneNode(std::to_string(j)));
+            mesh.setLocalToParent(mat4d::translate(vec3d(i*4.0 - n*2.0, j*4.0 - n*2.0, 0)));
+            mesh.setLocalBounds(box3d(-1, 1, -1, 1, -1, 1));
+        }
+    }
+}
+
+bool hasBounds(const SceneNode& node) {
+    bool bounded = node.hasLocalBounds();
+    for(const SceneNode& child : node.getChildren())
+        bounded = hasBounds(child) || bounded;
+    return bounded;
+}
+
+// Visibility by brute force: visible if own bounds are, or any child is. Nodes
+// without bounds in their subtree are visible with their parent.
+bool checkVisibility(SceneNode& node, const Frustum& f, bool parentVisible = false) {
+    bool visible = node.hasLocalBounds() &&
+        f.getVisibility(node.getLocalToWorld()*node.getLocalBounds()) != mork::Visibility::INVISIBLE;
+    for(SceneNode& child : node.getChildren()) {
+        if(hasBounds(child))
+            visible = checkVisibility(child, f) || visible;
+    }
+    if(!hasBounds(node))
+        visible = parentVisible;
+    for(SceneNode& child : node.getChildren()) {
+        if(!hasBounds(child))
+            checkVisibility(child, f, visible);
+    }
+
+    EXPECT_EQ(node.isVisible(), visible) << node.getName();
+    return visible;
+}
+
+TEST_F(BoundingVolumeHierarchyTest, Visibility)
+{
+    Scene scene;
+    scene.setBvhCulling(true);
+    ASSERT_EQ(scene.hasBvhCulling(), true);
+    buildGrid(scene.getRoot(), 30);
+
+    scene.getCamera().setPosition(vec3d(0, 0, 40));
+    scene.getCamera().lookAt(vec3d(1, 0, -1), vec3d(0, 0, 1));
+    scene.update();
+
+    const mork::BoundingVolumeHierarchy* bvh = scene.getBoundingVolumeHierarchy();
+    ASSERT_EQ(bvh->getLeafCount(), 900);
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+    ASSERT_LT(bvh->getTestedNodeCount(), bvh->getNodeCount());
+
+    // Move the camera
+    scene.getCamera().lookAt(vec3d(-1, 1, -1), vec3d(0, 0, 1));
+    scene.update();
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+
+    // Move some nodes: the tree is refitted
+    SceneNode& model = scene.getRoot().getChild("model");
+    model.getChild("row3").setLocalToParent(mat4d::translate(vec3d(0, 0, 10)));
+    model.getChild("row20").getChild("7").setLocalToParent(mat4d::translate(vec3d(-30, 30, 0)));
+    scene.update();
+    ASSERT_EQ(bvh->getLeafCount(), 900);
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+
+    // Structural changes: the tree is rebuilt
+    SceneNode& extra = model.addChild(SceneNode("extra"));
+    extra.setLocalBounds(box3d(-5, 5, -5, 5, -5, 5));
+    std::unique_ptr<SceneNode> row5 = model.removeChild(model.getChild("row5"));
+    scene.update();
+    ASSERT_EQ(bvh->getLeafCount(), 871);
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+
+    // Nodes that get bounds of their own are added as leaves
+    model.getChild("row6").setLocalBounds(box3d(-50, 50, -50, 50, -1, 1));
+    scene.update();
+    ASSERT_EQ(bvh->getLeafCount(), 872);
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+}
+
+TEST_F(BoundingVolumeHierarchyTest, Rebuild)
+{
+    Scene scene;
+    scene.setBvhCulling(true);
+    buildGrid(scene.getRoot(), 10);
+    scene.update();
+
+    const mork::BoundingVolumeHierarchy* bvh = scene.getBoundingVolumeHierarchy();
+    ASSERT_EQ(bvh->getCost(), bvh->getBuildCost());
+
+    // A small change does not degrade the tree
+    SceneNode& model = scene.getRoot().getChild("model");
+    model.getChild("row1").getChild("1").setLocalToParent(mat4d::translate(vec3d(0.5, 0, 0)));
+    scene.update();
+    ASSERT_LE(bvh->getCost(), bvh->getRebuildRatio()*bvh->getBuildCost());
+
+    // Scatter the nodes: the tree is rebuilt
+    for(int i = 0; i < 10; ++i) {
+        for(int j = 0; j < 10; ++j) {
+            vec3d p(((i*37 + j*11) % 10)*20.0, ((j*53 + i*7) % 10)*20.0, ((i*j) % 10)*20.0);
+            model.getChild("row" + std::to_string(i)).getChild(std::to_string(j)).setLocalToParent(mat4d::translate(p));
+        }
+    }
+    scene.update();
+    ASSERT_EQ(bvh->getCost(), bvh->getBuildCost());
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+}
+
+TEST_F(BoundingVolumeHierarchyTest, NodesWithoutBounds)
+{
+    Scene scene;
+    scene.setBvhCulling(true);
+    scene.getCamera().setPosition(vec3d(0, 0, 40));
+    scene.getCamera().lookAt(vec3d(0, 0, -1), vec3d(0, 1, 0));
+
+    SceneNode& shown = scene.getRoot().addChild(SceneNode("shown"));
+    shown.setLocalBounds(box3d(-1, 1, -1, 1, -1, 1));
+    SceneNode& culled = scene.getRoot().addChild(SceneNode("culled"));
+    culled.setLocalToParent(mat4d::translate(vec3d(0, 0, 100)));
+    culled.setLocalBounds(box3d(-1, 1, -1, 1, -1, 1));
+
+    // Lights and empty transform nodes below them, not in the tree
+    SceneNode& light = shown.addChild(SceneNode("light"));
+    light.setLocalToParent(mat4d::translate(vec3d(0, 0, 100)));
+    SceneNode& empty = shown.addChild(SceneNode("empty"));
+    SceneNode& nested = empty.addChild(SceneNode("nested"));
+    SceneNode& hidden = culled.addChild(SceneNode("hidden"));
+
+    scene.update();
+    ASSERT_EQ(scene.getBoundingVolumeHierarchy()->getLeafCount(), 2);
+    ASSERT_TRUE(shown.isVisible());
+    ASSERT_FALSE(culled.isVisible());
+    ASSERT_TRUE(light.isVisible());
+    ASSERT_TRUE(empty.isVisible());
+    ASSERT_TRUE(nested.isVisible());
+    ASSERT_FALSE(hidden.isVisible());
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+
+    // Reset with their parent
+    scene.getCamera().lookAt(vec3d(0, 0, 1), vec3d(0, 1, 0));
+    scene.update();
+    ASSERT_FALSE(shown.isVisible());
+    ASSERT_FALSE(light.isVisible());
+    ASSERT_FALSE(nested.isVisible());
+    ASSERT_TRUE(hidden.isVisible());
+    checkVisibility(scene.getRoot(), scene.getCamera().getWorldFrustum());
+}
+
+TEST_F(BoundingVolumeHierarchyTest, MoveScene)
+{
+    Scene scene;
+    scene.setBvhCulling(true);
+    buildGrid(scene.getRoot(), 10);
+    scene.update();
+
+    Scene moved = std::move(scene);
+    moved.getCamera().lookAt(vec3d(-1, 1, -1), vec3d(0, 0, 1));
+    moved.update();
+    ASSERT_EQ(moved.getBoundingVolumeHierarchy()->getLeafCount(), 100);
+    checkVisibility(moved.getRoot(), moved.getCamera().getWorldFrustum());
+}
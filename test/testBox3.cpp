@@ -71,3 +71,22 @@ TEST_F(Box3Test, NormTest)
 }
 
 
+
+TEST_F(Box3Test, AreaTest)
+{
+    mork::box3d empty;
+    ASSERT_EQ(empty.empty(), true);
+    ASSERT_EQ(empty.area(), 0);
+
+    mork::box3d box(-1, 1, -1, 1, -1, 1);
+    ASSERT_EQ(box.empty(), false);
+    ASSERT_EQ(box.area(), 24);
+
+    // Flat boxes are not empty
+    mork::box3d plane(0, 2, 0, 3, 0, 0);
+    ASSERT_EQ(plane.empty(), false);
+    ASSERT_EQ(plane.area(), 12);
+
+    ASSERT_EQ(box == mork::box3d(-1, 1, -1, 1, -1, 1), true);
+    ASSERT_EQ(box != plane, true);
+}
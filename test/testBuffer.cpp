@@ -1,4 +1,7 @@
 #include "../mork/render/GPUBuffer.h"
+#include "../mork/render/StreamBuffer.h"
+#include "../mork/render/GLState.h"
+#include "../mork/render/VertexArrayObject.h"
 #include "../mork/math/vec4.h"
 #include <gtest/gtest.h>
 
@@ -74,3 +77,113 @@ TEST_F(BufferTest, CreateAndFillShaderStorageTest)
     
 }
 
+
+TEST_F(BufferTest, ImmutableStorageTest)
+{
+    typedef  mork::GPUBuffer<float, GL_SHADER_STORAGE_BUFFER, GL_STATIC_DRAW> SSBO;
+    SSBO buf;
+
+    std::vector<float> v = {1.0f, 2.0f, 3.0f, 4.0f};
+    buf.setStorage(v.data(), v.size(), GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT);
+    ASSERT_TRUE(buf.isImmutable());
+
+    // Partial updates are allowed, respecification is not
+    float two[2] = {5.0f, 6.0f};
+    buf.setSubData(1, two, 2);
+    ASSERT_THROW(buf.setData(v), std::runtime_error);
+
+    {
+        auto bw = mork::ConstBufferView<SSBO>(buf);
+        const float* fptr = reinterpret_cast<const float*>(bw.get());
+        ASSERT_EQ(1.0f, fptr[0]);
+        ASSERT_EQ(5.0f, fptr[1]);
+        ASSERT_EQ(6.0f, fptr[2]);
+        ASSERT_EQ(4.0f, fptr[3]);
+    }
+
+    // New storage replaces the buffer
+    unsigned int id = buf.getId();
+    buf.setStorage(v, GL_MAP_READ_BIT);
+    ASSERT_NE(buf.getId(), id);
+}
+
+TEST_F(BufferTest, StreamBufferTest)
+{
+    mork::StreamBuffer buf(1024);
+
+    // Offsets are aligned to the element size, also for non power of two sizes
+    size_t first;
+    float* v = buf.allocate<float>(3, first);
+    ASSERT_EQ(first, 0);
+    v[0] = 1.0f; v[1] = 2.0f; v[2] = 3.0f;
+
+    auto a = buf.allocate(20, 20);
+    ASSERT_EQ(a.offset % 20, 0);
+    ASSERT_GE(a.offset, 3*sizeof(float));
+
+    // Coherent writes are visible to the GL without any flush
+    float read[3];
+    glGetNamedBufferSubData(buf.getId(), 0, sizeof(read), read);
+    ASSERT_EQ(read[0], 1.0f);
+    ASSERT_EQ(read[2], 3.0f);
+
+    // A new frame starts in the next region
+    buf.endFrame();
+    auto b = buf.allocate(16);
+    ASSERT_EQ(b.offset, 1024);
+
+    // Filling a region moves on to the next
+    buf.allocate(1000);
+    auto c = buf.allocate(100);
+    ASSERT_EQ(c.offset, 2048);
+
+    // Allocations larger than a region grow the buffer
+    auto d = buf.allocate(4000);
+    ASSERT_GE(buf.getRegionSize(), 4000);
+    ASSERT_EQ(d.offset, 0);
+}
+
+TEST_F(BufferTest, StateTrackerTest)
+{
+    mork::GLState& state = mork::GLState::getInstance();
+    mork::VertexArrayObject vao;
+    mork::GPUBuffer<float, GL_ARRAY_BUFFER, GL_STATIC_DRAW> a, b;
+
+    vao.bind();
+    a.bind();
+    state.resetCounters();
+
+    // Binding what is bound is skipped
+    vao.bind();
+    a.bind();
+    ASSERT_EQ(state.getElidedCalls(), 2);
+    ASSERT_EQ(state.getIssuedCalls(), 0);
+    ASSERT_EQ(state.getBuffer(GL_ARRAY_BUFFER), a.getId());
+
+    b.bind();
+    ASSERT_EQ(state.getIssuedCalls(), 1);
+    GLint bound = 0;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &bound);
+    ASSERT_EQ(bound, b.getId());
+
+    // Lazy unbinding leaves the buffer bound
+    state.setLazyUnbind(true);
+    b.unbind();
+    ASSERT_EQ(state.getBuffer(GL_ARRAY_BUFFER), b.getId());
+    state.setLazyUnbind(false);
+    b.unbind();
+    ASSERT_EQ(state.getBuffer(GL_ARRAY_BUFFER), 0);
+
+    // Deleted objects are forgotten, as their names are reused
+    {
+        mork::GPUBuffer<float, GL_ARRAY_BUFFER, GL_STATIC_DRAW> c;
+        c.bind();
+    }
+    ASSERT_EQ(state.getBuffer(GL_ARRAY_BUFFER), 0);
+
+    // Bindings changed behind the tracker are unknown after a reset
+    state.reset();
+    ASSERT_EQ(state.getVertexArray(), mork::GLState::UNKNOWN);
+    vao.unbind();
+    ASSERT_EQ(state.getVertexArray(), 0);
+}
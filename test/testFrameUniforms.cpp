@@ -0,0 +1,101 @@
+#include "../mork/render/FrameUniforms.h"
+#include "../mork/math/mat4.h"
+#include "../mork/math/pmath.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+
+
+class FrameUniformsTest : public ::testing::Test {
+
+protected:
+    FrameUniformsTest();
+
+    virtual ~FrameUniformsTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+FrameUniformsTest::FrameUniformsTest()
+{
+
+}
+
+FrameUniformsTest::~FrameUniformsTest()
+{
+
+}
+
+void FrameUniformsTest::SetUp()
+{
+}
+
+void FrameUniformsTest::TearDown()
+{
+}
+
+TEST_F(FrameUniformsTest, CameraBlock)
+{
+    mork::FrameUniforms fu;
+    mork::mat4d proj = mork::mat4d::perspectiveProjection(radians(45.0), 1.5, 0.1, 100.0);
+    mork::mat4d view = mork::mat4d::translate(mork::vec3d(1, 2, 3));
+    fu.setCamera(proj, view, mork::vec3d(-1, -2, -3));
+
+    // Matrices are stored row major
+    const mork::CameraBlock& block = fu.getCameraBlock();
+    for(int r = 0; r < 4; ++r) {
+        for(int c = 0; c < 4; ++c) {
+            ASSERT_FLOAT_EQ(block.projection[r*4 + c], proj[r][c]);
+            ASSERT_FLOAT_EQ(block.view[r*4 + c], view[r][c]);
+        }
+    }
+    ASSERT_FLOAT_EQ(block.view[3], 1.0f);
+    ASSERT_FLOAT_EQ(block.viewPos.y, -2.0f);
+    ASSERT_FLOAT_EQ(block.pad0, 0.0f);
+}
+
+TEST_F(FrameUniformsTest, LightsBlock)
+{
+    // Lights are black by default, with a valid attenuation
+    mork::FrameUniforms fu;
+    const mork::LightsBlock& block = fu.getLightsBlock();
+    ASSERT_FLOAT_EQ(block.dirLight.diffuse.x, 0.0f);
+    ASSERT_FLOAT_EQ(block.pointLight.constant, 1.0f);
+    ASSERT_FLOAT_EQ(block.spotLight.constant, 1.0f);
+
+    mork::PointLight point;
+    point.setPosition(mork::vec3d(4, 5, 6));
+    point.setAttenuation({2.0, 0.5, 0.25});
+    fu.setPointLight(point);
+    ASSERT_FLOAT_EQ(block.pointLight.position.z, 6.0f);
+    ASSERT_FLOAT_EQ(block.pointLight.linear, 0.5f);
+    ASSERT_FLOAT_EQ(block.pointLight.quadratic, 0.25f);
+    ASSERT_FLOAT_EQ(block.pointLight.diffuse.x, point.getDiffuseColor().x);
+
+    mork::SpotLight spot;
+    spot.setAngles(radians(30.0), radians(20.0));
+    spot.setDirection(mork::vec3d(0, 0, -1));
+    fu.setSpotLight(spot);
+    ASSERT_NEAR(block.spotLight.cutOff, std::cos(radians(20.0)), 1e-6);
+    ASSERT_NEAR(block.spotLight.outerCutOff, std::cos(radians(30.0)), 1e-6);
+    ASSERT_FLOAT_EQ(block.spotLight.direction.z, -1.0f);
+
+    mork::DirLight dir;
+    dir.setDirection(mork::vec3d(1, 0, 0));
+    dir.setSpecularColor(mork::vec3d(0.5, 0.5, 0.5));
+    fu.setDirLight(dir);
+    ASSERT_FLOAT_EQ(block.dirLight.direction.x, 1.0f);
+    ASSERT_FLOAT_EQ(block.dirLight.specular.y, 0.5f);
+    ASSERT_FLOAT_EQ(block.dirLight.pad3, 0.0f);
+}
@@ -150,13 +150,13 @@ TEST_F(FrustumTest, PointVisibilityTest)
     ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(0,0,1)), false);
     ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(0,0,-1)), false);
 
-    // Test clipping planes (default is 0.1 - 100, but frustum dont test for far plane)
+    // Test clipping planes (default is 0.1 - 100)
     ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(0.09,0,0)), false);
     ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(0.11,0,0)), true);
     ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(10,0,0)), true);
     ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(99,0,0)), true);
-    ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(101,0,0)), true);
-    ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(1.0e6,0,0)), true);
+    ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(101,0,0)), false);
+    ASSERT_EQ(scene.getCamera().getWorldFrustum().isInside(vec3d(1.0e6,0,0)), false);
 
 
 
@@ -173,3 +173,140 @@ TEST_F(FrustumTest, PointVisibilityTest)
 
 }
 
+
+TEST_F(FrustumTest, SphereVisibilityTest)
+{
+    Scene scene;
+
+    scene.getCamera().setPosition(vec3d(0, 0, 0));
+    scene.getCamera().lookAt(vec3d(1,0,0), vec3d(0,0,1));
+    scene.getCamera().setFOV(radians(45.0));
+    scene.getCamera().setAspectRatio(800, 600);
+
+    scene.update();
+    const Frustum& frustum = scene.getCamera().getWorldFrustum();
+
+    ASSERT_EQ(frustum.getVisibility(vec3d(10,0,0), 1.0), mork::Visibility::FULLY_VISIBLE);
+    // Crossing the near and the far plane
+    ASSERT_EQ(frustum.getVisibility(vec3d(0,0,0), 1.0), mork::Visibility::PARTIALLY_VISIBLE);
+    ASSERT_EQ(frustum.getVisibility(vec3d(100,0,0), 1.0), mork::Visibility::PARTIALLY_VISIBLE);
+    ASSERT_EQ(frustum.getVisibility(vec3d(102,0,0), 1.0), mork::Visibility::INVISIBLE);
+    ASSERT_EQ(frustum.getVisibility(vec3d(-2,0,0), 1.0), mork::Visibility::INVISIBLE);
+
+    // Just outside and just crossing the upper plane, 22.5 degrees above the view
+    // direction
+    vec3d up(10.0*cos(radians(22.5)), 0.0, 10.0*sin(radians(22.5)));
+    vec3d normal(-sin(radians(22.5)), 0.0, cos(radians(22.5)));
+    ASSERT_EQ(frustum.getVisibility(up + normal*1.01, 1.0), mork::Visibility::INVISIBLE);
+    ASSERT_EQ(frustum.getVisibility(up + normal*0.99, 1.0), mork::Visibility::PARTIALLY_VISIBLE);
+}
+
+TEST_F(FrustumTest, PlaneMaskTest)
+{
+    Scene scene;
+    SceneNode& node = scene.getRoot().addChild(SceneNode("node"));
+    node.setLocalBounds(mork::box3d(-1, 1, -1, 1, -1, 1));
+    node.setLocalToParent(mat4d::translate(vec3d(10, 0, 0)));
+    SceneNode& child = node.addChild(SceneNode("child"));
+    child.setLocalBounds(mork::box3d(-0.5, 0.5, -0.5, 0.5, -0.5, 0.5));
+
+    scene.getCamera().setPosition(vec3d(-10, 0, 0));
+    scene.getCamera().lookAt(vec3d(1,0,0), vec3d(0,0,1));
+    scene.getCamera().setFOV(radians(45.0));
+    scene.getCamera().setAspectRatio(800, 600);
+    scene.update();
+    const Frustum& frustum = scene.getCamera().getWorldFrustum();
+
+    // Fully inside: all planes are cleared from the mask
+    unsigned int mask = Frustum::ALL_PLANES;
+    int lastPlane = -1;
+    ASSERT_EQ(frustum.getVisibility(node.getWorldBounds(), mask, lastPlane), mork::Visibility::FULLY_VISIBLE);
+    ASSERT_EQ(mask, 0);
+    ASSERT_EQ(lastPlane, -1);
+
+    // Crossing the far plane: only the far plane is left in the mask
+    mask = Frustum::ALL_PLANES;
+    mork::box3d far(85, 95, -1, 1, -1, 1);
+    ASSERT_EQ(frustum.getVisibility(far, mask, lastPlane), mork::Visibility::PARTIALLY_VISIBLE);
+    ASSERT_EQ(mask, 1u << 5);
+
+    // Beyond the far plane: rejected by the far plane, which is remembered
+    mask = Frustum::ALL_PLANES;
+    mork::box3d beyond(95, 105, -1, 1, -1, 1);
+    ASSERT_EQ(frustum.getVisibility(beyond, mask, lastPlane), mork::Visibility::INVISIBLE);
+    ASSERT_EQ(lastPlane, 5);
+    ASSERT_EQ(frustum.getVisibility(beyond), mork::Visibility::INVISIBLE);
+
+    // Planes not in the mask are not tested
+    mask = Frustum::ALL_PLANES & ~(1u << 5);
+    lastPlane = -1;
+    ASSERT_EQ(frustum.getVisibility(beyond, mask, lastPlane), mork::Visibility::FULLY_VISIBLE);
+
+    // Far away nodes are culled by the scene
+    node.setLocalToParent(mat4d::translate(vec3d(150, 0, 0)));
+    scene.update();
+    ASSERT_EQ(node.isVisible(), false);
+    ASSERT_EQ(child.isVisible(), false);
+    node.setLocalToParent(mat4d::translate(vec3d(50, 0, 0)));
+    scene.update();
+    ASSERT_EQ(node.isVisible(), true);
+    ASSERT_EQ(child.isVisible(), true);
+}
+
+TEST_F(FrustumTest, BatchedVisibilityTest)
+{
+    Scene scene;
+    scene.getCamera().setPosition(vec3d(-10, 0, 0));
+    scene.getCamera().lookAt(vec3d(1,0,0), vec3d(0,0,1));
+    scene.getCamera().setFOV(radians(45.0));
+    scene.getCamera().setAspectRatio(800, 600);
+    scene.update();
+    const Frustum& frustum = scene.getCamera().getWorldFrustum();
+
+    // Pseudo random boxes around the camera, with a count that leaves a remainder
+    // for all batch sizes
+    mork::BoxArrays boxes;
+    std::vector<mork::box3d> reference;
+    unsigned int seed = 12345;
+    auto random = [&seed](double lo, double hi) {
+        seed = seed*1103515245u + 12345u;
+        return lo + (hi - lo)*((seed >> 8) & 0xffff)/65535.0;
+    };
+    for(int i = 0; i < 1000 + 13; ++i) {
+        vec3d c(random(-20, 40), random(-30, 30), random(-30, 30));
+        vec3d h(random(0.1, 3), random(0.1, 3), random(0.1, 3));
+        mork::box3d bb(c.x - h.x, c.x + h.x, c.y - h.y, c.y + h.y, c.z - h.z, c.z + h.z);
+        boxes.push_back(bb);
+        reference.push_back(bb);
+    }
+    ASSERT_EQ(boxes.size(), 1013);
+
+    std::vector<mork::Visibility> scalar(boxes.size());
+    frustum.getVisibility(boxes, scalar.data(), Frustum::SCALAR);
+
+    // The single precision reference agrees with the double precision test, except
+    // possibly for boxes touching a plane
+    int agree = 0;
+    int counts[3] = {0, 0, 0};
+    for(unsigned int i = 0; i < reference.size(); ++i) {
+        if(scalar[i] == frustum.getVisibility(reference[i]))
+            ++agree;
+        ++counts[scalar[i]];
+    }
+    ASSERT_GE(agree, 1010);
+    ASSERT_GT(counts[mork::FULLY_VISIBLE], 0);
+    ASSERT_GT(counts[mork::PARTIALLY_VISIBLE], 0);
+    ASSERT_GT(counts[mork::INVISIBLE], 0);
+
+    // All supported instruction sets give identical results
+    for(int simd = Frustum::SSE; simd <= Frustum::getSimdLevel(); ++simd) {
+        std::vector<mork::Visibility> result(boxes.size(), mork::PARTIALLY_VISIBLE);
+        frustum.getVisibility(boxes, result.data(), static_cast<Frustum::Simd>(simd));
+        ASSERT_EQ(result, scalar) << "simd level " << simd;
+    }
+
+    // The default picks the best
+    std::vector<mork::Visibility> best(boxes.size());
+    frustum.getVisibility(boxes, best.data());
+    ASSERT_EQ(best, scalar);
+}
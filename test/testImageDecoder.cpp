@@ -0,0 +1,104 @@
+#include "../mork/render/ImageDecoder.h"
+#include "../mork/glad/glad.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+
+class ImageDecoderTest : public ::testing::Test {
+
+protected:
+    ImageDecoderTest();
+
+    virtual ~ImageDecoderTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+ImageDecoderTest::ImageDecoderTest()
+{
+
+}
+
+ImageDecoderTest::~ImageDecoderTest()
+{
+
+}
+
+void ImageDecoderTest::SetUp()
+{
+}
+
+void ImageDecoderTest::TearDown()
+{
+}
+
+TEST_F(ImageDecoderTest, LoadAndFlip)
+{
+    mork::Image image = mork::Image::load("../bin/textures/awesomeface.png", false);
+    ASSERT_FALSE(image.empty());
+    ASSERT_EQ(image.getChannels(), 4);
+    ASSERT_EQ(image.getFormat(), GL_RGBA8);
+    ASSERT_EQ(image.getSize(), size_t(image.getWidth())*image.getHeight()*4);
+
+    mork::Image flipped = mork::Image::load("../bin/textures/awesomeface.png", true);
+    size_t rowSize = size_t(image.getWidth())*4;
+    for(int y = 0; y < image.getHeight(); ++y) {
+        ASSERT_EQ(std::memcmp(image.getPixels() + y*rowSize,
+                    flipped.getPixels() + (image.getHeight() - 1 - y)*rowSize, rowSize), 0);
+    }
+
+    flipped.flipVertical();
+    ASSERT_EQ(std::memcmp(image.getPixels(), flipped.getPixels(), image.getSize()), 0);
+
+    ASSERT_THROW(mork::Image::load("../bin/textures/missing.png", false), std::runtime_error);
+}
+
+TEST_F(ImageDecoderTest, DecodeConcurrently)
+{
+    std::vector<std::string> files = {
+        "../bin/textures/container.jpg",
+        "../bin/textures/awesomeface.png",
+        "../bin/textures/container2_specular.png",
+        "../bin/textures/brickwall.jpg"
+    };
+
+    // Decoders have their own threads, and flip per call
+    mork::ImageDecoder decoder(3);
+    ASSERT_EQ(decoder.getNumThreads(), 3);
+    std::future<mork::Image> flipped = decoder.decode(files[1], true);
+    std::vector<mork::Image> images = decoder.decodeAll(files, false);
+    ASSERT_EQ(images.size(), files.size());
+
+    for(size_t i = 0; i < files.size(); ++i) {
+        mork::Image expected = mork::Image::load(files[i], false);
+        ASSERT_EQ(images[i].getWidth(), expected.getWidth());
+        ASSERT_EQ(images[i].getChannels(), expected.getChannels());
+        ASSERT_EQ(std::memcmp(images[i].getPixels(), expected.getPixels(), expected.getSize()), 0);
+    }
+
+    mork::Image f = flipped.get();
+    f.flipVertical();
+    ASSERT_EQ(std::memcmp(f.getPixels(), images[1].getPixels(), f.getSize()), 0);
+
+    // Errors are thrown when the images are taken
+    std::future<mork::Image> missing = decoder.decode("../bin/textures/missing.png", false);
+    ASSERT_THROW(missing.get(), std::runtime_error);
+    files.push_back("../bin/textures/missing.png");
+    ASSERT_THROW(decoder.decodeAll(files, true), std::runtime_error);
+}
@@ -2,6 +2,8 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
+
 
 
 class MeshUtilsTest : public ::testing::Test {
@@ -63,3 +65,378 @@ TEST_F(MeshUtilsTest, StandardObjects)
 }
 
 
+// A flat n x n quad grid in the xy plane, with shared vertices
+void makeGrid(int n, std::vector<mork::vec3f>& positions, std::vector<unsigned int>& indices) {
+    for(int j = 0; j <= n; ++j)
+        for(int i = 0; i <= n; ++i)
+            positions.push_back(mork::vec3f(i, j, 0));
+
+    for(int j = 0; j < n; ++j) {
+        for(int i = 0; i < n; ++i) {
+            unsigned int k = j*(n + 1) + i;
+            indices.insert(indices.end(), {k, k + 1, k + n + 2, k, k + n + 2, k + n + 1});
+        }
+    }
+}
+
+// A unit sphere laid out as MeshHelper::SPHERE, with a seam of split vertices
+void makeSphere(int stacks, int sectors, std::vector<mork::vec3f>& positions, std::vector<unsigned int>& indices) {
+    for(int i = 0; i <= stacks; ++i) {
+        double stack = -0.5*M_PI + i*M_PI/stacks;
+        for(int j = 0; j <= sectors; ++j) {
+            double sector = -M_PI + j*2.0*M_PI/sectors;
+            positions.push_back(mork::vec3d(cos(stack)*cos(sector), cos(stack)*sin(sector), sin(stack)).cast<float>());
+        }
+    }
+
+    for(int i = 0; i < stacks; ++i) {
+        unsigned int k1 = i*(sectors + 1);
+        unsigned int k2 = k1 + sectors + 1;
+        for(int j = 0; j < sectors; ++j, ++k1, ++k2) {
+            if(i != 0)
+                indices.insert(indices.end(), {k1, k1 + 1, k2});
+            if(i != stacks - 1)
+                indices.insert(indices.end(), {k1 + 1, k2 + 1, k2});
+        }
+    }
+}
+
+TEST_F(MeshUtilsTest, SimplifyGrid)
+{
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> indices;
+    makeGrid(20, positions, indices);
+    ASSERT_EQ(indices.size(), 20*20*6);
+
+    float error;
+    auto lod = mork::MeshUtil::simplify(positions, indices, indices.size()/4, 1.0f, &error);
+    ASSERT_LE(lod.size(), indices.size()/4);
+    ASSERT_EQ(lod.size() % 3, 0);
+    // A flat surface is simplified without error
+    ASSERT_LT(error, 1e-6);
+
+    // Border vertices are kept, so the outline is unchanged
+    std::vector<char> used(positions.size(), 0);
+    for(unsigned int i : lod)
+        used[i] = 1;
+    for(int i = 0; i <= 20; ++i) {
+        ASSERT_TRUE(used[i]);
+        ASSERT_TRUE(used[20*21 + i]);
+        ASSERT_TRUE(used[i*21]);
+        ASSERT_TRUE(used[i*21 + 20]);
+    }
+
+    // Total area is preserved
+    double area = 0.0;
+    for(std::size_t i = 0; i < lod.size(); i += 3) {
+        auto n = (positions[lod[i+1]] - positions[lod[i]]).crossProduct(positions[lod[i+2]] - positions[lod[i]]);
+        ASSERT_GT(n.z, 0.0f);
+        area += 0.5*n.z;
+    }
+    ASSERT_NEAR(area, 400.0, 1e-3);
+}
+
+TEST_F(MeshUtilsTest, SimplifySphere)
+{
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> indices;
+    makeSphere(40, 80, positions, indices);
+
+    // Error limit stops the simplification
+    float error;
+    auto limited = mork::MeshUtil::simplify(positions, indices, 0, 0.01f, &error);
+    ASSERT_LT(limited.size(), indices.size());
+    ASSERT_LE(error, 0.01f);
+
+    auto lod = mork::MeshUtil::simplify(positions, indices, indices.size()/8, 1.0f, &error);
+    ASSERT_LE(lod.size(), indices.size()/8);
+    ASSERT_GT(lod.size(), 0);
+    ASSERT_LT(error, 0.05f);
+
+    // No triangle is flipped
+    for(std::size_t i = 0; i < lod.size(); i += 3) {
+        const auto& p0 = positions[lod[i]];
+        auto n = (positions[lod[i+1]] - p0).crossProduct(positions[lod[i+2]] - p0);
+        ASSERT_GT(n.dotproduct(p0 + positions[lod[i+1]] + positions[lod[i+2]]), 0.0f);
+    }
+
+    // The seam is kept
+    std::vector<char> used(positions.size(), 0);
+    for(unsigned int i : lod)
+        used[i] = 1;
+    for(int i = 1; i < 40; ++i) {
+        ASSERT_TRUE(used[i*81]);
+        ASSERT_TRUE(used[i*81 + 80]);
+    }
+}
+
+TEST_F(MeshUtilsTest, LodChain)
+{
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> indices;
+    makeSphere(40, 80, positions, indices);
+
+    std::vector<float> errors;
+    auto chain = mork::MeshUtil::generateLodChain(positions, indices, 5, 0.5f, &errors);
+    ASSERT_EQ(chain.size(), 5);
+    ASSERT_EQ(errors.size(), 5);
+    ASSERT_EQ(chain[0], indices);
+    ASSERT_EQ(errors[0], 0.0f);
+    for(std::size_t i = 1; i < chain.size(); ++i) {
+        ASSERT_LT(chain[i].size(), chain[i-1].size());
+        ASSERT_GE(errors[i], errors[i-1]);
+    }
+
+    // The chain stops when nothing can be collapsed
+    std::vector<mork::vec3f> quad = {mork::vec3f(0, 0, 0), mork::vec3f(1, 0, 0), mork::vec3f(1, 1, 0), mork::vec3f(0, 1, 0)};
+    auto quadChain = mork::MeshUtil::generateLodChain(quad, {0, 1, 2, 0, 2, 3}, 4, 0.5f);
+    ASSERT_EQ(quadChain.size(), 1);
+}
+
+// The triangles of an index list, each rotated to start at its smallest index
+// (keeping the winding), sorted
+std::vector<std::array<unsigned int, 3> > sortedTriangles(const std::vector<unsigned int>& indices) {
+    std::vector<std::array<unsigned int, 3> > triangles;
+    for(std::size_t i = 0; i < indices.size(); i += 3) {
+        std::array<unsigned int, 3> t = {indices[i], indices[i+1], indices[i+2]};
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        triangles.push_back(t);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+TEST_F(MeshUtilsTest, VertexCacheOptimization)
+{
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> indices;
+    makeGrid(40, positions, indices);
+
+    // Row by row, each row reloads the vertices of the previous one
+    auto before = mork::MeshUtil::analyzeVertexCache(indices, positions.size());
+    ASSERT_GT(before.acmr, 0.9f);
+    ASSERT_NEAR(before.atvr*positions.size(), before.transformed, 1e-2);
+
+    auto optimized = mork::MeshUtil::optimizeVertexCache(indices, positions.size());
+    ASSERT_EQ(sortedTriangles(optimized), sortedTriangles(indices));
+    auto after = mork::MeshUtil::analyzeVertexCache(optimized, positions.size());
+    ASSERT_LT(after.acmr, 0.8f);
+    ASSERT_LT(after.acmr, before.acmr);
+
+    // Overdraw ordering keeps the triangles, and most of the cache use
+    auto ordered = mork::MeshUtil::optimizeOverdraw(positions, optimized, 1.05f);
+    ASSERT_EQ(sortedTriangles(ordered), sortedTriangles(indices));
+    ASSERT_LT(mork::MeshUtil::analyzeVertexCache(ordered, positions.size()).acmr, 1.05f*after.acmr + 0.05f);
+
+    // Fetch order follows first use, and drops unused vertices
+    std::size_t used;
+    auto remap = mork::MeshUtil::generateFetchRemap({4, 2, 4, 0}, 5, &used);
+    ASSERT_EQ(used, 3);
+    ASSERT_EQ(remap, std::vector<unsigned int>({2, ~0u, 1, ~0u, 0}));
+}
+
+TEST_F(MeshUtilsTest, OptimizeMesh)
+{
+    using Vert = mork::vertex_pos_norm_uv;
+
+    // A sphere with every triangle having its own vertices
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> sphere;
+    makeSphere(20, 40, positions, sphere);
+    std::vector<Vert> vertices;
+    std::vector<unsigned int> indices;
+    for(unsigned int i : sphere) {
+        indices.push_back(vertices.size());
+        vertices.push_back(Vert(positions[i], positions[i], mork::vec2f(i, 0)));
+    }
+
+    // The vertices at the first and last pole are not used
+    std::size_t usedCount = positions.size() - 2;
+
+    std::size_t count;
+    auto weld = mork::MeshUtil::generateWeldRemap(vertices.data(), vertices.size(), sizeof(Vert), &count);
+    ASSERT_EQ(count, usedCount);
+    ASSERT_EQ(weld[0], 0);
+
+    auto stats = mork::MeshUtil::optimize(vertices, indices);
+    ASSERT_EQ(stats.verticesBefore, sphere.size());
+    ASSERT_EQ(stats.verticesAfter, usedCount);
+    ASSERT_EQ(vertices.size(), usedCount);
+    ASSERT_EQ(indices.size(), sphere.size());
+    ASSERT_EQ(stats.before.acmr, 3.0f);
+    ASSERT_LT(stats.after.acmr, 0.9f);
+    ASSERT_LT(stats.after.atvr, 1.5f);
+
+    // Vertices are in fetch order, and every triangle is still there
+    unsigned int next = 0;
+    for(unsigned int i : indices) {
+        ASSERT_LE(i, next);
+        if(i == next)
+            ++next;
+    }
+    std::vector<unsigned int> original;
+    for(unsigned int i : indices)
+        original.push_back(static_cast<unsigned int>(vertices[i].uv.x));
+    ASSERT_EQ(sortedTriangles(original), sortedTriangles(sphere));
+}
+
+TEST_F(MeshUtilsTest, PackVertices)
+{
+    // Half floats
+    ASSERT_EQ(mork::MeshUtil::floatToHalf(1.0f), 0x3c00);
+    ASSERT_EQ(mork::MeshUtil::floatToHalf(-2.0f), 0xc000);
+    ASSERT_EQ(mork::MeshUtil::floatToHalf(65504.0f), 0x7bff);
+    ASSERT_EQ(mork::MeshUtil::floatToHalf(65520.0f), 0x7c00);
+    ASSERT_EQ(mork::MeshUtil::floatToHalf(std::ldexp(1.0f, -24)), 0x0001);
+    ASSERT_EQ(mork::MeshUtil::floatToHalf(std::ldexp(1.0f, -26)), 0x0000);
+    for(unsigned int h = 0; h < 0x7c00; ++h)
+        ASSERT_EQ(mork::MeshUtil::floatToHalf(mork::MeshUtil::halfToFloat(h)), h);
+
+    // Octahedral encoding of both hemispheres
+    for(const auto& v : {mork::vec3f(0, 0, 1), mork::vec3f(0, 0, -1), mork::vec3f(1, 0, 0), mork::vec3f(1, -2, -3).normalize()}) {
+        short x, y;
+        mork::MeshUtil::encodeOctahedral(v, x, y);
+        ASSERT_GT(mork::MeshUtil::decodeOctahedral(x, y).dotproduct(v), 0.99999f);
+    }
+
+    // A textured sphere off the origin, with uvs repeating a few times
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> indices;
+    makeSphere(20, 40, positions, indices);
+    std::vector<mork::vertex_pos_norm_uv> sphere;
+    for(std::size_t i = 0; i < positions.size(); ++i) {
+        int stack = i/41, sector = i%41;
+        sphere.push_back(mork::vertex_pos_norm_uv(positions[i]*10.0f + mork::vec3f(100, 0, -5), positions[i], mork::vec2f(4.0f*sector/40, 2.0f*stack/20)));
+    }
+    auto vertices = mork::MeshUtil::calculateTangentSpace(sphere, indices);
+    // Without the unused pole vertices, which are left at the origin
+    std::size_t used;
+    auto remap = mork::MeshUtil::generateFetchRemap(indices, vertices.size(), &used);
+    mork::MeshUtil::remapVertices(vertices, indices, remap, used);
+
+    mork::MeshUtil::VertexPacking packing;
+    auto packed = mork::MeshUtil::packVertices(vertices, packing);
+    ASSERT_EQ(packed.size(), vertices.size());
+    ASSERT_EQ(sizeof(packed[0])*2, 40);
+    ASSERT_NEAR(packing.offset.x, 90.0f, 1e-4);
+    ASSERT_NEAR(packing.scale.z, 20.0f, 1e-4);
+
+    // Half a quantization step
+    ASSERT_LE(packing.positionError, 0.5f*std::sqrt(3.0f)*20.0f/65535.0f + 1e-5f);
+    ASSERT_GT(packing.positionError, 0.0f);
+    ASSERT_LT(packing.normalError, 1e-4f);
+    ASSERT_LT(packing.tangentError, 1e-4f);
+    ASSERT_LE(packing.uvError, std::ldexp(1.0f, -10));
+
+    auto unpacked = mork::MeshUtil::unpackVertices(packed, packing);
+    for(std::size_t i = 0; i < vertices.size(); ++i) {
+        const auto& a = vertices[i];
+        const auto& b = unpacked[i];
+        ASSERT_LE((b.pos - a.pos).length(), packing.positionError + 1e-5f);
+        ASSERT_GT(b.norm.dotproduct(a.norm), std::cos(packing.normalError) - 1e-6f);
+        ASSERT_LE(std::abs(b.uv.x - a.uv.x), packing.uvError);
+        // The bitangent is rebuilt with the same handedness
+        if(a.bitang.length() > 0.0f && a.tang.length() > 0.0f) {
+            ASSERT_GT(b.bitang.dotproduct(a.bitang), 0.0f);
+        }
+    }
+
+    // Normalized bounds map to the mesh bounds
+    mork::box3d bounds = packing.decode(mork::box3d(0, 1, 0, 1, 0, 1));
+    ASSERT_NEAR(bounds.xmin, 90.0, 1e-4);
+    ASSERT_NEAR(bounds.xmax, 110.0, 1e-4);
+    ASSERT_NEAR(bounds.zmin, -15.0, 1e-4);
+}
+
+TEST_F(MeshUtilsTest, PackedMeshBounds)
+{
+    std::vector<mork::vertex_pos_norm_tang_bitang_uv> vertices;
+    for(int i = 0; i < 3; ++i)
+        vertices.push_back(mork::vertex_pos_norm_tang_bitang_uv(mork::vec3f(10 + i, -i, 5 + i), mork::vec3f(0, 0, 1), mork::vec3f(1, 0, 0), mork::vec3f(0, 1, 0), mork::vec2f(i, 0)));
+
+    mork::MeshUtil::VertexPacking packing;
+    mork::Mesh<mork::vertex_pos_norm_tang_uv_packed> mesh(mork::MeshUtil::packVertices(vertices, packing));
+    ASSERT_EQ(mesh.getPacking(), nullptr);
+    ASSERT_NEAR(mesh.getBounds().xmax, 1.0, 1e-6);
+
+    // Bounds of packed meshes are in object space
+    mesh.setPacking(packing);
+    ASSERT_EQ(mesh.getPacking()->offset, packing.offset);
+    ASSERT_NEAR(mesh.getBounds().xmin, 10.0, 1e-3);
+    ASSERT_NEAR(mesh.getBounds().xmax, 12.0, 1e-3);
+    ASSERT_NEAR(mesh.getBounds().ymin, -2.0, 1e-3);
+    ASSERT_NEAR(mesh.getBounds().zmax, 7.0, 1e-3);
+}
+
+TEST_F(MeshUtilsTest, Meshlets)
+{
+    std::vector<mork::vec3f> positions;
+    std::vector<unsigned int> indices;
+    makeSphere(40, 80, positions, indices);
+    std::size_t triangles = indices.size()/3;
+
+    std::vector<unsigned int> meshletIndices;
+    auto meshlets = mork::MeshUtil::buildMeshlets(positions, indices, meshletIndices);
+    ASSERT_EQ(sortedTriangles(meshletIndices), sortedTriangles(indices));
+    // Meshlets are mostly full
+    ASSERT_LT(meshlets.size(), 2*triangles/124);
+
+    unsigned int next = 0;
+    for(const auto& m : meshlets) {
+        ASSERT_EQ(m.firstIndex, next);
+        next += m.numIndices;
+        ASSERT_LE(m.numIndices, 124*3);
+        ASSERT_LE(m.numVertices, 64);
+
+        std::vector<unsigned int> used(meshletIndices.begin() + m.firstIndex, meshletIndices.begin() + m.firstIndex + m.numIndices);
+        std::sort(used.begin(), used.end());
+        ASSERT_EQ(std::unique(used.begin(), used.end()) - used.begin(), m.numVertices);
+
+        // The bounds and the cone contain all vertices and triangles
+        float minDot = m.coneCutoff < 1.0f ? std::sqrt(1.0f - m.coneCutoff*m.coneCutoff) : -1.0f;
+        for(unsigned int i = m.firstIndex; i < m.firstIndex + m.numIndices; i += 3) {
+            const auto& p0 = positions[meshletIndices[i]];
+            auto n = (positions[meshletIndices[i+1]] - p0).crossProduct(positions[meshletIndices[i+2]] - p0);
+            if(n.length() > 0.0f) {
+                ASSERT_GE(n.normalize().dotproduct(m.coneAxis), minDot - 1e-5f);
+            }
+            for(int c = 0; c < 3; ++c)
+                ASSERT_LE((positions[meshletIndices[i+c]] - m.center).length(), m.radius*1.0001f);
+        }
+    }
+    ASSERT_EQ(next, indices.size());
+
+    // Seen from the side, all front facing triangles are drawn, and most back
+    // facing ones are culled
+    mork::mat4d projection = mork::mat4d::perspectiveProjection(radians(60.0), 1.0, 0.1, 100.0);
+    mork::Frustum frustum;
+    frustum.setPlanes(projection*mork::mat4d::translate(mork::vec3d(0, 0, -10)));
+    std::vector<mork::DrawElementsIndirectCommand> commands;
+    unsigned int visible = mork::MeshUtil::cullMeshlets(meshlets, frustum, mork::vec3d(0, 0, 10), commands);
+    ASSERT_LT(visible, meshlets.size()*3/4);
+    ASSERT_LE(commands.size(), visible);
+
+    std::vector<char> drawn(triangles, 0);
+    std::size_t drawnTriangles = 0;
+    for(const auto& c : commands) {
+        ASSERT_EQ(c.instanceCount, 1);
+        for(unsigned int i = c.firstIndex; i < c.firstIndex + c.count; i += 3) {
+            drawn[i/3] = 1;
+            ++drawnTriangles;
+        }
+    }
+    ASSERT_LT(drawnTriangles, triangles*3/4);
+    for(std::size_t t = 0; t < triangles; ++t) {
+        const auto& p0 = positions[meshletIndices[3*t]];
+        auto n = (positions[meshletIndices[3*t+1]] - p0).crossProduct(positions[meshletIndices[3*t+2]] - p0);
+        if(n.dotproduct(mork::vec3f(0, 0, 10) - p0) > 0.0f) {
+            ASSERT_TRUE(drawn[t]);
+        }
+    }
+
+    // Behind the camera, nothing is drawn
+    commands.clear();
+    frustum.setPlanes(projection*mork::mat4d::translate(mork::vec3d(0, 0, 10)));
+    ASSERT_EQ(mork::MeshUtil::cullMeshlets(meshlets, frustum, mork::vec3d(0, 0, -10), commands), 0);
+    ASSERT_TRUE(commands.empty());
+}
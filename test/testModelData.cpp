@@ -0,0 +1,203 @@
+#include "../mork/util/ModelData.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+
+
+class ModelDataTest : public ::testing::Test {
+
+protected:
+    ModelDataTest();
+
+    virtual ~ModelDataTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+ModelDataTest::ModelDataTest()
+{
+
+}
+
+ModelDataTest::~ModelDataTest()
+{
+
+}
+
+void ModelDataTest::SetUp()
+{
+}
+
+void ModelDataTest::TearDown()
+{
+}
+
+// A model of two triangle meshes, one on a child node, and a textured material
+static mork::ModelData makeModel() {
+    mork::ModelData data;
+
+    for(int m = 0; m < 2; ++m) {
+        std::vector<mork::VTBN> vertices;
+        for(int i = 0; i < 3 + m; ++i)
+            vertices.push_back(mork::VTBN(mork::vec3f(i, m, -i), mork::vec3f(0, 0, 1), mork::vec3f::ZERO, mork::vec3f::ZERO, mork::vec2f(i, m)));
+        std::vector<unsigned int> indices = {0, 1, 2};
+        if(m == 1)
+            indices.insert(indices.end(), {2, 3, 0});
+        data.addMesh(std::move(vertices), std::move(indices), m);
+    }
+
+    mork::ModelData::MaterialDesc plain;
+    plain.diffuseColor = mork::vec3f(0.5f, 0.25f, 1.0f);
+    data.materials.push_back(plain);
+
+    mork::ModelData::MaterialDesc textured;
+    textured.shininess = 8.0f;
+    textured.opacity = 0.5f;
+    textured.layers.push_back({mork::LayerType::DIFFUSE, mork::Op::MULTIPLY, 1.0f, "textures/container.jpg"});
+    textured.layers.push_back({mork::LayerType::NORMAL, mork::Op::ADD, 0.5f, "textures/brickwall_normal.jpg"});
+    data.materials.push_back(textured);
+
+    mork::ModelData::Node root;
+    root.parent = -1;
+    root.localToParent = mork::mat4d::translate(mork::vec3d(1, 2, 3));
+    root.bounds = data.getMeshes()[0].bounds;
+    root.meshes.push_back(0);
+    data.nodes.push_back(root);
+
+    mork::ModelData::Node child;
+    child.parent = 0;
+    child.localToParent = mork::mat4d::rotatez(0.5);
+    child.bounds = data.getMeshes()[1].bounds;
+    child.meshes.push_back(1);
+    data.nodes.push_back(child);
+
+    return data;
+}
+
+TEST_F(ModelDataTest, SaveAndLoad)
+{
+    mork::ModelData data = makeModel();
+    ASSERT_EQ(data.getMeshes()[1].bounds.xmax, 3.0);
+    ASSERT_EQ(data.getMeshes()[1].bounds.zmin, -3.0);
+
+    const char* file = "testModelData.mmesh";
+    ASSERT_TRUE(mork::ModelData::isCookedFile(file));
+    ASSERT_FALSE(mork::ModelData::isCookedFile("models/teapot.nff"));
+    data.save(file);
+
+    mork::ModelData loaded = mork::ModelData::load(file);
+    std::remove(file);
+
+    ASSERT_EQ(loaded.getMeshes().size(), 2);
+    for(int m = 0; m < 2; ++m) {
+        const auto& a = data.getMeshes()[m];
+        const auto& b = loaded.getMeshes()[m];
+        ASSERT_EQ(b.numVertices, a.numVertices);
+        ASSERT_EQ(b.numIndices, a.numIndices);
+        ASSERT_EQ(b.material, a.material);
+        ASSERT_EQ(std::memcmp(b.vertices, a.vertices, a.numVertices*sizeof(mork::VTBN)), 0);
+        ASSERT_EQ(std::memcmp(b.indices, a.indices, a.numIndices*sizeof(unsigned int)), 0);
+        ASSERT_EQ(b.bounds.xmin, a.bounds.xmin);
+        ASSERT_EQ(b.bounds.zmax, a.bounds.zmax);
+        // Blobs are aligned in the mapping, for direct uploads
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(b.vertices)%16, 0);
+    }
+
+    ASSERT_EQ(loaded.materials.size(), 2);
+    ASSERT_EQ(loaded.materials[0].diffuseColor, mork::vec3f(0.5f, 0.25f, 1.0f));
+    ASSERT_EQ(loaded.materials[0].layers.size(), 0);
+    ASSERT_EQ(loaded.materials[1].shininess, 8.0f);
+    ASSERT_EQ(loaded.materials[1].opacity, 0.5f);
+    ASSERT_EQ(loaded.materials[1].layers.size(), 2);
+    ASSERT_EQ(loaded.materials[1].layers[1].type, mork::LayerType::NORMAL);
+    ASSERT_EQ(loaded.materials[1].layers[1].op, mork::Op::ADD);
+    ASSERT_EQ(loaded.materials[1].layers[1].blendFactor, 0.5f);
+    ASSERT_EQ(loaded.materials[1].layers[1].file, "textures/brickwall_normal.jpg");
+
+    ASSERT_EQ(loaded.nodes.size(), 2);
+    ASSERT_EQ(loaded.nodes[0].parent, -1);
+    ASSERT_EQ(loaded.nodes[1].parent, 0);
+    ASSERT_EQ(loaded.nodes[1].meshes, std::vector<unsigned int>({1}));
+    for(int i = 0; i < 16; ++i)
+        ASSERT_EQ(loaded.nodes[1].localToParent.coefficients()[i], data.nodes[1].localToParent.coefficients()[i]);
+
+    // The loaded data outlives a move
+    mork::ModelData moved = std::move(loaded);
+    ASSERT_EQ(moved.getMeshes()[1].indices[4], 3);
+}
+
+TEST_F(ModelDataTest, RejectBadFiles)
+{
+    const char* file = "testModelData.mmesh";
+    makeModel().save(file);
+
+    std::vector<char> contents;
+    {
+        std::ifstream in(file, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto write = [&](const std::vector<char>& c) {
+        std::ofstream out(file, std::ios::binary);
+        out.write(c.data(), c.size());
+    };
+
+    // Truncated
+    write(std::vector<char>(contents.begin(), contents.end() - 4));
+    ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+
+    // Another version
+    std::vector<char> c = contents;
+    c[4] = 99;
+    write(c);
+    ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+
+    // Not a cooked file
+    c = contents;
+    c[0] = 'X';
+    write(c);
+    ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+
+    // A mesh with a material out of range. The meshes offset follows the
+    // counts and the nodes offset in the header, the material leads the record
+    c = contents;
+    uint64_t meshesOffset;
+    std::memcpy(&meshesOffset, c.data() + 40, sizeof(meshesOffset));
+    uint32_t material = 99;
+    std::memcpy(c.data() + meshesOffset, &material, sizeof(material));
+    write(c);
+    ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+
+    // Layers with a type or op out of range. The layers offset follows the
+    // materials offset in the header, the type and op lead the record
+    uint64_t layersOffset;
+    std::memcpy(&layersOffset, contents.data() + 56, sizeof(layersOffset));
+    for(int field = 0; field < 2; ++field) {
+        c = contents;
+        uint32_t value = 99;
+        std::memcpy(c.data() + layersOffset + field*sizeof(value), &value, sizeof(value));
+        write(c);
+        ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+    }
+
+    // Too short for a header
+    write(std::vector<char>(contents.begin(), contents.begin() + 8));
+    ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+
+    std::remove(file);
+    ASSERT_THROW(mork::ModelData::load(file), std::runtime_error);
+}
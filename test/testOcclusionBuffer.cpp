@@ -0,0 +1,230 @@
+#include "../mork/scene/OcclusionBuffer.h"
+#include "../mork/scene/Scene.h"
+#include "../mork/util/ThreadPool.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+using namespace mork;
+
+
+class OcclusionBufferTest : public ::testing::Test {
+
+protected:
+    OcclusionBufferTest();
+
+    virtual ~OcclusionBufferTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+OcclusionBufferTest::OcclusionBufferTest()
+{
+
+}
+
+OcclusionBufferTest::~OcclusionBufferTest()
+{
+
+}
+
+void OcclusionBufferTest::SetUp()
+{
+}
+
+void OcclusionBufferTest::TearDown()
+{
+}
+
+// Looking down -z from the origin
+mat4d occlusionViewProjection() {
+    return mat4d::perspectiveProjection(radians(90.0), 2.0, 0.1, 100.0);
+}
+
+TEST_F(OcclusionBufferTest, EmptyBuffer)
+{
+    OcclusionBuffer ob;
+    ob.begin(occlusionViewProjection());
+    ob.rasterize();
+
+    ASSERT_EQ(ob.getTriangleCount(), 0);
+    ASSERT_EQ(ob.getDepth(0, 0), 1.0f);
+    ASSERT_FALSE(ob.isOccluded(box3d(-1, 1, -1, 1, -21, -20)));
+}
+
+TEST_F(OcclusionBufferTest, WallTest)
+{
+    OcclusionBuffer ob;
+    ob.begin(occlusionViewProjection());
+    // A wall 10x10 at distance 10
+    ob.addOccluder(box3d(-5, 5, -5, 5, -10.5, -10), mat4d::IDENTITY);
+    ob.rasterize();
+    ASSERT_EQ(ob.getTriangleCount(), 12);
+
+    // Center of the buffer is covered
+    ASSERT_LT(ob.getDepth(ob.getWidth()/2, ob.getHeight()/2), 1.0f);
+    ASSERT_EQ(ob.getDepth(0, 0), 1.0f);
+
+    // Behind the wall
+    ASSERT_TRUE(ob.isOccluded(box3d(-1, 1, -1, 1, -21, -20)));
+    ASSERT_TRUE(ob.isOccluded(box3d(-9, 9, -9, 9, -21, -20)));
+    // In front of the wall
+    ASSERT_FALSE(ob.isOccluded(box3d(-1, 1, -1, 1, -6, -5)));
+    // Beside the wall
+    ASSERT_FALSE(ob.isOccluded(box3d(24, 26, -1, 1, -21, -20)));
+    // Partly behind the wall
+    ASSERT_FALSE(ob.isOccluded(box3d(5, 15, -1, 1, -21, -20)));
+    // Penetrating the wall
+    ASSERT_FALSE(ob.isOccluded(box3d(-1, 1, -1, 1, -21, -9)));
+    // Crossing the near plane
+    ASSERT_FALSE(ob.isOccluded(box3d(-1, 1, -1, 1, -21, 1)));
+    // The wall itself
+    ASSERT_FALSE(ob.isOccluded(box3d(-5, 5, -5, 5, -10.5, -10)));
+
+    // Moving the wall with its transform
+    ob.begin(occlusionViewProjection());
+    ob.addOccluder(box3d(-5, 5, -5, 5, -0.5, 0), mat4d::translate(vec3d(20, 0, -10)));
+    ob.rasterize();
+    ASSERT_FALSE(ob.isOccluded(box3d(-1, 1, -1, 1, -21, -20)));
+    ASSERT_TRUE(ob.isOccluded(box3d(39, 41, -1, 1, -21, -20)));
+}
+
+TEST_F(OcclusionBufferTest, SimdAndParallelMatch)
+{
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> xy(-30.0f, 30.0f);
+    std::uniform_real_distribution<float> z(-90.0f, -1.0f);
+
+    std::vector<vec3f> vertices;
+    std::vector<unsigned int> indices;
+    for(int i = 0; i < 3000; ++i) {
+        vertices.push_back(vec3f(xy(gen), xy(gen), z(gen)));
+        indices.push_back(i);
+    }
+
+    ThreadPool pool(4);
+    OcclusionBuffer scalar, simd, parallel;
+    for(OcclusionBuffer* ob : {&scalar, &simd, &parallel}) {
+        ob->begin(occlusionViewProjection());
+        ob->addOccluder(vertices, indices, mat4d::IDENTITY);
+    }
+    scalar.rasterize(nullptr, Frustum::SCALAR);
+    simd.rasterize(nullptr, Frustum::getSimdLevel());
+    parallel.rasterize(&pool, Frustum::getSimdLevel());
+    ASSERT_EQ(scalar.getTriangleCount(), 1000);
+
+    for(int y = 0; y < scalar.getHeight(); ++y) {
+        for(int x = 0; x < scalar.getWidth(); ++x) {
+            ASSERT_EQ(scalar.getDepth(x, y), simd.getDepth(x, y));
+            ASSERT_EQ(scalar.getDepth(x, y), parallel.getDepth(x, y));
+        }
+    }
+}
+
+TEST_F(OcclusionBufferTest, SimdMatchesAtSpanEnds)
+{
+    // Small triangles ending inside groups of 4 pixels, and long ones from close
+    // to the near plane reaching off screen. The requested width is padded to a
+    // multiple of 4
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> xy(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> far(-1e4f, 1e4f);
+    std::uniform_real_distribution<float> z(-3.0f, -0.1f);
+
+    std::vector<vec3f> vertices;
+    std::vector<unsigned int> indices;
+    for(int i = 0; i < 300; ++i) {
+        vec3f v(xy(gen), xy(gen), z(gen));
+        if(i % 30 == 0)
+            v = vec3f(far(gen), far(gen), -0.1001f);
+        vertices.push_back(v);
+        indices.push_back(i);
+    }
+
+    OcclusionBuffer scalar(94, 40), simd(94, 40);
+    for(OcclusionBuffer* ob : {&scalar, &simd}) {
+        ob->begin(occlusionViewProjection());
+        ob->addOccluder(vertices, indices, mat4d::IDENTITY);
+    }
+    scalar.rasterize(nullptr, Frustum::SCALAR);
+    simd.rasterize(nullptr, Frustum::getSimdLevel());
+    ASSERT_EQ(scalar.getWidth(), 96);
+
+    int covered = 0;
+    for(int y = 0; y < scalar.getHeight(); ++y) {
+        for(int x = 0; x < scalar.getWidth(); ++x) {
+            ASSERT_EQ(scalar.getDepth(x, y), simd.getDepth(x, y));
+            if(scalar.getDepth(x, y) < 1.0f)
+                ++covered;
+        }
+    }
+    ASSERT_GT(covered, 0);
+    ASSERT_LT(covered, scalar.getWidth()*scalar.getHeight());
+}
+
+TEST_F(OcclusionBufferTest, SceneTest)
+{
+    Scene scene;
+    scene.setOcclusionCulling(true);
+    ASSERT_TRUE(scene.hasOcclusionCulling());
+
+    SceneNode& wall = scene.getRoot().addChild(SceneNode("wall"));
+    box3d wallBox(-5, 5, -5, 5, -10.5, -10);
+    wall.setLocalBounds(wallBox);
+    scene.addOccluder(wall, wallBox);
+
+    SceneNode& group = scene.getRoot().addChild(SceneNode("group"));
+    SceneNode& hidden = group.addChild(SceneNode("hidden"));
+    hidden.setLocalBounds(box3d(-1, 1, -1, 1, -1, 1));
+    hidden.setLocalToParent(mat4d::translate(vec3d(0, 0, -30)));
+    SceneNode& shown = group.addChild(SceneNode("shown"));
+    shown.setLocalBounds(box3d(-1, 1, -1, 1, -1, 1));
+    shown.setLocalToParent(mat4d::translate(vec3d(15, 0, -30)));
+
+    scene.update();
+    ASSERT_TRUE(wall.isVisible());
+    ASSERT_TRUE(group.isVisible());
+    ASSERT_TRUE(shown.isVisible());
+    ASSERT_FALSE(hidden.isVisible());
+    ASSERT_EQ(scene.getOccludedNodeCount(), 1);
+
+    // Moving the hidden node in front of the wall
+    hidden.setLocalToParent(mat4d::translate(vec3d(0, 0, -5)));
+    scene.update();
+    ASSERT_TRUE(hidden.isVisible());
+    ASSERT_EQ(scene.getOccludedNodeCount(), 0);
+
+    // In a moved scene
+    hidden.setLocalToParent(mat4d::translate(vec3d(0, 0, -30)));
+    Scene moved = std::move(scene);
+    moved.update();
+    ASSERT_FALSE(hidden.isVisible());
+    ASSERT_EQ(moved.getOccludedNodeCount(), 1);
+
+    // The occluder is dropped with its node, even if the node lives on
+    std::unique_ptr<SceneNode> removed = moved.getRoot().removeChild(wall);
+    moved.update();
+    ASSERT_TRUE(hidden.isVisible());
+    moved.getRoot().addChild(std::move(removed));
+    moved.update();
+    ASSERT_TRUE(hidden.isVisible());
+
+    // Without occluders
+    moved.addOccluder(moved.getRoot().getChild("wall"), wallBox);
+    moved.update();
+    ASSERT_FALSE(hidden.isVisible());
+    moved.clearOccluders();
+    moved.update();
+    ASSERT_TRUE(hidden.isVisible());
+}
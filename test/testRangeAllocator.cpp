@@ -0,0 +1,155 @@
+#include "../mork/util/RangeAllocator.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+
+class RangeAllocatorTest : public ::testing::Test {
+
+protected:
+    RangeAllocatorTest();
+
+    virtual ~RangeAllocatorTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+RangeAllocatorTest::RangeAllocatorTest()
+{
+
+}
+
+RangeAllocatorTest::~RangeAllocatorTest()
+{
+
+}
+
+void RangeAllocatorTest::SetUp()
+{
+}
+
+void RangeAllocatorTest::TearDown()
+{
+}
+
+TEST_F(RangeAllocatorTest, AllocateAndFree)
+{
+    mork::RangeAllocator alloc(100);
+    unsigned int a = alloc.allocate(30);
+    unsigned int b = alloc.allocate(30);
+    unsigned int c = alloc.allocate(30);
+    ASSERT_EQ(a, 0);
+    ASSERT_EQ(b, 30);
+    ASSERT_EQ(c, 60);
+    ASSERT_EQ(alloc.getUsed(), 90);
+    ASSERT_EQ(alloc.allocate(20), mork::RangeAllocator::INVALID);
+
+    // Freeing the middle range leaves two free ranges
+    alloc.free(b);
+    ASSERT_EQ(alloc.getNumFreeRanges(), 2);
+    ASSERT_EQ(alloc.getLargestFree(), 30);
+
+    // Best fit: the 10 element range at the end is used before the hole
+    ASSERT_EQ(alloc.allocate(10), 90);
+    ASSERT_EQ(alloc.allocate(20), 30);
+    ASSERT_EQ(alloc.getSize(30), 20);
+
+    // Freed neighbours merge
+    alloc.free(a);
+    alloc.free(30);
+    ASSERT_EQ(alloc.getNumFreeRanges(), 1);
+    ASSERT_EQ(alloc.getLargestFree(), 60);
+    alloc.free(c);
+    alloc.free(90);
+    ASSERT_EQ(alloc.getNumFreeRanges(), 1);
+    ASSERT_EQ(alloc.getLargestFree(), 100);
+    ASSERT_EQ(alloc.getUsed(), 0);
+
+    ASSERT_THROW(alloc.free(5), std::runtime_error);
+    ASSERT_THROW(alloc.allocate(0), std::runtime_error);
+}
+
+TEST_F(RangeAllocatorTest, Grow)
+{
+    mork::RangeAllocator alloc(10);
+    alloc.allocate(8);
+    ASSERT_EQ(alloc.allocate(5), mork::RangeAllocator::INVALID);
+
+    // The new space merges with the free range at the end
+    alloc.grow(20);
+    ASSERT_EQ(alloc.getNumFreeRanges(), 1);
+    ASSERT_EQ(alloc.getLargestFree(), 12);
+    ASSERT_EQ(alloc.allocate(12), 8);
+    ASSERT_EQ(alloc.getLargestFree(), 0);
+
+    alloc.grow(25);
+    ASSERT_EQ(alloc.allocate(5), 20);
+    ASSERT_EQ(alloc.getCapacity(), 25);
+}
+
+TEST_F(RangeAllocatorTest, RandomCompact)
+{
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<unsigned int> sizes(1, 64);
+
+    mork::RangeAllocator alloc(1 << 14);
+    std::vector<std::pair<unsigned int, unsigned int> > live;
+    for(int i = 0; i < 2000; ++i) {
+        if(!live.empty() && gen()%3 == 0) {
+            unsigned int k = gen()%live.size();
+            alloc.free(live[k].first);
+            live[k] = live.back();
+            live.pop_back();
+        } else {
+            unsigned int size = sizes(gen);
+            unsigned int offset = alloc.allocate(size);
+            if(offset != mork::RangeAllocator::INVALID)
+                live.push_back({offset, size});
+        }
+    }
+
+    // Live ranges never overlap
+    std::sort(live.begin(), live.end());
+    unsigned int used = 0;
+    for(unsigned int i = 0; i < live.size(); ++i) {
+        if(i > 0) {
+            ASSERT_LE(live[i-1].first + live[i-1].second, live[i].first);
+        }
+        used += live[i].second;
+    }
+    ASSERT_EQ(alloc.getUsed(), used);
+    ASSERT_GT(alloc.getNumFreeRanges(), 1);
+
+    // Compaction keeps the order and packs everything at the start
+    auto moves = alloc.compact();
+    ASSERT_EQ(alloc.getNumFreeRanges(), 1);
+    ASSERT_EQ(alloc.getLargestFree(), alloc.getCapacity() - used);
+
+    unsigned int offset = 0;
+    unsigned int m = 0;
+    for(auto& range : live) {
+        if(range.first != offset) {
+            ASSERT_EQ(moves[m].from, range.first);
+            ASSERT_EQ(moves[m].to, offset);
+            ASSERT_EQ(moves[m].size, range.second);
+            ++m;
+        }
+        ASSERT_EQ(alloc.getSize(offset), range.second);
+        offset += range.second;
+    }
+    ASSERT_EQ(m, moves.size());
+    ASSERT_EQ(alloc.getNumAllocations(), live.size());
+}
@@ -0,0 +1,426 @@
+#include "../mork/render/RenderQueue.h"
+#include "../mork/render/Material.h"
+#include "../mork/render/MaterialTable.h"
+#include "../mork/render/Mesh.h"
+#include "../mork/scene/SceneNode.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+
+class RenderQueueTest : public ::testing::Test {
+
+protected:
+    RenderQueueTest();
+
+    virtual ~RenderQueueTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+RenderQueueTest::RenderQueueTest()
+{
+
+}
+
+RenderQueueTest::~RenderQueueTest()
+{
+
+}
+
+void RenderQueueTest::SetUp()
+{
+}
+
+void RenderQueueTest::TearDown()
+{
+}
+
+// A unit box node at (0, 0, z)
+std::unique_ptr<mork::SceneNode> makeNode(const std::string& name, double z) {
+    auto node = std::make_unique<mork::SceneNode>(name);
+    node->setLocalBounds(mork::box3d(-0.5, 0.5, -0.5, 0.5, -0.5, 0.5));
+    node->setLocalToParent(mork::mat4d::translate(mork::vec3d(0, 0, z)));
+    node->updateLocalToWorld(mork::mat4d::IDENTITY);
+    return node;
+}
+
+// Meshes are only used as identities when sorting, so any distinct pointers will do
+const mork::MeshBase* fakeMesh(const std::vector<char>& storage, int i) {
+    return reinterpret_cast<const mork::MeshBase*>(&storage[i]);
+}
+
+// A mesh with three levels of detail, without any GL resources
+class LodMesh : public mork::MeshBase {
+    public:
+        virtual void draw() const {}
+        virtual void bind() const {}
+        virtual void issueDraw(unsigned int /*lod*/ = 0) const {}
+        virtual void unbind() const {}
+        virtual void issueDrawInstanced(unsigned int /*lod*/, unsigned int /*instanceCount*/, unsigned int /*baseInstance*/) const {}
+        virtual unsigned int getNumLods() const { return 3; }
+        virtual float getLodError(unsigned int lod) const { return lod == 0 ? 0.0f : (lod == 1 ? 0.1f : 1.0f); }
+};
+
+TEST_F(RenderQueueTest, OpaqueBeforeTransparent)
+{
+    mork::Material opaque, transparent;
+    transparent.opacity = 0.5f;
+
+    auto n1 = makeNode("n1", 1);
+    auto n2 = makeNode("n2", 2);
+    std::vector<char> meshes(1);
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    queue.add(nullptr, &transparent, fakeMesh(meshes, 0), n1.get());
+    queue.add(nullptr, &opaque, fakeMesh(meshes, 0), n2.get());
+    queue.add(nullptr, nullptr, fakeMesh(meshes, 0), n1.get());
+    queue.sort();
+
+    const auto& items = queue.getItems();
+    ASSERT_EQ(items.size(), 3);
+    ASSERT_FALSE(items[0].key & mork::RenderQueue::TRANSPARENT_BIT);
+    ASSERT_FALSE(items[1].key & mork::RenderQueue::TRANSPARENT_BIT);
+    ASSERT_TRUE(items[2].key & mork::RenderQueue::TRANSPARENT_BIT);
+    ASSERT_EQ(items[2].material, &transparent);
+
+    // Every draw needs a mesh
+    ASSERT_THROW(queue.add(nullptr, &opaque, nullptr, n1.get()), std::runtime_error);
+    ASSERT_EQ(queue.getItems().size(), 3);
+}
+
+TEST_F(RenderQueueTest, GroupByState)
+{
+    std::vector<char> meshes(4);
+    std::vector<mork::Material> materials(3);
+    std::vector<std::unique_ptr<mork::SceneNode> > nodes;
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    for(int i = 0; i < 24; ++i) {
+        nodes.push_back(makeNode("n" + std::to_string(i), i));
+        queue.add(nullptr, &materials[i%3], fakeMesh(meshes, i%4), nodes.back().get());
+    }
+    queue.sort();
+
+    // Each material, and each mesh within a material, must be in one contiguous run
+    const auto& items = queue.getItems();
+    int materialRuns = 0, meshRuns = 0;
+    for(std::size_t i = 0; i < items.size(); ++i) {
+        if(i == 0 || items[i].material != items[i-1].material) {
+            ++materialRuns;
+            ++meshRuns;
+        } else if(items[i].mesh != items[i-1].mesh)
+            ++meshRuns;
+    }
+    ASSERT_EQ(materialRuns, 3);
+    // 3 materials x 4 meshes, as 3 and 4 are co-prime
+    ASSERT_EQ(meshRuns, 12);
+}
+
+TEST_F(RenderQueueTest, DepthOrder)
+{
+    mork::Material opaque, transparent;
+    transparent.opacity = 0.5f;
+
+    std::vector<std::unique_ptr<mork::SceneNode> > nodes;
+    std::vector<double> distances = {5, 1, 9, 3, 7};
+    for(double z : distances)
+        nodes.push_back(makeNode("n" + std::to_string(z), z));
+
+    std::vector<char> meshes(1);
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 10.0);
+    for(auto& node : nodes) {
+        queue.add(nullptr, &opaque, fakeMesh(meshes, 0), node.get());
+        queue.add(nullptr, &transparent, fakeMesh(meshes, 0), node.get());
+    }
+    queue.sort();
+
+    const auto& items = queue.getItems();
+    ASSERT_EQ(items.size(), 10);
+
+    // Opaque front to back
+    for(int i = 1; i < 5; ++i)
+        ASSERT_LT(items[i-1].node->getWorldPos().z, items[i].node->getWorldPos().z);
+    // Transparent back to front
+    for(int i = 6; i < 10; ++i)
+        ASSERT_GT(items[i-1].node->getWorldPos().z, items[i].node->getWorldPos().z);
+}
+
+TEST_F(RenderQueueTest, RadixSortIsStable)
+{
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 15);
+    std::uniform_real_distribution<double> zdist(0.0, 200.0);
+
+    std::vector<char> meshes(16);
+    std::vector<mork::Material> materials(16);
+    for(int i = 0; i < 16; i += 3)
+        materials[i].opacity = 0.5f;
+
+    std::vector<std::unique_ptr<mork::SceneNode> > nodes;
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    for(int i = 0; i < 5000; ++i) {
+        // Some nodes beyond far distance, to test clamping
+        nodes.push_back(makeNode("n" + std::to_string(i), zdist(gen)));
+        queue.add(nullptr, &materials[dist(gen)], fakeMesh(meshes, dist(gen)), nodes.back().get());
+    }
+
+    std::vector<mork::DrawItem> expected = queue.getItems();
+    std::stable_sort(expected.begin(), expected.end(),
+            [](const mork::DrawItem& a, const mork::DrawItem& b) { return a.key < b.key; });
+
+    queue.sort();
+    const auto& items = queue.getItems();
+    ASSERT_EQ(items.size(), expected.size());
+    for(std::size_t i = 0; i < items.size(); ++i) {
+        ASSERT_EQ(items[i].key, expected[i].key);
+        ASSERT_EQ(items[i].node, expected[i].node);
+    }
+}
+
+TEST_F(RenderQueueTest, LodSelection)
+{
+    LodMesh mesh;
+    auto near = makeNode("near", -0.5);
+    auto mid = makeNode("mid", -5);
+    auto far = makeNode("far", -50);
+    auto scaled = makeNode("scaled", -50);
+    scaled->setLocalToParent(mork::mat4d::translate(mork::vec3d(0, 0, -50))*mork::mat4d::scale(mork::vec3d(100, 100, 100)));
+    scaled->updateLocalToWorld(mork::mat4d::IDENTITY);
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0, 10.0);
+    for(auto* node : {near.get(), mid.get(), far.get(), scaled.get()})
+        queue.add(nullptr, nullptr, &mesh, node);
+
+    const auto& items = queue.getItems();
+    ASSERT_EQ(items[0].lod, 0);
+    ASSERT_EQ(items[1].lod, 1);
+    ASSERT_EQ(items[2].lod, 2);
+    // Errors scale with the node
+    ASSERT_EQ(items[3].lod, 0);
+
+    // No LOD selection without a scale
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    queue.add(nullptr, nullptr, &mesh, far.get());
+    ASSERT_EQ(queue.getItems()[0].lod, 0);
+}
+
+// A mesh with a single level of detail, without any GL resources
+class PlainMesh : public LodMesh {
+    public:
+        virtual unsigned int getNumLods() const { return 1; }
+};
+
+TEST_F(RenderQueueTest, Batches)
+{
+    std::vector<PlainMesh> meshes(2);
+    mork::Material opaque, transparent;
+    transparent.opacity = 0.5f;
+    LodMesh lodMesh;
+
+    std::vector<std::unique_ptr<mork::SceneNode> > nodes;
+    for(int i = 0; i < 60; ++i)
+        nodes.push_back(makeNode("n" + std::to_string(i), -(i%10) - 2));
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0, 10.0);
+    for(int i = 0; i < 10; ++i) {
+        queue.add(nullptr, &opaque, &meshes[0], nodes[i].get());
+        queue.add(nullptr, &opaque, &meshes[1], nodes[10 + i].get());
+        queue.add(nullptr, &transparent, &meshes[0], nodes[20 + i].get());
+        // Level 1 below distance 10, level 2 beyond
+        queue.add(nullptr, nullptr, &lodMesh, nodes[30 + i].get());
+    }
+    queue.sort();
+
+    // Every batch shares all state, and no two adjacent batches could be merged
+    const auto& items = queue.getItems();
+    const auto& batches = queue.getBatches();
+    unsigned int total = 0;
+    for(unsigned int b = 0; b < batches.size(); ++b) {
+        ASSERT_EQ(batches[b].first, total);
+        const auto& first = items[batches[b].first];
+        for(unsigned int i = batches[b].first; i < batches[b].first + batches[b].count; ++i) {
+            ASSERT_EQ(items[i].material, first.material);
+            ASSERT_EQ(items[i].mesh, first.mesh);
+            ASSERT_EQ(items[i].lod, first.lod);
+        }
+        if(b > 0) {
+            const auto& prev = items[batches[b-1].first];
+            ASSERT_TRUE(prev.material != first.material || prev.mesh != first.mesh || prev.lod != first.lod);
+        }
+        total += batches[b].count;
+    }
+    ASSERT_EQ(total, items.size());
+    // Two opaque meshes, the transparent mesh, and two levels of the lod mesh
+    ASSERT_EQ(batches.size(), 5);
+
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    ASSERT_TRUE(queue.getBatches().empty());
+}
+
+// A mesh in a GeometryArena, without any GL resources. The arena is only used as
+// an identity.
+class ArenaPlainMesh : public PlainMesh {
+    public:
+        ArenaPlainMesh(const mork::GeometryArenaBase* arena) : arena(arena) {}
+        virtual const mork::GeometryArenaBase* getArena() const { return arena; }
+    private:
+        const mork::GeometryArenaBase* arena;
+};
+
+TEST_F(RenderQueueTest, MultiDrawRuns)
+{
+    std::vector<char> arena(1);
+    auto* fakeArena = reinterpret_cast<const mork::GeometryArenaBase*>(&arena[0]);
+    std::vector<ArenaPlainMesh> meshes(2, ArenaPlainMesh(fakeArena));
+    // No textures, so multi draws may span them
+    mork::Material opaque, other, transparent;
+    other.shininess = 8.0f;
+    transparent.opacity = 0.5f;
+
+    std::vector<std::unique_ptr<mork::SceneNode> > nodes;
+    for(int i = 0; i < 6; ++i)
+        nodes.push_back(makeNode("n" + std::to_string(i), -i - 2));
+
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    queue.add(nullptr, &opaque, &meshes[0], nodes[0].get());
+    queue.add(nullptr, &other, &meshes[1], nodes[1].get());
+    queue.add(nullptr, &transparent, &meshes[0], nodes[2].get());
+    queue.add(nullptr, &transparent, &meshes[1], nodes[3].get());
+    queue.sort();
+
+    const auto& items = queue.getItems();
+    const auto& batches = queue.getBatches();
+    ASSERT_EQ(batches.size(), 4);
+
+    // Opaque materials without textures share a multi draw, transparent ones are
+    // drawn in another
+    ASSERT_EQ(queue.getMultiDrawEnd(0, true), 1);
+    ASSERT_EQ(queue.getMultiDrawEnd(2, true), 3);
+    for(unsigned int b = 0; b < 2; ++b)
+        ASSERT_FALSE(items[batches[b].first].key & mork::RenderQueue::TRANSPARENT_BIT);
+
+    // Without instance materials, only batches of the same material are merged
+    ASSERT_EQ(queue.getMultiDrawEnd(0, false), 0);
+    ASSERT_EQ(queue.getMultiDrawEnd(2, false), 3);
+
+    // Meshes outside arenas are drawn one batch at a time
+    PlainMesh plain;
+    queue.begin(mork::vec3d::ZERO, 100.0);
+    queue.add(nullptr, &opaque, &plain, nodes[4].get());
+    queue.add(nullptr, &opaque, &plain, nodes[5].get());
+    queue.sort();
+    ASSERT_EQ(queue.getMultiDrawEnd(0, true), 0);
+}
+
+// A mesh of two meshlets, at the origin and at x = 50, never back facing
+class MeshletMesh : public PlainMesh {
+    public:
+        MeshletMesh() {
+            meshlets.push_back({0, 30, 10, mork::vec3f(0, 0, -10), 1.0f, mork::vec3f::ZERO, 1.0f});
+            meshlets.push_back({30, 30, 10, mork::vec3f(50, 0, -10), 1.0f, mork::vec3f::ZERO, 1.0f});
+        }
+        virtual const std::vector<mork::Meshlet>& getMeshlets() const { return meshlets; }
+    private:
+        std::vector<mork::Meshlet> meshlets;
+};
+
+TEST_F(RenderQueueTest, MeshletCulling)
+{
+    MeshletMesh mesh;
+    mork::mat4d projection = mork::mat4d::perspectiveProjection(M_PI/2.0, 1.0, 0.1, 100.0);
+    mork::RenderQueue queue;
+    queue.begin(mork::vec3d::ZERO, 100.0);
+
+    // Only the meshlet at the origin is in front of the camera
+    mork::SceneNode node("node");
+    node.updateLocalToWorld(mork::mat4d::IDENTITY);
+    std::vector<mork::DrawElementsIndirectCommand> commands;
+    ASSERT_EQ(queue.getVisibleMeshlets(mesh, node, projection, mork::mat4d::IDENTITY, commands), 1);
+    ASSERT_EQ(commands.size(), 1);
+    ASSERT_EQ(commands[0].firstIndex, 0);
+
+    // The meshlets are culled in the space of the node: moved, the other one is
+    node.setLocalToParent(mork::mat4d::translate(mork::vec3d(-50, 0, 0)));
+    node.updateLocalToWorld(mork::mat4d::IDENTITY);
+    commands.clear();
+    ASSERT_EQ(queue.getVisibleMeshlets(mesh, node, projection, mork::mat4d::IDENTITY, commands), 1);
+    ASSERT_EQ(commands[0].firstIndex, 30);
+
+    // Seen from x = -50
+    queue.begin(mork::vec3d(-50, 0, 0), 100.0);
+    commands.clear();
+    ASSERT_EQ(queue.getVisibleMeshlets(mesh, node, projection, mork::mat4d::translate(mork::vec3d(50, 0, 0)), commands), 1);
+    ASSERT_EQ(commands[0].firstIndex, 0);
+}
+
+TEST_F(RenderQueueTest, MaterialTable)
+{
+    mork::MaterialTable table;
+    mork::Material a, b;
+    a.diffuseColor = mork::vec3f(1, 0.5, 0.25);
+    a.shininess = 8.0f;
+    b.opacity = 0.5f;
+
+    ASSERT_EQ(table.add(a), 0);
+    ASSERT_EQ(table.add(b), 1);
+    ASSERT_EQ(table.add(a), 0);
+    ASSERT_EQ(table.getNumMaterials(), 2);
+    ASSERT_TRUE(table.contains(b));
+
+    const mork::MaterialData& da = table.getData(0);
+    ASSERT_FLOAT_EQ(da.diffuseColor.y, 0.5f);
+    ASSERT_FLOAT_EQ(da.shininess, 8.0f);
+    ASSERT_EQ(da.numDiffuseLayers, 0);
+    ASSERT_FLOAT_EQ(table.getData(1).opacity, 0.5f);
+
+    // Changes are only seen after an update
+    a.shininess = 16.0f;
+    ASSERT_FLOAT_EQ(table.getData(0).shininess, 8.0f);
+    table.update(a);
+    ASSERT_FLOAT_EQ(table.getData(0).shininess, 16.0f);
+    ASSERT_EQ(table.getNumMaterials(), 2);
+
+    // A moved material keeps its record
+    mork::Material moved = std::move(b);
+    ASSERT_EQ(table.add(moved), 1);
+    ASSERT_FALSE(table.contains(b));
+
+    // A material reusing the address of a destroyed one gets its own record
+    std::optional<mork::Material> reused;
+    reused.emplace();
+    ASSERT_EQ(table.add(*reused), 2);
+    reused.reset();
+    reused.emplace();
+    ASSERT_FALSE(table.contains(*reused));
+    ASSERT_EQ(table.add(*reused), 3);
+
+    table.clear();
+    ASSERT_FALSE(table.contains(a));
+}
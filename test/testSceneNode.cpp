@@ -712,3 +712,272 @@ TEST_F(SceneNodeTest, Scene03_reference_stdmove_benchmark) {
 
 
 
+
+// Builds a small hierarchy with transforms and bounds on all levels
+void buildHierarchy(SceneNode& root) {
+    for(int i = 0; i < 3; ++i) {
+        SceneNode& a = root.addChild(SceneNode("a" + std::to_string(i)));
+        a.setLocalToParent(mat4d::translate(vec3d(i*10.0, 0, 0))*mat4d::rotatez(0.3*i));
+        a.setLocalBounds(mork::box3d(-1, 1, -1, 1, -1, 1));
+        for(int j = 0; j < 4; ++j) {
+            SceneNode& b = a.addChild(SceneNode("b" + std::to_string(j)));
+            b.setLocalToParent(mat4d::translate(vec3d(0, j*2.0, 1.0))*mat4d::rotatex(0.1*j));
+            b.setLocalBounds(mork::box3d(-0.5, 0.5, -0.5, 0.5, -2, 2));
+        }
+    }
+}
+
+// Compares the transform state of two structurally equal hierarchies
+void compareHierarchy(const SceneNode& n1, SceneNode& n2) {
+    ASSERT_EQ(n1.getName(), n2.getName());
+    mat4d m1 = n1.getLocalToWorld();
+    mat4d m2 = n2.getLocalToWorld();
+    for(int i = 0; i < 16; ++i)
+        ASSERT_NEAR(m1.coefficients()[i], m2.coefficients()[i], 1e-12);
+    ASSERT_NEAR((n1.getWorldPos() - n2.getWorldPos()).length(), 0.0, 1e-12);
+    mork::box3d b1 = n1.getWorldBounds();
+    mork::box3d b2 = n2.getWorldBounds();
+    ASSERT_NEAR(b1.xmin, b2.xmin, 1e-12);
+    ASSERT_NEAR(b1.xmax, b2.xmax, 1e-12);
+    ASSERT_NEAR(b1.ymin, b2.ymin, 1e-12);
+    ASSERT_NEAR(b1.ymax, b2.ymax, 1e-12);
+    ASSERT_NEAR(b1.zmin, b2.zmin, 1e-12);
+    ASSERT_NEAR(b1.zmax, b2.zmax, 1e-12);
+    ASSERT_EQ(n1.getChildren().size(), n2.getChildren().size());
+    for(const SceneNode& c1 : n1.getChildren())
+        compareHierarchy(c1, n2.getChild(c1.getName()));
+}
+
+TEST_F(SceneNodeTest, FlatTransforms)
+{
+    Scene recursive;
+    Scene flat;
+    flat.setFlatTransforms(true);
+    ASSERT_EQ(flat.hasFlatTransforms(), true);
+    ASSERT_EQ(recursive.hasFlatTransforms(), false);
+
+    buildHierarchy(recursive.getRoot());
+    buildHierarchy(flat.getRoot());
+
+    recursive.update();
+    flat.update();
+    compareHierarchy(recursive.getRoot(), flat.getRoot());
+
+    // Change transforms of attached nodes
+    for(Scene* s : {&recursive, &flat}) {
+        SceneNode& a1 = s->getRoot().getChild("a1");
+        a1.setLocalToParent(mat4d::translate(vec3d(5, 5, 5)));
+        a1.getChild("b2").enlargeLocalBounds(mork::box3d(0, 3, 0, 3, 0, 3));
+        s->update();
+    }
+    compareHierarchy(recursive.getRoot(), flat.getRoot());
+
+    // Structural changes: remove a subtree, add a new one and reinsert the removed one
+    for(Scene* s : {&recursive, &flat}) {
+        SceneNode& root = s->getRoot();
+        std::unique_ptr<SceneNode> removed = root.removeChild(root.getChild("a0"));
+        ASSERT_EQ(removed->getChild("b1").getLocalToParent(), mat4d::translate(vec3d(0, 2.0, 1.0))*mat4d::rotatex(0.1));
+        SceneNode& c = root.getChild("a2").addChild(SceneNode("c"));
+        c.setLocalToParent(mat4d::translate(vec3d(-3, 0, 0)));
+        c.setLocalBounds(mork::box3d(-1, 1, -1, 1, -1, 1));
+        root.getChild("a1").addChild(std::move(removed));
+        root.getChild("a1").getChild("a0").clearChildren();
+        s->update();
+    }
+    compareHierarchy(recursive.getRoot(), flat.getRoot());
+
+    // Switching back to recursive propagation keeps the state
+    flat.setFlatTransforms(false);
+    compareHierarchy(recursive.getRoot(), flat.getRoot());
+    flat.update();
+    compareHierarchy(recursive.getRoot(), flat.getRoot());
+}
+
+TEST_F(SceneNodeTest, IncrementalUpdate)
+{
+    for(bool flatTransforms : {false, true}) {
+        Scene scene;
+        scene.setFlatTransforms(flatTransforms);
+        buildHierarchy(scene.getRoot());
+
+        // Everything is visited in the first update, only the root thereafter
+        scene.update();
+        ASSERT_EQ(scene.getUpdatedNodeCount(), 16);
+        scene.update();
+        ASSERT_EQ(scene.getUpdatedNodeCount(), 1);
+
+        // A leaf: only the leaf and its ancestors are visited
+        SceneNode& a1 = scene.getRoot().getChild("a1");
+        a1.getChild("b2").setLocalToParent(mat4d::translate(vec3d(0, 0, 50)));
+        scene.update();
+        ASSERT_EQ(scene.getUpdatedNodeCount(), 3);
+
+        // An inner node: its whole subtree is visited
+        a1.setLocalToParent(mat4d::translate(vec3d(-20, 0, 0)));
+        scene.update();
+        ASSERT_EQ(scene.getUpdatedNodeCount(), 6);
+
+        // Setting an unchanged transform does not propagate to the children
+        a1.setLocalToParent(mat4d::translate(vec3d(-20, 0, 0)));
+        scene.update();
+        ASSERT_EQ(scene.getUpdatedNodeCount(), 2);
+
+        a1.getChild("b0").enlargeLocalBounds(mork::box3d(100, 101, 0, 1, 0, 1));
+        scene.update();
+        ASSERT_EQ(scene.getUpdatedNodeCount(), 3);
+        ASSERT_EQ(scene.getRoot().getWorldBounds().xmax > 80.0, true);
+
+        // The result equals a full update of the same hierarchy
+        SceneNode reference("root");
+        buildHierarchy(reference);
+        reference.getChild("a1").setLocalToParent(mat4d::translate(vec3d(-20, 0, 0)));
+        reference.getChild("a1").getChild("b2").setLocalToParent(mat4d::translate(vec3d(0, 0, 50)));
+        reference.getChild("a1").getChild("b0").enlargeLocalBounds(mork::box3d(100, 101, 0, 1, 0, 1));
+        reference.updateLocalToWorld(mat4d::IDENTITY);
+        compareHierarchy(reference, scene.getRoot());
+        
+        // Removing a child shrinks the bounds again
+        std::unique_ptr<SceneNode> b0 = a1.removeChild(a1.getChild("b0"));
+        scene.update();
+        ASSERT_EQ(scene.getRoot().getWorldBounds().xmax < 80.0, true);
+    }
+}
+
+// Builds a larger hierarchy of varying depth and fan-out
+void buildLargeHierarchy(SceneNode& root) {
+    for(int i = 0; i < 6; ++i) {
+        SceneNode& a = root.addChild(SceneNode("a" + std::to_string(i)));
+        a.setLocalToParent(mat4d::translate(vec3d(i*40.0 - 100.0, 0, -50.0))*mat4d::rotatey(0.2*i));
+        for(int j = 0; j < 5 + 10*i; ++j) {
+            SceneNode& b = a.addChild(SceneNode("b" + std::to_string(j)));
+            b.setLocalToParent(mat4d::translate(vec3d(j*3.0, 0, -j*2.0)));
+            for(int k = 0; k < 20; ++k) {
+                SceneNode& c = b.addChild(SceneNode("c" + std::to_string(k)));
+                c.setLocalToParent(mat4d::translate(vec3d(0, k - 10.0, 0))*mat4d::rotatex(0.05*k));
+                c.setLocalBounds(mork::box3d(-0.5, 0.5, -0.5, 0.5, -0.5, 0.5));
+            }
+        }
+    }
+}
+
+void compareVisibility(const SceneNode& n1, SceneNode& n2) {
+    ASSERT_EQ(n1.isVisible(), n2.isVisible());
+    for(const SceneNode& c1 : n1.getChildren())
+        compareVisibility(c1, n2.getChild(c1.getName()));
+}
+
+TEST_F(SceneNodeTest, ParallelUpdate)
+{
+    Scene serial;
+    Scene parallel;
+    parallel.setThreads(4);
+    ASSERT_EQ(parallel.getThreads(), 4);
+    ASSERT_EQ(serial.getThreads(), 1);
+
+    buildLargeHierarchy(serial.getRoot());
+    buildLargeHierarchy(parallel.getRoot());
+    ASSERT_EQ(serial.getRoot().getSubtreeSize(), 1 + 6 + 21*(5 + 15 + 25 + 35 + 45 + 55));
+
+    serial.update();
+    parallel.update();
+    ASSERT_EQ(serial.getUpdatedNodeCount(), parallel.getUpdatedNodeCount());
+    compareHierarchy(serial.getRoot(), parallel.getRoot());
+    compareVisibility(serial.getRoot(), parallel.getRoot());
+
+    // Partial changes, including the camera
+    for(Scene* s : {&serial, &parallel}) {
+        s->getRoot().getChild("a5").setLocalToParent(mat4d::translate(vec3d(0, 0, -20.0)));
+        s->getRoot().getChild("a2").getChild("b7").getChild("c3").setLocalToParent(mat4d::translate(vec3d(1, 1, 1)));
+        s->getCamera().setPosition(vec3d(10, 0, 10));
+        s->update();
+    }
+    ASSERT_EQ(serial.getUpdatedNodeCount(), parallel.getUpdatedNodeCount());
+    compareHierarchy(serial.getRoot(), parallel.getRoot());
+    compareVisibility(serial.getRoot(), parallel.getRoot());
+
+    // Removing a subtree updates the subtree sizes
+    std::unique_ptr<SceneNode> a3 = parallel.getRoot().removeChild(parallel.getRoot().getChild("a3"));
+    ASSERT_EQ(parallel.getRoot().getSubtreeSize(), serial.getRoot().getSubtreeSize() - a3->getSubtreeSize());
+    parallel.getRoot().getChild("a4").clearChildren();
+    ASSERT_EQ(parallel.getRoot().getChild("a4").getSubtreeSize(), 1);
+}
+
+TEST_F(SceneNodeTest, Handles)
+{
+    SceneNode root("root");
+
+    // The handle follows the node when moved into the hierarchy
+    SceneNode tmp("h1");
+    mork::NodeHandle h1 = tmp.getHandle();
+    SceneNode& n1 = root.addChild(std::move(tmp));
+    ASSERT_EQ(n1.getHandle(), h1);
+    ASSERT_EQ(SceneNode::fromHandle(h1), &n1);
+    ASSERT_NE(tmp.getHandle(), h1);
+
+    mork::NodeHandle h2 = root.addChild(SceneNode("h2")).getHandle();
+    mork::NodeHandle h3 = root.addChild(std::make_unique<SceneNode>("h3")).getHandle();
+    ASSERT_EQ(SceneNode::fromHandle(h3)->getName(), "h3");
+
+    // Lookup by interned name
+    mork::NameId id2;
+    ASSERT_TRUE(mork::NameTable::getInstance().find("h2", id2));
+    ASSERT_TRUE(root.hasChild(id2));
+    ASSERT_EQ(&root.getChild(id2), SceneNode::fromHandle(h2));
+    ASSERT_EQ(root.getChild(id2).getNameId(), id2);
+
+    // Removal by handle moves the last child in place
+    std::unique_ptr<SceneNode> removed = root.removeChild(h1);
+    ASSERT_EQ(removed->getHandle(), h1);
+    ASSERT_EQ(root.getChildren().size(), 2);
+    ASSERT_EQ(root.getChildren()[0].get().getName(), "h3");
+    ASSERT_EQ(root.getChildren()[1].get().getName(), "h2");
+    ASSERT_FALSE(root.hasChild(*removed));
+    ASSERT_TRUE(root.hasChild(root.getChild("h3")));
+
+    // Handles of destroyed nodes dangle, also when their slot is reused
+    removed.reset();
+    ASSERT_EQ(SceneNode::fromHandle(h1), nullptr);
+    SceneNode reuse("reuse");
+    ASSERT_EQ(SceneNode::fromHandle(h1), nullptr);
+    ASSERT_EQ(SceneNode::fromHandle(reuse.getHandle()), &reuse);
+    ASSERT_THROW(root.removeChild(h1), std::runtime_error);
+    ASSERT_EQ(SceneNode::fromHandle(mork::NodeHandle()), nullptr);
+
+    root.clearChildren();
+    ASSERT_EQ(SceneNode::fromHandle(h2), nullptr);
+    ASSERT_EQ(SceneNode::fromHandle(h3), nullptr);
+
+    // Unnamed nodes are found by their name
+    SceneNode& anon = root.addChild(SceneNode());
+    ASSERT_EQ(&root.getChild(anon.getName()), &anon);
+}
+
+TEST_F(SceneNodeTest, NamesReleased)
+{
+    mork::NameTable& names = mork::NameTable::getInstance();
+    SceneNode root("root");
+    root.addChild(SceneNode("kept"));
+    unsigned int size = names.size();
+
+    // Spawning uniquely named nodes does not grow the name table
+    for(int i = 0; i < 100; ++i) {
+        SceneNode& node = root.addChild(SceneNode("spawned" + std::to_string(i)));
+        SceneNode& anon = node.addChild(SceneNode());
+        ASSERT_FALSE(anon.getName().empty());
+        root.removeChild(node);
+    }
+    ASSERT_EQ(names.size(), size);
+    mork::NameId id;
+    ASSERT_FALSE(names.find("spawned0", id));
+
+    // Names shared by nodes live as long as any of them
+    {
+        SceneNode a("shared");
+        SceneNode b(a.getNameId());
+        SceneNode moved(std::move(a));
+        ASSERT_EQ(moved.getName(), "shared");
+        ASSERT_EQ(b.getName(), "shared");
+    }
+    ASSERT_FALSE(names.find("shared", id));
+    ASSERT_EQ(names.size(), size);
+}
@@ -1,4 +1,7 @@
 #include "../mork/render/Texture.cpp"
+#include "../mork/render/TextureArrayPool.h"
+#include "../mork/render/TextureCache.h"
+#include "../mork/render/MaterialTable.h"
 
 #include <gtest/gtest.h>
 
@@ -115,6 +118,96 @@ TEST_F(TextureTest, Texture2dMoveAndVector)
 
 
 
+}
+
+TEST_F(TextureTest, Texture2dUploadAndSubImage)
+{
+    // Small uploads go directly, large ones through a pixel unpack buffer
+    for(int size : {16, 1024}) {
+        std::vector<unsigned char> pixels(size*size*4);
+        for(size_t i = 0; i < pixels.size(); ++i)
+            pixels[i] = i%251;
+
+        mork::Texture<2> tex;
+        tex.loadTexture(size, size, GL_RGBA8, pixels.data(), true);
+        ASSERT_EQ(tex.getWidth(), size);
+        ASSERT_EQ(tex.getFormat(), GL_RGBA8);
+
+        // Replace a 2x2 block
+        std::vector<unsigned char> block(2*2*4, 255);
+        tex.setSubImage(4, 6, 2, 2, block.data());
+        for(int y = 6; y < 8; ++y)
+            for(int x = 4; x < 6; ++x)
+                for(int c = 0; c < 4; ++c)
+                    pixels[(y*size + x)*4 + c] = 255;
+
+        std::vector<unsigned char> read(pixels.size());
+        glGetTextureImage(tex.getTextureId(), 0, GL_RGBA, GL_UNSIGNED_BYTE, read.size(), read.data());
+        ASSERT_EQ(read, pixels);
+
+        ASSERT_THROW(tex.setSubImage(size - 1, 0, 2, 2, block.data()), std::runtime_error);
+
+        // Loading again replaces the immutable texture
+        tex.loadTexture(8, 8, GL_RGBA8, pixels.data(), false);
+        ASSERT_EQ(tex.getWidth(), 8);
+        ASSERT_NE(tex.getTextureId(), 0);
+    }
+}
+
+TEST_F(TextureTest, TextureArrayPoolPack)
+{
+    auto makeTexture = [](int size, GLenum format, unsigned char value) {
+        std::vector<unsigned char> pixels(size*size*4, value);
+        mork::Texture<2> tex;
+        tex.loadTexture(size, size, format, pixels.data(), true);
+        return tex;
+    };
+
+    // Pools start with room for 2 layers, so the third 16x16 texture grows the array
+    mork::TextureArrayPool pool(2);
+    mork::Material a, b;
+    a.diffuseLayers.push_back(mork::TextureLayer(makeTexture(16, GL_RGBA8, 10)));
+    a.normalLayers.push_back(mork::TextureLayer(makeTexture(16, GL_RGBA8, 20)));
+    b.diffuseLayers.push_back(mork::TextureLayer(makeTexture(16, GL_RGBA8, 30)));
+    b.specularLayers.push_back(mork::TextureLayer(makeTexture(8, GL_RGBA8, 40)));
+    ASSERT_TRUE(a.hasBoundTextures());
+
+    pool.pack(a);
+    pool.pack(b);
+    ASSERT_FALSE(a.hasBoundTextures());
+    ASSERT_FALSE(b.hasBoundTextures());
+    ASSERT_EQ(a.diffuseLayers[0].texture, nullptr);
+
+    ASSERT_EQ(pool.getNumArrays(), 2);
+    ASSERT_EQ(pool.getNumLayers(0), 3);
+    ASSERT_EQ(pool.getCapacity(0), 4);
+    ASSERT_EQ(pool.getNumLayers(1), 1);
+    ASSERT_EQ(a.normalLayers[0].arrayIndex, 0);
+    ASSERT_EQ(a.normalLayers[0].arrayLayer, 1);
+    ASSERT_EQ(b.diffuseLayers[0].arrayLayer, 2);
+    ASSERT_EQ(b.specularLayers[0].arrayIndex, 1);
+
+    // The layers survived the growth, with all mip levels
+    for(int level : {0, 4}) {
+        int size = 16 >> level;
+        std::vector<unsigned char> read(size*size*4*3);
+        glGetTextureImage(pool.getTextureId(0), level, GL_RGBA, GL_UNSIGNED_BYTE, read.size(), read.data());
+        ASSERT_EQ(read[0], 10);
+        ASSERT_EQ(read[size*size*4], 20);
+        ASSERT_EQ(read[2*size*size*4], 30);
+    }
+
+    // Table records refer to the pool arrays
+    mork::MaterialData data = {};
+    mork::MaterialTable::compile(b, data);
+    ASSERT_EQ(data.diffuseLayers[0].texture, 0);
+    ASSERT_EQ(data.diffuseLayers[0].layer, 2);
+    ASSERT_EQ(data.specularLayers[0].texture, 1);
+    ASSERT_EQ(data.specularLayers[0].layer, 0);
+
+    // Only immutable textures can be pooled
+    mork::Texture<2> target(16, 16, GL_RGBA, false);
+    ASSERT_THROW(pool.add(target), std::runtime_error);
 }
 
 TEST_F(TextureTest, Texture2dGenerateEmpty)
@@ -148,3 +241,39 @@ TEST_F(TextureTest, Texture3dGenerateEmpty)
 }
 
 
+
+TEST_F(TextureTest, TextureCacheShare)
+{
+    mork::TextureCache& cache = mork::TextureCache::getInstance();
+    unsigned int before = cache.size();
+
+    // Paths to the same file share the texture, other options do not
+    mork::TextureCache::Handle a = cache.load("../bin/textures/container.jpg", true);
+    mork::TextureCache::Handle b = cache.load("../bin/../bin/textures/./container.jpg", true);
+    mork::TextureCache::Handle c = cache.load("../bin/textures/container.jpg", false);
+    ASSERT_EQ(a, b);
+    ASSERT_NE(a, c);
+    ASSERT_EQ(cache.find("../bin/textures/container.jpg", true), a);
+    ASSERT_EQ(cache.size(), before + 2);
+
+    // Textures are released with their last handle
+    c.reset();
+    ASSERT_EQ(cache.find("../bin/textures/container.jpg", false), nullptr);
+    ASSERT_EQ(cache.size(), before + 1);
+
+    // Layers sharing a texture get one pool layer
+    mork::TextureArrayPool pool;
+    mork::Material m, n;
+    m.diffuseLayers.push_back(mork::TextureLayer(a, mork::Op::MULTIPLY, 1.0f));
+    n.diffuseLayers.push_back(mork::TextureLayer(b, mork::Op::MULTIPLY, 1.0f));
+    n.specularLayers.push_back(mork::TextureLayer(cache.load("../bin/textures/brickwall.jpg", true), mork::Op::ADD, 1.0f));
+    a.reset();
+    b.reset();
+    pool.pack(m);
+    pool.pack(n);
+    ASSERT_EQ(pool.getNumArrays(), 2);
+    ASSERT_EQ(pool.getNumLayers(0), 1);
+    ASSERT_EQ(m.diffuseLayers[0].arrayLayer, n.diffuseLayers[0].arrayLayer);
+    ASSERT_EQ(n.specularLayers[0].arrayIndex, 1);
+    ASSERT_EQ(cache.size(), before);
+}
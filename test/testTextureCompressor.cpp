@@ -0,0 +1,280 @@
+#include "../mork/render/TextureCompressor.h"
+#include "../mork/util/ThreadPool.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+
+
+class TextureCompressorTest : public ::testing::Test {
+
+protected:
+    TextureCompressorTest();
+
+    virtual ~TextureCompressorTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+TextureCompressorTest::TextureCompressorTest()
+{
+
+}
+
+TextureCompressorTest::~TextureCompressorTest()
+{
+
+}
+
+void TextureCompressorTest::SetUp()
+{
+}
+
+void TextureCompressorTest::TearDown()
+{
+}
+
+// Reference decoders, to check the encoded blocks
+
+static uint64_t readBits(const unsigned char* block, int offset, int bits) {
+    uint64_t v = 0;
+    for(int b = 0; b < bits; ++b)
+        v |= uint64_t((block[(offset + b) >> 3] >> ((offset + b) & 7)) & 1) << b;
+    return v;
+}
+
+static void decodeBC1(const unsigned char* block, unsigned char rgba[64]) {
+    int c[2] = {block[0] | block[1] << 8, block[2] | block[3] << 8};
+    int palette[4][4];
+    for(int e = 0; e < 2; ++e) {
+        int r = (c[e] >> 11) & 31, g = (c[e] >> 5) & 63, b = c[e] & 31;
+        palette[e][0] = (r << 3) | (r >> 2);
+        palette[e][1] = (g << 2) | (g >> 4);
+        palette[e][2] = (b << 3) | (b >> 2);
+        palette[e][3] = 255;
+    }
+    for(int ch = 0; ch < 4; ++ch) {
+        if(c[0] > c[1]) {
+            palette[2][ch] = (2*palette[0][ch] + palette[1][ch])/3;
+            palette[3][ch] = (palette[0][ch] + 2*palette[1][ch])/3;
+        } else {
+            palette[2][ch] = (palette[0][ch] + palette[1][ch])/2;
+            palette[3][ch] = 0;
+        }
+    }
+    for(int i = 0; i < 16; ++i)
+        for(int ch = 0; ch < 4; ++ch)
+            rgba[4*i + ch] = palette[readBits(block, 32 + 2*i, 2)][ch];
+}
+
+static void decodeBC4(const unsigned char* block, int channel, unsigned char rgba[64]) {
+    int a0 = block[0], a1 = block[1];
+    int palette[8] = {a0, a1};
+    for(int p = 2; p < 8; ++p) {
+        if(a0 > a1)
+            palette[p] = ((8 - p)*a0 + (p - 1)*a1)/7;
+        else
+            palette[p] = p == 6 ? 0 : p == 7 ? 255 : ((6 - p)*a0 + (p - 1)*a1)/5;
+    }
+    for(int i = 0; i < 16; ++i)
+        rgba[4*i + channel] = palette[readBits(block, 16 + 3*i, 3)];
+}
+
+// Only mode 6, as written by the encoder
+static void decodeBC7(const unsigned char* block, unsigned char rgba[64]) {
+    static const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+    ASSERT_EQ(readBits(block, 0, 7), 64);
+    int e[2][4];
+    for(int c = 0; c < 4; ++c) {
+        e[0][c] = readBits(block, 7 + 14*c, 7) << 1 | readBits(block, 63, 1);
+        e[1][c] = readBits(block, 14 + 14*c, 7) << 1 | readBits(block, 64, 1);
+    }
+    for(int i = 0; i < 16; ++i) {
+        int index = i == 0 ? readBits(block, 65, 3) : readBits(block, 68 + 4*(i - 1), 4);
+        for(int c = 0; c < 4; ++c)
+            rgba[4*i + c] = ((64 - WEIGHTS[index])*e[0][c] + WEIGHTS[index]*e[1][c] + 32) >> 6;
+    }
+}
+
+// The largest channel difference of the first channels of two blocks
+static int maxError(const unsigned char* a, const unsigned char* b, int channels) {
+    int error = 0;
+    for(int i = 0; i < 16; ++i)
+        for(int c = 0; c < channels; ++c)
+            error = std::max(error, std::abs(int(a[4*i + c]) - int(b[4*i + c])));
+    return error;
+}
+
+// A block blending two colors along a diagonal
+static void gradientBlock(const int from[4], const int to[4], unsigned char rgba[64]) {
+    for(int i = 0; i < 16; ++i) {
+        float t = ((i%4) + (i/4))/6.0f;
+        for(int c = 0; c < 4; ++c)
+            rgba[4*i + c] = static_cast<unsigned char>(std::lround(from[c] + t*(to[c] - from[c])));
+    }
+}
+
+TEST_F(TextureCompressorTest, BlockEncoders)
+{
+    const int from[4] = {20, 200, 60, 255};
+    const int to[4] = {220, 40, 90, 40};
+    unsigned char texels[64], decoded[64], block[16];
+    gradientBlock(from, to, texels);
+
+    // Seven colors on a line, fitted by the four BC1 colors: at most half a
+    // palette step (a sixth of the largest range) off
+    mork::TextureCompressor::encodeBC1(texels, block);
+    decodeBC1(block, decoded);
+    ASSERT_LE(maxError(texels, decoded, 3), 34);
+
+    // Solid colors are exact up to the 565 quantization
+    unsigned char solid[64];
+    for(int i = 0; i < 64; ++i)
+        solid[i] = (i%4 == 0) ? 255 : (i%4 == 1) ? 128 : 0;
+    mork::TextureCompressor::encodeBC1(solid, block);
+    decodeBC1(block, decoded);
+    ASSERT_LE(maxError(solid, decoded, 3), 2);
+
+    // Single channels are fitted by eight levels
+    mork::TextureCompressor::encodeBC4(texels, 0, block);
+    decodeBC4(block, 0, decoded);
+    ASSERT_LE(maxError(texels, decoded, 1), 15);
+
+    mork::TextureCompressor::encodeBC5(texels, block);
+    decodeBC4(block, 0, decoded);
+    decodeBC4(block + 8, 1, decoded);
+    ASSERT_LE(maxError(texels, decoded, 2), 15);
+
+    mork::TextureCompressor::encodeBC3(texels, block);
+    decodeBC1(block + 8, decoded);
+    ASSERT_LE(maxError(texels, decoded, 3), 34);
+    decodeBC4(block, 3, decoded);
+    for(int i = 0; i < 16; ++i)
+        ASSERT_LE(std::abs(int(texels[4*i + 3]) - int(decoded[4*i + 3])), 15);
+
+    // BC7 has 16 levels for all four channels
+    mork::TextureCompressor::encodeBC7(texels, block);
+    decodeBC7(block, decoded);
+    ASSERT_LE(maxError(texels, decoded, 4), 10);
+
+    mork::TextureCompressor::encodeBC7(solid, block);
+    decodeBC7(block, decoded);
+    ASSERT_LE(maxError(solid, decoded, 4), 1);
+}
+
+TEST_F(TextureCompressorTest, CompressImage)
+{
+    mork::ThreadPool pool(4);
+    mork::Image image = mork::Image::load("../bin/textures/container.jpg", false);
+    ASSERT_EQ(image.getChannels(), 3);
+
+    mork::TextureCompressor::Options options;
+    mork::CompressedImage c = mork::TextureCompressor::compress(image, options, &pool);
+    ASSERT_EQ(c.format, mork::BlockFormat::BC1);
+    ASSERT_EQ(c.width, image.getWidth());
+
+    // A full mip chain, down to 1x1
+    int levels = 1;
+    while((std::max(image.getWidth(), image.getHeight()) >> levels) > 0)
+        ++levels;
+    ASSERT_EQ(c.levels.size(), levels);
+    for(int l = 0; l < levels; ++l) {
+        int w = std::max(image.getWidth() >> l, 1), h = std::max(image.getHeight() >> l, 1);
+        ASSERT_EQ(c.levels[l].size(), mork::CompressedImage::getLevelSize(c.format, w, h));
+    }
+    ASSERT_EQ(c.levels.back().size(), 8);
+
+    // The first level decodes close to the image
+    double sum = 0.0;
+    int bw = (image.getWidth() + 3)/4;
+    for(int by = 0; by < image.getHeight()/4; ++by) {
+        for(int bx = 0; bx < image.getWidth()/4; ++bx) {
+            unsigned char decoded[64];
+            decodeBC1(&c.levels[0][(by*bw + bx)*8], decoded);
+            for(int i = 0; i < 16; ++i) {
+                const unsigned char* p = image.getPixels() + ((by*4 + i/4)*image.getWidth() + bx*4 + i%4)*3;
+                for(int ch = 0; ch < 3; ++ch) {
+                    double d = double(p[ch]) - decoded[4*i + ch];
+                    sum += d*d;
+                }
+            }
+        }
+    }
+    double mse = sum/(double(image.getWidth()/4*4)*(image.getHeight()/4*4)*3);
+    double psnr = 10.0*std::log10(255.0*255.0/mse);
+    ASSERT_GT(psnr, 28.0);
+
+    // Normal maps are BC5 with normalized mip levels, and found by name
+    ASSERT_TRUE(mork::TextureCompressor::isNormalMapName("textures/brickwall_normal.jpg"));
+    ASSERT_TRUE(mork::TextureCompressor::isNormalMapName("Rock_N.png"));
+    ASSERT_FALSE(mork::TextureCompressor::isNormalMapName("textures/brickwall.jpg"));
+    options.normalMap = true;
+    ASSERT_EQ(mork::TextureCompressor::chooseFormat(3, options), mork::BlockFormat::BC5);
+    options.normalMap = false;
+    ASSERT_EQ(mork::TextureCompressor::chooseFormat(1, options), mork::BlockFormat::BC4);
+    ASSERT_EQ(mork::TextureCompressor::chooseFormat(4, options), mork::BlockFormat::BC7);
+    options.highQuality = false;
+    ASSERT_EQ(mork::TextureCompressor::chooseFormat(2, options), mork::BlockFormat::BC3);
+
+    std::vector<unsigned char> normals = {
+        255, 128, 128, 255,   128, 255, 128, 255,
+        128, 128, 255, 255,   128, 128, 255, 255};
+    std::vector<unsigned char> down = mork::TextureCompressor::downsample(normals, 2, 2, true);
+    ASSERT_EQ(down.size(), 4);
+    double x = down[0]/127.5 - 1.0, y = down[1]/127.5 - 1.0, z = down[2]/127.5 - 1.0;
+    ASSERT_NEAR(x*x + y*y + z*z, 1.0, 0.02);
+    ASSERT_NEAR(x, y, 0.01);
+}
+
+TEST_F(TextureCompressorTest, Containers)
+{
+    mork::CompressedImage image;
+    image.format = mork::BlockFormat::BC7;
+    image.width = 10;
+    image.height = 5;
+    for(int l = 0; l < 4; ++l) {
+        size_t size = mork::CompressedImage::getLevelSize(image.format, std::max(10 >> l, 1), std::max(5 >> l, 1));
+        std::vector<unsigned char> level(size);
+        for(size_t i = 0; i < size; ++i)
+            level[i] = (i*7 + l)%256;
+        image.levels.push_back(level);
+    }
+    ASSERT_EQ(image.levels[0].size(), 3*2*16);
+
+    for(const char* file : {"testTextureCompressor.ktx2", "testTextureCompressor.dds"}) {
+        image.format = mork::BlockFormat::BC7;
+        if(std::string(file).find(".dds") != std::string::npos)
+            image.format = mork::BlockFormat::BC5;
+        ASSERT_TRUE(mork::CompressedImage::isCompressedFile(file));
+
+        if(image.format == mork::BlockFormat::BC7)
+            image.saveKTX2(file);
+        else
+            image.saveDDS(file);
+        mork::CompressedImage loaded = mork::CompressedImage::load(file);
+        std::remove(file);
+
+        ASSERT_EQ(loaded.format, image.format);
+        ASSERT_EQ(loaded.width, 10);
+        ASSERT_EQ(loaded.height, 5);
+        ASSERT_EQ(loaded.levels, image.levels);
+    }
+
+    ASSERT_FALSE(mork::CompressedImage::isCompressedFile("textures/container.jpg"));
+    ASSERT_THROW(mork::CompressedImage::load("../bin/textures/container.jpg"), std::runtime_error);
+    ASSERT_THROW(mork::CompressedImage::load("missing.ktx2"), std::runtime_error);
+}
@@ -0,0 +1,78 @@
+#include "../mork/util/ThreadPool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+
+class ThreadPoolTest : public ::testing::Test {
+
+protected:
+    ThreadPoolTest();
+
+    virtual ~ThreadPoolTest();
+
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    virtual void SetUp();
+
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    virtual void TearDown();
+
+};
+
+
+
+ThreadPoolTest::ThreadPoolTest()
+{
+
+}
+
+ThreadPoolTest::~ThreadPoolTest()
+{
+
+}
+
+void ThreadPoolTest::SetUp()
+{
+}
+
+void ThreadPoolTest::TearDown()
+{
+}
+
+TEST_F(ThreadPoolTest, Submit)
+{
+    mork::ThreadPool pool(4);
+    ASSERT_EQ(pool.size(), 4);
+
+    std::vector<std::future<int> > results;
+    for(int i = 0; i < 100; ++i)
+        results.push_back(pool.submit([i]() { return i*i; }));
+
+    for(int i = 0; i < 100; ++i)
+        ASSERT_EQ(results[i].get(), i*i);
+
+    // Exceptions are passed through the future
+    auto f = pool.submit([]() -> int { throw std::runtime_error("expected"); });
+    ASSERT_THROW(f.get(), std::runtime_error);
+}
+
+TEST_F(ThreadPoolTest, RunWeighted)
+{
+    mork::ThreadPool pool(3);
+
+    std::vector<int> values(1000, 0);
+    std::atomic<int> sum(0);
+    pool.runWeighted(values.size(), 50,
+            [](std::size_t i) { return i % 7 + 1; },
+            [&](std::size_t i) { values[i] = i; sum += i; });
+
+    for(int i = 0; i < 1000; ++i)
+        ASSERT_EQ(values[i], i);
+    ASSERT_EQ(sum, 999*1000/2);
+
+    // Nothing to do
+    pool.runWeighted(0, 50, [](std::size_t) { return 1; }, [](std::size_t) { FAIL(); });
+}
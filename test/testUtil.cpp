@@ -1,6 +1,7 @@
 #include "../mork/util/Util.h"
 #include "../mork/util/Time.h"
 #include "../mork/util/File.h"
+#include "../mork/util/NameTable.h"
 #include "../mork/core/Log.h"
 
 #include <gtest/gtest.h>
@@ -60,6 +61,49 @@ TEST_F(UtilTest, Test2)
     ASSERT_EQ(test.length(), 12);
 }
 
+TEST_F(UtilTest, TestNameTable)
+{
+    mork::NameTable& table = mork::NameTable::getInstance();
+
+    mork::NameId a = table.intern("nameTableA");
+    mork::NameId b = table.intern("nameTableB");
+    ASSERT_NE(a, b);
+    ASSERT_EQ(table.intern("nameTableA"), a);
+    ASSERT_EQ(table.getString(a), "nameTableA");
+
+    mork::NameId found;
+    ASSERT_TRUE(table.find("nameTableB", found));
+    ASSERT_EQ(found, b);
+    ASSERT_FALSE(table.find("nameTableNeverInterned", found));
+
+    // Anonymous names are unique, and found by their string once named
+    mork::NameId anon1 = table.anonymous();
+    mork::NameId anon2 = table.anonymous();
+    ASSERT_NE(anon1, anon2);
+    const std::string& name = table.getString(anon1);
+    ASSERT_NE(name, table.getString(anon2));
+    ASSERT_TRUE(table.find(name, found));
+    ASSERT_EQ(found, anon1);
+    ASSERT_EQ(table.intern(name), anon1);
+
+    // Strings are freed with their last reference, and the ids reused
+    unsigned int size = table.size();
+    table.release(b);
+    ASSERT_FALSE(table.find("nameTableB", found));
+    ASSERT_EQ(table.size(), size - 1);
+    ASSERT_EQ(table.intern("nameTableC"), b);
+    table.release(a);
+    ASSERT_TRUE(table.find("nameTableA", found));
+    table.release(a);
+    ASSERT_FALSE(table.find("nameTableA", found));
+
+    table.release(anon1);
+    ASSERT_TRUE(table.find(name, found));
+    table.release(anon1);
+    ASSERT_FALSE(table.find(name, found));
+    ASSERT_EQ(table.anonymous(), anon1);
+}
+
 TEST_F(UtilTest, TestString2Vec3d)
 {
     mork::vec3d v = mork::string2vec3d("1,2,3");